@@ -91,7 +91,13 @@ typedef struct curl_handle_s {
     char ch_error[CURL_ERROR_SIZE]; /* Error buffer for CURLOPT_ERRORBUFFER */
 } curl_handle_t;
 
-TAILQ_HEAD(curl_session_s, curl_handle_s) extCurlSessions;
+/*
+ * Handles belong to the transform that opened them, so each thread
+ * keeps its own list.  A thread's list is initialized when it opens
+ * its first handle.
+ */
+static SLAX_THREAD_LOCAL TAILQ_HEAD(curl_session_s, curl_handle_s)
+    extCurlSessions;
 
 /*
  * Discard any transient data in the handle, particularly data
@@ -432,7 +438,8 @@ static curl_handle_t *
 extCurlHandleAlloc (void)
 {
     curl_handle_t *curlp = xmlMalloc(sizeof(*curlp));
-    static unsigned seed = 1618; /* Non-zero starting number (why not phi?) */
+    /* Non-zero starting number (why not phi?) */
+    static SLAX_THREAD_LOCAL unsigned seed = 1618;
 
     if (curlp) {
 	bzero(curlp, sizeof(*curlp));
@@ -449,6 +456,8 @@ extCurlHandleAlloc (void)
 	curlp->ch_handle = curl_easy_init();
 
 	/* Add it to the list of curl handles */
+	if (extCurlSessions.tqh_last == NULL)
+	    TAILQ_INIT(&extCurlSessions);
 	TAILQ_INSERT_TAIL(&extCurlSessions, curlp, ch_link);
     }
 
@@ -49,18 +49,39 @@
 #define dlfunc(_p, _n)          NULL /* Fail */
 #endif /* HAVE_DLFCN_H */
 
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif /* HAVE_PTHREAD_H */
+
 
 /*
  * Function pointer for driver initialization function
  */
 typedef void (*db_driver_init_func_t)(db_driver_t *);
 
-TAILQ_HEAD(db_drivers_s, db_driver_s) extDbDrivers;
-TAILQ_HEAD(db_session_s, db_handle_s) extDbSessions;
+/*
+ * Drivers are loaded once and shared by all threads, so the list is
+ * guarded by a lock.  Sessions belong to the transform that opened
+ * them, so they are kept per thread; a thread's list is initialized
+ * when it is first added to.
+ */
+static TAILQ_HEAD(db_drivers_s, db_driver_s) extDbDrivers =
+    TAILQ_HEAD_INITIALIZER(extDbDrivers);
+static SLAX_THREAD_LOCAL TAILQ_HEAD(db_session_s, db_handle_s) extDbSessions;
+
+#ifdef HAVE_PTHREAD_H
+static pthread_mutex_t extDbDriverLock = PTHREAD_MUTEX_INITIALIZER;
+#define DB_DRIVER_LOCK() pthread_mutex_lock(&extDbDriverLock)
+#define DB_DRIVER_UNLOCK() pthread_mutex_unlock(&extDbDriverLock)
+#else /* HAVE_PTHREAD_H */
+#define DB_DRIVER_LOCK() do { } while (0)
+#define DB_DRIVER_UNLOCK() do { } while (0)
+#endif /* HAVE_PTHREAD_H */
 
 /*
  * Given name of the driver, dlopens the library, initializes it, adds to the
- * list of available drivers and returns it
+ * list of available drivers and returns it.  The caller holds
+ * extDbDriverLock.
  */
 static db_driver_t *
 db_load_driver (const char *name)
@@ -88,10 +109,10 @@ db_load_driver (const char *name)
 		snprintf(driver->dd_name, sizeof(driver->dd_name), 
 			 "%s", name);
 
-		TAILQ_INSERT_TAIL(&extDbDrivers, driver, dd_link);
-
 		(*func)(driver);
 
+		TAILQ_INSERT_TAIL(&extDbDrivers, driver, dd_link);
+
 		return driver;
 	    }
 	}
@@ -109,7 +130,7 @@ static db_handle_t *
 db_handle_alloc (db_driver_t *driver)
 {
     db_handle_t *handle = xmlMalloc(sizeof(*handle));
-    static unsigned seed = 1234;
+    static SLAX_THREAD_LOCAL unsigned seed = 1234;
 
     if (handle) {
 	bzero(handle, sizeof(*handle));
@@ -117,6 +138,8 @@ db_handle_alloc (db_driver_t *driver)
 	snprintf(handle->dh_name, sizeof(handle->dh_name), "%udb", seed++);
 	handle->dh_driver = driver;
 	
+	if (extDbSessions.tqh_last == NULL)
+	    TAILQ_INIT(&extDbSessions);
 	TAILQ_INSERT_TAIL(&extDbSessions, handle, dh_link);
     }
 
@@ -144,20 +167,27 @@ static db_driver_t *
 db_get_driver (const char *name)
 {
     db_driver_t *driver;
+
+    DB_DRIVER_LOCK();
+
     /*
      * Iterate through the list of available drivers and return the matching
      * one
      */
     TAILQ_FOREACH(driver, &extDbDrivers, dd_link) {
-	if (streq(driver->dd_name, name)) {
-	    return driver;
-	}
+	if (streq(driver->dd_name, name))
+	    break;
     }
 
     /*
      * Look up and load driver library
      */
-    return db_load_driver(name);
+    if (driver == NULL)
+	driver = db_load_driver(name);
+
+    DB_DRIVER_UNLOCK();
+
+    return driver;
 }
 
 /*
@@ -1154,7 +1184,6 @@ void
 extDbInit (void)
 {
     TAILQ_INIT(&extDbSessions);
-    TAILQ_INIT(&extDbDrivers);
 
     slaxRegisterFunctionTable(DB_FULL_NS, slaxDbTable);
 }
@@ -1162,7 +1191,6 @@ extDbInit (void)
 SLAX_DYN_FUNC(slaxDynLibInit)
 {
     TAILQ_INIT(&extDbSessions);
-    TAILQ_INIT(&extDbDrivers);
 
     arg->da_functions = slaxDbTable; /* Fill in our function table */
 
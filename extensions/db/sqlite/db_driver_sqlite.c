@@ -60,13 +60,20 @@ typedef struct db_sqlite_stmt_s {
 					       prepare this statement */
 } db_sqlite_stmt_t;
 
-TAILQ_HEAD(db_sqlite_session_s, db_sqlite_handle_s) db_sqlite_sessions;
-TAILQ_HEAD(db_sqlite_stmts_s, db_sqlite_stmt_s) db_sqlite_stmts;
+/*
+ * Sessions and statements are kept per thread.  Statements hang off
+ * a session, so both lists are initialized when a thread opens its
+ * first session.
+ */
+static SLAX_THREAD_LOCAL TAILQ_HEAD(db_sqlite_session_s, db_sqlite_handle_s)
+    db_sqlite_sessions;
+static SLAX_THREAD_LOCAL TAILQ_HEAD(db_sqlite_stmts_s, db_sqlite_stmt_s)
+    db_sqlite_stmts;
 
 /*
  * Unique identifier for open sqlite sessions
  */
-static unsigned int seed = 1234;
+static SLAX_THREAD_LOCAL unsigned int seed = 1234;
 
 /*
  * Allocates and initializes a session
@@ -82,6 +89,10 @@ db_sqlite_handle_alloc (db_handle_t *db_handle)
 
 	dbsp->dsh_db_handle = db_handle;
 
+	if (db_sqlite_sessions.tqh_last == NULL) {
+	    TAILQ_INIT(&db_sqlite_sessions);
+	    TAILQ_INIT(&db_sqlite_stmts);
+	}
 	TAILQ_INSERT_TAIL(&db_sqlite_sessions, dbsp, dsh_link);
     }
 
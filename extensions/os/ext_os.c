@@ -394,7 +394,7 @@ slaxAddChildName (xmlDocPtr docp, xmlNodePtr parent, const char *name,
 static const char *
 slaxErrnoName (int err)
 {
-    static char buf[16];
+    static SLAX_THREAD_LOCAL char buf[16];
     errno_map_t *errp;
 
     for (errp = errno_map; errp->err_no; errp++)
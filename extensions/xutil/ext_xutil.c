@@ -35,60 +35,52 @@
 #include <libslax/slaxinternals.h>
 
 #include "jsonlexer.h"
+#include "jsonreader.h"
 #include "jsonwriter.h"
+#include "jsonbinary.h"
 
 #define XML_FULL_NS "http://xml.libslax.org/xutil"
 
 #define ELT_TYPES	"types"
 #define ELT_ROOT	"root"
 #define ELT_CLEAN_NAMES	"clean-names"
+#define ELT_JSON_LINES	"json-lines"
+#define ATT_ERRORS	"errors"
 #define VAL_NO		"no"
 #define VAL_YES		"yes"
 
+#define XUTIL_PARSE_CHUNK	(64 * 1024) /* Bytes handed to the parser at once */
+
 /*
  * Parse a string into an XML hierarchy:
  *     var $xml = xutil:string-to-xml($string);
  * Multiple strings can be passed in and they are automatically concatenated:
  *     var $xml = xutil:string-to-xml($string1, $string2, $string3);
+ *
+ * The strings are pushed into the parser a chunk at a time, so they're
+ * never concatenated.  The parsed root is then moved into the RTF
+ * container rather than copied.
  */
 static void
 extXutilStringToXml (xmlXPathParserContext *ctxt, int nargs)
 {
     xmlXPathObjectPtr ret = NULL;
+    xmlParserCtxtPtr pctxt = NULL;
     xmlDocPtr xmlp = NULL;
     xmlDocPtr container = NULL;
     xmlNodePtr childp;
     xmlChar *strstack[nargs];	/* Stack for strings */
-    int ndx;
-    int bufsiz;
-    char *buf;
+    int ndx, len, off, chunk, total = 0, failed = FALSE;
 
     bzero(strstack, sizeof(strstack));
     for (ndx = nargs - 1; ndx >= 0; ndx--) {
 	strstack[ndx] = xmlXPathPopString(ctxt);
-    }
-
-    for (bufsiz = 0, ndx = 0; ndx < nargs; ndx++)
 	if (strstack[ndx])
-	    bufsiz += xmlStrlen(strstack[ndx]);
-
-    buf = alloca(bufsiz + 1);
-    buf[bufsiz] = '\0';
-    for (bufsiz = 0, ndx = 0; ndx < nargs; ndx++) {
-	if (strstack[ndx]) {
-	    int len = xmlStrlen(strstack[ndx]);
-	    memcpy(buf + bufsiz, strstack[ndx], len);
-	    bufsiz += len;
-	}
+	    total += xmlStrlen(strstack[ndx]);
     }
 
-    /* buf now has the complete string */
-    xmlp = xmlReadMemory(buf, bufsiz, "raw_data", NULL, XML_PARSE_NOENT);
-    if (xmlp == NULL)
-	goto bail;
-
     ret = xmlXPathNewNodeSet(NULL);
-    if (ret == NULL)
+    if (ret == NULL || total == 0)
 	goto bail;
 
     /* Fake an RVT to hold the output of the template */
@@ -96,17 +88,50 @@ extXutilStringToXml (xmlXPathParserContext *ctxt, int nargs)
     if (container == NULL)
 	goto bail;
 
+    pctxt = xmlCreatePushParserCtxt(NULL, NULL, NULL, 0, "raw_data");
+    if (pctxt == NULL)
+	goto bail;
+    xmlCtxtUseOptions(pctxt, XML_PARSE_NOENT);
+
+    /* Once a chunk fails, there's no point in feeding the rest */
+    for (ndx = 0; ndx < nargs && !failed; ndx++) {
+	if (strstack[ndx] == NULL)
+	    continue;
+
+	len = xmlStrlen(strstack[ndx]);
+	for (off = 0; off < len && !failed; off += chunk) {
+	    chunk = len - off;
+	    if (chunk > XUTIL_PARSE_CHUNK)
+		chunk = XUTIL_PARSE_CHUNK;
+
+	    if (xmlParseChunk(pctxt, (const char *) strstack[ndx] + off,
+			      chunk, 0) != 0)
+		failed = TRUE;
+	}
+    }
+    if (!failed)
+	xmlParseChunk(pctxt, NULL, 0, 1);
+
+    xmlp = pctxt->myDoc;
+    pctxt->myDoc = NULL;
+    if (xmlp == NULL || !pctxt->wellFormed)
+	goto bail;
+
     /*
-     * XXX There should be a way to read the xml input directly
-     * into the RTF container.  Lacking that, we copy it.
+     * Adopting the root (rather than just relinking it) moves its
+     * names into the container's dictionary, and moves any references
+     * to the parsed document's own namespaces, such as the one for
+     * "xml:", over to the container
      */
     childp = xmlDocGetRootElement(xmlp);
     if (childp) {
-	xmlNodePtr newp = xmlDocCopyNode(childp, container, 1);
-	if (newp) {
-	    xmlAddChild((xmlNodePtr) container, newp);
-	    xmlXPathNodeSetAdd(ret->nodesetval, newp);
-	}
+	xmlUnlinkNode(childp);
+	if (xmlDOMWrapAdoptNode(NULL, xmlp, childp, container,
+				(xmlNodePtr) container, 0) == 0) {
+	    xmlAddChild((xmlNodePtr) container, childp);
+	    xmlXPathNodeSetAdd(ret->nodesetval, childp);
+	} else
+	    xmlFreeNode(childp);
     }
 
 bail:
@@ -117,6 +142,8 @@ bail:
 
     if (xmlp)
 	xmlFreeDoc(xmlp);
+    if (pctxt)
+	xmlFreeParserCtxt(pctxt);
 
     for (ndx = nargs - 1; ndx >= 0; ndx--) {
 	if (strstack[ndx])
@@ -125,19 +152,33 @@ bail:
 }
 
 /*
- * Callback from the libxml2 IO mechanism to build the output string
+ * Turn a buffer into the string result of an extension function.
+ * The buffer's content becomes the string, without another copy.
  */
-static int
-extXutilRawwriteCallback (void *opaque, const char *buf, int len)
+static void
+extXutilReturnBuffer (xmlXPathParserContext *ctxt, xmlBufferPtr xbuf)
 {
-    slax_data_list_t *listp = opaque;
+    xmlChar *buf;
 
-    if (listp == NULL)
-	return 0;
+    if (xmlBufferLength(xbuf) == 0) {
+	xmlXPathReturnEmptyString(ctxt);
+	return;
+    }
 
-    slaxDataListAddLen(listp, buf, len);
+#if LIBXML_VERSION >= 20800
+    buf = xmlBufferDetach(xbuf);
+#else /* LIBXML_VERSION >= 20800 */
+    /* No xmlBufferDetach() before 2.8.0; take the content ourselves */
+    buf = xbuf->content;
+    xbuf->content = NULL;
+    xbuf->size = xbuf->use = 0;
+#endif /* LIBXML_VERSION >= 20800 */
+    if (buf == NULL) {
+	xmlXPathReturnEmptyString(ctxt);
+	return;
+    }
 
-    return len;
+    valuePush(ctxt, xmlXPathWrapString(buf));
 }
 
 /*
@@ -150,17 +191,12 @@ static void
 extXutilXmlToString (xmlXPathParserContext *ctxt, int nargs)
 {
     xmlSaveCtxtPtr handle;
-    slax_data_list_t list;
-    slax_data_node_t *dnp;
+    xmlBufferPtr xbuf = NULL;
     xmlXPathObjectPtr xop;
     xmlXPathObjectPtr objstack[nargs];	/* Stack for objects */
     int ndx;
-    char *buf;
-    int bufsiz;
     int hit = 0;
 
-    slaxDataListInit(&list);
-
     bzero(objstack, sizeof(objstack));
     for (ndx = nargs - 1; ndx >= 0; ndx--) {
 	objstack[ndx] = valuePop(ctxt);
@@ -174,8 +210,15 @@ extXutilXmlToString (xmlXPathParserContext *ctxt, int nargs)
 	return;
     }
 
-    /* We make a custom IO handler to save content into a list of strings */
-    handle = xmlSaveToIO(extXutilRawwriteCallback, NULL, &list, NULL,
+    /* Save the content into a single buffer that grows as needed */
+    xbuf = xmlBufferCreate();
+    if (xbuf == NULL) {
+	xmlXPathReturnEmptyString(ctxt);
+	goto bail;
+    }
+    xmlBufferSetAllocationScheme(xbuf, XML_BUFFER_ALLOC_DOUBLEIT);
+
+    handle = xmlSaveToBuffer(xbuf, NULL,
                  XML_SAVE_FORMAT | XML_SAVE_NO_DECL | XML_SAVE_NO_XHTML);
     if (handle == NULL) {
 	xmlXPathReturnEmptyString(ctxt);
@@ -194,90 +237,29 @@ extXutilXmlToString (xmlXPathParserContext *ctxt, int nargs)
 		xmlNodePtr node = tab->nodeTab[i];
 
 		xmlSaveTree(handle, node);
-		xmlSaveFlush(handle);
 	    }
 	}
     }
 
-    xmlSaveClose(handle);	/* This frees is also */
+    xmlSaveClose(handle);	/* Flushes into xbuf and frees handle */
 
-    /* Now we turn the saved data from a linked list into a single string */
-    bufsiz = 0;
-    SLAXDATALIST_FOREACH(dnp, &list) {
-	bufsiz += dnp->dn_len;
-    }
-
-    /* If the objects are empty, let's get out now */
-    if (bufsiz == 0) {
-	xmlXPathReturnEmptyString(ctxt);
-	goto bail;
-    }
-
-    buf = xmlMalloc(bufsiz + 1);
-    if (buf == NULL) {
-	xmlXPathReturnEmptyString(ctxt);
-	goto bail;
-    }
-	
-    bufsiz = 0;
-    SLAXDATALIST_FOREACH(dnp, &list) {
-	memcpy(buf + bufsiz, dnp->dn_data, dnp->dn_len);
-	bufsiz += dnp->dn_len;
-    }
-    buf[bufsiz] = '\0';
-
-    valuePush(ctxt, xmlXPathWrapCString(buf));
+    extXutilReturnBuffer(ctxt, xbuf);
 
  bail:
-    slaxDataListClean(&list);
+    if (xbuf)
+	xmlBufferFree(xbuf);
 
     for (ndx = 0; ndx < nargs; ndx++)
 	xmlXPathFreeObject(objstack[ndx]);
 }
 
-/*
- * Callback from the libxml2 IO mechanism to build the output string
- */
-static int
-extXutilWriteCallback (void *opaque, const char *fmt, ...)
-{
-    slax_data_list_t *listp = opaque;
-    char buf[BUFSIZ];
-    char *cp = buf;
-    size_t len;
-    va_list vap;
-
-    if (listp == NULL)
-	return 0;
-
-    va_start(vap, fmt);
-    len = vsnprintf(buf, sizeof(buf), fmt, vap);
-    if (len >= sizeof(buf)) {
-	va_end(vap);
-	va_start(vap, fmt);
-	if (vasprintf(&cp, fmt, vap) < 0 || cp == NULL)
-	    return -1;
-    }
-    va_end(vap);
-
-    slaxDataListAddLen(listp, cp, len);
-
-    if (cp != buf)
-	free(cp);   /* Allocated by vasprintf() */
-
-    return len;
-}
-
 static void
 extXutilXmlToJson (xmlXPathParserContext *ctxt UNUSED, int nargs UNUSED)
 {
     int i;
     xmlXPathObject *xop;
     const char *value, *key;
-    slax_data_list_t list;
-    slax_data_node_t *dnp;
-    char *buf;
-    int bufsiz;
+    xmlBufferPtr xbuf;
     unsigned flags = 0;
 
     if (nargs < 1 || nargs > 2) {
@@ -314,6 +296,9 @@ extXutilXmlToJson (xmlXPathParserContext *ctxt UNUSED, int nargs UNUSED)
 		} else if (streq(key, ELT_QUOTES)) {
 		    if (streq(value, VAL_OPTIONAL))
 			flags |= JWF_OPTIONAL_QUOTES;
+		} else if (streq(key, ELT_JSON_LINES)) {
+		    if (streq(value, VAL_YES))
+			flags |= JWF_LINES;
 		}
 	    }
 	}
@@ -329,7 +314,13 @@ extXutilXmlToJson (xmlXPathParserContext *ctxt UNUSED, int nargs UNUSED)
 	return;
     }
 
-    slaxDataListInit(&list);
+    xbuf = xmlBufferCreate();
+    if (xbuf == NULL) {
+	xmlXPathFreeObject(xop);
+	xmlXPathReturnEmptyString(ctxt);
+	return;
+    }
+    xmlBufferSetAllocationScheme(xbuf, XML_BUFFER_ALLOC_DOUBLEIT);
 
     for (i = 0; i < xop->nodesetval->nodeNr; i++) {
 	xmlNodePtr nop;
@@ -340,38 +331,114 @@ extXutilXmlToJson (xmlXPathParserContext *ctxt UNUSED, int nargs UNUSED)
 	if (nop->type != XML_ELEMENT_NODE)
 	    continue;
 
-	slaxJsonWriteNode(extXutilWriteCallback, &list, nop, flags);
+	slaxJsonWriteNodeBuffer(xbuf, nop, flags);
     }
 
-    /* Now we turn the saved data from a linked list into a single string */
-    bufsiz = 0;
-    SLAXDATALIST_FOREACH(dnp, &list) {
-	bufsiz += dnp->dn_len;
-    }
+    extXutilReturnBuffer(ctxt, xbuf);
 
-    /* If the objects are empty, let's get out now */
-    if (bufsiz == 0) {
-	xmlXPathReturnEmptyString(ctxt);
-	goto bail;
-    }
+    xmlBufferFree(xbuf);
+    xmlXPathFreeObject(xop);
+}
 
-    buf = xmlMalloc(bufsiz + 1);
-    if (buf == NULL) {
-	xmlXPathReturnEmptyString(ctxt);
-	goto bail;
+/*
+ * Move each record of JSON lines input under the top element, as
+ * it's read
+ */
+static int
+extXutilJsonLinesRecord (xmlDocPtr docp, void *opaque)
+{
+    xmlNodePtr top = opaque;
+    xmlNodePtr newp;
+
+    newp = xmlDocCopyNode(xmlDocGetRootElement(docp), top->doc, 1);
+    if (newp)
+	xmlAddChild(top, newp);
+    xmlFreeDoc(docp);
+
+    return (newp == NULL);
+}
+
+/*
+ * Read the options for json-to-xml() and the binary decoders, given
+ * as a node set of elements like <root> and <types>
+ */
+static int
+extXutilDecodeOptions (xmlXPathObjectPtr xop, const char *func,
+		       unsigned *flagsp, char **root_namep, int *linesp)
+{
+    const char *value, *key;
+    int i;
+
+    if (!xop->nodesetval || !xop->nodesetval->nodeNr) {
+	LX_ERR("%s: invalid second parameter\n", func);
+	return -1;
     }
-	
-    bufsiz = 0;
-    SLAXDATALIST_FOREACH(dnp, &list) {
-	memcpy(buf + bufsiz, dnp->dn_data, dnp->dn_len);
-	bufsiz += dnp->dn_len;
+
+    for (i = 0; i < xop->nodesetval->nodeNr; i++) {
+	xmlNodePtr nop, cop;
+
+	nop = xop->nodesetval->nodeTab[i];
+	if (nop->children == NULL)
+	    continue;
+
+	for (cop = nop->children; cop; cop = cop->next) {
+	    if (cop->type != XML_ELEMENT_NODE)
+		continue;
+
+	    key = xmlNodeName(cop);
+	    if (!key)
+		continue;
+	    value = xmlNodeValue(cop);
+	    if (streq(key, ELT_TYPES)) {
+		if (streq(value, VAL_NO))
+		    *flagsp |= SDF_NO_TYPES;
+	    } else if (streq(key, ELT_ROOT)) {
+		xmlFreeAndEasy(*root_namep);
+		*root_namep = xmlStrdup2(value);
+	    } else if (streq(key, ELT_CLEAN_NAMES)) {
+		if (streq(value, VAL_YES))
+		    *flagsp |= SDF_CLEAN_NAMES;
+	    } else if (streq(key, ELT_JSON_LINES)) {
+		if (linesp && streq(value, VAL_YES))
+		    *linesp = TRUE;
+	    }
+	}
     }
-    buf[bufsiz] = '\0';
 
-    valuePush(ctxt, xmlXPathWrapCString(buf));
+    return 0;
+}
 
- bail:
-    xmlXPathFreeObject(xop);
+/*
+ * Copy the root of a decoded document into an RTF container, returning
+ * a node set holding the copy
+ */
+static xmlXPathObjectPtr
+extXutilDocToRtf (xmlXPathParserContext *ctxt, xmlDocPtr docp)
+{
+    xmlXPathObjectPtr ret;
+    xmlDocPtr container;
+    xmlNodePtr newp;
+
+    ret = xmlXPathNewNodeSet(NULL);
+    if (ret == NULL)
+	return NULL;
+
+    /* Fake an RVT to hold the output of the template */
+    container = slaxMakeRtf(ctxt);
+    if (container == NULL)
+	return ret;
+
+    /*
+     * XXX There should be a way to read the xml input directly
+     * into the RTF container.  Lacking that, we copy it.
+     */
+    newp = xmlDocCopyNode(xmlDocGetRootElement(docp), container, 1);
+    if (newp) {
+	xmlAddChild((xmlNodePtr) container, newp);
+	xmlXPathNodeSetAdd(ret->nodesetval, newp);
+    }
+
+    return ret;
 }
 
 static void
@@ -382,8 +449,7 @@ extXutilJsonToXml (xmlXPathParserContext *ctxt UNUSED, int nargs UNUSED)
     xmlDocPtr docp = NULL;
     xmlDocPtr container = NULL;
     xmlNodePtr childp;
-    int i;
-    const char *value, *key;
+    int lines = FALSE, skipped;
     char *root_name = NULL;
 
     if (nargs < 1 || nargs > 2) {
@@ -393,70 +459,55 @@ extXutilJsonToXml (xmlXPathParserContext *ctxt UNUSED, int nargs UNUSED)
 
     if (nargs == 2) {
 	xmlXPathObject *xop = valuePop(ctxt);
-	if (!xop->nodesetval || !xop->nodesetval->nodeNr) {
-	    LX_ERR("json-to-xml: invalid second parameter\n");
-	    xmlXPathFreeObject(xop);
+	int rc = extXutilDecodeOptions(xop, "json-to-xml",
+				       &flags, &root_name, &lines);
+
+	xmlXPathFreeObject(xop);
+	if (rc < 0) {
 	    xmlXPathReturnEmptyString(ctxt);
 	    return;
 	}
-
-	for (i = 0; i < xop->nodesetval->nodeNr; i++) {
-	    xmlNodePtr nop, cop;
-
-	    nop = xop->nodesetval->nodeTab[i];
-	    if (nop->children == NULL)
-		continue;
-
-	    for (cop = nop->children; cop; cop = cop->next) {
-		if (cop->type != XML_ELEMENT_NODE)
-		    continue;
-
-		key = xmlNodeName(cop);
-		if (!key)
-		    continue;
-		value = xmlNodeValue(cop);
-		if (streq(key, ELT_TYPES)) {
-		    if (streq(value, VAL_NO))
-			flags |= SDF_NO_TYPES;
-		} else if (streq(key, ELT_ROOT)) {
-		    root_name = xmlStrdup2(value);
-		} else if (streq(key, ELT_CLEAN_NAMES)) {
-		    if (streq(value, VAL_YES))
-			flags |= SDF_CLEAN_NAMES;
-		}
-	    }
-	}
-
-	xmlXPathFreeObject(xop);
     }
 
     char *json = (char *) xmlXPathPopString(ctxt);
     if (json == NULL)
 	goto bail;
 
-    docp = slaxJsonDataToXml(json, root_name, flags);
-    if (docp == NULL)
-	goto bail;
-    
-    ret = xmlXPathNewNodeSet(NULL);
-    if (ret == NULL)
+    if (lines) {
+	/* Each line becomes a <record> under a single top element */
+	container = slaxMakeRtf(ctxt);
+	if (container == NULL)
+	    goto bail;
+
+	childp = xmlNewDocNode(container, NULL,
+			       (const xmlChar *) (root_name ?: ELT_JSON), NULL);
+	if (childp == NULL)
+	    goto bail;
+	xmlAddChild((xmlNodePtr) container, childp);
+
+	skipped = slaxJsonLinesDataToXml(json, NULL, flags,
+					 extXutilJsonLinesRecord, childp);
+	if (skipped < 0)
+	    goto bail;
+
+	/* Let the script see that bad lines were skipped */
+	if (skipped > 0) {
+	    char buf[16];
+
+	    snprintf(buf, sizeof(buf), "%d", skipped);
+	    xmlSetProp(childp, (const xmlChar *) ATT_ERRORS,
+		       (const xmlChar *) buf);
+	}
+
+	ret = xmlXPathNewNodeSet(childp);
 	goto bail;
+    }
 
-    /* Fake an RVT to hold the output of the template */
-    container = slaxMakeRtf(ctxt);
-    if (container == NULL)
+    docp = slaxJsonDataToXml(json, root_name, flags);
+    if (docp == NULL)
 	goto bail;
 
-    /*
-     * XXX There should be a way to read the xml input directly
-     * into the RTF container.  Lacking that, we copy it.
-     */
-    childp = xmlDocGetRootElement(docp);
-    xmlNodePtr newp = xmlDocCopyNode(childp, container, 1);
-    if (newp) {
-	xmlAddChild((xmlNodePtr) container, newp);
-	xmlXPathNodeSetAdd(ret->nodesetval, newp);
-    }
+    ret = extXutilDocToRtf(ctxt, docp);
 
 bail:
     if (root_name != NULL)
@@ -472,6 +523,155 @@ bail:
 	xmlFreeDoc(docp);
 }
 
+/*
+ * Decode CBOR or MessagePack data into XML, in the same form as
+ * json-to-xml() gives.  XPath strings can't hold arbitrary bytes,
+ * so the data is passed as base64:
+ *     var $xml = xutil:cbor-to-xml($base64, $options);
+ */
+static void
+extXutilBinaryToXml (xmlXPathParserContext *ctxt, int nargs, int format,
+		     const char *func)
+{
+    xmlXPathObjectPtr ret = NULL;
+    unsigned flags = 0;
+    xmlDocPtr docp = NULL;
+    char *root_name = NULL;
+    char *str, *data = NULL;
+    size_t len;
+
+    if (nargs < 1 || nargs > 2) {
+	xmlXPathSetArityError(ctxt);
+	return;
+    }
+
+    if (nargs == 2) {
+	xmlXPathObject *xop = valuePop(ctxt);
+	int rc = extXutilDecodeOptions(xop, func, &flags, &root_name, NULL);
+
+	xmlXPathFreeObject(xop);
+	if (rc < 0) {
+	    xmlXPathReturnEmptyString(ctxt);
+	    return;
+	}
+    }
+
+    str = (char *) xmlXPathPopString(ctxt);
+    if (str == NULL)
+	goto bail;
+
+    data = slaxBase64Decode(str, strlen(str), &len);
+    if (data == NULL) {
+	LX_ERR("%s: invalid base64 data\n", func);
+	goto bail;
+    }
+
+    docp = slaxJsonBinaryDataToXml(format, data, len, root_name, flags);
+    if (docp == NULL)
+	goto bail;
+
+    ret = extXutilDocToRtf(ctxt, docp);
+
+bail:
+    if (ret != NULL)
+	valuePush(ctxt, ret);
+    else
+	valuePush(ctxt, xmlXPathNewNodeSet(NULL));
+
+    xmlFreeAndEasy(root_name);
+    xmlFreeAndEasy(str);
+    xmlFreeAndEasy(data);
+    if (docp)
+	xmlFreeDoc(docp);
+}
+
+/*
+ * Encode XML hierarchies as CBOR or MessagePack, returned as base64:
+ *     var $base64 = xutil:xml-to-cbor($xml);
+ * Each node is encoded as a map (or an array, for type="array"), one
+ * after another.
+ */
+static void
+extXutilXmlToBinary (xmlXPathParserContext *ctxt, int nargs, int format,
+		     const char *func)
+{
+    xmlXPathObject *xop;
+    xmlBufferPtr xbuf;
+    char *str;
+    size_t len;
+    int i;
+
+    if (nargs != 1) {
+	xmlXPathSetArityError(ctxt);
+	return;
+    }
+
+    xop = valuePop(ctxt);
+    if (!xop->nodesetval || !xop->nodesetval->nodeNr) {
+	LX_ERR("%s: invalid parameter\n", func);
+	xmlXPathFreeObject(xop);
+	xmlXPathReturnEmptyString(ctxt);
+	return;
+    }
+
+    xbuf = xmlBufferCreate();
+    if (xbuf == NULL) {
+	xmlXPathFreeObject(xop);
+	xmlXPathReturnEmptyString(ctxt);
+	return;
+    }
+    xmlBufferSetAllocationScheme(xbuf, XML_BUFFER_ALLOC_DOUBLEIT);
+
+    for (i = 0; i < xop->nodesetval->nodeNr; i++) {
+	xmlNodePtr nop;
+
+	nop = xop->nodesetval->nodeTab[i];
+	if (nop->type == XML_DOCUMENT_NODE)
+	    nop = nop->children;
+	if (nop->type != XML_ELEMENT_NODE)
+	    continue;
+
+	if (slaxJsonBinaryWriteNode(format, xbuf, nop) < 0) {
+	    LX_ERR("%s: cannot encode data\n", func);
+	    break;
+	}
+    }
+
+    str = slaxBase64Encode((const char *) xmlBufferContent(xbuf),
+			   xmlBufferLength(xbuf), &len);
+    if (str)
+	valuePush(ctxt, xmlXPathWrapString((xmlChar *) str));
+    else
+	xmlXPathReturnEmptyString(ctxt);
+
+    xmlBufferFree(xbuf);
+    xmlXPathFreeObject(xop);
+}
+
+static void
+extXutilCborToXml (xmlXPathParserContext *ctxt, int nargs)
+{
+    extXutilBinaryToXml(ctxt, nargs, JB_CBOR, "cbor-to-xml");
+}
+
+static void
+extXutilXmlToCbor (xmlXPathParserContext *ctxt, int nargs)
+{
+    extXutilXmlToBinary(ctxt, nargs, JB_CBOR, "xml-to-cbor");
+}
+
+static void
+extXutilMsgpackToXml (xmlXPathParserContext *ctxt, int nargs)
+{
+    extXutilBinaryToXml(ctxt, nargs, JB_MSGPACK, "msgpack-to-xml");
+}
+
+static void
+extXutilXmlToMsgpack (xmlXPathParserContext *ctxt, int nargs)
+{
+    extXutilXmlToBinary(ctxt, nargs, JB_MSGPACK, "xml-to-msgpack");
+}
+
 /*
  * Adjust the max call depth, the limit of recursion in libxml2:
  *     expr xutil:max-call-depth(5000);
@@ -531,6 +731,26 @@ slax_function_table_t slaxXutilTable[] = {
 	"Decodes data from JSON into XML nodes",
 	"(string)", XPATH_XSLT_TREE,
     },
+    {
+	"xml-to-cbor", extXutilXmlToCbor,
+	"Encodes XML hierarchies as CBOR data (in base64)",
+	"(xml-data)", XPATH_STRING,
+    },
+    {
+	"cbor-to-xml", extXutilCborToXml,
+	"Decodes CBOR data (in base64) into XML nodes",
+	"(string)", XPATH_XSLT_TREE,
+    },
+    {
+	"xml-to-msgpack", extXutilXmlToMsgpack,
+	"Encodes XML hierarchies as MessagePack data (in base64)",
+	"(xml-data)", XPATH_STRING,
+    },
+    {
+	"msgpack-to-xml", extXutilMsgpackToXml,
+	"Decodes MessagePack data (in base64) into XML nodes",
+	"(string)", XPATH_XSLT_TREE,
+    },
     {
 	"max-call-depth", extXutilMaxCallDepth,
 	"Sets the maximum call depth for recursion in the XSLT engine",
@@ -0,0 +1,1466 @@
+/*
+ * Copyright (c) 2013, Juniper Networks, Inc.
+ * All rights reserved.
+ * This SOFTWARE is licensed under the LICENSE provided in the
+ * ../Copyright file. By downloading, installing, copying, or otherwise
+ * using the SOFTWARE, you agree to be bound by the terms of that
+ * LICENSE.
+ *
+ * jsonbinary.c -- CBOR and MessagePack, to and from JSON-style XML
+ *
+ * CBOR (RFC 8949) and MessagePack carry the same data model as JSON,
+ * so rather than building XML ourselves, we decode each item into the
+ * token the JSON reader's parser would have seen for the same data
+ * as JSON text, and hand it over with slaxJsonReaderToken().  The XML
+ * is then exactly what slaxJsonDataToXml() builds, names, "type"
+ * attributes and all.  Like the JSON reader, input is pushed in
+ * chunks of any size; an item split across chunks is held until the
+ * rest of it arrives.
+ *
+ * Where the binary formats go beyond JSON:
+ *   - byte strings (and MessagePack "ext" data) become base64 strings
+ *   - CBOR tags are dropped, leaving the tagged item
+ *   - "undefined", other simple values, and non-finite floats
+ *     become null
+ *   - map keys that aren't strings are turned into strings
+ *
+ * Encoding reads the XML the way jsonwriter.c does.  Numbers that are
+ * integers fitting in 64 bits are written as integers, and other
+ * numbers as floats (single precision if that's exact).  A "number"
+ * that isn't a finite JSON number is an error.
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <math.h>
+
+#include <libxml/xmlmemory.h>
+#include <libxml/parser.h>
+
+#include <libslax/slax.h>
+#include "slaxinternals.h"
+#include "jsonreader.h"
+#include "jsonwriter.h"
+#include "jsonbinary.h"
+
+#define JB_STACK_INIT	32	/* Initial depth of the container stack */
+#define JB_BUF_INIT	256	/* Initial size of a buffer */
+#define JB_MAX_STRING	INT32_MAX /* Longest string (libxml2 uses ints) */
+#define JB_INDEFINITE	UINT64_MAX /* Container ends with a "break" */
+
+/* Kinds of items (jbi_kind) */
+#define JBI_UINT	1	/* Unsigned integer (jbi_value) */
+#define JBI_NEGINT	2	/* Negative integer (-1 - jbi_value) */
+#define JBI_FLOAT	3	/* Floating point (jbi_double) */
+#define JBI_TEXT	4	/* Text string (jbi_value bytes at jbi_data) */
+#define JBI_BYTES	5	/* Byte string (jbi_value bytes at jbi_data) */
+#define JBI_ARRAY	6	/* Array of jbi_value items */
+#define JBI_MAP		7	/* Map of jbi_value pairs */
+#define JBI_TRUE	8	/* true */
+#define JBI_FALSE	9	/* false */
+#define JBI_NULL	10	/* null (and things we treat as null) */
+#define JBI_TAG		11	/* CBOR tag (dropped) */
+#define JBI_TEXT_START	12	/* CBOR indefinite-length text string */
+#define JBI_BYTES_START	13	/* CBOR indefinite-length byte string */
+#define JBI_BREAK	14	/* CBOR "break" */
+
+/* Open containers (jbf_type) */
+#define JBF_ARRAY	1	/* Array */
+#define JBF_MAP		2	/* Map (keys and values both count) */
+#define JBF_TEXT	3	/* Chunks of an indefinite-length text string */
+#define JBF_BYTES	4	/* Chunks of an indefinite-length byte string */
+
+typedef struct json_binary_item_s {
+    int jbi_kind;		/* Kind of item (JBI_*) */
+    size_t jbi_size;		/* Bytes in the item (or needed to know) */
+    uint64_t jbi_value;		/* Integer value, count, or length */
+    double jbi_double;		/* Floating point value */
+    const char *jbi_data;	/* Contents of a string */
+} json_binary_item_t;
+
+typedef struct json_binary_frame_s {
+    int jbf_type;		/* Type of container (JBF_*) */
+    uint64_t jbf_left;		/* Items left, or JB_INDEFINITE */
+    uint64_t jbf_seen;		/* Items seen */
+} json_binary_frame_t;
+
+typedef struct json_binary_buf_s {
+    char *jbb_data;		/* Data */
+    size_t jbb_len;		/* Bytes used */
+    size_t jbb_size;		/* Bytes allocated */
+} json_binary_buf_t;
+
+struct json_binary_s {
+    int jb_format;		/* Input format (JB_*) */
+    char *jb_filename;		/* Filename, for error messages */
+    json_reader_t *jb_reader;	/* The JSON reader building our XML */
+    uint64_t jb_offset;		/* Offset of the current item */
+    int jb_errors;		/* Number of errors */
+    int jb_done;		/* Seen the whole top-level item */
+    json_binary_frame_t *jb_stack; /* Open containers */
+    int jb_depth;		/* Number of open containers */
+    int jb_stack_size;		/* Size of jb_stack */
+    json_binary_buf_t jb_pend;	/* Item split across chunks */
+    json_binary_buf_t jb_str;	/* Indefinite-length string being built */
+};
+
+static void
+jsonBinaryError (json_binary_t *jbp, const char *fmt, ...)
+{
+    char buf[BUFSIZ];
+    va_list vap;
+
+    va_start(vap, fmt);
+    vsnprintf(buf, sizeof(buf), fmt, vap);
+    va_end(vap);
+
+    slaxError("%s: offset %" PRIu64 ": %s", jbp->jb_filename,
+	      jbp->jb_offset, buf);
+    jbp->jb_errors += 1;
+}
+
+static int
+jsonBinaryAppend (json_binary_t *jbp, json_binary_buf_t *jbbp,
+		  const char *data, size_t len)
+{
+    if (len == 0)
+	return 0;
+
+    if (jbbp->jbb_len + len > jbbp->jbb_size) {
+	size_t size = jbbp->jbb_size ? jbbp->jbb_size : JB_BUF_INIT;
+	char *buf;
+
+	while (size < jbbp->jbb_len + len)
+	    size *= 2;
+
+	buf = xmlRealloc(jbbp->jbb_data, size);
+	if (buf == NULL) {
+	    jsonBinaryError(jbp, "out of memory");
+	    return -1;
+	}
+
+	jbbp->jbb_data = buf;
+	jbbp->jbb_size = size;
+    }
+
+    memcpy(jbbp->jbb_data + jbbp->jbb_len, data, len);
+    jbbp->jbb_len += len;
+    return 0;
+}
+
+/*
+ * Read a big-endian integer
+ */
+static uint64_t
+jsonBinaryUint (const unsigned char *cp, int len)
+{
+    uint64_t val = 0;
+
+    while (len-- > 0)
+	val = (val << 8) | *cp++;
+
+    return val;
+}
+
+static double
+jsonBinaryFloat (uint32_t bits)
+{
+    float val;
+
+    memcpy(&val, &bits, sizeof(val));
+    return val;
+}
+
+static double
+jsonBinaryDouble (uint64_t bits)
+{
+    double val;
+
+    memcpy(&val, &bits, sizeof(val));
+    return val;
+}
+
+/*
+ * Widen an IEEE 754 half-precision float to single precision
+ */
+static double
+jsonBinaryHalf (unsigned half)
+{
+    uint32_t sign = (uint32_t) (half & 0x8000) << 16;
+    uint32_t exp = (half >> 10) & 0x1f;
+    uint32_t mant = half & 0x3ff;
+
+    if (exp == 31)		/* Infinity and NaN */
+	return jsonBinaryFloat(sign | 0x7f800000 | (mant << 13));
+
+    if (exp == 0) {
+	if (mant == 0)
+	    return jsonBinaryFloat(sign);
+
+	/* Subnormal: normalize it, since single precision has room */
+	exp = 127 - 15 + 1;
+	while (!(mant & 0x400)) {
+	    mant <<= 1;
+	    exp -= 1;
+	}
+	return jsonBinaryFloat(sign | (exp << 23) | ((mant & 0x3ff) << 13));
+    }
+
+    return jsonBinaryFloat(sign | ((exp + 127 - 15) << 23) | (mant << 13));
+}
+
+/*
+ * A string's contents follow its head; see if they're all here
+ */
+static int
+jsonBinaryPayload (const unsigned char *buf, size_t avail, size_t head,
+		   uint64_t len, json_binary_item_t *jbip)
+{
+    if (len > JB_MAX_STRING)
+	return -1;
+
+    jbip->jbi_size = head + len;
+    if (avail < jbip->jbi_size)
+	return 0;
+
+    jbip->jbi_data = (const char *) buf + head;
+    jbip->jbi_value = len;
+    return 1;
+}
+
+/*
+ * Decode the CBOR item at buf.  Returns 1 if it's all there, 0 if
+ * we need jbi_size bytes to go further, or -1 if it's not valid.
+ */
+static int
+jsonCborHead (const unsigned char *buf, size_t avail, json_binary_item_t *jbip)
+{
+    int major, info;
+    size_t head;
+    uint64_t val;
+
+    jbip->jbi_size = 1;
+    if (avail < 1)
+	return 0;
+
+    major = buf[0] >> 5;
+    info = buf[0] & 0x1f;
+
+    if (info < 24)
+	head = 1;
+    else if (info < 28)
+	head = 1 + (1 << (info - 24));
+    else if (info == 31 && major >= 2 && major != 6)
+	head = 1;		/* Indefinite length, or "break" */
+    else
+	return -1;
+
+    jbip->jbi_size = head;
+    if (avail < head)
+	return 0;
+
+    val = (info < 24) ? (uint64_t) info : jsonBinaryUint(buf + 1, head - 1);
+    jbip->jbi_value = val;
+
+    switch (major) {
+    case 0:
+	jbip->jbi_kind = JBI_UINT;
+	break;
+
+    case 1:
+	jbip->jbi_kind = JBI_NEGINT;
+	break;
+
+    case 2:
+    case 3:
+	if (info == 31) {
+	    jbip->jbi_kind = (major == 2) ? JBI_BYTES_START : JBI_TEXT_START;
+	    break;
+	}
+
+	jbip->jbi_kind = (major == 2) ? JBI_BYTES : JBI_TEXT;
+	return jsonBinaryPayload(buf, avail, head, val, jbip);
+
+    case 4:
+    case 5:
+	jbip->jbi_kind = (major == 4) ? JBI_ARRAY : JBI_MAP;
+	if (info == 31)
+	    jbip->jbi_value = JB_INDEFINITE;
+	break;
+
+    case 6:
+	jbip->jbi_kind = JBI_TAG;
+	break;
+
+    case 7:
+	switch (info) {
+	case 20:
+	    jbip->jbi_kind = JBI_FALSE;
+	    break;
+
+	case 21:
+	    jbip->jbi_kind = JBI_TRUE;
+	    break;
+
+	case 25:
+	    jbip->jbi_kind = JBI_FLOAT;
+	    jbip->jbi_double = jsonBinaryHalf(val);
+	    break;
+
+	case 26:
+	    jbip->jbi_kind = JBI_FLOAT;
+	    jbip->jbi_double = jsonBinaryFloat(val);
+	    break;
+
+	case 27:
+	    jbip->jbi_kind = JBI_FLOAT;
+	    jbip->jbi_double = jsonBinaryDouble(val);
+	    break;
+
+	case 31:
+	    jbip->jbi_kind = JBI_BREAK;
+	    break;
+
+	default:		/* null, undefined, other simple values */
+	    jbip->jbi_kind = JBI_NULL;
+	    break;
+	}
+	break;
+    }
+
+    return 1;
+}
+
+/*
+ * Decode the MessagePack item at buf, returning as jsonCborHead() does
+ */
+static int
+jsonMsgpackHead (const unsigned char *buf, size_t avail,
+		 json_binary_item_t *jbip)
+{
+    int ch, len = 0, ext = 0, fixext = -1;
+    uint64_t val;
+    int64_t sval;
+
+    jbip->jbi_size = 1;
+    if (avail < 1)
+	return 0;
+
+    ch = buf[0];
+
+    if (ch <= 0x7f) {		/* Positive fixint */
+	jbip->jbi_kind = JBI_UINT;
+	jbip->jbi_value = ch;
+	return 1;
+    }
+
+    if (ch >= 0xe0) {		/* Negative fixint */
+	jbip->jbi_kind = JBI_NEGINT;
+	jbip->jbi_value = 0xff - ch;
+	return 1;
+    }
+
+    if (ch <= 0x9f) {		/* Fixmap and fixarray */
+	jbip->jbi_kind = (ch <= 0x8f) ? JBI_MAP : JBI_ARRAY;
+	jbip->jbi_value = ch & 0x0f;
+	return 1;
+    }
+
+    if (ch <= 0xbf) {		/* Fixstr */
+	jbip->jbi_kind = JBI_TEXT;
+	return jsonBinaryPayload(buf, avail, 1, ch & 0x1f, jbip);
+    }
+
+    switch (ch) {
+    case 0xc0:
+	jbip->jbi_kind = JBI_NULL;
+	return 1;
+
+    case 0xc2:
+	jbip->jbi_kind = JBI_FALSE;
+	return 1;
+
+    case 0xc3:
+	jbip->jbi_kind = JBI_TRUE;
+	return 1;
+
+    case 0xc4: case 0xc5: case 0xc6:	/* bin 8/16/32 */
+	jbip->jbi_kind = JBI_BYTES;
+	len = 1 << (ch - 0xc4);
+	break;
+
+    case 0xc7: case 0xc8: case 0xc9:	/* ext 8/16/32 */
+	jbip->jbi_kind = JBI_BYTES;
+	len = 1 << (ch - 0xc7);
+	ext = 1;
+	break;
+
+    case 0xca: case 0xcb:		/* float 32/64 */
+	jbip->jbi_kind = JBI_FLOAT;
+	len = (ch == 0xca) ? 4 : 8;
+	break;
+
+    case 0xcc: case 0xcd: case 0xce: case 0xcf: /* uint 8/16/32/64 */
+	jbip->jbi_kind = JBI_UINT;
+	len = 1 << (ch - 0xcc);
+	break;
+
+    case 0xd0: case 0xd1: case 0xd2: case 0xd3: /* int 8/16/32/64 */
+	jbip->jbi_kind = JBI_NEGINT;
+	len = 1 << (ch - 0xd0);
+	break;
+
+    case 0xd4: case 0xd5: case 0xd6: case 0xd7: case 0xd8: /* fixext */
+	jbip->jbi_kind = JBI_BYTES;
+	fixext = 1 << (ch - 0xd4);
+	ext = 1;
+	break;
+
+    case 0xd9: case 0xda: case 0xdb:	/* str 8/16/32 */
+	jbip->jbi_kind = JBI_TEXT;
+	len = 1 << (ch - 0xd9);
+	break;
+
+    case 0xdc: case 0xdd:		/* array 16/32 */
+	jbip->jbi_kind = JBI_ARRAY;
+	len = (ch == 0xdc) ? 2 : 4;
+	break;
+
+    case 0xde: case 0xdf:		/* map 16/32 */
+	jbip->jbi_kind = JBI_MAP;
+	len = (ch == 0xde) ? 2 : 4;
+	break;
+
+    default:				/* 0xc1 is never used */
+	return -1;
+    }
+
+    /* The head is the initial byte, any length or value, and ext type */
+    jbip->jbi_size = 1 + len + ext;
+    if (avail < jbip->jbi_size)
+	return 0;
+
+    val = jsonBinaryUint(buf + 1, len);
+    jbip->jbi_value = val;
+
+    switch (jbip->jbi_kind) {
+    case JBI_BYTES:
+    case JBI_TEXT:
+	return jsonBinaryPayload(buf, avail, 1 + len + ext,
+				 (fixext >= 0) ? (uint64_t) fixext : val, jbip);
+
+    case JBI_FLOAT:
+	jbip->jbi_double = (len == 4) ? jsonBinaryFloat(val)
+	    : jsonBinaryDouble(val);
+	break;
+
+    case JBI_NEGINT:
+	/* Sign-extend, then sort out which kind of integer it is */
+	sval = (int64_t) (val << (64 - 8 * len)) >> (64 - 8 * len);
+	if (sval >= 0) {
+	    jbip->jbi_kind = JBI_UINT;
+	    jbip->jbi_value = sval;
+	} else
+	    jbip->jbi_value = (uint64_t) -(sval + 1);
+	break;
+    }
+
+    return 1;
+}
+
+static int
+jsonBinaryHead (json_binary_t *jbp, const unsigned char *buf, size_t avail,
+		json_binary_item_t *jbip)
+{
+    if (jbp->jb_format == JB_CBOR)
+	return jsonCborHead(buf, avail, jbip);
+
+    return jsonMsgpackHead(buf, avail, jbip);
+}
+
+static inline json_binary_frame_t *
+jsonBinaryTop (json_binary_t *jbp)
+{
+    return jbp->jb_depth ? &jbp->jb_stack[jbp->jb_depth - 1] : NULL;
+}
+
+/*
+ * Is the next item in this container a map key?
+ */
+static inline int
+jsonBinaryIsKey (json_binary_frame_t *jbfp)
+{
+    return (jbfp->jbf_type == JBF_MAP && (jbfp->jbf_seen % 2) == 0);
+}
+
+static int
+jsonBinaryToken (json_binary_t *jbp, int tok, const char *data, size_t len)
+{
+    if (slaxJsonReaderToken(jbp->jb_reader, tok, data, len) < 0) {
+	jbp->jb_errors += 1;
+	return -1;
+    }
+
+    return 0;
+}
+
+static int
+jsonBinaryPushFrame (json_binary_t *jbp, int type, uint64_t left)
+{
+    json_binary_frame_t *jbfp;
+
+    if (jbp->jb_depth >= jbp->jb_stack_size) {
+	int size = jbp->jb_stack_size ? jbp->jb_stack_size * 2 : JB_STACK_INIT;
+
+	jbfp = xmlRealloc(jbp->jb_stack, size * sizeof(*jbfp));
+	if (jbfp == NULL) {
+	    jsonBinaryError(jbp, "out of memory");
+	    return -1;
+	}
+
+	jbp->jb_stack = jbfp;
+	jbp->jb_stack_size = size;
+    }
+
+    jbfp = &jbp->jb_stack[jbp->jb_depth++];
+    jbfp->jbf_type = type;
+    jbfp->jbf_left = left;
+    jbfp->jbf_seen = 0;
+
+    return 0;
+}
+
+/*
+ * Items after the first in a container are separated by commas
+ */
+static int
+jsonBinaryNext (json_binary_t *jbp, json_binary_frame_t *jbfp)
+{
+    if (jbfp->jbf_seen > 0
+	    && (jbfp->jbf_type == JBF_ARRAY || jsonBinaryIsKey(jbfp)))
+	return jsonBinaryToken(jbp, JT_COMMA, ",", 1);
+
+    return 0;
+}
+
+/*
+ * An item is complete: count it against its container, and close
+ * each container that's now full, which completes an item in turn
+ */
+static int
+jsonBinaryDone (json_binary_t *jbp)
+{
+    json_binary_frame_t *jbfp;
+
+    for (;;) {
+	jbfp = jsonBinaryTop(jbp);
+	if (jbfp == NULL) {
+	    jbp->jb_done = TRUE;
+	    return 0;
+	}
+
+	if (jsonBinaryIsKey(jbfp) && jsonBinaryToken(jbp, JT_COLON, ":", 1))
+	    return -1;
+
+	jbfp->jbf_seen += 1;
+	if (jbfp->jbf_left == JB_INDEFINITE || --jbfp->jbf_left > 0)
+	    return 0;
+
+	jbp->jb_depth -= 1;
+	if (jbfp->jbf_type == JBF_MAP) {
+	    if (jsonBinaryToken(jbp, JT_CBRACE, "}", 1))
+		return -1;
+	} else if (jsonBinaryToken(jbp, JT_CBRACK, "]", 1))
+	    return -1;
+    }
+}
+
+/*
+ * Start an array or map
+ */
+static int
+jsonBinaryOpen (json_binary_t *jbp, int type, uint64_t count)
+{
+    json_binary_frame_t *jbfp = jsonBinaryTop(jbp);
+    int map = (type == JBF_MAP);
+
+    if (jbfp) {
+	if (jsonBinaryIsKey(jbfp)) {
+	    jsonBinaryError(jbp, "map keys must be strings or numbers");
+	    return -1;
+	}
+
+	if (jsonBinaryNext(jbp, jbfp))
+	    return -1;
+    }
+
+    if (jsonBinaryToken(jbp, map ? JT_OBRACE : JT_OBRACK, map ? "{" : "[", 1))
+	return -1;
+
+    if (count == 0) {
+	if (jsonBinaryToken(jbp, map ? JT_CBRACE : JT_CBRACK,
+			    map ? "}" : "]", 1))
+	    return -1;
+	return jsonBinaryDone(jbp);
+    }
+
+    /* A map holds a key and a value for each entry */
+    if (map && count != JB_INDEFINITE) {
+	if (count >= JB_INDEFINITE / 2) {
+	    jsonBinaryError(jbp, "map is too large");
+	    return -1;
+	}
+	count *= 2;
+    }
+
+    return jsonBinaryPushFrame(jbp, type, count);
+}
+
+/*
+ * Format a floating point number with the fewest digits that read
+ * back as the same double, so 0.1 is "0.1" rather than
+ * "0.10000000000000001", and in the "%g" style JSON data usually
+ * has, with exponents like "e300" and "e-7".  Trying "%.15g",
+ * "%.16g", and "%.17g" in turn would do, but formatting a double
+ * costs several times what strtod() does, so we format once with
+ * every digit we might need, then try rounding those digits to
+ * fewer, checking each try with strtod().
+ */
+static size_t
+jsonBinaryFormatDouble (char *buf, size_t size, double val)
+{
+    char all[32], digits[20], *cp, *bp = buf;
+    int maxprec = 17;		/* Digits that are always enough */
+    int prec, exp, rexp, neg, ndigits, i;
+    double back;
+
+    /* "-d.dddde-XX": the mantissa digits, then the exponent */
+    snprintf(all, sizeof(all), "%.*e", maxprec - 1, val);
+    cp = all;
+    neg = (*cp == '-');
+    if (neg)
+	cp += 1;
+
+    for (i = 0; i < maxprec; cp++)
+	if (isdigit((unsigned char) *cp))
+	    all[i++] = *cp;	/* Safe: we're always behind cp */
+    exp = atoi(cp + 1);
+    all[maxprec] = '\0';
+
+    for (prec = 15; prec <= maxprec; prec++) {
+	memcpy(digits, all, prec);
+	rexp = exp;
+
+	/*
+	 * Round to prec digits, which may carry all the way up.  If
+	 * what's dropped is exactly "5", the value itself may be just
+	 * under or over it, and only printf() knows which way to go.
+	 */
+	if (prec < maxprec && all[prec] == '5'
+		&& strspn(all + prec + 1, "0") == (size_t) (maxprec - prec - 1)) {
+	    char tie[32];
+
+	    snprintf(tie, sizeof(tie), "%.*e", prec - 1, val);
+	    cp = tie + neg;
+	    for (i = 0; i < prec; cp++)
+		if (isdigit((unsigned char) *cp))
+		    digits[i++] = *cp;
+	    rexp = atoi(cp + 1);
+
+	} else if (prec < maxprec && all[prec] >= '5') {
+	    for (i = prec - 1; i >= 0 && digits[i] == '9'; i--)
+		digits[i] = '0';
+	    if (i >= 0)
+		digits[i] += 1;
+	    else {
+		digits[0] = '1';
+		rexp += 1;
+	    }
+	}
+
+	for (ndigits = prec; ndigits > 1 && digits[ndigits - 1] == '0'; )
+	    ndigits -= 1;
+
+	bp = buf;
+	if (neg)
+	    *bp++ = '-';
+
+	if (rexp < -4 || rexp >= prec) {
+	    /* Exponent form, as "%g" does it */
+	    *bp++ = digits[0];
+	    if (ndigits > 1) {
+		*bp++ = '.';
+		memcpy(bp, digits + 1, ndigits - 1);
+		bp += ndigits - 1;
+	    }
+	    bp += snprintf(bp, size - (bp - buf), "e%d", rexp);
+
+	} else if (rexp < 0) {
+	    *bp++ = '0';
+	    *bp++ = '.';
+	    for (i = rexp + 1; i < 0; i++)
+		*bp++ = '0';
+	    memcpy(bp, digits, ndigits);
+	    bp += ndigits;
+	    *bp = '\0';
+
+	} else {
+	    for (i = 0; i <= rexp; i++)
+		*bp++ = (i < ndigits) ? digits[i] : '0';
+	    if (ndigits > rexp + 1) {
+		*bp++ = '.';
+		memcpy(bp, digits + rexp + 1, ndigits - rexp - 1);
+		bp += ndigits - rexp - 1;
+	    }
+	    *bp = '\0';
+	}
+
+	if (prec == maxprec)
+	    break;		/* Exact by definition */
+
+	back = strtod(buf, NULL);
+	if (back == val)
+	    break;
+    }
+
+    return bp - buf;
+}
+
+/*
+ * Both formats require text strings to be UTF-8, so check that they
+ * are.  xmlGetUTF8Char() checks the form of each sequence, but not
+ * that it's the shortest one, or that it isn't a surrogate.  Controls
+ * are replaced with U+FFFD, as the JSON reader does, in a copy that's
+ * returned in *allocp.
+ */
+static int
+jsonBinaryText (json_binary_t *jbp, const char **datap, size_t *lenp,
+		char **allocp)
+{
+    const unsigned char *cp = (const unsigned char *) *datap;
+    const unsigned char *ep = cp + *lenp;
+    size_t controls = 0;
+    char *bp;
+    int ch, clen;
+
+    while (cp < ep) {
+	clen = (ep - cp < 4) ? ep - cp : 4;
+	ch = xmlGetUTF8Char(cp, &clen);
+	if (ch < 0 || (clen == 2 && ch < 0x80) || (clen == 3 && ch < 0x800)
+	        || (clen == 4 && ch < 0x10000) || ch > 0x10ffff
+	        || (ch >= 0xd800 && ch < 0xe000)) {
+	    jsonBinaryError(jbp, "text string is not valid UTF-8");
+	    return -1;
+	}
+
+	if (slaxJsonIsControl(ch))
+	    controls += 1;
+	cp += clen;
+    }
+
+    if (controls == 0)
+	return 0;
+
+    bp = *allocp = xmlMalloc(*lenp + controls * 2);
+    if (bp == NULL) {
+	jsonBinaryError(jbp, "out of memory");
+	return -1;
+    }
+
+    /* Controls are single bytes, and no other character has one */
+    for (cp = (const unsigned char *) *datap; cp < ep; cp++) {
+	if (slaxJsonIsControl(*cp)) {
+	    memcpy(bp, JSON_REPLACEMENT_CHAR, 3);
+	    bp += 3;
+	} else
+	    *bp++ = *cp;
+    }
+
+    *datap = *allocp;
+    *lenp = bp - *allocp;
+    return 0;
+}
+
+/*
+ * Handle a scalar, which is a value or a map key
+ */
+static int
+jsonBinaryScalar (json_binary_t *jbp, json_binary_item_t *jbip)
+{
+    json_binary_frame_t *jbfp = jsonBinaryTop(jbp);
+    char buf[64];
+    char *alloc = NULL;
+    const char *data = buf;
+    size_t len = 0;
+    int tok = JT_NUMBER, rc;
+
+    if (jbfp == NULL) {
+	jsonBinaryError(jbp, "top-level item must be a map or an array");
+	return -1;
+    }
+
+    switch (jbip->jbi_kind) {
+    case JBI_UINT:
+	len = snprintf(buf, sizeof(buf), "%" PRIu64, jbip->jbi_value);
+	break;
+
+    case JBI_NEGINT:
+	if (jbip->jbi_value == UINT64_MAX) /* -2^64 doesn't fit */
+	    len = snprintf(buf, sizeof(buf), "-18446744073709551616");
+	else
+	    len = snprintf(buf, sizeof(buf), "-%" PRIu64, jbip->jbi_value + 1);
+	break;
+
+    case JBI_FLOAT:
+	if (!isfinite(jbip->jbi_double)) {
+	    tok = JT_NULL;
+	    data = VAL_NULL;
+	    len = strlen(data);
+	    break;
+	}
+
+	/*
+	 * Half and single floats are printed as the double they
+	 * widen to, since printing them at their own precision would
+	 * read back as a different double
+	 */
+	len = jsonBinaryFormatDouble(buf, sizeof(buf), jbip->jbi_double);
+	break;
+
+    case JBI_TEXT:
+	tok = JT_STRING;
+	data = jbip->jbi_data;
+	len = jbip->jbi_value;
+	if (jsonBinaryText(jbp, &data, &len, &alloc))
+	    return -1;
+	break;
+
+    case JBI_BYTES:
+	tok = JT_STRING;
+	data = alloc = slaxBase64Encode(jbip->jbi_data, jbip->jbi_value, &len);
+	if (alloc == NULL) {
+	    jsonBinaryError(jbp, "out of memory");
+	    return -1;
+	}
+	break;
+
+    case JBI_TRUE:
+	tok = JT_TRUE;
+	data = VAL_TRUE;
+	len = strlen(data);
+	break;
+
+    case JBI_FALSE:
+	tok = JT_FALSE;
+	data = VAL_FALSE;
+	len = strlen(data);
+	break;
+
+    case JBI_NULL:
+	tok = JT_NULL;
+	data = VAL_NULL;
+	len = strlen(data);
+	break;
+    }
+
+    /* Whatever it is, a key is a string */
+    if (jsonBinaryIsKey(jbfp))
+	tok = JT_STRING;
+
+    rc = jsonBinaryNext(jbp, jbfp);
+    if (rc == 0)
+	rc = jsonBinaryToken(jbp, tok, data, len);
+    if (rc == 0)
+	rc = jsonBinaryDone(jbp);
+
+    xmlFree(alloc);
+    return rc;
+}
+
+/*
+ * Handle one complete item
+ */
+static int
+jsonBinaryItem (json_binary_t *jbp, json_binary_item_t *jbip)
+{
+    json_binary_frame_t *jbfp = jsonBinaryTop(jbp);
+    json_binary_item_t item;
+
+    if (jbp->jb_done) {
+	jsonBinaryError(jbp, "extra data after the end of input");
+	return -1;
+    }
+
+    /* Indefinite-length strings are a series of definite ones */
+    if (jbfp && (jbfp->jbf_type == JBF_TEXT || jbfp->jbf_type == JBF_BYTES)) {
+	if (jbip->jbi_kind == JBI_BREAK) {
+	    bzero(&item, sizeof(item));
+	    item.jbi_kind = (jbfp->jbf_type == JBF_TEXT) ? JBI_TEXT : JBI_BYTES;
+	    item.jbi_data = jbp->jb_str.jbb_data ?: "";
+	    item.jbi_value = jbp->jb_str.jbb_len;
+	    jbp->jb_depth -= 1;
+	    return jsonBinaryScalar(jbp, &item);
+	}
+
+	if (jbip->jbi_kind != ((jbfp->jbf_type == JBF_TEXT)
+			       ? JBI_TEXT : JBI_BYTES)) {
+	    jsonBinaryError(jbp, "invalid chunk in an indefinite-length string");
+	    return -1;
+	}
+
+	return jsonBinaryAppend(jbp, &jbp->jb_str, jbip->jbi_data,
+				jbip->jbi_value);
+    }
+
+    switch (jbip->jbi_kind) {
+    case JBI_ARRAY:
+	return jsonBinaryOpen(jbp, JBF_ARRAY, jbip->jbi_value);
+
+    case JBI_MAP:
+	return jsonBinaryOpen(jbp, JBF_MAP, jbip->jbi_value);
+
+    case JBI_TAG:
+	return 0;
+
+    case JBI_TEXT_START:
+    case JBI_BYTES_START:
+	jbp->jb_str.jbb_len = 0;
+	return jsonBinaryPushFrame(jbp, (jbip->jbi_kind == JBI_TEXT_START)
+				   ? JBF_TEXT : JBF_BYTES, JB_INDEFINITE);
+
+    case JBI_BREAK:
+	if (jbfp == NULL || jbfp->jbf_left != JB_INDEFINITE) {
+	    jsonBinaryError(jbp, "unexpected \"break\"");
+	    return -1;
+	}
+
+	if (jbfp->jbf_type == JBF_MAP && (jbfp->jbf_seen % 2) != 0) {
+	    jsonBinaryError(jbp, "map key without a value");
+	    return -1;
+	}
+
+	jbp->jb_depth -= 1;
+	if (jsonBinaryToken(jbp, (jbfp->jbf_type == JBF_MAP) ? JT_CBRACE
+			    : JT_CBRACK, "]", 1))
+	    return -1;
+	return jsonBinaryDone(jbp);
+    }
+
+    return jsonBinaryScalar(jbp, jbip);
+}
+
+/*
+ * Create a decoder, which builds a document with an element named
+ * root_name (or "json") at the top
+ */
+json_binary_t *
+slaxJsonBinaryCreate (int format, const char *filename,
+		      const char *root_name, unsigned flags)
+{
+    json_binary_t *jbp;
+
+    jbp = xmlMalloc(sizeof(*jbp));
+    if (jbp == NULL)
+	return NULL;
+
+    bzero(jbp, sizeof(*jbp));
+    jbp->jb_format = format;
+    jbp->jb_filename = (char *) xmlStrdup((const xmlChar *)
+					  (filename ?: "input"));
+    jbp->jb_reader = slaxJsonReaderCreate(filename, root_name, flags);
+    if (jbp->jb_filename == NULL || jbp->jb_reader == NULL) {
+	slaxJsonBinaryFree(jbp);
+	return NULL;
+    }
+
+    return jbp;
+}
+
+/*
+ * Free a decoder, along with the document it was building
+ */
+void
+slaxJsonBinaryFree (json_binary_t *jbp)
+{
+    if (jbp == NULL)
+	return;
+
+    slaxJsonReaderFree(jbp->jb_reader);
+    xmlFree(jbp->jb_filename);
+    xmlFree(jbp->jb_stack);
+    xmlFree(jbp->jb_pend.jbb_data);
+    xmlFree(jbp->jb_str.jbb_data);
+    xmlFree(jbp);
+}
+
+/*
+ * Feed the next chunk of input to the decoder.  Returns -1 if the
+ * input has errors, after which further input is ignored.
+ */
+int
+slaxJsonBinaryPush (json_binary_t *jbp, const char *data, size_t len)
+{
+    json_binary_buf_t *pend = &jbp->jb_pend;
+    json_binary_item_t item;
+    const unsigned char *cp;
+    size_t want;
+    int rc;
+
+    if (jbp->jb_errors)
+	return -1;
+
+    while (len > 0) {
+	if (pend->jbb_len == 0) {
+	    cp = (const unsigned char *) data;
+	    rc = jsonBinaryHead(jbp, cp, len, &item);
+	    if (rc == 0)	/* Hold on to it until the rest arrives */
+		return jsonBinaryAppend(jbp, pend, data, len);
+
+	} else {
+	    /* Top up the partial item, just to the end of it */
+	    for (;;) {
+		cp = (const unsigned char *) pend->jbb_data;
+		rc = jsonBinaryHead(jbp, cp, pend->jbb_len, &item);
+		if (rc != 0 || len == 0)
+		    break;
+
+		want = item.jbi_size - pend->jbb_len;
+		if (want > len)
+		    want = len;
+
+		if (jsonBinaryAppend(jbp, pend, data, want))
+		    return -1;
+		data += want;
+		len -= want;
+	    }
+
+	    if (rc == 0)
+		return 0;
+	}
+
+	if (rc < 0) {
+	    jsonBinaryError(jbp, "invalid item (initial byte 0x%02x)", *cp);
+	    return -1;
+	}
+
+	if (jsonBinaryItem(jbp, &item))
+	    return -1;
+
+	jbp->jb_offset += item.jbi_size;
+	if (pend->jbb_len)
+	    pend->jbb_len = 0;
+	else {
+	    data += item.jbi_size;
+	    len -= item.jbi_size;
+	}
+    }
+
+    return 0;
+}
+
+/*
+ * Finish decoding, returning the document (or NULL if the input had
+ * errors).  The decoder is freed.
+ */
+xmlDocPtr
+slaxJsonBinaryFinish (json_binary_t *jbp)
+{
+    xmlDocPtr docp = NULL;
+
+    if (jbp->jb_errors == 0 && !jbp->jb_done)
+	jsonBinaryError(jbp, (jbp->jb_offset || jbp->jb_pend.jbb_len)
+			? "unexpected end of input" : "no input");
+
+    if (jbp->jb_errors) {
+	slaxError("%s: %d error%s detected during parsing",
+		  jbp->jb_filename, jbp->jb_errors,
+		  (jbp->jb_errors == 1) ? "" : "s");
+    } else {
+	docp = slaxJsonReaderFinish(jbp->jb_reader);
+	jbp->jb_reader = NULL;
+    }
+
+    slaxJsonBinaryFree(jbp);
+    return docp;
+}
+
+/*
+ * Turn a buffer of binary data into an XML document
+ */
+xmlDocPtr
+slaxJsonBinaryDataToXml (int format, const char *data, size_t len,
+			 const char *root_name, unsigned flags)
+{
+    json_binary_t *jbp;
+
+    jbp = slaxJsonBinaryCreate(format, NULL, root_name, flags);
+    if (jbp == NULL)
+	return NULL;
+
+    slaxJsonBinaryPush(jbp, data, len);
+
+    return slaxJsonBinaryFinish(jbp);
+}
+
+static int
+jsonBinaryPushFunc (void *opaque, const char *data, size_t len)
+{
+    return slaxJsonBinaryPush(opaque, data, len);
+}
+
+/*
+ * Turn a file of binary data into an XML document, reading it a
+ * chunk at a time
+ */
+xmlDocPtr
+slaxJsonBinaryFileToXml (int format, const char *fname,
+			 const char *root_name, unsigned flags)
+{
+    json_binary_t *jbp;
+
+    jbp = slaxJsonBinaryCreate(format, fname, root_name, flags);
+    if (jbp == NULL)
+	return NULL;
+
+    if (slaxJsonReadFile(fname, jsonBinaryPushFunc, jbp)) {
+	slaxJsonBinaryFree(jbp);
+	return NULL;
+    }
+
+    return slaxJsonBinaryFinish(jbp);
+}
+
+/*
+ * The encoder
+ */
+
+/*
+ * Write an initial byte followed by a big-endian value of len bytes
+ */
+static int
+jsonBinaryPut (xmlBufferPtr xbuf, int first, uint64_t val, int len)
+{
+    unsigned char buf[9];
+    int i;
+
+    buf[0] = first;
+    for (i = len; i > 0; i--) {
+	buf[i] = val & 0xff;
+	val >>= 8;
+    }
+
+    return xmlBufferAdd(xbuf, buf, len + 1) ? -1 : 0;
+}
+
+/*
+ * CBOR: the initial byte and argument for a major type
+ */
+static int
+jsonCborPutHead (xmlBufferPtr xbuf, int major, uint64_t val)
+{
+    major <<= 5;
+
+    if (val < 24)
+	return jsonBinaryPut(xbuf, major | val, 0, 0);
+    if (val <= 0xff)
+	return jsonBinaryPut(xbuf, major | 24, val, 1);
+    if (val <= 0xffff)
+	return jsonBinaryPut(xbuf, major | 25, val, 2);
+    if (val <= 0xffffffff)
+	return jsonBinaryPut(xbuf, major | 26, val, 4);
+
+    return jsonBinaryPut(xbuf, major | 27, val, 8);
+}
+
+/*
+ * MessagePack: the shortest of the fix, 8, 16, and 32 bit forms of
+ * a type (fix or first8 is zero if the type lacks that form)
+ */
+static int
+jsonMsgpackPutHead (xmlBufferPtr xbuf, uint64_t val, int fix, uint64_t fixmax,
+		    int first8, int first16, int first32)
+{
+    if (fix && val <= fixmax)
+	return jsonBinaryPut(xbuf, fix | val, 0, 0);
+    if (first8 && val <= 0xff)
+	return jsonBinaryPut(xbuf, first8, val, 1);
+    if (val <= 0xffff)
+	return jsonBinaryPut(xbuf, first16, val, 2);
+    if (val <= 0xffffffff)
+	return jsonBinaryPut(xbuf, first32, val, 4);
+
+    return -1;
+}
+
+static int
+jsonBinaryPutString (int format, xmlBufferPtr xbuf, const char *str)
+{
+    size_t len = strlen(str);
+    int rc;
+
+    if (format == JB_CBOR)
+	rc = jsonCborPutHead(xbuf, 3, len);
+    else
+	rc = jsonMsgpackPutHead(xbuf, len, 0xa0, 31, 0xd9, 0xda, 0xdb);
+
+    if (rc == 0 && len > 0)
+	rc = xmlBufferAdd(xbuf, (const xmlChar *) str, len) ? -1 : 0;
+
+    return rc;
+}
+
+static int
+jsonBinaryPutContainer (int format, xmlBufferPtr xbuf, int map, uint64_t count)
+{
+    if (format == JB_CBOR)
+	return jsonCborPutHead(xbuf, map ? 5 : 4, count);
+
+    if (map)
+	return jsonMsgpackPutHead(xbuf, count, 0x80, 15, 0, 0xde, 0xdf);
+
+    return jsonMsgpackPutHead(xbuf, count, 0x90, 15, 0, 0xdc, 0xdd);
+}
+
+static int
+jsonBinaryPutSimple (int format, xmlBufferPtr xbuf, int kind)
+{
+    int cbor = (format == JB_CBOR);
+
+    switch (kind) {
+    case JBI_TRUE:
+	return jsonBinaryPut(xbuf, cbor ? 0xf5 : 0xc3, 0, 0);
+
+    case JBI_FALSE:
+	return jsonBinaryPut(xbuf, cbor ? 0xf4 : 0xc2, 0, 0);
+    }
+
+    return jsonBinaryPut(xbuf, cbor ? 0xf6 : 0xc0, 0, 0);
+}
+
+/*
+ * Write an integer; for a negative one, val is -1 minus the value
+ * (the CBOR form), which lets us use the whole range of both formats
+ */
+static int
+jsonBinaryPutInt (int format, xmlBufferPtr xbuf, int negative, uint64_t val)
+{
+    if (format == JB_CBOR)
+	return jsonCborPutHead(xbuf, negative ? 1 : 0, val);
+
+    if (!negative) {
+	if (val <= 0x7f)
+	    return jsonBinaryPut(xbuf, val, 0, 0);
+	if (val <= 0xff)
+	    return jsonBinaryPut(xbuf, 0xcc, val, 1);
+	if (val <= 0xffff)
+	    return jsonBinaryPut(xbuf, 0xcd, val, 2);
+	if (val <= 0xffffffff)
+	    return jsonBinaryPut(xbuf, 0xce, val, 4);
+	return jsonBinaryPut(xbuf, 0xcf, val, 8);
+    }
+
+    /* The two's complement of -1 - val is ~val */
+    if (val < 32)
+	return jsonBinaryPut(xbuf, 0xff - val, 0, 0);
+    if (val < 0x80)
+	return jsonBinaryPut(xbuf, 0xd0, ~val, 1);
+    if (val < 0x8000)
+	return jsonBinaryPut(xbuf, 0xd1, ~val, 2);
+    if (val < 0x80000000)
+	return jsonBinaryPut(xbuf, 0xd2, ~val, 4);
+    return jsonBinaryPut(xbuf, 0xd3, ~val, 8);
+}
+
+static int
+jsonBinaryPutDouble (int format, xmlBufferPtr xbuf, double val)
+{
+    int cbor = (format == JB_CBOR);
+    float fval = val;
+    uint32_t fbits;
+    uint64_t dbits;
+
+    if ((double) fval == val) {
+	memcpy(&fbits, &fval, sizeof(fbits));
+	return jsonBinaryPut(xbuf, cbor ? 0xfa : 0xca, fbits, 4);
+    }
+
+    memcpy(&dbits, &val, sizeof(dbits));
+    return jsonBinaryPut(xbuf, cbor ? 0xfb : 0xcb, dbits, 8);
+}
+
+/*
+ * Write the value of a "number" element.  Text that isn't a finite
+ * JSON number is an error, since it can't be written as a number and
+ * writing it as a string would lose the "number" type.
+ */
+static int
+jsonBinaryPutNumber (int format, xmlBufferPtr xbuf, xmlNodePtr nodep)
+{
+    const char *str = slaxJsonValue(nodep), *start, *end;
+    char buf[64], *num = buf, *ep;
+    size_t len;
+    long long sval;
+    unsigned long long uval;
+    double dval;
+    int rc;
+
+    if (str == NULL)
+	str = "";
+
+    for (start = str; isspace((unsigned char) *start); start++)
+	continue;
+    for (end = start + strlen(start);
+	     end > start && isspace((unsigned char) end[-1]); end--)
+	continue;
+
+    len = end - start;
+    if (len >= sizeof(buf)) {
+	num = xmlMalloc(len + 1);
+	if (num == NULL)
+	    return -1;
+    }
+
+    memcpy(num, start, len);
+    num[len] = '\0';
+
+    /* strtod() takes hex and "nan" too, which JSON doesn't */
+    if (len == 0 || strspn(num, "0123456789+-.eE") != len)
+	goto invalid;
+
+    if (strspn(num + (*num == '-'), "0123456789") == len - (*num == '-')) {
+	errno = 0;
+	if (*num == '-') {
+	    /* "-0" falls through to be a float, which keeps its sign */
+	    sval = strtoll(num, NULL, 10);
+	    if (errno == 0 && sval < 0) {
+		rc = jsonBinaryPutInt(format, xbuf, TRUE,
+				      (uint64_t) -(sval + 1));
+		goto done;
+	    }
+	} else {
+	    uval = strtoull(num, NULL, 10);
+	    if (errno == 0) {
+		rc = jsonBinaryPutInt(format, xbuf, FALSE, uval);
+		goto done;
+	    }
+	}
+    }
+
+    dval = strtod(num, &ep);
+    if (*ep != '\0' || !isfinite(dval))
+	goto invalid;
+
+    rc = jsonBinaryPutDouble(format, xbuf, dval);
+    goto done;
+
+ invalid:
+    slaxError("invalid number in <%s>: '%s'", slaxJsonName(nodep), str);
+    rc = -1;
+
+ done:
+    if (num != buf)
+	xmlFree(num);
+    return rc;
+}
+
+static uint64_t
+jsonBinaryCount (xmlNodePtr parent)
+{
+    xmlNodePtr nodep;
+    uint64_t count = 0;
+
+    for (nodep = parent->children; nodep; nodep = nodep->next)
+	if (nodep->type == XML_ELEMENT_NODE)
+	    count += 1;
+
+    return count;
+}
+
+static int
+jsonBinaryWriteChildren (int format, xmlBufferPtr xbuf, xmlNodePtr parent,
+			 int in_array);
+
+/*
+ * Write an element, preceded by its name if it's in a map.  We read
+ * the element the way jsonWriteNode() does, except that the "member"
+ * type doesn't drop the name of an element in a map, since that would
+ * leave the map without a key.
+ */
+static int
+jsonBinaryWriteNode (int format, xmlBufferPtr xbuf, xmlNodePtr nodep,
+		     int in_array)
+{
+    const char *type = slaxJsonAttribValue(nodep, ATT_TYPE);
+    const char *value;
+
+    if (!in_array && jsonBinaryPutString(format, xbuf, slaxJsonName(nodep)))
+	return -1;
+
+    if (type) {
+	if (streq(type, VAL_NUMBER))
+	    return jsonBinaryPutNumber(format, xbuf, nodep);
+
+	if (streq(type, VAL_TRUE))
+	    return jsonBinaryPutSimple(format, xbuf, JBI_TRUE);
+
+	if (streq(type, VAL_FALSE))
+	    return jsonBinaryPutSimple(format, xbuf, JBI_FALSE);
+
+	if (streq(type, VAL_NULL))
+	    return jsonBinaryPutSimple(format, xbuf, JBI_NULL);
+
+	if (streq(type, VAL_ARRAY)) {
+	    if (jsonBinaryPutContainer(format, xbuf, FALSE,
+				       jsonBinaryCount(nodep)))
+		return -1;
+	    return jsonBinaryWriteChildren(format, xbuf, nodep, TRUE);
+	}
+    }
+
+    if (slaxJsonHasChildNodes(nodep)) {
+	if (jsonBinaryPutContainer(format, xbuf, TRUE, jsonBinaryCount(nodep)))
+	    return -1;
+	return jsonBinaryWriteChildren(format, xbuf, nodep, FALSE);
+    }
+
+    value = slaxJsonValue(nodep);
+    return jsonBinaryPutString(format, xbuf, value ?: "");
+}
+
+static int
+jsonBinaryWriteChildren (int format, xmlBufferPtr xbuf, xmlNodePtr parent,
+			 int in_array)
+{
+    xmlNodePtr nodep;
+
+    for (nodep = parent->children; nodep; nodep = nodep->next) {
+	if (nodep->type == XML_ELEMENT_NODE
+		&& jsonBinaryWriteNode(format, xbuf, nodep, in_array))
+	    return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Write a top element (like <json>) as a map, or as an array if its
+ * type is "array", the way jsonWriteTop() does
+ */
+int
+slaxJsonBinaryWriteNode (int format, xmlBufferPtr xbuf, xmlNodePtr nodep)
+{
+    const char *type = slaxJsonAttribValue(nodep, ATT_TYPE);
+    int in_array = (type && streq(type, VAL_ARRAY));
+
+    if (jsonBinaryPutContainer(format, xbuf, !in_array, jsonBinaryCount(nodep)))
+	return -1;
+
+    return jsonBinaryWriteChildren(format, xbuf, nodep, in_array);
+}
@@ -0,0 +1,59 @@
+/*
+ * Copyright (c) 2013, Juniper Networks, Inc.
+ * All rights reserved.
+ * This SOFTWARE is licensed under the LICENSE provided in the
+ * ../Copyright file. By downloading, installing, copying, or otherwise
+ * using the SOFTWARE, you agree to be bound by the terms of that
+ * LICENSE.
+ *
+ * jsonbinary.h -- CBOR and MessagePack, to and from JSON-style XML
+ */
+
+/* Binary formats */
+#define JB_CBOR		1	/* CBOR (RFC 8949) */
+#define JB_MSGPACK	2	/* MessagePack */
+
+typedef struct json_binary_s json_binary_t;
+
+/*
+ * Create a decoder for the given format (JB_*); filename is used in
+ * error messages and root_name (default "json") names the top
+ * element.  Flags are SDF_*, as for slaxJsonReaderCreate().
+ */
+json_binary_t *
+slaxJsonBinaryCreate (int format, const char *filename,
+		      const char *root_name, unsigned flags);
+
+/*
+ * Feed the next chunk of input; returns -1 on error
+ */
+int
+slaxJsonBinaryPush (json_binary_t *jbp, const char *data, size_t len);
+
+/*
+ * Finish the input, returning the document (NULL on errors) and
+ * freeing the decoder
+ */
+xmlDocPtr
+slaxJsonBinaryFinish (json_binary_t *jbp);
+
+/*
+ * Free a decoder without finishing it
+ */
+void
+slaxJsonBinaryFree (json_binary_t *jbp);
+
+xmlDocPtr
+slaxJsonBinaryDataToXml (int format, const char *data, size_t len,
+			 const char *root_name, unsigned flags);
+
+xmlDocPtr
+slaxJsonBinaryFileToXml (int format, const char *fname,
+			 const char *root_name, unsigned flags);
+
+/*
+ * Append the binary form of a JSON-style element (like the <json>
+ * element made by the readers) to a buffer.  Returns -1 on error.
+ */
+int
+slaxJsonBinaryWriteNode (int format, xmlBufferPtr xbuf, xmlNodePtr nodep);
@@ -57,7 +57,7 @@ slaxJsonTagging (int tagging)
 void
 slaxJsonElementOpen (slax_data_t *sdp, const char *name)
 {
-    int valid = xmlValidateName((const xmlChar *) name, FALSE);
+    int valid = xmlValidateNCName((const xmlChar *) name, FALSE);
     const char *element = valid ? ELT_ELEMENT : name;
 
     slaxElementOpen(sdp, element);
@@ -254,8 +254,13 @@ slaxJsonTagContent (slax_data_t *sdp, int content)
 	slaxAttribAddLiteral(sdp, ATT_TYPE, tag);
 }
 
+/*
+ * Turn JSON data into XML using the bison grammar.  slaxJsonDataToXml()
+ * uses the streaming reader in jsonreader.c instead.
+ */
 xmlDocPtr
-slaxJsonDataToXml (const char *data, const char *root_name, unsigned flags)
+slaxJsonDataToXmlGrammar (const char *data, const char *root_name,
+			  unsigned flags)
 {
     slax_data_t sd;
     xmlDocPtr res;
@@ -316,8 +321,8 @@ slaxJsonDataToXml (const char *data, const char *root_name, unsigned flags)
 }
 
 xmlDocPtr
-slaxJsonFileToXml (const char *fname, const char *root_name,
-		       unsigned flags)
+slaxJsonFileToXmlGrammar (const char *fname, const char *root_name,
+			  unsigned flags)
 {
     slax_data_t sd;
     xmlDocPtr res;
@@ -350,6 +355,8 @@ slaxJsonFileToXml (const char *fname, const char *root_name,
 	return NULL;
     }
 
+    slaxSetupWholeInput(&sd);
+
     /*
      * Fake up an inputStream so the error mechanisms will work
      */
@@ -70,5 +70,16 @@ xmlDocPtr
 slaxJsonFileToXml (const char *fname, const char *root_name,
 		       unsigned flags);
 
+/*
+ * The same, using the bison grammar instead of the streaming reader
+ */
+xmlDocPtr
+slaxJsonDataToXmlGrammar (const char *data, const char *root_name,
+			  unsigned flags);
+
+xmlDocPtr
+slaxJsonFileToXmlGrammar (const char *fname, const char *root_name,
+			  unsigned flags);
+
 void
 slaxJsonElementValue (slax_data_t *sdp, slax_string_t *value);
@@ -0,0 +1,1292 @@
+/*
+ * Copyright (c) 2013, Juniper Networks, Inc.
+ * All rights reserved.
+ * This SOFTWARE is licensed under the LICENSE provided in the
+ * ../Copyright file. By downloading, installing, copying, or otherwise
+ * using the SOFTWARE, you agree to be bound by the terms of that
+ * LICENSE.
+ *
+ * jsonreader.c -- build XML from JSON input, a chunk at a time
+ *
+ * The bison grammar (M_JSON in slaxparser.y) can parse JSON, but it
+ * wants the whole input in memory and builds the tree through
+ * slax_string_t tokens and the SLAX tree functions.  This reader is
+ * a small tokenizer and state machine that builds the same XML
+ * directly: each member of an object becomes an element named for
+ * the member (or <element name="..."> if that's not a valid XML
+ * name), each item of an array becomes a <member> element, and the
+ * "type" attribute records numbers, booleans, nulls, arrays, and
+ * array members.
+ *
+ * Input is pushed in chunks of any size; only the tree and the token
+ * currently being built are held in memory.  Tokens that lie within
+ * a single chunk are used in place, without being copied.
+ *
+ * Like the grammar, we accept a few things that strict JSON doesn't:
+ * single-quoted strings, bare (unquoted) member names, a trailing
+ * comma in an object or array, array items without commas between
+ * them, and C-style comments, which become XML comments.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <stdint.h>
+
+#include <libxml/xmlmemory.h>
+#include <libxml/parser.h>
+
+#include <libslax/slax.h>
+#include "slaxinternals.h"
+#include "jsonlexer.h"
+#include "jsonreader.h"
+
+#define JR_STACK_INIT	32	/* Initial depth of the container stack */
+#define JR_BUF_INIT	256	/* Initial size of the token buffer */
+#define JR_READ_SIZE	(64 * 1024) /* Size of chunks read from files */
+#define JR_NAME_CACHE	256	/* Entries in the valid-name cache */
+
+/* Lexer states (jr_lex) */
+#define JL_NONE		0	/* Between tokens */
+#define JL_STRING	1	/* Inside a quoted string */
+#define JL_ESCAPE	2	/* Just saw a backslash in a string */
+#define JL_UNICODE	3	/* Inside a "\uXXXX" escape */
+#define JL_NUMBER	4	/* Inside a number */
+#define JL_BARE		5	/* Inside a bare word */
+#define JL_SLASH	6	/* Just saw a '/' */
+#define JL_COMMENT	7	/* Inside a comment */
+#define JL_COMMENT_STAR	8	/* Saw a '*' inside a comment */
+
+/* Parser states (jr_state) */
+#define JS_TOP		0	/* Expecting the top-level object or array */
+#define JS_DONE		1	/* Seen the whole thing */
+#define JS_OBJ_NAME	2	/* Expecting a member name or '}' */
+#define JS_OBJ_COLON	3	/* Expecting ':' */
+#define JS_OBJ_VALUE	4	/* Expecting a member value */
+#define JS_OBJ_NEXT	5	/* Expecting ',' or '}' */
+#define JS_ARR_VALUE	6	/* Expecting an item or ']' */
+#define JS_ARR_NEXT	7	/* Expecting ',', an item, or ']' */
+
+/* Containers (jr_stack) */
+#define JC_OBJECT	1
+#define JC_ARRAY	2
+
+typedef struct json_name_cache_s {
+    const xmlChar *jnc_name;	/* Name (owned by the dictionary) */
+    int jnc_valid;		/* Is it a valid XML name? */
+} json_name_cache_t;
+
+struct json_reader_s {
+    char *jr_filename;		/* Filename, for error messages */
+    unsigned jr_flags;		/* Flags (SDF_*) */
+    xmlDocPtr jr_docp;		/* Document being built */
+    xmlDictPtr jr_dict;		/* The document's dictionary */
+    xmlNodePtr jr_node;		/* Current element */
+    const xmlChar *jr_member;	/* Dictionary copy of "member" */
+    const xmlChar *jr_element;	/* Dictionary copy of "element" */
+    unsigned jr_line;		/* Current line number */
+    int jr_errors;		/* Number of errors */
+    int jr_lex;			/* Lexer state (JL_*) */
+    int jr_state;		/* Parser state (JS_*) */
+    unsigned char *jr_stack;	/* Open containers (JC_*) */
+    int jr_depth;		/* Number of open containers */
+    int jr_stack_size;		/* Size of jr_stack */
+    char jr_quote;		/* Quote that started this string */
+    char jr_last;		/* Last character of a number */
+    unsigned jr_ucs;		/* Value of a "\uXXXX" escape */
+    int jr_ucs_digits;		/* Number of digits seen in jr_ucs */
+    char jr_ucs_text[4];	/* Those digits, in case they're not hex */
+    unsigned jr_surrogate;	/* High surrogate awaiting its partner */
+    char *jr_buf;		/* Token being built, across chunks */
+    size_t jr_len;		/* Length of token in jr_buf */
+    size_t jr_size;		/* Size of jr_buf */
+    json_name_cache_t jr_names[JR_NAME_CACHE]; /* Valid name cache */
+};
+
+/*
+ * Report an error
+ */
+static void
+jsonReaderError (json_reader_t *jrp, const char *fmt, ...)
+{
+    char buf[BUFSIZ];
+    va_list vap;
+
+    va_start(vap, fmt);
+    vsnprintf(buf, sizeof(buf), fmt, vap);
+    va_end(vap);
+
+    slaxError("%s:%u: %s", jrp->jr_filename, jrp->jr_line, buf);
+    jrp->jr_errors += 1;
+}
+
+/*
+ * Append data to the token buffer
+ */
+static int
+jsonReaderAppend (json_reader_t *jrp, const char *data, size_t len)
+{
+    if (jrp->jr_len + len + 1 > jrp->jr_size) {
+	size_t size = jrp->jr_size ? jrp->jr_size * 2 : JR_BUF_INIT;
+	char *cp;
+
+	while (size < jrp->jr_len + len + 1)
+	    size *= 2;
+
+	cp = xmlRealloc(jrp->jr_buf, size);
+	if (cp == NULL) {
+	    jsonReaderError(jrp, "out of memory");
+	    return -1;
+	}
+
+	jrp->jr_buf = cp;
+	jrp->jr_size = size;
+    }
+
+    memcpy(jrp->jr_buf + jrp->jr_len, data, len);
+    jrp->jr_len += len;
+    jrp->jr_buf[jrp->jr_len] = '\0';
+
+    return 0;
+}
+
+/*
+ * Append a character, in UTF-8
+ */
+static int
+jsonReaderAppendUcs (json_reader_t *jrp, unsigned ucs)
+{
+    char buf[4];
+    int len;
+
+    if (ucs < 0x80) {
+	buf[0] = ucs;
+	len = 1;
+    } else if (ucs < 0x800) {
+	buf[0] = 0xc0 | (ucs >> 6);
+	buf[1] = 0x80 | (ucs & 0x3f);
+	len = 2;
+    } else if (ucs < 0x10000) {
+	buf[0] = 0xe0 | (ucs >> 12);
+	buf[1] = 0x80 | ((ucs >> 6) & 0x3f);
+	buf[2] = 0x80 | (ucs & 0x3f);
+	len = 3;
+    } else {
+	buf[0] = 0xf0 | (ucs >> 18);
+	buf[1] = 0x80 | ((ucs >> 12) & 0x3f);
+	buf[2] = 0x80 | ((ucs >> 6) & 0x3f);
+	buf[3] = 0x80 | (ucs & 0x3f);
+	len = 4;
+    }
+
+    return jsonReaderAppend(jrp, buf, len);
+}
+
+/*
+ * A high surrogate that isn't followed by a low one is replaced
+ * with U+FFFD, as is a low surrogate on its own
+ */
+static int
+jsonReaderSurrogate (json_reader_t *jrp)
+{
+    if (jrp->jr_surrogate == 0)
+	return 0;
+
+    jrp->jr_surrogate = 0;
+    return jsonReaderAppendUcs(jrp, 0xfffd);
+}
+
+/*
+ * Handle the value of a complete "\uXXXX" escape.  Controls can't
+ * appear in XML text, so they become U+FFFD like a stray surrogate.
+ */
+static int
+jsonReaderUnicode (json_reader_t *jrp, unsigned ucs)
+{
+    if (ucs >= 0xdc00 && ucs < 0xe000 && jrp->jr_surrogate) {
+	ucs = 0x10000 + ((jrp->jr_surrogate - 0xd800) << 10) + (ucs - 0xdc00);
+	jrp->jr_surrogate = 0;
+	return jsonReaderAppendUcs(jrp, ucs);
+    }
+
+    if (jsonReaderSurrogate(jrp))
+	return -1;
+
+    if (ucs >= 0xd800 && ucs < 0xdc00) {
+	jrp->jr_surrogate = ucs;
+	return 0;
+    }
+
+    if (slaxJsonIsControl(ucs) || (ucs >= 0xdc00 && ucs < 0xe000))
+	ucs = 0xfffd;
+
+    return jsonReaderAppendUcs(jrp, ucs);
+}
+
+static int
+jsonReaderHex (int ch)
+{
+    if (ch >= '0' && ch <= '9')
+	return ch - '0';
+    if (ch >= 'a' && ch <= 'f')
+	return ch - 'a' + 10;
+    if (ch >= 'A' && ch <= 'F')
+	return ch - 'A' + 10;
+    return -1;
+}
+
+/*
+ * Give a node the line number we're on
+ */
+static inline void
+jsonReaderLine (json_reader_t *jrp, xmlNodePtr nodep)
+{
+    nodep->line = (jrp->jr_line < 65535) ? jrp->jr_line : 65535;
+}
+
+static void
+jsonReaderType (json_reader_t *jrp, xmlNodePtr nodep, const char *type)
+{
+    if (!(jrp->jr_flags & SDF_NO_TYPES))
+	xmlNewProp(nodep, (const xmlChar *) ATT_TYPE, (const xmlChar *) type);
+}
+
+/*
+ * Add a new element under the current one, and make it current
+ */
+static xmlNodePtr
+jsonReaderOpen (json_reader_t *jrp, const xmlChar *name)
+{
+    xmlNodePtr nodep;
+
+    /* The name is from the document's dictionary, so it can be eaten */
+    nodep = xmlNewDocNodeEatName(jrp->jr_docp, NULL, const_drop(name), NULL);
+    if (nodep == NULL) {
+	jsonReaderError(jrp, "out of memory");
+	return NULL;
+    }
+
+    jsonReaderLine(jrp, nodep);
+    xmlAddChild(jrp->jr_node, nodep);
+    jrp->jr_node = nodep;
+
+    return nodep;
+}
+
+/*
+ * Open the element for a member of an object.  Names that aren't
+ * valid XML names are recorded in the "name" attribute of an
+ * <element> element, like slaxJsonElementOpenName() does.  A name
+ * with a colon counts as invalid, since it would need a prefix that
+ * isn't declared.
+ */
+static int
+jsonReaderOpenName (json_reader_t *jrp, const char *name, size_t len)
+{
+    const xmlChar *dname;
+    json_name_cache_t *jncp;
+    xmlNodePtr nodep;
+    char *cp;
+
+    if (jrp->jr_flags & SDF_CLEAN_NAMES) {
+	/* Clean a copy, since the name may point into the caller's data */
+	if (name != jrp->jr_buf) {
+	    jrp->jr_len = 0;
+	    if (jsonReaderAppend(jrp, name, len))
+		return -1;
+	    name = jrp->jr_buf;
+	}
+
+	/* An empty name becomes "_" */
+	if (len == 0) {
+	    if (jsonReaderAppend(jrp, "_", 1))
+		return -1;
+	    name = jrp->jr_buf;
+	    len = 1;
+	}
+
+	cp = jrp->jr_buf;
+	if (*cp != '_' && !isalpha((unsigned char) *cp))
+	    *cp = '_';
+
+	for ( ; cp < jrp->jr_buf + len; cp++)
+	    if (*cp != '_' && *cp != '.' && !isalnum((unsigned char) *cp))
+		*cp = '_';
+    }
+
+    dname = xmlDictLookup(jrp->jr_dict, (const xmlChar *) name, len);
+    if (dname == NULL) {
+	jsonReaderError(jrp, "out of memory");
+	return -1;
+    }
+
+    /* Dictionary names are unique, so the pointer is the key */
+    jncp = &jrp->jr_names[((uintptr_t) dname >> 3) % JR_NAME_CACHE];
+    if (jncp->jnc_name != dname) {
+	jncp->jnc_name = dname;
+	jncp->jnc_valid = (xmlValidateNCName(dname, FALSE) == 0);
+    }
+
+    if (jncp->jnc_valid)
+	return jsonReaderOpen(jrp, dname) ? 0 : -1;
+
+    nodep = jsonReaderOpen(jrp, jrp->jr_element);
+    if (nodep == NULL)
+	return -1;
+
+    xmlNewProp(nodep, (const xmlChar *) ATT_NAME, dname);
+    return 0;
+}
+
+/*
+ * Keep a comment as an XML comment, the way the SLAX lexer does:
+ * trimmed of blanks (but not newlines) and padded with one space.
+ * The comment text follows a leading blank in jr_buf, so the padded
+ * string is built in place.
+ */
+static void
+jsonReaderComment (json_reader_t *jrp)
+{
+    char *start = jrp->jr_buf + 1, *end = jrp->jr_buf + jrp->jr_len;
+    xmlChar *buf, *contents;
+    xmlNodePtr nodep;
+    size_t offset;
+
+    while (start < end && isspace((unsigned char) *start) && *start != '\n')
+	start += 1;
+    while (end > start && isspace((unsigned char) end[-1]) && end[-1] != '\n')
+	end -= 1;
+
+    if (end == start)
+	return;
+
+    /* Appending the trailing blank may move jr_buf */
+    offset = start - jrp->jr_buf - 1;
+    jrp->jr_len = end - jrp->jr_buf;
+    if (jsonReaderAppend(jrp, " ", 1))
+	return;
+
+    buf = (xmlChar *) jrp->jr_buf + offset;
+    buf[0] = ' ';
+
+    contents = slaxCommentMakeValue(buf);
+    nodep = xmlNewDocComment(jrp->jr_docp, contents ?: buf);
+    if (nodep) {
+	jsonReaderLine(jrp, nodep);
+	xmlAddChild(jrp->jr_node, nodep);
+    }
+    xmlFreeAndEasy(contents);
+}
+
+/*
+ * Push a container on the stack
+ */
+static int
+jsonReaderPushContainer (json_reader_t *jrp, int type)
+{
+    if (jrp->jr_depth >= jrp->jr_stack_size) {
+	int size = jrp->jr_stack_size ? jrp->jr_stack_size * 2 : JR_STACK_INIT;
+	unsigned char *stack = xmlRealloc(jrp->jr_stack, size);
+
+	if (stack == NULL) {
+	    jsonReaderError(jrp, "out of memory");
+	    return -1;
+	}
+
+	jrp->jr_stack = stack;
+	jrp->jr_stack_size = size;
+    }
+
+    jrp->jr_stack[jrp->jr_depth++] = type;
+    jrp->jr_state = (type == JC_OBJECT) ? JS_OBJ_NAME : JS_ARR_VALUE;
+
+    return 0;
+}
+
+static inline int
+jsonReaderContainer (json_reader_t *jrp)
+{
+    return jrp->jr_depth ? jrp->jr_stack[jrp->jr_depth - 1] : 0;
+}
+
+/*
+ * A value is complete: close the element that holds it
+ */
+static void
+jsonReaderValueDone (json_reader_t *jrp)
+{
+    switch (jsonReaderContainer(jrp)) {
+    case 0:
+	jrp->jr_state = JS_DONE;
+	break;
+
+    case JC_OBJECT:
+	jrp->jr_node = jrp->jr_node->parent;
+	jrp->jr_state = JS_OBJ_NEXT;
+	break;
+
+    case JC_ARRAY:
+	jrp->jr_node = jrp->jr_node->parent;
+	jrp->jr_state = JS_ARR_NEXT;
+	break;
+    }
+}
+
+/*
+ * Close the innermost container
+ */
+static void
+jsonReaderPopContainer (json_reader_t *jrp)
+{
+    jrp->jr_depth -= 1;
+    jsonReaderValueDone(jrp);
+}
+
+/*
+ * Handle a value, which goes into the current element.  An item of
+ * an array gets its own <member> element first.
+ */
+static int
+jsonReaderValue (json_reader_t *jrp, int tok, const char *data, size_t len)
+{
+    int in_array = (jsonReaderContainer(jrp) == JC_ARRAY);
+    const char *type;
+    xmlNodePtr nodep;
+
+    if (in_array && jsonReaderOpen(jrp, jrp->jr_member) == NULL)
+	return -1;
+
+    switch (tok) {
+    case JT_OBRACE:
+	if (in_array)
+	    jsonReaderType(jrp, jrp->jr_node, VAL_MEMBER);
+	return jsonReaderPushContainer(jrp, JC_OBJECT);
+
+    case JT_OBRACK:
+	jsonReaderType(jrp, jrp->jr_node, VAL_ARRAY);
+	return jsonReaderPushContainer(jrp, JC_ARRAY);
+
+    case JT_STRING:
+	type = in_array ? VAL_MEMBER : NULL;
+	break;
+
+    case JT_NUMBER:
+	type = VAL_NUMBER;
+	break;
+
+    case JT_TRUE:
+	type = VAL_TRUE;
+	break;
+
+    case JT_FALSE:
+	type = VAL_FALSE;
+	break;
+
+    case JT_NULL:
+	type = VAL_NULL;
+	break;
+
+    default:
+	jsonReaderError(jrp, "syntax error before '%.*s'",
+			(int) (len > 20 ? 20 : len), data);
+	return -1;
+    }
+
+    nodep = xmlNewDocTextLen(jrp->jr_docp, (const xmlChar *) data, len);
+    if (nodep == NULL) {
+	jsonReaderError(jrp, "out of memory");
+	return -1;
+    }
+
+    jsonReaderLine(jrp, nodep);
+    xmlAddChild(jrp->jr_node, nodep);
+
+    if (type)
+	jsonReaderType(jrp, jrp->jr_node, type);
+
+    jsonReaderValueDone(jrp);
+    return 0;
+}
+
+/*
+ * The parser: handle one token
+ */
+static int
+jsonReaderToken (json_reader_t *jrp, int tok, const char *data, size_t len)
+{
+    switch (jrp->jr_state) {
+    case JS_TOP:
+	if (tok == JT_OBRACE)
+	    return jsonReaderPushContainer(jrp, JC_OBJECT);
+	if (tok == JT_OBRACK) {
+	    jsonReaderType(jrp, jrp->jr_node, VAL_ARRAY);
+	    return jsonReaderPushContainer(jrp, JC_ARRAY);
+	}
+	break;
+
+    case JS_OBJ_NAME:
+	if (tok == JT_CBRACE) {
+	    jsonReaderPopContainer(jrp);
+	    return 0;
+	}
+	if (tok == JT_STRING || tok == JT_BARE) {
+	    if (jsonReaderOpenName(jrp, data, len))
+		return -1;
+	    jrp->jr_state = JS_OBJ_COLON;
+	    return 0;
+	}
+	break;
+
+    case JS_OBJ_COLON:
+	if (tok == JT_COLON) {
+	    jrp->jr_state = JS_OBJ_VALUE;
+	    return 0;
+	}
+	break;
+
+    case JS_OBJ_VALUE:
+	return jsonReaderValue(jrp, tok, data, len);
+
+    case JS_OBJ_NEXT:
+	if (tok == JT_COMMA) {
+	    jrp->jr_state = JS_OBJ_NAME;
+	    return 0;
+	}
+	if (tok == JT_CBRACE) {
+	    jsonReaderPopContainer(jrp);
+	    return 0;
+	}
+	break;
+
+    case JS_ARR_NEXT:
+	if (tok == JT_COMMA) {
+	    jrp->jr_state = JS_ARR_VALUE;
+	    return 0;
+	}
+	/* fallthru */
+
+    case JS_ARR_VALUE:
+	if (tok == JT_CBRACK) {
+	    jsonReaderPopContainer(jrp);
+	    return 0;
+	}
+	if (tok != JT_COMMA && tok != JT_COLON && tok != JT_CBRACE)
+	    return jsonReaderValue(jrp, tok, data, len);
+	break;
+    }
+
+    if (jrp->jr_state == JS_DONE)
+	jsonReaderError(jrp, "extra data after the end of input: '%.*s'",
+			(int) (len > 20 ? 20 : len), data);
+    else
+	jsonReaderError(jrp, "syntax error before '%.*s'",
+			(int) (len > 20 ? 20 : len), data);
+    return -1;
+}
+
+/*
+ * Hand the parser a token that's already been decoded, for readers
+ * of other formats that build the same XML (see jsonbinary.c)
+ */
+int
+slaxJsonReaderToken (json_reader_t *jrp, int tok, const char *data, size_t len)
+{
+    if (jrp->jr_errors)
+	return -1;
+
+    return jsonReaderToken(jrp, tok, data, len);
+}
+
+/*
+ * Finish a number or bare word
+ */
+static int
+jsonReaderWord (json_reader_t *jrp, int lex, const char *data, size_t len)
+{
+    int tok = JT_BARE;
+    size_t i;
+
+    if (lex == JL_NUMBER) {
+	for (i = 0; i < len; i++)
+	    if (isdigit((int) data[i]))
+		return jsonReaderToken(jrp, JT_NUMBER, data, len);
+
+	jsonReaderError(jrp, "invalid number '%.*s'", (int) len, data);
+	return -1;
+    }
+
+    if (len == 4 && memcmp(data, "true", 4) == 0)
+	tok = JT_TRUE;
+    else if (len == 5 && memcmp(data, "false", 5) == 0)
+	tok = JT_FALSE;
+    else if (len == 4 && memcmp(data, "null", 4) == 0)
+	tok = JT_NULL;
+
+    return jsonReaderToken(jrp, tok, data, len);
+}
+
+static inline int
+jsonReaderNumberChar (json_reader_t *jrp, int ch)
+{
+    if (isdigit(ch) || ch == '.' || ch == 'e' || ch == 'E')
+	return TRUE;
+    return ((ch == '+' || ch == '-')
+	    && (jrp->jr_last == 'e' || jrp->jr_last == 'E'));
+}
+
+static inline int
+jsonReaderBareChar (int ch)
+{
+    return (isalnum(ch) || ch == '_');
+}
+
+/*
+ * Create a reader, which builds a document with an element named
+ * root_name (or "json") at the top
+ */
+json_reader_t *
+slaxJsonReaderCreate (const char *filename, const char *root_name,
+		      unsigned flags)
+{
+    json_reader_t *jrp;
+    xmlNodePtr nodep;
+
+    jrp = xmlMalloc(sizeof(*jrp));
+    if (jrp == NULL)
+	return NULL;
+
+    bzero(jrp, sizeof(*jrp));
+    jrp->jr_flags = flags;
+    jrp->jr_line = 1;
+    jrp->jr_filename = (char *) xmlStrdup((const xmlChar *)
+					  (filename ?: "json"));
+
+    jrp->jr_docp = xmlNewDoc((const xmlChar *) XML_DEFAULT_VERSION);
+    if (jrp->jr_filename == NULL || jrp->jr_docp == NULL)
+	goto fail;
+
+    jrp->jr_docp->standalone = 1;
+    jrp->jr_docp->URL = xmlStrdup((const xmlChar *) "json.input");
+    jrp->jr_docp->dict = jrp->jr_dict = xmlDictCreate();
+    if (jrp->jr_dict == NULL)
+	goto fail;
+
+    jrp->jr_member = xmlDictLookup(jrp->jr_dict,
+				   (const xmlChar *) ELT_MEMBER, -1);
+    jrp->jr_element = xmlDictLookup(jrp->jr_dict,
+				    (const xmlChar *) ELT_ELEMENT, -1);
+
+    nodep = xmlNewDocNode(jrp->jr_docp, NULL,
+			  (const xmlChar *) (root_name ?: ELT_JSON), NULL);
+    if (nodep == NULL)
+	goto fail;
+
+    xmlDocSetRootElement(jrp->jr_docp, nodep);
+    jrp->jr_node = nodep;
+
+    return jrp;
+
+ fail:
+    slaxJsonReaderFree(jrp);
+    return NULL;
+}
+
+/*
+ * Free a reader, along with the document it was building
+ */
+void
+slaxJsonReaderFree (json_reader_t *jrp)
+{
+    if (jrp == NULL)
+	return;
+
+    if (jrp->jr_docp)
+	xmlFreeDoc(jrp->jr_docp);
+    xmlFree(jrp->jr_filename);
+    xmlFree(jrp->jr_stack);
+    xmlFree(jrp->jr_buf);
+    xmlFree(jrp);
+}
+
+/*
+ * Feed the next chunk of input to the reader.  Returns -1 if the
+ * input has errors, after which further input is ignored.
+ */
+int
+slaxJsonReaderPush (json_reader_t *jrp, const char *data, size_t len)
+{
+    const char *cp = data, *ep = data + len;
+    const char *start = NULL;	/* Start of a token within this chunk */
+    int ch, hex;
+
+    if (jrp->jr_errors)
+	return -1;
+
+    /* A token that started in an earlier chunk is in jr_buf */
+    while (cp < ep) {
+	switch (jrp->jr_lex) {
+	case JL_NONE:
+	    ch = (unsigned char) *cp;
+
+	    switch (ch) {
+	    case '\n':
+		jrp->jr_line += 1;
+		/* fallthru */
+	    case ' ':
+	    case '\t':
+	    case '\r':
+		cp += 1;
+		continue;
+
+	    case '{':
+	    case '}':
+	    case '[':
+	    case ']':
+	    case ':':
+	    case ',':
+		if (jsonReaderToken(jrp, (ch == '{') ? JT_OBRACE
+				    : (ch == '}') ? JT_CBRACE
+				    : (ch == '[') ? JT_OBRACK
+				    : (ch == ']') ? JT_CBRACK
+				    : (ch == ':') ? JT_COLON : JT_COMMA,
+				    cp, 1))
+		    return -1;
+		cp += 1;
+		continue;
+
+	    case '"':
+	    case '\'':
+		jrp->jr_lex = JL_STRING;
+		jrp->jr_quote = ch;
+		jrp->jr_len = 0;
+		start = ++cp;
+		continue;
+
+	    case '/':
+		jrp->jr_lex = JL_SLASH;
+		cp += 1;
+		continue;
+	    }
+
+	    jrp->jr_len = 0;
+	    start = cp;
+
+	    if (isdigit(ch) || ch == '.' || ch == '+' || ch == '-') {
+		jrp->jr_lex = JL_NUMBER;
+		jrp->jr_last = ch;
+		cp += 1;
+	    } else if (isalpha(ch) || ch == '_') {
+		jrp->jr_lex = JL_BARE;
+		cp += 1;
+	    } else {
+		jsonReaderError(jrp, "unexpected character '%c'", ch);
+		return -1;
+	    }
+	    continue;
+
+	case JL_STRING:
+	    if (start == NULL)
+		start = cp;
+
+	    /* Find the end of the run of plain characters */
+	    while (cp < ep && *cp != jrp->jr_quote && *cp != '\\'
+		   && !slaxJsonIsControl((unsigned char) *cp)) {
+		if (*cp == '\n')
+		    jrp->jr_line += 1;
+		cp += 1;
+	    }
+
+	    /* A lone high surrogate is replaced before the text after it */
+	    if (cp > start && jsonReaderSurrogate(jrp))
+		return -1;
+
+	    if (cp == ep)
+		break;		/* Save the run below */
+
+	    /* A raw control character is replaced, like "\u0001" */
+	    if (slaxJsonIsControl((unsigned char) *cp)) {
+		if (jsonReaderSurrogate(jrp)
+			|| jsonReaderAppend(jrp, start, cp - start)
+			|| jsonReaderAppendUcs(jrp, 0xfffd))
+		    return -1;
+		start = NULL;
+		cp += 1;
+		continue;
+	    }
+
+	    if (*cp == jrp->jr_quote) {
+		int rc;
+
+		if (jrp->jr_len == 0 && jrp->jr_surrogate == 0)
+		    rc = jsonReaderToken(jrp, JT_STRING, start, cp - start);
+		else if (jsonReaderAppend(jrp, start, cp - start)
+			 || jsonReaderSurrogate(jrp))
+		    rc = -1;
+		else
+		    rc = jsonReaderToken(jrp, JT_STRING,
+					 jrp->jr_buf, jrp->jr_len);
+		if (rc)
+		    return -1;
+
+		jrp->jr_lex = JL_NONE;
+		jrp->jr_len = 0;
+		start = NULL;
+		cp += 1;
+		continue;
+	    }
+
+	    /* A backslash; save the run so far and decode the escape */
+	    if (jsonReaderAppend(jrp, start, cp - start))
+		return -1;
+	    jrp->jr_lex = JL_ESCAPE;
+	    start = NULL;
+	    cp += 1;
+	    continue;
+
+	case JL_ESCAPE:
+	    ch = (unsigned char) *cp++;
+	    jrp->jr_lex = JL_STRING;
+
+	    if (ch == 'u') {
+		jrp->jr_lex = JL_UNICODE;
+		jrp->jr_ucs = 0;
+		jrp->jr_ucs_digits = 0;
+		continue;
+	    }
+
+	    if (jsonReaderSurrogate(jrp))
+		return -1;
+
+	    switch (ch) {
+	    case 'b':
+		ch = '\b';
+		break;
+	    case 'f':
+		ch = '\f';
+		break;
+	    case 'n':
+		ch = '\n';
+		break;
+	    case 'r':
+		ch = '\r';
+		break;
+	    case 't':
+		ch = '\t';
+		break;
+	    case '\n':
+		jrp->jr_line += 1;
+		break;
+	    }
+
+	    /* Anything else (quotes, backslash, slash) is itself */
+	    if (slaxJsonIsControl(ch)) {
+		if (jsonReaderAppendUcs(jrp, 0xfffd))
+		    return -1;
+	    } else {
+		char c = ch;
+		if (jsonReaderAppend(jrp, &c, 1))
+		    return -1;
+	    }
+	    continue;
+
+	case JL_UNICODE:
+	    hex = jsonReaderHex(*cp);
+	    if (hex < 0) {
+		/* Not "\uXXXX" after all; keep what we saw, like SLAX does */
+		jrp->jr_lex = JL_STRING;
+		if (jsonReaderSurrogate(jrp)
+			|| jsonReaderAppend(jrp, "u", 1)
+			|| jsonReaderAppend(jrp, jrp->jr_ucs_text,
+					    jrp->jr_ucs_digits))
+		    return -1;
+		continue;
+	    }
+
+	    jrp->jr_ucs_text[jrp->jr_ucs_digits++] = *cp++;
+	    jrp->jr_ucs = (jrp->jr_ucs << 4) | hex;
+
+	    if (jrp->jr_ucs_digits == 4) {
+		jrp->jr_lex = JL_STRING;
+		if (jsonReaderUnicode(jrp, jrp->jr_ucs))
+		    return -1;
+	    }
+	    continue;
+
+	case JL_NUMBER:
+	case JL_BARE:
+	    if (start == NULL)
+		start = cp;
+
+	    if (jrp->jr_lex == JL_NUMBER) {
+		while (cp < ep && jsonReaderNumberChar(jrp, (unsigned char) *cp))
+		    jrp->jr_last = *cp++;
+	    } else {
+		while (cp < ep && jsonReaderBareChar((unsigned char) *cp))
+		    cp += 1;
+	    }
+
+	    if (cp == ep)
+		break;		/* Save the partial word below */
+
+	    {
+		int lex = jrp->jr_lex, rc;
+
+		jrp->jr_lex = JL_NONE;
+		if (jrp->jr_len == 0)
+		    rc = jsonReaderWord(jrp, lex, start, cp - start);
+		else if (jsonReaderAppend(jrp, start, cp - start))
+		    rc = -1;
+		else
+		    rc = jsonReaderWord(jrp, lex, jrp->jr_buf, jrp->jr_len);
+		if (rc)
+		    return -1;
+	    }
+
+	    jrp->jr_len = 0;
+	    start = NULL;
+	    continue;
+
+	case JL_SLASH:
+	    if (*cp != '*') {
+		jsonReaderError(jrp, "unexpected character '/'");
+		return -1;
+	    }
+	    jrp->jr_lex = JL_COMMENT;
+	    jrp->jr_len = 0;
+	    if (jsonReaderAppend(jrp, " ", 1))	/* Room for the padding */
+		return -1;
+	    start = ++cp;
+	    continue;
+
+	case JL_COMMENT:
+	case JL_COMMENT_STAR:
+	    if (start == NULL)
+		start = cp;
+
+	    ch = (unsigned char) *cp++;
+	    if (ch == '/' && jrp->jr_lex == JL_COMMENT_STAR) {
+		jrp->jr_lex = JL_NONE;
+		if (jsonReaderAppend(jrp, start, cp - start))
+		    return -1;
+		jrp->jr_len -= 2;	/* Drop the closing marker */
+		jsonReaderComment(jrp);
+		jrp->jr_len = 0;
+		start = NULL;
+	    } else if (slaxJsonIsControl(ch)) {
+		/* Replace it, as in a string, or the comment isn't XML */
+		if (jsonReaderAppend(jrp, start, cp - 1 - start)
+			|| jsonReaderAppendUcs(jrp, 0xfffd))
+		    return -1;
+		jrp->jr_lex = JL_COMMENT;
+		start = NULL;
+	    } else {
+		if (ch == '\n')
+		    jrp->jr_line += 1;
+		jrp->jr_lex = (ch == '*') ? JL_COMMENT_STAR : JL_COMMENT;
+	    }
+	    continue;
+	}
+
+	break;
+    }
+
+    /* Save any token that's continued in the next chunk */
+    if (start && cp > start) {
+	if (jsonReaderAppend(jrp, start, cp - start))
+	    return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Finish reading, returning the document (or NULL if the input had
+ * errors).  The reader is freed.
+ */
+xmlDocPtr
+slaxJsonReaderFinish (json_reader_t *jrp)
+{
+    xmlDocPtr docp = NULL;
+
+    if (jrp->jr_errors == 0) {
+	switch (jrp->jr_lex) {
+	case JL_NUMBER:
+	case JL_BARE:
+	    jsonReaderWord(jrp, jrp->jr_lex, jrp->jr_buf, jrp->jr_len);
+	    break;
+
+	case JL_STRING:
+	case JL_ESCAPE:
+	case JL_UNICODE:
+	    jsonReaderError(jrp, "unterminated string");
+	    break;
+
+	case JL_SLASH:
+	case JL_COMMENT:
+	case JL_COMMENT_STAR:
+	    jsonReaderError(jrp, "unterminated comment");
+	    break;
+	}
+    }
+
+    if (jrp->jr_errors == 0 && jrp->jr_state != JS_DONE)
+	jsonReaderError(jrp, "unexpected end of input");
+
+    if (jrp->jr_errors) {
+	slaxError("%s: %d error%s detected during parsing",
+		  jrp->jr_filename, jrp->jr_errors,
+		  (jrp->jr_errors == 1) ? "" : "s");
+    } else {
+	docp = jrp->jr_docp;
+	jrp->jr_docp = NULL;
+    }
+
+    slaxJsonReaderFree(jrp);
+    return docp;
+}
+
+/*
+ * Turn a string of JSON data into an XML document
+ */
+xmlDocPtr
+slaxJsonDataToXml (const char *data, const char *root_name, unsigned flags)
+{
+    json_reader_t *jrp;
+
+    if (flags & SDF_JSON_NO_MEMBERS)
+	return slaxJsonDataToXmlGrammar(data, root_name, flags);
+
+    jrp = slaxJsonReaderCreate("json", root_name, flags);
+    if (jrp == NULL)
+	return NULL;
+
+    slaxJsonReaderPush(jrp, data, strlen(data));
+
+    return slaxJsonReaderFinish(jrp);
+}
+
+/*
+ * Read a file (or standard input) a chunk at a time, handing each
+ * chunk to func until it returns non-zero.  Returns -1 if the file
+ * can't be read.
+ */
+int
+slaxJsonReadFile (const char *fname, slaxJsonPushFunc_t func, void *opaque)
+{
+    FILE *fp;
+    char *buf;
+    size_t len;
+    int rc = 0;
+
+    if (slaxFilenameIsStd(fname))
+	fp = stdin;
+    else {
+	fp = fopen(fname, "r");
+	if (fp == NULL) {
+	    slaxError("%s: cannot open: %s", fname, strerror(errno));
+	    return -1;
+	}
+    }
+
+    buf = xmlMalloc(JR_READ_SIZE);
+    if (buf == NULL)
+	rc = -1;
+    else {
+	while ((len = fread(buf, 1, JR_READ_SIZE, fp)) > 0)
+	    if (func(opaque, buf, len))
+		break;
+
+	if (ferror(fp)) {
+	    slaxError("%s: read error: %s", fname, strerror(errno));
+	    rc = -1;
+	}
+
+	xmlFree(buf);
+    }
+
+    if (fp != stdin)
+	fclose(fp);
+
+    return rc;
+}
+
+static int
+jsonReaderPushFunc (void *opaque, const char *data, size_t len)
+{
+    return slaxJsonReaderPush(opaque, data, len);
+}
+
+/*
+ * Turn a file of JSON data into an XML document, reading it a chunk
+ * at a time
+ */
+xmlDocPtr
+slaxJsonFileToXml (const char *fname, const char *root_name,
+		   unsigned flags)
+{
+    json_reader_t *jrp;
+
+    if (flags & SDF_JSON_NO_MEMBERS)
+	return slaxJsonFileToXmlGrammar(fname, root_name, flags);
+
+    jrp = slaxJsonReaderCreate(fname, root_name, flags);
+    if (jrp == NULL)
+	return NULL;
+
+    if (slaxJsonReadFile(fname, jsonReaderPushFunc, jrp)) {
+	slaxJsonReaderFree(jrp);
+	return NULL;
+    }
+
+    return slaxJsonReaderFinish(jrp);
+}
+
+/*
+ * JSON lines (aka NDJSON): each line holds a complete object or
+ * array.  Every line gets its own reader, and the finished document
+ * is passed to the caller's function as soon as the newline arrives,
+ * so only one record is in memory at a time.
+ */
+typedef struct json_lines_s {
+    const char *jl_filename;	/* Filename, for error messages */
+    const char *jl_record;	/* Name of each record's element */
+    unsigned jl_flags;		/* Flags (SDF_*) */
+    slaxJsonRecordFunc_t jl_func; /* Caller's function */
+    void *jl_opaque;		/* Caller's data */
+    json_reader_t *jl_reader;	/* Reader for the current line */
+    unsigned jl_line;		/* Current line number */
+    int jl_errors;		/* Number of bad records */
+    int jl_stop;		/* The caller's function failed */
+} json_lines_t;
+
+/*
+ * Finish the current line's record, if it has one
+ */
+static void
+jsonLinesEnd (json_lines_t *jlp)
+{
+    xmlDocPtr docp;
+
+    if (jlp->jl_reader == NULL)
+	return;
+
+    docp = slaxJsonReaderFinish(jlp->jl_reader);
+    jlp->jl_reader = NULL;
+
+    if (docp == NULL)
+	jlp->jl_errors += 1;
+    else if (jlp->jl_func(docp, jlp->jl_opaque))
+	jlp->jl_stop = TRUE;
+}
+
+static int
+jsonLinesPush (void *opaque, const char *data, size_t len)
+{
+    json_lines_t *jlp = opaque;
+    const char *nl, *cp;
+    size_t seg;
+
+    while (len > 0 && !jlp->jl_stop) {
+	nl = memchr(data, '\n', len);
+	seg = nl ? (size_t) (nl - data) : len;
+
+	if (jlp->jl_reader == NULL) {
+	    /* Blank lines (or blank starts of lines) don't make records */
+	    for (cp = data; cp < data + seg; cp++)
+		if (!isspace((unsigned char) *cp))
+		    break;
+
+	    if (cp < data + seg) {
+		jlp->jl_reader = slaxJsonReaderCreate(jlp->jl_filename,
+						      jlp->jl_record,
+						      jlp->jl_flags);
+		if (jlp->jl_reader == NULL) {
+		    jlp->jl_stop = TRUE;
+		    break;
+		}
+		jlp->jl_reader->jr_line = jlp->jl_line;
+	    }
+	}
+
+	/* Errors are kept in the reader and reported when it finishes */
+	if (jlp->jl_reader)
+	    slaxJsonReaderPush(jlp->jl_reader, data, seg);
+
+	if (nl == NULL)
+	    break;
+
+	jsonLinesEnd(jlp);
+	jlp->jl_line += 1;
+	data += seg + 1;
+	len -= seg + 1;
+    }
+
+    return jlp->jl_stop;
+}
+
+static void
+jsonLinesInit (json_lines_t *jlp, const char *filename,
+	       const char *record_name, unsigned flags,
+	       slaxJsonRecordFunc_t func, void *opaque)
+{
+    bzero(jlp, sizeof(*jlp));
+    jlp->jl_filename = filename;
+    jlp->jl_record = record_name ?: ELT_RECORD;
+    jlp->jl_flags = flags;
+    jlp->jl_func = func;
+    jlp->jl_opaque = opaque;
+    jlp->jl_line = 1;
+}
+
+static int
+jsonLinesFinish (json_lines_t *jlp)
+{
+    if (!jlp->jl_stop)
+	jsonLinesEnd(jlp);	/* The last line needn't end with a newline */
+    else if (jlp->jl_reader)
+	slaxJsonReaderFree(jlp->jl_reader);
+
+    return jlp->jl_stop ? -1 : jlp->jl_errors;
+}
+
+/*
+ * Turn a string of JSON lines into a series of XML documents, one per
+ * line, whose top elements are named record_name (or "record").  Each
+ * document is given to func, which must free it, and can return
+ * non-zero to stop.  Lines with errors are reported and skipped.
+ * Returns the number of lines skipped, or -1 if func stopped us.
+ */
+int
+slaxJsonLinesDataToXml (const char *data, const char *record_name,
+			unsigned flags, slaxJsonRecordFunc_t func,
+			void *opaque)
+{
+    json_lines_t jl;
+
+    jsonLinesInit(&jl, "json", record_name, flags, func, opaque);
+    jsonLinesPush(&jl, data, strlen(data));
+
+    return jsonLinesFinish(&jl);
+}
+
+/*
+ * The same, reading a file (or standard input) a chunk at a time
+ */
+int
+slaxJsonLinesFileToXml (const char *fname, const char *record_name,
+			unsigned flags, slaxJsonRecordFunc_t func,
+			void *opaque)
+{
+    json_lines_t jl;
+    int rc;
+
+    jsonLinesInit(&jl, fname, record_name, flags, func, opaque);
+    rc = slaxJsonReadFile(fname, jsonLinesPush, &jl);
+    if (jsonLinesFinish(&jl) < 0 || rc)
+	return -1;
+
+    return jl.jl_errors;
+}
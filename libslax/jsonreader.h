@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) 2013, Juniper Networks, Inc.
+ * All rights reserved.
+ * This SOFTWARE is licensed under the LICENSE provided in the
+ * ../Copyright file. By downloading, installing, copying, or otherwise
+ * using the SOFTWARE, you agree to be bound by the terms of that
+ * LICENSE.
+ *
+ * jsonreader.h -- build XML from JSON input, a chunk at a time
+ */
+
+typedef struct json_reader_s json_reader_t;
+
+/*
+ * Create a reader; filename is used in error messages and root_name
+ * (default "json") names the top element.  Flags are SDF_*.
+ */
+json_reader_t *
+slaxJsonReaderCreate (const char *filename, const char *root_name,
+		      unsigned flags);
+
+/*
+ * Feed the next chunk of input; returns -1 on error
+ */
+int
+slaxJsonReaderPush (json_reader_t *jrp, const char *data, size_t len);
+
+/*
+ * C0 controls other than tab, newline and return (including NUL)
+ * can't appear in XML text, so readers replace them with U+FFFD
+ */
+static inline int
+slaxJsonIsControl (unsigned ch)
+{
+    return ch < 0x20 && ch != '\t' && ch != '\n' && ch != '\r';
+}
+
+#define JSON_REPLACEMENT_CHAR	"\xef\xbf\xbd" /* U+FFFD, in UTF-8 */
+
+/* Tokens, for slaxJsonReaderToken() */
+#define JT_OBRACE	1	/* '{' */
+#define JT_CBRACE	2	/* '}' */
+#define JT_OBRACK	3	/* '[' */
+#define JT_CBRACK	4	/* ']' */
+#define JT_COLON	5	/* ':' */
+#define JT_COMMA	6	/* ',' */
+#define JT_STRING	7	/* Quoted string */
+#define JT_NUMBER	8	/* Number */
+#define JT_TRUE		9	/* "true" */
+#define JT_FALSE	10	/* "false" */
+#define JT_NULL		11	/* "null" */
+#define JT_BARE		12	/* Any other bare word */
+
+/*
+ * Feed the parser a token decoded from some other format; data is
+ * the unescaped value of a string or the text of a number.  Returns
+ * -1 on error.
+ */
+int
+slaxJsonReaderToken (json_reader_t *jrp, int tok, const char *data,
+		     size_t len);
+
+/*
+ * Finish the input, returning the document (NULL on errors) and
+ * freeing the reader
+ */
+xmlDocPtr
+slaxJsonReaderFinish (json_reader_t *jrp);
+
+/*
+ * Free a reader without finishing it
+ */
+void
+slaxJsonReaderFree (json_reader_t *jrp);
+
+/*
+ * Handle one record of JSON lines input; the function must free the
+ * document, and returns non-zero to stop reading
+ */
+typedef int (*slaxJsonRecordFunc_t)(xmlDocPtr docp, void *opaque);
+
+/*
+ * Turn JSON lines (one object or array per line) into one document
+ * per line, named record_name (default "record").  Returns the number
+ * of lines skipped because of errors, or -1 if reading stopped.
+ */
+int
+slaxJsonLinesDataToXml (const char *data, const char *record_name,
+			unsigned flags, slaxJsonRecordFunc_t func,
+			void *opaque);
+
+int
+slaxJsonLinesFileToXml (const char *fname, const char *record_name,
+			unsigned flags, slaxJsonRecordFunc_t func,
+			void *opaque);
+
+/*
+ * Read a file (or "-" for standard input) a chunk at a time, handing
+ * each chunk to func until it returns non-zero
+ */
+typedef int (*slaxJsonPushFunc_t)(void *opaque, const char *data, size_t len);
+
+int
+slaxJsonReadFile (const char *fname, slaxJsonPushFunc_t func, void *opaque);
@@ -15,10 +15,13 @@
 #include <string.h>
 #include <ctype.h>
 #include <errno.h>
+#include <stdint.h>
 
 #include <libxml/xmlmemory.h>
 #include <libxml/parser.h>
 #include <libxml/xmlsave.h>
+#include <libxml/xmlreader.h>
+#include <libxslt/xslt.h>
 
 #include <libslax/slax.h>
 #include "slaxinternals.h"
@@ -29,8 +32,11 @@
 static int
 jsonWriteChildren (slax_writer_t *swp, xmlNodePtr parent, unsigned flags);
 
-static const char *
-jsonAttribValue (xmlNodePtr nodep, const char *name)
+/*
+ * Return the value of an attribute, if it's simple text
+ */
+const char *
+slaxJsonAttribValue (xmlNodePtr nodep, const char *name)
 {
     xmlAttrPtr attr = xmlHasProp(nodep, (const xmlChar *) name);
 
@@ -41,8 +47,11 @@ jsonAttribValue (xmlNodePtr nodep, const char *name)
     return NULL;
 }
 
-static int
-jsonHasChildNodes (xmlNodePtr nodep)
+/*
+ * Does this element hold anything but text (making it an object)?
+ */
+int
+slaxJsonHasChildNodes (xmlNodePtr nodep)
 {
     if (nodep == NULL)
 	return FALSE;
@@ -54,18 +63,25 @@ jsonHasChildNodes (xmlNodePtr nodep)
     return FALSE;
 }
 
-static const char *
-jsonName (xmlNodePtr nodep)
+/*
+ * Return the JSON name of an element: the "name" attribute of an
+ * <element> element, or the element's own name
+ */
+const char *
+slaxJsonName (xmlNodePtr nodep)
 {
-    const char *name = jsonAttribValue(nodep, ATT_NAME);
+    const char *name = slaxJsonAttribValue(nodep, ATT_NAME);
     if (name == NULL)
 	name = (const char *) nodep->name;
 
     return name;
 }
 
-static const char *
-jsonValue (xmlNodePtr nodep)
+/*
+ * Return the text value of an element
+ */
+const char *
+slaxJsonValue (xmlNodePtr nodep)
 {
     if (nodep && nodep->children && nodep->children->type == XML_TEXT_NODE)
 	return (const char *) nodep->children->content;
@@ -86,45 +102,135 @@ jsonNameNeedsQuotes (const char *str, unsigned flags)
     return "\"";
 }
 
+/*
+ * Only elements are written, so only a following element needs a comma
+ */
 static const char *
 jsonNeedsComma (xmlNodePtr nodep UNUSED)
 {
     xmlNodePtr nextp;
     for (nextp = nodep->next; nextp; nextp = nextp->next)
-	if (nextp->type != XML_TEXT_NODE)
+	if (nextp->type == XML_ELEMENT_NODE)
 	    return ",";
 
     return "";
 }
 
-static void
-jsonEscape (char *buf, int bufsiz, const char *str)
+/*
+ * Word-at-a-time scanning: SWAR_ONES has 0x01 in every byte, so
+ * "SWAR_ONES * c" has c in every byte.  SWAR_LESS() is nonzero if
+ * any byte of w is less than n (for n <= 128), and SWAR_ZERO() is
+ * nonzero if any byte is zero.  Bytes with the high bit set (UTF-8)
+ * are never flagged.
+ */
+#define SWAR_ONES		0x0101010101010101ULL
+#define SWAR_HIGH		(SWAR_ONES * 0x80)
+#define SWAR_LESS(_w, _n)	(((_w) - SWAR_ONES * (_n)) & ~(_w) & SWAR_HIGH)
+#define SWAR_ZERO(_w)		SWAR_LESS(_w, 1)
+
+/*
+ * Does this byte need escaping in a JSON string (RFC 8259 section 7)?
+ */
+static inline int
+jsonNeedsEscape (unsigned char ch)
+{
+    return (ch < 0x20 || ch == '"' || ch == '\\');
+}
+
+/*
+ * Return the length of the leading run of bytes that can be copied
+ * into a JSON string as-is.  Eight bytes are checked at a time, so
+ * long runs of clean text are copied at close to memory speed.  The
+ * NUL counts as a byte needing escape, so we never read past the
+ * end of the word holding it.
+ */
+static size_t
+jsonCleanLength (const char *str)
 {
-    char esc;
+    const char *cp = str;
+    uint64_t word;
 
-    for ( ; str && *str; str++) {
-	if (bufsiz < 1)
+    /* Go a byte at a time until we're aligned, so loads can't fault */
+    for ( ; ((uintptr_t) cp & (sizeof(word) - 1)) != 0; cp++)
+	if (*cp == '\0' || jsonNeedsEscape(*cp))
+	    return cp - str;
+
+    for (;;) {
+	memcpy(&word, cp, sizeof(word));
+
+	if (SWAR_LESS(word, 0x20) || SWAR_ZERO(word ^ (SWAR_ONES * '"'))
+		|| SWAR_ZERO(word ^ (SWAR_ONES * '\\')))
+	    break;
+
+	cp += sizeof(word);
+    }
+
+    /* Find the byte that stopped us (possibly the trailing NUL) */
+    while (*cp && !jsonNeedsEscape(*cp))
+	cp += 1;
+
+    return cp - str;
+}
+
+/*
+ * Write a string, escaped for JSON, directly into the writer.  Runs
+ * of clean bytes are copied in one piece.
+ */
+static void
+jsonWriteEscaped (slax_writer_t *swp, const char *str)
+{
+    static const char hex[] = "0123456789abcdef";
+    char esc[7];
+    size_t len;
+    unsigned char ch;
+
+    if (str == NULL)
+	return;
+
+    for (;;) {
+	len = jsonCleanLength(str);
+	if (len)
+	    slaxWriteString(swp, str, len);
+
+	str += len;
+	ch = *str++;
+	if (ch == '\0')
 	    break;
-	if (*str == '\b')
-	    esc = 'b';
-	else if (*str == '\n')
-	    esc = 'n';
-	else if (*str == '\r')
-	    esc = 'r';
-	else if (*str == '\t')
-	    esc = 't';
-	else {
-	    *buf++ = *str;
-	    bufsiz -= 1;
-	    continue;
+
+	esc[0] = '\\';
+	esc[2] = '\0';
+
+	switch (ch) {
+	case '"':  esc[1] = '"'; break;
+	case '\\': esc[1] = '\\'; break;
+	case '\b': esc[1] = 'b'; break;
+	case '\f': esc[1] = 'f'; break;
+	case '\n': esc[1] = 'n'; break;
+	case '\r': esc[1] = 'r'; break;
+	case '\t': esc[1] = 't'; break;
+	default:
+	    esc[1] = 'u';
+	    esc[2] = '0';
+	    esc[3] = '0';
+	    esc[4] = hex[ch >> 4];
+	    esc[5] = hex[ch & 0xf];
+	    esc[6] = '\0';
 	}
 
-	*buf++ = '\\';
-	*buf++ = esc;
-	bufsiz -= 2;
+	slaxWriteString(swp, esc, -1);
     }
+}
 
-    *buf = '\0';
+/*
+ * Write the name of a member, followed by the colon
+ */
+static void
+jsonWriteName (slax_writer_t *swp, const char *name, const char *quote)
+{
+    slaxWriteString(swp, quote, -1);
+    jsonWriteEscaped(swp, name);
+    slaxWriteString(swp, quote, -1);
+    slaxWriteLiteral(swp, ": ");
 }
 
 static void
@@ -133,46 +239,36 @@ jsonWriteNewline (slax_writer_t *swp, int delta, unsigned flags)
     if (flags & JWF_PRETTY)
 	slaxWriteNewline(swp, delta);
     else
-	slaxWrite(swp, " ");
+	slaxWriteLiteral(swp, " ");
 }
 
 static int
 jsonWriteNode (slax_writer_t *swp, xmlNodePtr nodep,
 		       unsigned flags)
 {
-    const char *type = jsonAttribValue(nodep, ATT_TYPE);
-    const char *name = jsonName(nodep);
+    const char *type = slaxJsonAttribValue(nodep, ATT_TYPE);
+    const char *name = slaxJsonName(nodep);
     const char *quote = jsonNameNeedsQuotes(name, flags);
     const char *comma = jsonNeedsComma(nodep);
 
     if (name == NULL)
 	return 0;
 
-    int nlen = strlen(name) + 1;
-    char ename[nlen * 2];
-    jsonEscape(ename, sizeof(ename), name);
-    name = ename;
-
     if (type) {
 	if (streq(type, VAL_NUMBER) || streq(type, VAL_TRUE)
 	        || streq(type, VAL_FALSE) || streq(type, VAL_NULL)) {
-	    const char *value = jsonValue(nodep);
-	    int vlen = strlen(value) + 1;
-	    char evalue[vlen * 2];
-	    jsonEscape(evalue, sizeof(evalue), value);
-	    value = evalue;
-
 	    if (!(flags & JWF_ARRAY))
-		slaxWrite(swp, "%s%s%s: ", quote, name, quote);
-	    slaxWrite(swp, "%s%s", value, comma);
+		jsonWriteName(swp, name, quote);
+	    jsonWriteEscaped(swp, slaxJsonValue(nodep));
+	    slaxWriteString(swp, comma, -1);
 
 	    jsonWriteNewline(swp, 0, flags);
 	    return 0;
 
 	} else if (streq(type, VAL_ARRAY)) {
 	    if (!(flags & JWF_ARRAY))
-		slaxWrite(swp, "%s%s%s: ", quote, name, quote);
-	    slaxWrite(swp, "[");
+		jsonWriteName(swp, name, quote);
+	    slaxWriteLiteral(swp, "[");
 	    jsonWriteNewline(swp, NEWL_INDENT, flags);
 
 	    jsonWriteChildren(swp, nodep, JWF_ARRAY | flags);
@@ -187,10 +283,10 @@ jsonWriteNode (slax_writer_t *swp, xmlNodePtr nodep,
 	}
     }
 
-    if (jsonHasChildNodes(nodep)) {
+    if (slaxJsonHasChildNodes(nodep)) {
 	if (!(flags & JWF_ARRAY))
-	    slaxWrite(swp, "%s%s%s: ", quote, name, quote);
-	slaxWrite(swp, "{");
+	    jsonWriteName(swp, name, quote);
+	slaxWriteLiteral(swp, "{");
 	jsonWriteNewline(swp, NEWL_INDENT, flags);
 
 	jsonWriteChildren(swp, nodep, flags & ~JWF_ARRAY);
@@ -199,18 +295,13 @@ jsonWriteNode (slax_writer_t *swp, xmlNodePtr nodep,
 	jsonWriteNewline(swp, NEWL_OUTDENT, flags);
 
     } else {
-	const char *value = jsonValue(nodep);
-	int vlen = value ? strlen(value) + 1 : 0;
-	char evalue[vlen * 2 + 1];
-	if (value) {
-	    jsonEscape(evalue, sizeof(evalue), value);
-	    value = evalue;
-	}
-
 	if (!(flags & JWF_ARRAY))
-	    slaxWrite(swp, "%s%s%s: ", quote, name, quote);
+	    jsonWriteName(swp, name, quote);
 
-	slaxWrite(swp, "\"%s\"%s", value ?: "", comma);
+	slaxWriteLiteral(swp, "\"");
+	jsonWriteEscaped(swp, slaxJsonValue(nodep));
+	slaxWriteLiteral(swp, "\"");
+	slaxWriteString(swp, comma, -1);
 	jsonWriteNewline(swp, 0, flags);
     }
 
@@ -232,12 +323,30 @@ jsonWriteChildren (slax_writer_t *swp UNUSED, xmlNodePtr parent,
     return rc;
 }
 
-int
-slaxJsonWriteNode (slaxWriterFunc_t func, void *data, xmlNodePtr nodep,
-		       unsigned flags)
+/*
+ * Write a node as JSON, using the given writer.  For JSON lines
+ * (JWF_LINES), each child element is written as its own compact
+ * object or array, followed by a newline.
+ */
+static int
+jsonWriteTop (slax_writer_t *swp, xmlNodePtr nodep, unsigned flags)
 {
-    slax_writer_t *swp = slaxGetWriter(func, data);
-    const char *type = jsonAttribValue(nodep, ATT_TYPE);
+    const char *type;
+
+    if (flags & JWF_LINES) {
+	xmlNodePtr childp;
+	int rc = 0;
+
+	flags &= ~(JWF_LINES | JWF_PRETTY);
+	for (childp = nodep->children; childp && rc == 0;
+	     childp = childp->next)
+	    if (childp->type == XML_ELEMENT_NODE)
+		rc = jsonWriteTop(swp, childp, flags);
+
+	return rc;
+    }
+
+    type = slaxJsonAttribValue(nodep, ATT_TYPE);
 
     if (type && streq(type, VAL_ARRAY))
 	flags |= JWF_ARRAY;
@@ -250,6 +359,39 @@ slaxJsonWriteNode (slaxWriterFunc_t func, void *data, xmlNodePtr nodep,
     slaxWrite(swp, (flags & JWF_ARRAY) ? "]" : "}");
     slaxWriteNewline(swp, (flags & JWF_PRETTY) ? NEWL_OUTDENT : 0);
 
+    return rc;
+}
+
+int
+slaxJsonWriteNode (slaxWriterFunc_t func, void *data, xmlNodePtr nodep,
+		       unsigned flags)
+{
+    slax_writer_t *swp = slaxGetWriter(func, data);
+    int rc;
+
+    if (swp == NULL)
+	return -1;
+
+    rc = jsonWriteTop(swp, nodep, flags);
+
+    slaxFreeWriter(swp);
+    return rc;
+}
+
+/*
+ * Append the JSON form of a node to an xmlBuffer
+ */
+int
+slaxJsonWriteNodeBuffer (xmlBufferPtr xbuf, xmlNodePtr nodep, unsigned flags)
+{
+    slax_writer_t *swp = slaxGetWriterBuffer(xbuf);
+    int rc;
+
+    if (swp == NULL)
+	return -1;
+
+    rc = jsonWriteTop(swp, nodep, flags);
+
     slaxFreeWriter(swp);
     return rc;
 }
@@ -259,5 +401,385 @@ slaxJsonWriteDoc (slaxWriterFunc_t func, void *data, xmlDocPtr docp,
 		      unsigned flags)
 {
     xmlNodePtr nodep = xmlDocGetRootElement(docp);
+
+    if (nodep == NULL)
+	return -1;
+
     return slaxJsonWriteNode(func, data, nodep, flags | JWF_ROOT);
 }
+
+/*
+ * Write a document as JSON straight to a file descriptor, in chunks
+ * rather than lines, so compact output (a single line) is never held
+ * in memory as a whole
+ */
+int
+slaxJsonWriteDocFd (int fd, xmlDocPtr docp, unsigned flags)
+{
+    xmlNodePtr nodep = xmlDocGetRootElement(docp);
+    slax_writer_t *swp;
+    int rc;
+
+    if (nodep == NULL)
+	return -1;
+
+    swp = slaxGetWriterFd(fd);
+    if (swp == NULL)
+	return -1;
+
+    rc = jsonWriteTop(swp, nodep, flags | JWF_ROOT);
+
+    slaxFreeWriter(swp);
+    return rc;
+}
+
+/*
+ * Streaming conversion: the input is read with an xmlTextReader and
+ * the JSON is written as the elements go by, so memory is bounded by
+ * the depth of the document rather than its size.  jsonWriteNode()
+ * looks ahead for two things we can't know until later: whether an
+ * untyped element is an object (it has child nodes) or a string, and
+ * whether an item needs a comma (it has a following sibling).  So an
+ * object's opening brace is written when its first child arrives, and
+ * the comma and newline after an item are written when the next item
+ * starts or when its parent closes.
+ */
+#define JSF_LINES	1	/* Root element holding JSON lines records */
+#define JSF_TOP		2	/* Top object or array */
+#define JSF_OBJECT	3	/* Object (element with children) */
+#define JSF_ARRAY	4	/* Array (type="array") */
+#define JSF_PENDING	5	/* Object or string; we don't know yet */
+#define JSF_SCALAR	6	/* Number, true, false, or null */
+
+typedef struct json_stream_frame_s {
+    int jsf_kind;		/* Kind of element (JSF_*) */
+    unsigned jsf_flags;		/* Flags for this element (JWF_*) */
+    xmlChar *jsf_name;		/* Name of this member */
+    int jsf_sep;		/* Last child awaits its comma and newline */
+    int jsf_sep_delta;		/* Indent change for that newline */
+    int jsf_text_done;		/* Seen a child that isn't text */
+} json_stream_frame_t;
+
+typedef struct json_stream_s {
+    slax_writer_t *js_swp;	/* Our writer */
+    unsigned js_flags;		/* Caller's flags (JWF_*) */
+    json_stream_frame_t *js_stack; /* Open elements */
+    int js_depth;		/* Number of open elements */
+    int js_size;		/* Size of js_stack */
+    char *js_text;		/* Text of the innermost element */
+    size_t js_len;		/* Length of js_text */
+    size_t js_alloc;		/* Size of js_text */
+} json_stream_t;
+
+static void
+jsonStreamText (json_stream_t *jsp, const xmlChar *value)
+{
+    json_stream_frame_t *fp;
+    size_t len;
+
+    if (jsp->js_depth == 0 || value == NULL)
+	return;
+
+    fp = &jsp->js_stack[jsp->js_depth - 1];
+    if ((fp->jsf_kind != JSF_PENDING && fp->jsf_kind != JSF_SCALAR)
+	    || fp->jsf_text_done)
+	return;
+
+    len = xmlStrlen(value);
+    if (jsp->js_len + len + 1 > jsp->js_alloc) {
+	size_t size = jsp->js_alloc ? jsp->js_alloc * 2 : BUFSIZ;
+	char *cp;
+
+	while (size < jsp->js_len + len + 1)
+	    size *= 2;
+
+	cp = xmlRealloc(jsp->js_text, size);
+	if (cp == NULL)
+	    return;
+
+	jsp->js_text = cp;
+	jsp->js_alloc = size;
+    }
+
+    memcpy(jsp->js_text + jsp->js_len, value, len);
+    jsp->js_len += len;
+    jsp->js_text[jsp->js_len] = '\0';
+}
+
+/*
+ * An untyped element has a child node, so it's an object
+ */
+static void
+jsonStreamObject (json_stream_t *jsp, json_stream_frame_t *fp)
+{
+    if (!(fp->jsf_flags & JWF_ARRAY))
+	jsonWriteName(jsp->js_swp, (const char *) fp->jsf_name,
+		      jsonNameNeedsQuotes((const char *) fp->jsf_name,
+					  fp->jsf_flags));
+    slaxWriteLiteral(jsp->js_swp, "{");
+    jsonWriteNewline(jsp->js_swp, NEWL_INDENT, fp->jsf_flags);
+
+    fp->jsf_kind = JSF_OBJECT;
+}
+
+/*
+ * Finish the line of the last child written, with a comma if
+ * another child follows
+ */
+static void
+jsonStreamSeparate (json_stream_t *jsp, json_stream_frame_t *fp, int comma)
+{
+    if (!fp->jsf_sep)
+	return;
+
+    if (comma)
+	slaxWriteLiteral(jsp->js_swp, ",");
+    jsonWriteNewline(jsp->js_swp, fp->jsf_sep_delta, fp->jsf_flags);
+    fp->jsf_sep = FALSE;
+}
+
+/*
+ * Another node that isn't text: for an untyped element, that means
+ * it's an object, and a scalar's value is only its leading text
+ */
+static void
+jsonStreamOther (json_stream_t *jsp)
+{
+    json_stream_frame_t *fp;
+
+    if (jsp->js_depth == 0)
+	return;
+
+    fp = &jsp->js_stack[jsp->js_depth - 1];
+    fp->jsf_text_done = TRUE;
+    if (fp->jsf_kind == JSF_PENDING)
+	jsonStreamObject(jsp, fp);
+}
+
+/*
+ * An element starts.  Returns TRUE if its subtree should be skipped.
+ */
+static int
+jsonStreamStart (json_stream_t *jsp, xmlTextReaderPtr reader)
+{
+    json_stream_frame_t *parent = NULL, *fp;
+    unsigned flags = jsp->js_flags | JWF_ROOT;
+    const char *type;
+    xmlChar *attr;
+    int kind;
+
+    if (jsp->js_depth > 0) {
+	parent = &jsp->js_stack[jsp->js_depth - 1];
+
+	if (parent->jsf_kind == JSF_SCALAR) {
+	    /* Children of numbers and such aren't written */
+	    parent->jsf_text_done = TRUE;
+	    return TRUE;
+	}
+
+	if (parent->jsf_kind == JSF_PENDING)
+	    jsonStreamObject(jsp, parent);
+
+	parent->jsf_text_done = TRUE;
+	jsonStreamSeparate(jsp, parent, TRUE);
+
+	flags = parent->jsf_flags;
+	if (parent->jsf_kind == JSF_ARRAY)
+	    flags |= JWF_ARRAY;
+	else if (parent->jsf_kind == JSF_OBJECT)
+	    flags &= ~JWF_ARRAY;
+    }
+
+    if (jsp->js_depth >= jsp->js_size) {
+	int size = jsp->js_size ? jsp->js_size * 2 : 32;
+	json_stream_frame_t *stack;
+
+	stack = xmlRealloc(jsp->js_stack, size * sizeof(*stack));
+	if (stack == NULL)
+	    return TRUE;
+
+	jsp->js_stack = stack;
+	jsp->js_size = size;
+    }
+
+    attr = xmlTextReaderGetAttribute(reader, (const xmlChar *) ATT_TYPE);
+    type = (const char *) attr;
+
+    if (parent == NULL && (flags & JWF_LINES)) {
+	kind = JSF_LINES;
+	flags &= ~(JWF_LINES | JWF_PRETTY);
+
+    } else if (parent == NULL || parent->jsf_kind == JSF_LINES) {
+	kind = JSF_TOP;
+	if (type && streq(type, VAL_ARRAY))
+	    flags |= JWF_ARRAY;
+
+	slaxWriteString(jsp->js_swp, (flags & JWF_ARRAY) ? "[" : "{", 1);
+	jsonWriteNewline(jsp->js_swp, NEWL_INDENT, flags);
+
+    } else if (type && (streq(type, VAL_NUMBER) || streq(type, VAL_TRUE)
+			|| streq(type, VAL_FALSE) || streq(type, VAL_NULL))) {
+	kind = JSF_SCALAR;
+
+    } else if (type && streq(type, VAL_ARRAY)) {
+	kind = JSF_ARRAY;
+
+    } else {
+	kind = JSF_PENDING;
+	if (type && streq(type, VAL_MEMBER))
+	    flags |= JWF_ARRAY;
+    }
+
+    xmlFreeAndEasy(attr);
+
+    fp = &jsp->js_stack[jsp->js_depth++];
+    bzero(fp, sizeof(*fp));
+    fp->jsf_kind = kind;
+    fp->jsf_flags = flags;
+
+    if (kind == JSF_SCALAR || kind == JSF_ARRAY || kind == JSF_PENDING) {
+	fp->jsf_name = xmlTextReaderGetAttribute(reader,
+						 (const xmlChar *) ATT_NAME);
+	if (fp->jsf_name == NULL)
+	    fp->jsf_name = xmlStrdup(xmlTextReaderConstLocalName(reader));
+	jsp->js_len = 0;
+    }
+
+    if (kind == JSF_ARRAY) {
+	if (!(flags & JWF_ARRAY))
+	    jsonWriteName(jsp->js_swp, (const char *) fp->jsf_name,
+			  jsonNameNeedsQuotes((const char *) fp->jsf_name,
+					      flags));
+	slaxWriteLiteral(jsp->js_swp, "[");
+	jsonWriteNewline(jsp->js_swp, NEWL_INDENT, flags);
+    }
+
+    return FALSE;
+}
+
+/*
+ * An element ends
+ */
+static void
+jsonStreamEnd (json_stream_t *jsp)
+{
+    slax_writer_t *swp = jsp->js_swp;
+    json_stream_frame_t *fp;
+    const char *name, *text;
+    int delta = 0;
+
+    if (jsp->js_depth == 0)
+	return;
+
+    fp = &jsp->js_stack[jsp->js_depth - 1];
+    name = (const char *) fp->jsf_name;
+    text = jsp->js_len ? jsp->js_text : NULL;
+
+    switch (fp->jsf_kind) {
+    case JSF_SCALAR:
+	if (!(fp->jsf_flags & JWF_ARRAY))
+	    jsonWriteName(swp, name, jsonNameNeedsQuotes(name, fp->jsf_flags));
+	jsonWriteEscaped(swp, text);
+	break;
+
+    case JSF_PENDING:
+	if (!(fp->jsf_flags & JWF_ARRAY))
+	    jsonWriteName(swp, name, jsonNameNeedsQuotes(name, fp->jsf_flags));
+	slaxWriteLiteral(swp, "\"");
+	jsonWriteEscaped(swp, text);
+	slaxWriteLiteral(swp, "\"");
+	break;
+
+    case JSF_OBJECT:
+    case JSF_ARRAY:
+	jsonStreamSeparate(jsp, fp, FALSE);
+	slaxWriteString(swp, (fp->jsf_kind == JSF_ARRAY) ? "]" : "}", 1);
+	delta = NEWL_OUTDENT;
+	break;
+
+    case JSF_TOP:
+	jsonStreamSeparate(jsp, fp, FALSE);
+	slaxWriteString(swp, (fp->jsf_flags & JWF_ARRAY) ? "]" : "}", 1);
+	slaxWriteNewline(swp, (fp->jsf_flags & JWF_PRETTY) ? NEWL_OUTDENT : 0);
+	break;
+    }
+
+    xmlFreeAndEasy(fp->jsf_name);
+    jsp->js_depth -= 1;
+    jsp->js_len = 0;
+
+    if (fp->jsf_kind != JSF_TOP && fp->jsf_kind != JSF_LINES
+	    && jsp->js_depth > 0) {
+	fp = &jsp->js_stack[jsp->js_depth - 1];
+	fp->jsf_sep = TRUE;
+	fp->jsf_sep_delta = delta;
+    }
+}
+
+/*
+ * Convert an XML file to JSON without building a tree, writing
+ * straight to a file descriptor.  The output is the same as
+ * slaxJsonWriteDocFd() gives for the parsed document.  Returns -1
+ * if the input can't be read or parsed.
+ */
+int
+slaxJsonWriteFileFd (int fd, const char *filename, unsigned flags)
+{
+    xmlTextReaderPtr reader;
+    json_stream_t js;
+    int rc;
+
+    reader = xmlReaderForFile(filename, NULL, XSLT_PARSE_OPTIONS);
+    if (reader == NULL)
+	return -1;
+
+    bzero(&js, sizeof(js));
+    js.js_flags = flags;
+    js.js_swp = slaxGetWriterFd(fd);
+    if (js.js_swp == NULL) {
+	xmlFreeTextReader(reader);
+	return -1;
+    }
+
+    rc = xmlTextReaderRead(reader);
+    while (rc == 1) {
+	switch (xmlTextReaderNodeType(reader)) {
+	case XML_READER_TYPE_ELEMENT:
+	    if (jsonStreamStart(&js, reader)) {
+		rc = xmlTextReaderNext(reader);
+		continue;
+	    }
+	    if (xmlTextReaderIsEmptyElement(reader))
+		jsonStreamEnd(&js);
+	    break;
+
+	case XML_READER_TYPE_END_ELEMENT:
+	    jsonStreamEnd(&js);
+	    break;
+
+	case XML_READER_TYPE_TEXT:
+	case XML_READER_TYPE_CDATA:
+	case XML_READER_TYPE_WHITESPACE:
+	case XML_READER_TYPE_SIGNIFICANT_WHITESPACE:
+	    jsonStreamText(&js, xmlTextReaderConstValue(reader));
+	    break;
+
+	case XML_READER_TYPE_COMMENT:
+	case XML_READER_TYPE_PROCESSING_INSTRUCTION:
+	    jsonStreamOther(&js);
+	    break;
+	}
+
+	rc = xmlTextReaderRead(reader);
+    }
+
+    while (js.js_depth > 0)
+	xmlFreeAndEasy(js.js_stack[--js.js_depth].jsf_name);
+
+    slaxFreeWriter(js.js_swp);
+    xmlFree(js.js_stack);
+    xmlFree(js.js_text);
+    xmlFreeTextReader(reader);
+
+    return (rc < 0) ? -1 : 0;
+}
@@ -13,13 +13,38 @@ int
 slaxJsonWriteNode (slaxWriterFunc_t func, void *data, xmlNodePtr nodep,
 		       unsigned flags);
 
+int
+slaxJsonWriteNodeBuffer (xmlBufferPtr xbuf, xmlNodePtr nodep, unsigned flags);
+
 int
 slaxJsonWriteDoc (slaxWriterFunc_t func, void *data, xmlDocPtr docp,
 		      unsigned flags);
 
+int
+slaxJsonWriteDocFd (int fd, xmlDocPtr docp, unsigned flags);
+
+int
+slaxJsonWriteFileFd (int fd, const char *filename, unsigned flags);
+
+/*
+ * Helpers for reading JSON-style XML, shared with jsonbinary.c
+ */
+const char *
+slaxJsonAttribValue (xmlNodePtr nodep, const char *name);
+
+int
+slaxJsonHasChildNodes (xmlNodePtr nodep);
+
+const char *
+slaxJsonName (xmlNodePtr nodep);
+
+const char *
+slaxJsonValue (xmlNodePtr nodep);
+
 #define JWF_ROOT	(1<<0)	/* Root node */
 #define JWF_ARRAY	(1<<1)	/* Inside array */
 #define JWF_NODESET	(1<<2)	/* Top of a nodeset */
 #define JWF_PRETTY	(1<<3)	/* Pretty print (newlines) */
 
 #define JWF_OPTIONAL_QUOTES (1<<4)	/* Don't use quotes unless needed */
+#define JWF_LINES	(1<<5)	/* Each child is a record on its own line */
@@ -27,6 +27,17 @@ struct _xsltStylesheet;
 /**
  * Turn on the SLAX XSLT document parsing hook.  This must be
  * called before SLAX files can be parsed.
+ *
+ * Thread safety: slaxEnable(), the include and extension paths, the
+ * I/O, error, and log callbacks, and the cache directory are process
+ * wide and must be set up before other threads use the library (and
+ * torn down after they are done).  Once set up, scripts may be parsed
+ * and transforms run on several threads at once, as long as each
+ * thread uses its own documents and transform contexts.  The trace
+ * and progress callbacks, the exit code, profiling data, and handles
+ * opened by the curl and db extensions belong to the calling thread.
+ * The script registry and extension loading are locked internally.
+ * The debugger is not thread safe.
  * @param enable [in] new setting for enabling slax
  */
 void slaxEnable(int enable);
@@ -51,6 +62,19 @@ int
 slaxWriteDoc(slaxWriterFunc_t func, void *data, struct _xmlDoc *docp,
 	     int partial, const char *vers);
 
+/**
+ * Write an XSLT document in SLAX format straight to a file descriptor.
+ * Output is written in large chunks, rather than a line at a time,
+ * so callers using stdio on the same descriptor should fflush() first.
+ * @param fd [in] file descriptor to write to
+ * @param docp [in] source document (XSLT stylesheet)
+ * @param partial [in] write partial (snippet) output
+ * @param vers [in] SLAX version to write, or NULL for the current one
+ * @return TRUE on success
+ */
+int
+slaxWriteDocFd(int fd, struct _xmlDoc *docp, int partial, const char *vers);
+
 /*
  * Read a SLAX stylesheet from an open file descriptor.
  * Written as a clone of libxml2's xmlCtxtReadFd().
@@ -78,6 +102,134 @@ struct _xmlDoc *
 slaxLoadBuffer (const char *filename, char *input,
 		struct _xmlDict *dict, int partial);
 
+/**
+ * Restart the numbering of the variable names the parser generates
+ * on this thread, so the next script gets the same names it would in
+ * a fresh process.  Only call this between unrelated scripts, never
+ * between a script and the files it imports or includes.  Scripts
+ * compiled by slaxScriptCacheGet() take their names from counters
+ * shared by all threads, which this leaves alone.
+ */
+void
+slaxNameReset (void);
+
+/**
+ * Read a document in binary XML ("bxml") form, as written by
+ * slaxBxmlSaveFd().  Loading skips XML parsing entirely, which makes
+ * it much cheaper than reading the same document as text.
+ *
+ * @param filename [in] name of the file, or "-" for stdin
+ * @param dict [in] libxml2 dictionary for the names, or NULL
+ * @return the document, or NULL on errors (which are reported)
+ */
+struct _xmlDoc *
+slaxBxmlLoadFile (const char *filename, struct _xmlDict *dict);
+
+/**
+ * Read a document in binary XML form from a memory buffer
+ *
+ * @param filename [in] name of the document (for its URL and errors)
+ * @param data [in] binary XML data
+ * @param len [in] length of the data
+ * @param dict [in] libxml2 dictionary for the names, or NULL
+ * @return the document, or NULL on errors (which are reported)
+ */
+struct _xmlDoc *
+slaxBxmlLoadMemory (const char *filename, const char *data, size_t len,
+		    struct _xmlDict *dict);
+
+/**
+ * Write a document in binary XML form to a file descriptor.  Output
+ * is buffered internally, so callers using stdio on the same
+ * descriptor should fflush() first.
+ *
+ * @param fd [in] file descriptor to write to
+ * @param docp [in] document to write
+ * @return zero on success, -1 on errors
+ */
+int
+slaxBxmlSaveFd (int fd, struct _xmlDoc *docp);
+
+/**
+ * Set the directory used to cache compiled SLAX scripts.  When set,
+ * slaxLoadFile() saves the XSLT it builds for each script and reuses
+ * it until the script changes.  A NULL value turns caching off.
+ *
+ * @param dir [in] cache directory (created if needed), or NULL
+ * @return zero on success, -1 if the directory cannot be created
+ */
+int
+slaxCacheSetDirectory (const char *dir);
+
+/**
+ * Return the number of cache hits and misses seen by slaxLoadFile()
+ *
+ * @param hitsp [out] number of scripts loaded from the cache
+ * @param missesp [out] number of scripts that had to be parsed
+ */
+void
+slaxCacheGetCounters (unsigned long *hitsp, unsigned long *missesp);
+
+/**
+ * Return a compiled, ready-to-apply stylesheet for a script, from
+ * the in-process registry.  The script is compiled on first use and
+ * again whenever it, or any file it imports or includes, changes.
+ * The stylesheet belongs to the registry: release it with
+ * slaxScriptCacheRelease() and do not free it.
+ *
+ * @param filename [in] name of the script (searched like an include)
+ * @return the stylesheet, or NULL if the script cannot be compiled
+ */
+struct _xsltStylesheet *
+slaxScriptCacheGet (const char *filename);
+
+/**
+ * Release a stylesheet returned by slaxScriptCacheGet()
+ *
+ * @param stylep [in] stylesheet to release
+ */
+void
+slaxScriptCacheRelease (struct _xsltStylesheet *stylep);
+
+/**
+ * Empty the registry of compiled stylesheets.  Stylesheets still in
+ * use are freed when released.
+ */
+void
+slaxScriptCacheFlush (void);
+
+/**
+ * Return the number of hits and misses in the cache of compiled
+ * expressions used by slax:evaluate() and the debugger.  The cache
+ * and its counters are kept per thread.
+ *
+ * @param hitsp [out] number of expressions found in the cache
+ * @param missesp [out] number of expressions that had to be compiled
+ */
+void
+slaxXpathCacheGetCounters (unsigned long *hitsp, unsigned long *missesp);
+
+/**
+ * Empty the calling thread's cache of compiled expressions.  Each
+ * thread has its own cache and only that thread can flush it.  A
+ * thread's cache is flushed when the thread exits, and
+ * slaxEnable(SLAX_CLEANUP) flushes the calling thread's cache.
+ */
+void
+slaxXpathCacheFlush (void);
+
+/**
+ * Return the number of superseded mutable variable containers that
+ * "while" loops have freed before the end of the transform, and the
+ * (approximate) number of bytes they held.  The counters are kept
+ * per thread.
+ *
+ * @param containersp [out] number of containers freed
+ * @param bytesp [out] bytes reclaimed
+ */
+void
+slaxMvarGetCounters (unsigned long *containersp, unsigned long *bytesp);
+
 /*
  * Prefer text expressions be stored in <xsl:text> elements
  * THIS FUNCTION IS DEPRECATED.
@@ -0,0 +1,1106 @@
+/*
+ * Copyright (c) 2013, Juniper Networks, Inc.
+ * All rights reserved.
+ * This SOFTWARE is licensed under the LICENSE provided in the
+ * ../Copyright file. By downloading, installing, copying, or otherwise
+ * using the SOFTWARE, you agree to be bound by the terms of that
+ * LICENSE.
+ *
+ * slaxbxml.c -- compact binary form of XML documents
+ *
+ * When slaxproc runs are chained, each hop serializes its result
+ * tree as text and the next one parses it again.  The binary form
+ * ("bxml") skips both: it is the tree itself, written in document
+ * order as a series of records holding length-prefixed strings, so
+ * loading is a single pass that makes nodes and copies strings, with
+ * no tokenizing, unescaping, or character checks.
+ *
+ * Names (of elements, attributes, and PIs, plus namespace prefixes
+ * and URIs) are interned: the first use of a name writes it in full
+ * and gives it the next number, and later uses write only the number.
+ * The loader keeps the dictionary's pointer for each number, so a
+ * name is read from the input and added to the document's dictionary
+ * once per file.  xmlNewDocNode() and xmlNewNsProp() still look each
+ * name up in the dictionary for every node and attribute, but that
+ * finds the existing entry rather than adding a copy.
+ *
+ * The file is "BXML" and a version byte, followed by the document's
+ * child nodes and an end record.  Each node is a record type (BXR_*)
+ * followed by:
+ *
+ *     element: name, count of namespace definitions (each a prefix
+ *         and a URI), namespace, count of attributes (each a name,
+ *         a namespace, and a value), then the child nodes and an
+ *         end record
+ *     text, CDATA, comment: string
+ *     processing instruction: name, string
+ *     entity reference: name
+ *
+ * Numbers are unsigned LEB128 varints.  A string is its length, its
+ * bytes, and a NUL, so the loader can hand it to libxml2 in place.
+ * A name is a number; if it's the next unused number, the string
+ * follows.  A prefix is zero for none, or one more than a name.
+ * A namespace is BXN_NONE, BXN_INLINE (a prefix and URI follow, to be
+ * found in scope, for namespaces the tree uses but doesn't declare),
+ * or BXN_DEFINED plus the number of its definition, counting
+ * definitions in document order.
+ *
+ * DTDs are not kept; with XSLT_PARSE_OPTIONS, entities and default
+ * attributes are already expanded in the tree.
+ */
+
+#include "slaxinternals.h"
+#include <libslax/slax.h>
+#include <libxml/parserInternals.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <inttypes.h>
+
+#define BXML_MAGIC	"BXML"
+#define BXML_MAGIC_LEN	4
+#define BXML_VERSION	1
+
+/* Record types */
+#define BXR_END		0	/* End of an element's (or the doc's) children */
+#define BXR_ELEMENT	1	/* Element */
+#define BXR_TEXT	2	/* Text */
+#define BXR_TEXT_NOENC	3	/* Text with output escaping disabled */
+#define BXR_CDATA	4	/* CDATA section */
+#define BXR_COMMENT	5	/* Comment */
+#define BXR_PI		6	/* Processing instruction */
+#define BXR_ENTITY_REF	7	/* Entity reference */
+
+/* Namespace references */
+#define BXN_NONE	0	/* No namespace */
+#define BXN_INLINE	1	/* Prefix and URI follow */
+#define BXN_DEFINED	2	/* Plus the number of the definition */
+
+#define BXML_OUTSIZ	(64 * 1024) /* Size of the output buffer */
+#define BXML_HASHSIZ	256	/* Initial size of the writer's hashes */
+#define BXML_TABLESIZ	64	/* Initial size of the loader's tables */
+
+/*
+ * The writer numbers names and namespace definitions with a pair of
+ * open hashes; names are keyed by their string and namespaces by
+ * their address.
+ */
+typedef struct bxml_hash_entry_s {
+    const void *bhe_key;	/* Name or xmlNsPtr (NULL for free slots) */
+    unsigned bhe_hash;		/* Hash value of bhe_key */
+    unsigned bhe_id;		/* Number we've given it */
+} bxml_hash_entry_t;
+
+typedef struct bxml_hash_s {
+    bxml_hash_entry_t *bh_table; /* Slots */
+    unsigned bh_size;		/* Number of slots (a power of two) */
+    unsigned bh_count;		/* Number of slots in use */
+    int bh_strings;		/* Keys are strings */
+} bxml_hash_t;
+
+typedef struct bxml_writer_s {
+    int bw_fd;			/* File descriptor to write to */
+    int bw_errors;		/* Write errors */
+    size_t bw_len;		/* Bytes in bw_buf */
+    bxml_hash_t bw_names;	/* Names we've written */
+    bxml_hash_t bw_ns;		/* Namespace definitions we've written */
+    unsigned char bw_buf[BXML_OUTSIZ]; /* Output buffer */
+} bxml_writer_t;
+
+typedef struct bxml_reader_s {
+    const char *br_filename;	/* Name of the input (for errors) */
+    const unsigned char *br_start; /* Start of input */
+    const unsigned char *br_cp;	/* Current position */
+    const unsigned char *br_end; /* End of input */
+    xmlDocPtr br_docp;		/* Document we're building */
+    const xmlChar **br_names;	/* Names, by number */
+    unsigned br_names_count;	/* Number of names */
+    unsigned br_names_size;	/* Size of br_names */
+    xmlNsPtr *br_ns;		/* Namespace definitions, by number */
+    unsigned br_ns_count;	/* Number of definitions */
+    unsigned br_ns_size;	/* Size of br_ns */
+    int br_errors;		/* Errors seen */
+} bxml_reader_t;
+
+/*
+ * Hash a name (FNV-1a)
+ */
+static unsigned
+slaxBxmlHashString (const xmlChar *str)
+{
+    unsigned hash = 2166136261U;
+
+    for ( ; *str; str++) {
+	hash ^= *str;
+	hash *= 16777619U;
+    }
+
+    return hash;
+}
+
+static unsigned
+slaxBxmlHashPointer (const void *ptr)
+{
+    uintptr_t val = (uintptr_t) ptr;
+
+    val ^= val >> 17;
+    return (unsigned) (val * 2654435761U);
+}
+
+static int
+slaxBxmlHashInit (bxml_hash_t *bhp, int strings)
+{
+    bhp->bh_table = xmlMalloc(BXML_HASHSIZ * sizeof(*bhp->bh_table));
+    if (bhp->bh_table == NULL)
+	return -1;
+
+    bzero(bhp->bh_table, BXML_HASHSIZ * sizeof(*bhp->bh_table));
+    bhp->bh_size = BXML_HASHSIZ;
+    bhp->bh_count = 0;
+    bhp->bh_strings = strings;
+    return 0;
+}
+
+/*
+ * Find the slot for a key: either the slot holding it or the free
+ * slot where it belongs
+ */
+static bxml_hash_entry_t *
+slaxBxmlHashFind (bxml_hash_t *bhp, const void *key, unsigned hash)
+{
+    unsigned mask = bhp->bh_size - 1;
+    unsigned slot = hash & mask;
+    bxml_hash_entry_t *bhep;
+
+    for (;;) {
+	bhep = &bhp->bh_table[slot];
+	if (bhep->bhe_key == NULL)
+	    return bhep;
+
+	if (bhep->bhe_hash == hash
+	        && (bhep->bhe_key == key
+		    || (bhp->bh_strings
+			&& xmlStrEqual(bhep->bhe_key, key))))
+	    return bhep;
+
+	slot = (slot + 1) & mask;
+    }
+}
+
+/*
+ * Double the size of a hash, keeping it at most half full
+ */
+static int
+slaxBxmlHashGrow (bxml_hash_t *bhp)
+{
+    bxml_hash_entry_t *old = bhp->bh_table, *bhep;
+    unsigned size = bhp->bh_size, i;
+
+    bhp->bh_table = xmlMalloc(size * 2 * sizeof(*bhp->bh_table));
+    if (bhp->bh_table == NULL) {
+	bhp->bh_table = old;
+	return -1;
+    }
+
+    bzero(bhp->bh_table, size * 2 * sizeof(*bhp->bh_table));
+    bhp->bh_size = size * 2;
+
+    for (i = 0; i < size; i++) {
+	if (old[i].bhe_key == NULL)
+	    continue;
+	bhep = slaxBxmlHashFind(bhp, old[i].bhe_key, old[i].bhe_hash);
+	*bhep = old[i];
+    }
+
+    xmlFree(old);
+    return 0;
+}
+
+/*
+ * Write data to our file descriptor
+ */
+static void
+slaxBxmlWrite (bxml_writer_t *bwp, const unsigned char *data, size_t len)
+{
+    ssize_t rc;
+
+    while (len > 0 && bwp->bw_errors == 0) {
+	rc = write(bwp->bw_fd, data, len);
+	if (rc < 0) {
+	    if (errno == EINTR)
+		continue;
+	    bwp->bw_errors += 1;
+	    break;
+	}
+
+	data += rc;
+	len -= rc;
+    }
+}
+
+static void
+slaxBxmlFlush (bxml_writer_t *bwp)
+{
+    slaxBxmlWrite(bwp, bwp->bw_buf, bwp->bw_len);
+    bwp->bw_len = 0;
+}
+
+static void
+slaxBxmlPut (bxml_writer_t *bwp, const void *data, size_t len)
+{
+    if (bwp->bw_len + len > sizeof(bwp->bw_buf)) {
+	slaxBxmlFlush(bwp);
+
+	/* Big strings go straight out */
+	if (len >= sizeof(bwp->bw_buf)) {
+	    slaxBxmlWrite(bwp, data, len);
+	    return;
+	}
+    }
+
+    memcpy(bwp->bw_buf + bwp->bw_len, data, len);
+    bwp->bw_len += len;
+}
+
+static void
+slaxBxmlPutByte (bxml_writer_t *bwp, unsigned char val)
+{
+    if (bwp->bw_len == sizeof(bwp->bw_buf))
+	slaxBxmlFlush(bwp);
+
+    bwp->bw_buf[bwp->bw_len++] = val;
+}
+
+static void
+slaxBxmlPutNumber (bxml_writer_t *bwp, uint64_t val)
+{
+    unsigned char buf[10];
+    size_t len = 0;
+
+    if (val < 0x80) {
+	slaxBxmlPutByte(bwp, val);
+	return;
+    }
+
+    do {
+	buf[len] = val & 0x7f;
+	val >>= 7;
+	if (val)
+	    buf[len] |= 0x80;
+	len += 1;
+    } while (val);
+
+    slaxBxmlPut(bwp, buf, len);
+}
+
+static void
+slaxBxmlPutString (bxml_writer_t *bwp, const xmlChar *str)
+{
+    size_t len;
+
+    if (str == NULL)
+	str = (const xmlChar *) "";
+
+    len = strlen((const char *) str);
+    slaxBxmlPutNumber(bwp, len);
+    slaxBxmlPut(bwp, str, len + 1); /* Include the NUL */
+}
+
+/*
+ * Write a name, as its number if we've seen it before.  For an
+ * optional name (a prefix), NULL is written as zero and the
+ * numbers are one higher.
+ */
+static void
+slaxBxmlPutName (bxml_writer_t *bwp, const xmlChar *name, int optional)
+{
+    bxml_hash_t *bhp = &bwp->bw_names;
+    bxml_hash_entry_t *bhep;
+    unsigned hash;
+
+    if (name == NULL) {
+	if (optional) {
+	    slaxBxmlPutNumber(bwp, 0);
+	    return;
+	}
+	name = (const xmlChar *) "";
+    }
+
+    if ((bhp->bh_count + 1) * 2 > bhp->bh_size && slaxBxmlHashGrow(bhp)) {
+	bwp->bw_errors += 1;
+	return;
+    }
+
+    hash = slaxBxmlHashString(name);
+    bhep = slaxBxmlHashFind(bhp, name, hash);
+    if (bhep->bhe_key) {
+	slaxBxmlPutNumber(bwp, bhep->bhe_id + (optional ? 1 : 0));
+	return;
+    }
+
+    bhep->bhe_key = name;
+    bhep->bhe_hash = hash;
+    bhep->bhe_id = bhp->bh_count++;
+
+    slaxBxmlPutNumber(bwp, bhep->bhe_id + (optional ? 1 : 0));
+    slaxBxmlPutString(bwp, name);
+}
+
+/*
+ * Write a namespace definition, giving it the next number
+ */
+static void
+slaxBxmlPutNsDef (bxml_writer_t *bwp, xmlNsPtr ns)
+{
+    bxml_hash_t *bhp = &bwp->bw_ns;
+    bxml_hash_entry_t *bhep;
+    unsigned hash;
+
+    if ((bhp->bh_count + 1) * 2 > bhp->bh_size && slaxBxmlHashGrow(bhp)) {
+	bwp->bw_errors += 1;
+	return;
+    }
+
+    hash = slaxBxmlHashPointer(ns);
+    bhep = slaxBxmlHashFind(bhp, ns, hash);
+    if (bhep->bhe_key == NULL) {
+	bhep->bhe_key = ns;
+	bhep->bhe_hash = hash;
+    }
+    bhep->bhe_id = bhp->bh_count++; /* The loader numbers each one */
+
+    slaxBxmlPutName(bwp, ns->prefix, TRUE);
+    slaxBxmlPutName(bwp, ns->href, FALSE);
+}
+
+/*
+ * Write a reference to the namespace of an element or attribute
+ */
+static void
+slaxBxmlPutNs (bxml_writer_t *bwp, xmlNsPtr ns)
+{
+    bxml_hash_entry_t *bhep;
+
+    if (ns == NULL) {
+	slaxBxmlPutNumber(bwp, BXN_NONE);
+	return;
+    }
+
+    bhep = slaxBxmlHashFind(&bwp->bw_ns, ns, slaxBxmlHashPointer(ns));
+    if (bhep->bhe_key) {
+	slaxBxmlPutNumber(bwp, BXN_DEFINED + bhep->bhe_id);
+	return;
+    }
+
+    /* Not defined in the tree (e.g. the "xml" namespace) */
+    slaxBxmlPutNumber(bwp, BXN_INLINE);
+    slaxBxmlPutName(bwp, ns->prefix, TRUE);
+    slaxBxmlPutName(bwp, ns->href, FALSE);
+}
+
+static void
+slaxBxmlPutElement (bxml_writer_t *bwp, xmlNodePtr nodep)
+{
+    xmlNsPtr ns;
+    xmlAttrPtr attr;
+    xmlChar *value;
+    unsigned count;
+
+    slaxBxmlPutByte(bwp, BXR_ELEMENT);
+    slaxBxmlPutName(bwp, nodep->name, FALSE);
+
+    count = 0;
+    for (ns = nodep->nsDef; ns; ns = ns->next)
+	count += 1;
+    slaxBxmlPutNumber(bwp, count);
+    for (ns = nodep->nsDef; ns; ns = ns->next)
+	slaxBxmlPutNsDef(bwp, ns);
+
+    slaxBxmlPutNs(bwp, nodep->ns);
+
+    count = 0;
+    for (attr = nodep->properties; attr; attr = attr->next)
+	count += 1;
+    slaxBxmlPutNumber(bwp, count);
+
+    for (attr = nodep->properties; attr; attr = attr->next) {
+	slaxBxmlPutName(bwp, attr->name, FALSE);
+	slaxBxmlPutNs(bwp, attr->ns);
+
+	/* The common case is a single text node we can use as is */
+	if (attr->children == NULL)
+	    slaxBxmlPutString(bwp, NULL);
+	else if (attr->children->type == XML_TEXT_NODE
+		 && attr->children->next == NULL)
+	    slaxBxmlPutString(bwp, attr->children->content);
+	else {
+	    value = xmlNodeGetContent((xmlNodePtr) attr);
+	    slaxBxmlPutString(bwp, value);
+	    xmlFree(value);
+	}
+    }
+}
+
+/*
+ * Write the record for a node, returning TRUE for elements, whose
+ * children and end record follow
+ */
+static int
+slaxBxmlPutNode (bxml_writer_t *bwp, xmlNodePtr nodep)
+{
+    switch (nodep->type) {
+    case XML_ELEMENT_NODE:
+	slaxBxmlPutElement(bwp, nodep);
+	return TRUE;
+
+    case XML_TEXT_NODE:
+	slaxBxmlPutByte(bwp, (nodep->name == xmlStringTextNoenc)
+			? BXR_TEXT_NOENC : BXR_TEXT);
+	slaxBxmlPutString(bwp, nodep->content);
+	break;
+
+    case XML_CDATA_SECTION_NODE:
+	slaxBxmlPutByte(bwp, BXR_CDATA);
+	slaxBxmlPutString(bwp, nodep->content);
+	break;
+
+    case XML_COMMENT_NODE:
+	slaxBxmlPutByte(bwp, BXR_COMMENT);
+	slaxBxmlPutString(bwp, nodep->content);
+	break;
+
+    case XML_PI_NODE:
+	slaxBxmlPutByte(bwp, BXR_PI);
+	slaxBxmlPutName(bwp, nodep->name, FALSE);
+	slaxBxmlPutString(bwp, nodep->content);
+	break;
+
+    case XML_ENTITY_REF_NODE:
+	slaxBxmlPutByte(bwp, BXR_ENTITY_REF);
+	slaxBxmlPutName(bwp, nodep->name, FALSE);
+	break;
+
+    default:
+	/* DTDs and XInclude markers aren't kept */
+	break;
+    }
+
+    return FALSE;
+}
+
+/*
+ * Write a document in binary form to a file descriptor.  Returns -1
+ * on errors.
+ */
+int
+slaxBxmlSaveFd (int fd, xmlDocPtr docp)
+{
+    bxml_writer_t *bwp;
+    xmlNodePtr nodep;
+    unsigned depth = 0;
+    int rc;
+
+    bwp = xmlMalloc(sizeof(*bwp));
+    if (bwp == NULL)
+	return -1;
+
+    bzero(bwp, sizeof(*bwp));
+    bwp->bw_fd = fd;
+
+    if (slaxBxmlHashInit(&bwp->bw_names, TRUE)
+	    || slaxBxmlHashInit(&bwp->bw_ns, FALSE)) {
+	xmlFree(bwp->bw_names.bh_table);
+	xmlFree(bwp);
+	return -1;
+    }
+
+    slaxBxmlPut(bwp, BXML_MAGIC, BXML_MAGIC_LEN);
+    slaxBxmlPutByte(bwp, BXML_VERSION);
+
+    /* Walk the tree in document order, without recursing */
+    nodep = docp->children;
+    while (nodep) {
+	if (slaxBxmlPutNode(bwp, nodep)) {
+	    if (nodep->children) {
+		depth += 1;
+		nodep = nodep->children;
+		continue;
+	    }
+	    slaxBxmlPutByte(bwp, BXR_END);
+	}
+
+	while (nodep->next == NULL && depth > 0) {
+	    nodep = nodep->parent;
+	    depth -= 1;
+	    slaxBxmlPutByte(bwp, BXR_END);
+	}
+
+	nodep = nodep->next;
+    }
+
+    slaxBxmlPutByte(bwp, BXR_END);
+    slaxBxmlFlush(bwp);
+
+    rc = bwp->bw_errors ? -1 : 0;
+
+    xmlFree(bwp->bw_names.bh_table);
+    xmlFree(bwp->bw_ns.bh_table);
+    xmlFree(bwp);
+
+    return rc;
+}
+
+static void
+slaxBxmlError (bxml_reader_t *brp, const char *fmt, ...)
+{
+    char buf[BUFSIZ];
+    va_list vap;
+
+    va_start(vap, fmt);
+    vsnprintf(buf, sizeof(buf), fmt, vap);
+    va_end(vap);
+
+    slaxError("%s: offset %lu: %s", brp->br_filename,
+	      (unsigned long) (brp->br_cp - brp->br_start), buf);
+    brp->br_errors += 1;
+}
+
+static int
+slaxBxmlGetNumber (bxml_reader_t *brp, uint64_t *valp)
+{
+    const unsigned char *cp = brp->br_cp;
+    uint64_t val = 0;
+    unsigned shift;
+
+    if (cp < brp->br_end && *cp < 0x80) {
+	*valp = *cp;
+	brp->br_cp = cp + 1;
+	return 0;
+    }
+
+    for (shift = 0; cp < brp->br_end && shift < 64; shift += 7) {
+	val |= (uint64_t) (*cp & 0x7f) << shift;
+	if ((*cp++ & 0x80) == 0) {
+	    *valp = val;
+	    brp->br_cp = cp;
+	    return 0;
+	}
+    }
+
+    slaxBxmlError(brp, "invalid number");
+    return -1;
+}
+
+/*
+ * Return a string from the input, in place
+ */
+static const xmlChar *
+slaxBxmlGetString (bxml_reader_t *brp, size_t *lenp)
+{
+    const unsigned char *cp;
+    uint64_t len;
+
+    if (slaxBxmlGetNumber(brp, &len))
+	return NULL;
+
+    cp = brp->br_cp;
+    if (len >= (uint64_t) (brp->br_end - cp) || cp[len] != '\0') {
+	slaxBxmlError(brp, "invalid string");
+	return NULL;
+    }
+
+    brp->br_cp = cp + len + 1;
+    if (lenp)
+	*lenp = len;
+    return cp;
+}
+
+/*
+ * Return a name, from our table or (for a new one) from the input.
+ * An optional name returns NULL (and no error) when there's none.
+ */
+static const xmlChar *
+slaxBxmlGetName (bxml_reader_t *brp, int optional, int *errp)
+{
+    const xmlChar *str, *name, **names;
+    uint64_t num;
+    size_t len;
+    unsigned size;
+
+    *errp = TRUE;
+
+    if (slaxBxmlGetNumber(brp, &num))
+	return NULL;
+
+    if (optional) {
+	if (num == 0) {
+	    *errp = FALSE;
+	    return NULL;
+	}
+	num -= 1;
+    }
+
+    if (num < brp->br_names_count) {
+	*errp = FALSE;
+	return brp->br_names[num];
+    }
+
+    if (num != brp->br_names_count) {
+	slaxBxmlError(brp, "invalid name reference");
+	return NULL;
+    }
+
+    str = slaxBxmlGetString(brp, &len);
+    if (str == NULL)
+	return NULL;
+
+    if (len > INT_MAX) {
+	slaxBxmlError(brp, "name too long");
+	return NULL;
+    }
+
+    name = xmlDictLookup(brp->br_docp->dict, str, len);
+    if (name == NULL) {
+	slaxBxmlError(brp, "out of memory");
+	return NULL;
+    }
+
+    if (brp->br_names_count == brp->br_names_size) {
+	size = brp->br_names_size ? brp->br_names_size * 2 : BXML_TABLESIZ;
+	names = xmlRealloc(brp->br_names, size * sizeof(*names));
+	if (names == NULL) {
+	    slaxBxmlError(brp, "out of memory");
+	    return NULL;
+	}
+	brp->br_names = names;
+	brp->br_names_size = size;
+    }
+
+    brp->br_names[brp->br_names_count++] = name;
+    *errp = FALSE;
+    return name;
+}
+
+static int
+slaxBxmlAddNs (bxml_reader_t *brp, xmlNsPtr ns)
+{
+    xmlNsPtr *table;
+    unsigned size;
+
+    if (brp->br_ns_count == brp->br_ns_size) {
+	size = brp->br_ns_size ? brp->br_ns_size * 2 : BXML_TABLESIZ;
+	table = xmlRealloc(brp->br_ns, size * sizeof(*table));
+	if (table == NULL) {
+	    slaxBxmlError(brp, "out of memory");
+	    return -1;
+	}
+	brp->br_ns = table;
+	brp->br_ns_size = size;
+    }
+
+    brp->br_ns[brp->br_ns_count++] = ns;
+    return 0;
+}
+
+/*
+ * Read a namespace reference for a node (or its attribute)
+ */
+static int
+slaxBxmlGetNs (bxml_reader_t *brp, xmlNodePtr nodep, xmlNsPtr *nsp)
+{
+    const xmlChar *prefix, *href;
+    uint64_t num;
+    int err;
+
+    *nsp = NULL;
+
+    if (slaxBxmlGetNumber(brp, &num))
+	return -1;
+
+    if (num == BXN_NONE)
+	return 0;
+
+    if (num == BXN_INLINE) {
+	prefix = slaxBxmlGetName(brp, TRUE, &err);
+	if (err)
+	    return -1;
+	href = slaxBxmlGetName(brp, FALSE, &err);
+	if (err)
+	    return -1;
+
+	*nsp = xmlSearchNsByHref(brp->br_docp, nodep, href);
+	if (*nsp == NULL)
+	    *nsp = xmlNewNs(nodep, href, prefix);
+	if (*nsp == NULL) {
+	    slaxBxmlError(brp, "invalid namespace '%s'", href);
+	    return -1;
+	}
+	return 0;
+    }
+
+    num -= BXN_DEFINED;
+    if (num >= brp->br_ns_count) {
+	slaxBxmlError(brp, "invalid namespace reference");
+	return -1;
+    }
+
+    *nsp = brp->br_ns[num];
+    return 0;
+}
+
+/*
+ * Append a node to its parent.  The document is treated as a node,
+ * as libxml2 does; the two structures start with the same fields.
+ */
+static void
+slaxBxmlLink (xmlNodePtr parent, xmlNodePtr nodep)
+{
+    nodep->parent = parent;
+
+    if (parent->last) {
+	parent->last->next = nodep;
+	nodep->prev = parent->last;
+    } else
+	parent->children = nodep;
+
+    parent->last = nodep;
+}
+
+/*
+ * Read an element record (after its type), returning the element
+ */
+static xmlNodePtr
+slaxBxmlGetElement (bxml_reader_t *brp, xmlNodePtr parent)
+{
+    xmlDocPtr docp = brp->br_docp;
+    const xmlChar *name, *prefix, *href, *value;
+    xmlNodePtr nodep;
+    xmlNsPtr ns;
+    uint64_t count;
+    int err;
+
+    name = slaxBxmlGetName(brp, FALSE, &err);
+    if (err)
+	return NULL;
+
+    nodep = xmlNewDocNode(docp, NULL, name, NULL);
+    if (nodep == NULL) {
+	slaxBxmlError(brp, "out of memory");
+	return NULL;
+    }
+
+    /* Link it first, so namespace lookups can see its ancestors */
+    slaxBxmlLink(parent, nodep);
+
+    if (slaxBxmlGetNumber(brp, &count))
+	return NULL;
+
+    for ( ; count > 0; count--) {
+	prefix = slaxBxmlGetName(brp, TRUE, &err);
+	if (err)
+	    return NULL;
+	href = slaxBxmlGetName(brp, FALSE, &err);
+	if (err)
+	    return NULL;
+
+	ns = xmlNewNs(nodep, href, prefix);
+	if (ns == NULL)		/* A redundant definition of "xml" */
+	    ns = xmlSearchNsByHref(docp, nodep, href);
+	if (ns == NULL) {
+	    slaxBxmlError(brp, "invalid namespace '%s'", href);
+	    return NULL;
+	}
+
+	if (slaxBxmlAddNs(brp, ns))
+	    return NULL;
+    }
+
+    if (slaxBxmlGetNs(brp, nodep, &nodep->ns))
+	return NULL;
+
+    if (slaxBxmlGetNumber(brp, &count))
+	return NULL;
+
+    for ( ; count > 0; count--) {
+	name = slaxBxmlGetName(brp, FALSE, &err);
+	if (err)
+	    return NULL;
+	if (slaxBxmlGetNs(brp, nodep, &ns))
+	    return NULL;
+	value = slaxBxmlGetString(brp, NULL);
+	if (value == NULL)
+	    return NULL;
+
+	if (xmlNewNsProp(nodep, ns, name, value) == NULL) {
+	    slaxBxmlError(brp, "out of memory");
+	    return NULL;
+	}
+    }
+
+    return nodep;
+}
+
+/*
+ * Make a text node for a string that isn't whitespace.  Short
+ * strings are kept in the node itself, in the space used by
+ * properties and nsDef, as libxml2's parser does with
+ * XML_PARSE_COMPACT; this saves an allocation for most leaf values.
+ */
+static xmlNodePtr
+slaxBxmlNewShortText (xmlDocPtr docp, const xmlChar *str, size_t len)
+{
+    xmlNodePtr nodep;
+
+    if (len >= 2 * sizeof(void *))
+	return xmlNewDocTextLen(docp, str, len);
+
+    nodep = xmlNewDocText(docp, NULL);
+    if (nodep) {
+	nodep->content = (xmlChar *) &nodep->properties;
+	memcpy(nodep->content, str, len + 1); /* Our strings end in a NUL */
+    }
+
+    return nodep;
+}
+
+/*
+ * Build the document from the records in the input
+ */
+static int
+slaxBxmlGetTree (bxml_reader_t *brp)
+{
+    xmlDocPtr docp = brp->br_docp;
+    xmlNodePtr parent = (xmlNodePtr) docp, nodep;
+    const xmlChar *str, *name;
+    size_t len;
+    int type, err;
+
+    while (brp->br_cp < brp->br_end) {
+	type = *brp->br_cp++;
+
+	switch (type) {
+	case BXR_END:
+	    if (parent == (xmlNodePtr) docp) {
+		if (brp->br_cp != brp->br_end) {
+		    slaxBxmlError(brp, "extra data after document");
+		    return -1;
+		}
+		return 0;
+	    }
+	    parent = parent->parent;
+	    continue;
+
+	case BXR_ELEMENT:
+	    nodep = slaxBxmlGetElement(brp, parent);
+	    if (nodep == NULL)
+		return -1;
+	    parent = nodep;
+	    continue;
+
+	case BXR_TEXT:
+	case BXR_TEXT_NOENC:
+	case BXR_CDATA:
+	case BXR_COMMENT:
+	    str = slaxBxmlGetString(brp, &len);
+	    if (str == NULL)
+		return -1;
+
+	    if (len > INT_MAX) {
+		slaxBxmlError(brp, "string too long");
+		return -1;
+	    }
+
+	    if (type == BXR_CDATA)
+		nodep = xmlNewCDataBlock(docp, str, len);
+	    else if (type == BXR_COMMENT)
+		nodep = xmlNewDocComment(docp, str);
+	    else {
+		nodep = slaxBxmlNewShortText(docp, str, len);
+		if (nodep && type == BXR_TEXT_NOENC)
+		    nodep->name = xmlStringTextNoenc;
+	    }
+	    break;
+
+	case BXR_PI:
+	    name = slaxBxmlGetName(brp, FALSE, &err);
+	    if (err)
+		return -1;
+	    str = slaxBxmlGetString(brp, NULL);
+	    if (str == NULL)
+		return -1;
+
+	    nodep = xmlNewDocPI(docp, name, str);
+	    break;
+
+	case BXR_ENTITY_REF:
+	    name = slaxBxmlGetName(brp, FALSE, &err);
+	    if (err)
+		return -1;
+
+	    nodep = xmlNewReference(docp, name);
+	    break;
+
+	default:
+	    brp->br_cp -= 1;
+	    slaxBxmlError(brp, "invalid record type %d", type);
+	    return -1;
+	}
+
+	if (nodep == NULL) {
+	    slaxBxmlError(brp, "out of memory");
+	    return -1;
+	}
+
+	slaxBxmlLink(parent, nodep);
+    }
+
+    slaxBxmlError(brp, "unexpected end of input");
+    return -1;
+}
+
+/*
+ * Build a document from binary XML held in memory.  The filename
+ * becomes the document's URL and is used in error messages.  If
+ * dict is given, the document's names are kept there.
+ */
+xmlDocPtr
+slaxBxmlLoadMemory (const char *filename, const char *data, size_t len,
+		    xmlDictPtr dict)
+{
+    bxml_reader_t br;
+    xmlDocPtr docp;
+
+    bzero(&br, sizeof(br));
+    br.br_filename = filename ?: "input";
+    br.br_start = br.br_cp = (const unsigned char *) data;
+    br.br_end = br.br_start + len;
+
+    if (len < BXML_MAGIC_LEN + 1
+	    || memcmp(data, BXML_MAGIC, BXML_MAGIC_LEN) != 0) {
+	slaxBxmlError(&br, "not a binary XML document");
+	return NULL;
+    }
+
+    br.br_cp += BXML_MAGIC_LEN;
+    if (*br.br_cp != BXML_VERSION) {
+	slaxBxmlError(&br, "unsupported binary XML version %u", *br.br_cp);
+	return NULL;
+    }
+    br.br_cp += 1;
+
+    docp = xmlNewDoc((const xmlChar *) XML_DEFAULT_VERSION);
+    if (docp == NULL)
+	return NULL;
+
+    if (dict) {
+	docp->dict = dict;
+	xmlDictReference(dict);
+    } else
+	docp->dict = xmlDictCreate();
+
+    if (filename && !slaxFilenameIsStd(filename))
+	docp->URL = xmlStrdup((const xmlChar *) filename);
+
+    br.br_docp = docp;
+
+    if (docp->dict == NULL || slaxBxmlGetTree(&br)) {
+	xmlFreeDoc(docp);
+	docp = NULL;
+    }
+
+    xmlFree(br.br_names);
+    xmlFree(br.br_ns);
+
+    return docp;
+}
+
+/*
+ * Read all of a stream (like stdin or a pipe) into memory
+ */
+static char *
+slaxBxmlReadAll (int fd, size_t *lenp)
+{
+    char *buf = NULL, *newp;
+    size_t len = 0, size = 0;
+    ssize_t rc;
+
+    for (;;) {
+	if (len == size) {
+	    size = size ? size * 2 : BXML_OUTSIZ;
+	    newp = xmlRealloc(buf, size);
+	    if (newp == NULL) {
+		xmlFree(buf);
+		return NULL;
+	    }
+	    buf = newp;
+	}
+
+	rc = read(fd, buf + len, size - len);
+	if (rc == 0)
+	    break;
+	if (rc < 0) {
+	    if (errno == EINTR)
+		continue;
+	    xmlFree(buf);
+	    return NULL;
+	}
+	len += rc;
+    }
+
+    *lenp = len;
+    return buf;
+}
+
+/*
+ * Build a document from a binary XML file ("-" for stdin).  Regular
+ * files are mapped rather than read.
+ */
+xmlDocPtr
+slaxBxmlLoadFile (const char *filename, xmlDictPtr dict)
+{
+    struct stat st;
+    xmlDocPtr docp;
+    void *map;
+    char *buf;
+    size_t len;
+    int fd;
+
+    if (slaxFilenameIsStd(filename))
+	fd = 0;
+    else {
+	fd = open(filename, O_RDONLY);
+	if (fd < 0) {
+	    slaxError("%s: %s", filename, strerror(errno));
+	    return NULL;
+	}
+    }
+
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (map != MAP_FAILED) {
+	    docp = slaxBxmlLoadMemory(filename, map, st.st_size, dict);
+	    munmap(map, st.st_size);
+	    if (fd != 0)
+		close(fd);
+	    return docp;
+	}
+    }
+
+    buf = slaxBxmlReadAll(fd, &len);
+    if (fd != 0)
+	close(fd);
+
+    if (buf == NULL) {
+	slaxError("%s: %s", filename, strerror(errno));
+	return NULL;
+    }
+
+    docp = slaxBxmlLoadMemory(filename, buf, len, dict);
+    xmlFree(buf);
+
+    return docp;
+}
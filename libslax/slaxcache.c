@@ -0,0 +1,497 @@
+/*
+ * Copyright (c) 2013, Juniper Networks, Inc.
+ * All rights reserved.
+ * This SOFTWARE is licensed under the LICENSE provided in the
+ * ../Copyright file. By downloading, installing, copying, or otherwise
+ * using the SOFTWARE, you agree to be bound by the terms of that
+ * LICENSE.
+ *
+ * slaxcache.c -- persistent cache of compiled SLAX scripts
+ *
+ * Turning a SLAX script into an XSLT tree means running the lexer,
+ * the bison grammar, and all the post-parse rewrites.  Reading the
+ * equivalent XSLT with libxml2's parser is far cheaper, so when a
+ * cache directory is configured, slaxLoadFile() saves the XSLT tree
+ * it builds and later loads reuse it without touching the lexer.
+ *
+ * Each cache entry is a file named after a hash of the script's path
+ * and the libslax version, holding a one line header, a table of line
+ * numbers, and the XSLT document.  The header records the libslax
+ * version that made the entry, and the script's mtime (to the
+ * nanosecond), size, and a hash of its contents.  A matching mtime
+ * and size is a hit without reading the script; otherwise the script
+ * contents are hashed and compared, and on a match the header is
+ * rewritten so later loads don't hash again.  Where nanoseconds
+ * aren't available, or the script changed in the same second the
+ * entry was written, the header doesn't record them and the next load
+ * always checks the hash.  Imported and included scripts are loaded
+ * through slaxLoadFile() as well, so each gets its own entry and is
+ * validated on its own.
+ *
+ * The line numbers of the XSLT elements are not part of the XML, so
+ * they are saved in document order in the line table and restored
+ * when the entry is loaded, keeping error messages and the debugger
+ * pointing at the SLAX source.
+ */
+
+#include "slaxinternals.h"
+#include <libslax/slax.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <time.h>
+
+#define SLAX_CACHE_MAGIC	"slax-cache"
+#define SLAX_CACHE_VERSION	2
+#define SLAX_CACHE_SUFFIX	".xsl"
+
+#define FNV_OFFSET_BASIS	0xcbf29ce484222325ULL
+#define FNV_PRIME		0x100000001b3ULL
+
+static char *slaxCacheDir;	/* Directory holding cache entries */
+static unsigned long slaxCacheHits; /* Number of cache hits */
+static unsigned long slaxCacheMisses; /* Number of cache misses */
+static slax_mutex_t slaxCacheLock = SLAX_MUTEX_INITIALIZER; /* Counters */
+
+/*
+ * Set (or clear, if dir is NULL) the directory used to hold cache
+ * entries.  The directory is created if it does not exist.
+ */
+int
+slaxCacheSetDirectory (const char *dir)
+{
+    if (slaxCacheDir) {
+	xmlFree(slaxCacheDir);
+	slaxCacheDir = NULL;
+    }
+
+    if (dir == NULL)
+	return 0;
+
+    if (mkdir(dir, 0755) < 0 && errno != EEXIST) {
+	slaxLog("slax: cache: cannot create '%s': %s", dir, strerror(errno));
+	return -1;
+    }
+
+    slaxCacheDir = (char *) xmlStrdup((const xmlChar *) dir);
+    return slaxCacheDir ? 0 : -1;
+}
+
+/*
+ * Return the hit and miss counters
+ */
+void
+slaxCacheGetCounters (unsigned long *hitsp, unsigned long *missesp)
+{
+    slaxMutexLock(&slaxCacheLock);
+    if (hitsp)
+	*hitsp = slaxCacheHits;
+    if (missesp)
+	*missesp = slaxCacheMisses;
+    slaxMutexUnlock(&slaxCacheLock);
+}
+
+/*
+ * Fold a buffer into an FNV-1a hash value
+ */
+static uint64_t
+slaxCacheHash (uint64_t hash, const void *buf, size_t len)
+{
+    const unsigned char *cp = buf;
+
+    for ( ; len > 0; len--, cp++) {
+	hash ^= *cp;
+	hash *= FNV_PRIME;
+    }
+
+    return hash;
+}
+
+/*
+ * Return the nanoseconds part of a file's mtime, or -1 if the
+ * platform doesn't give us one
+ */
+long
+slaxCacheMtimeNsec (struct stat *stp UNUSED)
+{
+#if defined(HAVE_STRUCT_STAT_ST_MTIM_TV_NSEC)
+    return stp->st_mtim.tv_nsec;
+#elif defined(HAVE_STRUCT_STAT_ST_MTIMESPEC_TV_NSEC)
+    return stp->st_mtimespec.tv_nsec;
+#else
+    return -1;
+#endif
+}
+
+/*
+ * Hash the contents of an open file, leaving the file rewound
+ */
+static int
+slaxCacheHashFile (FILE *file, uint64_t *hashp)
+{
+    char buf[BUFSIZ * 4];
+    uint64_t hash = FNV_OFFSET_BASIS;
+    size_t len;
+
+    while ((len = fread(buf, 1, sizeof(buf), file)) > 0)
+	hash = slaxCacheHash(hash, buf, len);
+
+    if (ferror(file))
+	return TRUE;
+
+    rewind(file);
+    *hashp = hash;
+    return FALSE;
+}
+
+/*
+ * Record line numbers of all elements under nodep, in document order
+ */
+static void
+slaxCacheSaveLines (FILE *fp, xmlNodePtr nodep)
+{
+    for ( ; nodep; nodep = nodep->next) {
+	if (nodep->type != XML_ELEMENT_NODE)
+	    continue;
+
+	fprintf(fp, " %u", nodep->line);
+	slaxCacheSaveLines(fp, nodep->children);
+    }
+}
+
+/*
+ * Restore line numbers from the line table, in document order
+ */
+static char *
+slaxCacheRestoreLines (char *cp, xmlNodePtr nodep)
+{
+    for ( ; nodep && cp; nodep = nodep->next) {
+	if (nodep->type != XML_ELEMENT_NODE)
+	    continue;
+
+	nodep->line = (unsigned short) strtoul(cp, &cp, 10);
+	cp = slaxCacheRestoreLines(cp, nodep->children);
+    }
+
+    return cp;
+}
+
+/*
+ * Fill in the key for the given script.  Returns TRUE if the
+ * script cannot be cached.
+ */
+static int
+slaxCacheMakeKey (slax_cache_key_t *keyp, const char *filename,
+		  FILE *file, int partial)
+{
+    struct stat st;
+    char real[MAXPATHLEN];
+    const char *path = filename;
+    uint64_t hash;
+
+    bzero(keyp, sizeof(*keyp));
+
+    if (slaxCacheDir == NULL || slaxFilenameIsStd(filename) || file == NULL)
+	return TRUE;
+
+    /* Only regular files have a meaningful mtime and can be rewound */
+    if (fstat(fileno(file), &st) < 0 || !S_ISREG(st.st_mode))
+	return TRUE;
+
+    if (realpath(filename, real))
+	path = real;
+
+    hash = slaxCacheHash(FNV_OFFSET_BASIS, path, strlen(path));
+    hash = slaxCacheHash(hash, &partial, sizeof(partial));
+    hash = slaxCacheHash(hash, LIBSLAX_VERSION, sizeof(LIBSLAX_VERSION) - 1);
+
+    snprintf(keyp->sck_path, sizeof(keyp->sck_path),
+	     "%s/%016" PRIx64 SLAX_CACHE_SUFFIX, slaxCacheDir, hash);
+
+    keyp->sck_mtime = st.st_mtime;
+    keyp->sck_nsec = slaxCacheMtimeNsec(&st);
+    keyp->sck_size = st.st_size;
+    keyp->sck_valid = TRUE;
+
+    return FALSE;
+}
+
+/*
+ * Read a cache entry into memory
+ */
+static char *
+slaxCacheReadEntry (const char *path, size_t *lenp)
+{
+    struct stat st;
+    char *buf;
+    FILE *fp;
+    size_t len;
+
+    fp = fopen(path, "r");
+    if (fp == NULL)
+	return NULL;
+
+    if (fstat(fileno(fp), &st) < 0 || st.st_size <= 0) {
+	fclose(fp);
+	return NULL;
+    }
+
+    buf = xmlMalloc(st.st_size + 1);
+    if (buf == NULL) {
+	fclose(fp);
+	return NULL;
+    }
+
+    len = fread(buf, 1, st.st_size, fp);
+    fclose(fp);
+
+    if (len != (size_t) st.st_size) {
+	xmlFree(buf);
+	return NULL;
+    }
+
+    buf[len] = '\0';
+    *lenp = len;
+    return buf;
+}
+
+/*
+ * Return the nanoseconds to record in an entry's header.  A script
+ * modified in the second we write the entry could change again without
+ * its mtime changing (on file systems with coarse timestamps), so we
+ * record -1 instead, forcing the next load to check the hash.
+ */
+static long
+slaxCacheHeaderNsec (slax_cache_key_t *keyp)
+{
+    return (keyp->sck_mtime >= time(NULL)) ? -1 : keyp->sck_nsec;
+}
+
+/*
+ * Create a uniquely named temporary file next to the cache entry and
+ * write the entry's header into it.  The caller writes the rest and
+ * calls slaxCacheCommit().
+ */
+static FILE *
+slaxCacheCreate (slax_cache_key_t *keyp, char *tmp, size_t size)
+{
+    FILE *fp;
+    int fd;
+
+    snprintf(tmp, size, "%s.XXXXXX", keyp->sck_path);
+
+    fd = mkstemp(tmp);
+    if (fd < 0) {
+	slaxLog("slax: cache: cannot write '%s': %s", tmp, strerror(errno));
+	return NULL;
+    }
+
+    /* mkstemp() makes the file private; entries are meant to be shared */
+    fchmod(fd, 0644);
+
+    fp = fdopen(fd, "w");
+    if (fp == NULL) {
+	slaxLog("slax: cache: cannot write '%s': %s", tmp, strerror(errno));
+	close(fd);
+	unlink(tmp);
+	return NULL;
+    }
+
+    fprintf(fp, SLAX_CACHE_MAGIC " %u %s %lld %ld %lld %016" PRIx64 "\n",
+	    SLAX_CACHE_VERSION, LIBSLAX_VERSION, (long long) keyp->sck_mtime,
+	    slaxCacheHeaderNsec(keyp), (long long) keyp->sck_size,
+	    keyp->sck_hash);
+
+    return fp;
+}
+
+/*
+ * Close the temporary file and rename it into place, so concurrent
+ * readers never see a partial entry
+ */
+static void
+slaxCacheCommit (slax_cache_key_t *keyp, FILE *fp, const char *tmp,
+		 int failed)
+{
+    failed |= ferror(fp);
+    if (fclose(fp) != 0 || failed || rename(tmp, keyp->sck_path) < 0) {
+	slaxLog("slax: cache: cannot save '%s'", keyp->sck_path);
+	unlink(tmp);
+    }
+}
+
+/*
+ * Rewrite an entry whose script was touched but not changed, so the
+ * header holds the script's current mtime and later loads don't need
+ * to hash it again.  The line table and XML are copied as they are.
+ */
+static void
+slaxCacheRefresh (slax_cache_key_t *keyp, const char *lines,
+		  const char *xml, size_t len)
+{
+    char tmp[MAXPATHLEN + 16];	/* Room for the ".XXXXXX" suffix */
+    FILE *fp;
+    int failed;
+
+    fp = slaxCacheCreate(keyp, tmp, sizeof(tmp));
+    if (fp == NULL)
+	return;
+
+    failed = (fputs(lines, fp) == EOF || fputc('\n', fp) == EOF
+	      || fwrite(xml, 1, len, fp) != len);
+
+    slaxCacheCommit(keyp, fp, tmp, failed);
+    slaxLog("slax: cache: refreshed '%s'", keyp->sck_path);
+}
+
+/*
+ * Look for a valid cache entry for a script, returning the XSLT
+ * document if we have one.  On a miss, the key is filled in so
+ * slaxCacheStore() can save the freshly parsed document.
+ */
+xmlDocPtr
+slaxCacheLoad (slax_cache_key_t *keyp, const char *filename, FILE *file,
+	       xmlDictPtr dict, int partial)
+{
+    char *buf, *cp, *xml;
+    char made_by[64];
+    size_t len;
+    unsigned version;
+    long long mtime, size;
+    long nsec;
+    uint64_t hash;
+    xmlParserCtxtPtr ctxt;
+    xmlDocPtr docp = NULL;
+
+    if (slaxCacheMakeKey(keyp, filename, file, partial))
+	return NULL;
+
+    buf = slaxCacheReadEntry(keyp->sck_path, &len);
+    if (buf == NULL)
+	goto miss;
+
+    /*
+     * The header: magic, version, libslax version, mtime (seconds and
+     * nanoseconds), size and content hash
+     */
+    cp = strchr(buf, '\n');
+    if (cp == NULL)
+	goto fail;
+    *cp++ = '\0';
+
+    if (sscanf(buf, SLAX_CACHE_MAGIC " %u %63s %lld %ld %lld %" SCNx64,
+	       &version, made_by, &mtime, &nsec, &size, &hash) != 6
+	    || version != SLAX_CACHE_VERSION
+	    || !streq(made_by, LIBSLAX_VERSION))
+	goto fail;
+
+    if (mtime != (long long) keyp->sck_mtime || nsec < 0
+	    || nsec != keyp->sck_nsec
+	    || size != (long long) keyp->sck_size) {
+	/*
+	 * The script was touched; see if the contents changed.  We
+	 * keep the hash so a rewritten entry doesn't rehash the file.
+	 */
+	if (slaxCacheHashFile(file, &keyp->sck_hash))
+	    goto fail;
+	keyp->sck_hashed = TRUE;
+
+	if (hash != keyp->sck_hash)
+	    goto fail;
+    }
+
+    /* The line table is the second line; the XML follows it */
+    xml = strchr(cp, '\n');
+    if (xml == NULL)
+	goto fail;
+    *xml++ = '\0';
+
+    ctxt = xmlNewParserCtxt();
+    if (ctxt == NULL)
+	goto fail;
+
+    if (dict) {
+	if (ctxt->dict)
+	    xmlDictFree(ctxt->dict);
+	ctxt->dict = dict;
+	xmlDictReference(ctxt->dict);
+    }
+
+    docp = xmlCtxtReadMemory(ctxt, xml, len - (xml - buf), filename, NULL,
+		     XSLT_PARSE_OPTIONS | XML_PARSE_NOERROR
+		     | XML_PARSE_NOWARNING);
+    xmlFreeParserCtxt(ctxt);
+
+    if (docp == NULL)
+	goto fail;
+
+    /*
+     * If we had to hash the script, record its current state, unless
+     * the header would come out the same (as it does for a script
+     * changed in the last second).
+     */
+    if (keyp->sck_hashed
+	    && (mtime != (long long) keyp->sck_mtime
+		|| nsec != slaxCacheHeaderNsec(keyp)
+		|| size != (long long) keyp->sck_size))
+	slaxCacheRefresh(keyp, cp, xml, len - (xml - buf));
+
+    slaxCacheRestoreLines(cp, docp->children);
+    xmlFree(buf);
+
+    slaxMutexLock(&slaxCacheLock);
+    slaxCacheHits += 1;
+    slaxMutexUnlock(&slaxCacheLock);
+    slaxLog("slax: cache: hit for '%s' (%s)", filename, keyp->sck_path);
+
+    return docp;
+
+ fail:
+    xmlFree(buf);
+ miss:
+    rewind(file);
+    slaxMutexLock(&slaxCacheLock);
+    slaxCacheMisses += 1;
+    slaxMutexUnlock(&slaxCacheLock);
+    slaxLog("slax: cache: miss for '%s' (%s)", filename, keyp->sck_path);
+
+    return NULL;
+}
+
+/*
+ * Save a freshly parsed document in the cache.  The hash is taken
+ * over the buffer the parser read, not the file as it is now, so a
+ * script rewritten since the parse can't be paired with the old
+ * tree.  The entry is written to a uniquely named temporary file and
+ * renamed into place, so concurrent writers (in this process or
+ * another) never share a temporary file.
+ */
+void
+slaxCacheStore (slax_cache_key_t *keyp, const char *buf, size_t len,
+		xmlDocPtr docp)
+{
+    char tmp[MAXPATHLEN + 16];	/* Room for the ".XXXXXX" suffix */
+    xmlSaveCtxtPtr handle;
+    FILE *fp;
+
+    if (!keyp->sck_valid || buf == NULL || docp == NULL)
+	return;
+
+    keyp->sck_hash = slaxCacheHash(FNV_OFFSET_BASIS, buf, len);
+
+    fp = slaxCacheCreate(keyp, tmp, sizeof(tmp));
+    if (fp == NULL)
+	return;
+
+    slaxCacheSaveLines(fp, docp->children);
+    fprintf(fp, "\n");
+    fflush(fp);
+
+    handle = xmlSaveToFd(fileno(fp), "UTF-8", 0);
+    if (handle) {
+	xmlSaveDoc(handle, docp);
+	xmlSaveClose(handle);
+    }
+
+    slaxCacheCommit(keyp, fp, tmp, handle == NULL);
+}
@@ -1246,8 +1246,7 @@ slaxDebugEvalXpath (slaxDebugState_t *statep, const char *expr)
     if (xpctxt == NULL)
 	return NULL;
 
-    return slaxXpathEval(statep->ds_node, statep->ds_inst, xpctxt,
-			 statep->ds_script, expr);
+    return slaxXpathEval(statep->ds_node, statep->ds_inst, xpctxt, expr);
 }
 
 /*
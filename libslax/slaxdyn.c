@@ -69,6 +69,14 @@ static slax_dyn_list_t slaxDynLibraries;
 
 static int slaxDynInited;
 
+/*
+ * Scripts may be loaded on several threads at once, so loading a
+ * library (and marking it loaded) happens under a lock.  A thread
+ * that finds a library already marked waits here until the library's
+ * functions are registered.
+ */
+static slax_mutex_t slaxDynLock = SLAX_MUTEX_INITIALIZER;
+
 void
 slaxDynAdd (const char *dir)
 {
@@ -291,9 +299,11 @@ slaxDynLoad (xmlDocPtr docp)
 
     slaxDynFindNamespaces(&nslist, docp, root, TRUE);
 
+    slaxMutexLock(&slaxDynLock);
     SLAXDATALIST_FOREACH(dnp, &nslist) {
 	slaxDynLoadNamespace(docp, root, (const char *) dnp->dn_data);
     }
+    slaxMutexUnlock(&slaxDynLock);
 
     slaxDataListClean(&nslist);
 }
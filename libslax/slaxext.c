@@ -186,8 +186,8 @@ typedef struct trace_precomp_s {
  * This is the callback function that we use to pass trace data
  * up to the caller.
  */
-static slaxTraceCallback_t slaxTraceCallback;
-static void *slaxTraceCallbackData;
+static SLAX_THREAD_LOCAL slaxTraceCallback_t slaxTraceCallback;
+static SLAX_THREAD_LOCAL void *slaxTraceCallbackData;
 
 /**
  * Deallocates a trace_precomp_t
@@ -492,6 +492,7 @@ slaxWhileElement (xsltTransformContextPtr ctxt,
 {
     int value;
     while_precomp_t *comp = (while_precomp_t *) precomp;
+    unsigned long mark;
 
     if (comp->wp_test == NULL) {
 	xsltGenericError(xsltGenericErrorContext,
@@ -499,6 +500,9 @@ slaxWhileElement (xsltTransformContextPtr ctxt,
 	return;
     }
 
+    /* Let mvar containers superseded in the loop be freed as we go */
+    mark = slaxMvarLoopStart();
+
     for (;;) {
 	/*
 	 * Adjust the context to allow the XPath expresion to
@@ -537,7 +541,289 @@ slaxWhileElement (xsltTransformContextPtr ctxt,
 	/* Apply the template code inside the element */
 	xsltApplyOneTemplate(ctxt, node,
 			      inst->children, NULL, NULL);
+
+	slaxMvarReclaim(ctxt, mark);
     }
+
+    slaxMvarLoopEnd(ctxt, mark);
+}
+
+/* ---------------------------------------------------------------------- */
+
+/*
+ * A "for" statement over a range ("for $i (1 ... $max)") is turned
+ * into the XML element <slax:for> by the parser.  Rather than building
+ * a node for each member of the range, we count from one end to the
+ * other, binding the variable to each number in turn.  "." is left
+ * unchanged, as it is for other "for" loops.
+ */
+typedef struct for_precomp_s {
+    xsltElemPreComp fp_comp;	   /* Standard precomp header */
+    const xmlChar *fp_name;	   /* Variable name (from the dictionary) */
+    const xmlChar *fp_uri;	   /* Variable namespace (ditto) */
+    xmlXPathCompExprPtr fp_from;   /* Compiled start of the range */
+    xmlXPathCompExprPtr fp_to;	   /* Compiled end of the range */
+    xmlNsPtr *fp_nslist;	   /* Prebuilt namespace list */
+    int fp_nscount;		   /* Number of namespaces in fp_nslist */
+} for_precomp_t;
+
+/**
+ * Deallocates a for_precomp_t
+ *
+ * @comp the precomp data to free (a for_precomp_t)
+ */
+static void
+slaxForFreeComp (for_precomp_t *comp)
+{
+    if (comp == NULL)
+	return;
+
+    if (comp->fp_from)
+	xmlXPathFreeCompExpr(comp->fp_from);
+    if (comp->fp_to)
+	xmlXPathFreeCompExpr(comp->fp_to);
+
+    xmlFreeAndEasy(comp->fp_nslist);
+    xmlFree(comp);
+}
+
+/**
+ * Precompile one of the range attributes of a for element
+ *
+ * @inst the <for> element
+ * @attrib the attribute name
+ * @return the compiled expression, or NULL on failure
+ */
+static xmlXPathCompExprPtr
+slaxForCompileAttrib (xmlNodePtr inst, const char *attrib)
+{
+    xmlChar *value;
+    xmlXPathCompExprPtr res;
+
+    value = xmlGetNsProp(inst, (const xmlChar *) attrib, NULL);
+    if (value == NULL) {
+	xsltGenericError(xsltGenericErrorContext,
+			 "for: missing %s attribute\n", attrib);
+	return NULL;
+    }
+
+    res = xmlXPathCompile(value);
+    if (res == NULL)
+	xsltGenericError(xsltGenericErrorContext,
+			 "for: %s attribute does not compile: %s\n",
+			 attrib, value);
+
+    xmlFree(value);
+    return res;
+}
+
+/**
+ * Precompile a for element, so make running it faster
+ *
+ * @style the current stylesheet
+ * @inst this instance
+ * @function the transform function (opaquely passed to xsltInitElemPreComp)
+ */
+static xsltElemPreCompPtr
+slaxForCompile (xsltStylesheetPtr style, xmlNodePtr inst,
+		xsltTransformFunction function)
+{
+    xmlChar *name;
+    const xmlChar *uri;
+    for_precomp_t *comp;
+
+    comp = xmlMalloc(sizeof(*comp));
+    if (comp == NULL) {
+	xsltGenericError(xsltGenericErrorContext, "for: malloc failed\n");
+	return NULL;
+    }
+
+    memset(comp, 0, sizeof(*comp));
+
+    xsltInitElemPreComp((xsltElemPreCompPtr) comp, style, inst, function,
+			 (xsltElemPreCompDeallocator) slaxForFreeComp);
+
+    /*
+     * Split the variable name into its local part and namespace,
+     * and intern them, since libxslt finds local variables by
+     * comparing dictionary pointers.
+     */
+    name = xmlGetNsProp(inst, (const xmlChar *) ATT_NAME, NULL);
+    if (name == NULL) {
+	xsltGenericError(xsltGenericErrorContext,
+			 "for: missing name attribute\n");
+	return NULL;
+    }
+
+    uri = xsltGetQNameURI(inst, &name);
+    if (name == NULL)
+	return NULL;
+
+    comp->fp_name = xmlDictLookup(style->dict, name, -1);
+    if (uri)
+	comp->fp_uri = xmlDictLookup(style->dict, uri, -1);
+    xmlFree(name);
+
+    /* Precompile the ends of the range */
+    comp->fp_from = slaxForCompileAttrib(inst, ATT_FROM);
+    comp->fp_to = slaxForCompileAttrib(inst, ATT_TO);
+    if (comp->fp_from == NULL || comp->fp_to == NULL)
+	return NULL;
+
+    /* Prebuild the namespace list */
+    comp->fp_nslist = xmlGetNsList(inst->doc, inst);
+    if (comp->fp_nslist != NULL) {
+	int i = 0;
+	while (comp->fp_nslist[i] != NULL)
+	    i++;
+	comp->fp_nscount = i;
+    }
+
+    return &comp->fp_comp;
+}
+
+/**
+ * Evaluate one end of the range, as a number
+ *
+ * @ctxt transform context
+ * @node current input node
+ * @comp the precompiled info
+ * @expr the compiled expression
+ * @return the value, or NaN on failure
+ */
+static double
+slaxForEvalNumber (xsltTransformContextPtr ctxt, xmlNodePtr node,
+		   for_precomp_t *comp, xmlXPathCompExprPtr expr)
+{
+    xmlNsPtr *save_nslist = ctxt->xpathCtxt->namespaces;
+    int save_nscount = ctxt->xpathCtxt->nsNr;
+    xmlNodePtr save_context = ctxt->xpathCtxt->node;
+    xmlXPathObjectPtr res;
+    double value = xmlXPathNAN;
+
+    ctxt->xpathCtxt->namespaces = comp->fp_nslist;
+    ctxt->xpathCtxt->nsNr = comp->fp_nscount;
+    ctxt->xpathCtxt->node = node;
+
+    res = xmlXPathCompiledEval(expr, ctxt->xpathCtxt);
+
+    ctxt->xpathCtxt->node = save_context;
+    ctxt->xpathCtxt->nsNr = save_nscount;
+    ctxt->xpathCtxt->namespaces = save_nslist;
+
+    if (res) {
+	value = xmlXPathCastToNumber(res);
+	xmlXPathFreeObject(res);
+    }
+
+    return value;
+}
+
+/**
+ * Handle a <slax:for> element, as manufactured by the "for" statement
+ * when given a range.  The variable is pushed onto the variable stack
+ * as a number, with a new value for each member of the range.
+ *
+ * @ctxt transform context
+ * @node current input node
+ * @inst the <for> element
+ * @comp the precompiled info (a for_precomp_t)
+ */
+static void
+slaxForElement (xsltTransformContextPtr ctxt,
+		xmlNodePtr node, xmlNodePtr inst,
+		xsltElemPreCompPtr precomp)
+{
+    for_precomp_t *comp = (for_precomp_t *) precomp;
+    xsltStackElemPtr var;
+    double from, to;
+    long long num, last, step;
+    int save_size, save_pos;
+    unsigned long mark;
+
+    if (comp->fp_from == NULL || comp->fp_to == NULL) {
+	xsltGenericError(xsltGenericErrorContext,
+			 "for: range was not compiled\n");
+	return;
+    }
+
+    from = slaxForEvalNumber(ctxt, node, comp, comp->fp_from);
+    to = slaxForEvalNumber(ctxt, node, comp, comp->fp_to);
+
+    /* A range with NaN or infinite ends is empty */
+    if (xmlXPathIsNaN(from) || xmlXPathIsInf(from)
+	    || xmlXPathIsNaN(to) || xmlXPathIsInf(to))
+	return;
+
+    num = (long long) from;
+    last = (long long) to;
+    step = (num <= last) ? 1 : -1;
+
+    slaxLog("for: %qd ... %qd + %qd", num, last, step);
+
+    if (inst->children == NULL)
+	return;
+
+    var = xmlMalloc(sizeof(*var));
+    if (var == NULL) {
+	xsltGenericError(xsltGenericErrorContext, "for: malloc failed\n");
+	return;
+    }
+
+    memset(var, 0, sizeof(*var));
+    var->name = comp->fp_name;
+    var->nameURI = comp->fp_uri;
+    var->computed = 1;
+
+    /*
+     * The body sees a single-node context, like the inner
+     * for-each of other "for" loops.
+     */
+    save_size = ctxt->xpathCtxt->contextSize;
+    save_pos = ctxt->xpathCtxt->proximityPosition;
+
+    /* Let mvar containers superseded in the loop be freed as we go */
+    mark = slaxMvarLoopStart();
+
+    for (;;) {
+	/* If the user typed 'quit' or 'run' at the debugger prompt, bail */
+        if (ctxt->debugStatus == XSLT_DEBUG_QUIT
+			|| ctxt->debugStatus == XSLT_DEBUG_RUN_RESTART)
+	    break;
+
+        if (ctxt->debugStatus != XSLT_DEBUG_NONE)
+            xslHandleDebugger(inst, node, ctxt->templ, ctxt);
+
+	var->value = xmlXPathNewFloat((double) num);
+	if (var->value == NULL)
+	    break;
+
+	ctxt->xpathCtxt->contextSize = 1;
+	ctxt->xpathCtxt->proximityPosition = 1;
+
+	/*
+	 * Apply the template code inside the element, passing our
+	 * variable as a "param" so it's pushed for the body and
+	 * popped (but not freed) afterwards.
+	 */
+	xsltApplyOneTemplate(ctxt, node, inst->children, NULL, var);
+
+	xmlXPathFreeObject(var->value);
+	var->value = NULL;
+
+	slaxMvarReclaim(ctxt, mark);
+
+	if (num == last || ctxt->state == XSLT_STATE_STOPPED)
+	    break;
+	num += step;
+    }
+
+    slaxMvarLoopEnd(ctxt, mark);
+
+    ctxt->xpathCtxt->contextSize = save_size;
+    ctxt->xpathCtxt->proximityPosition = save_pos;
+
+    xmlFree(var);
 }
 
 /* ---------------------------------------------------------------------- */
@@ -546,8 +832,11 @@ slaxWhileElement (xsltTransformContextPtr ctxt,
  * Return a sequence of fictional nodes, based on the two arguments.
  * "1 .. 10" builds <item> 1, <item> 2, thru <item> 10, where
  * "44 .. 40" builds <item> 44, <item> 43, thur <item> 40.
- * These can be used to make cheap iterators, but have the sad side effect
- * of making all the nodes at one time.
+ * These have the sad side effect of making all the nodes at one time,
+ * so "for" loops over a range use <slax:for> instead; we're left with
+ * ranges used as values, as in "for-each (1 ... 10)".  The nodes are
+ * new and distinct, so we skip the duplicate check that
+ * xmlXPathNodeSetAdd makes, which is quadratic over the whole range.
  */
 static void
 slaxExtBuildSequence (xmlXPathParserContextPtr ctxt, int nargs)
@@ -596,7 +885,7 @@ slaxExtBuildSequence (xmlXPathParserContextPtr ctxt, int nargs)
 				 (const xmlChar *) "item", (xmlChar *) buf);
 	if (nodep) {
 	    xmlAddChild((xmlNodePtr) container, nodep);
-	    xmlXPathNodeSetAdd(ret->nodesetval, nodep);
+	    xmlXPathNodeSetAddUnique(ret->nodesetval, nodep);
 	}
     }
 
@@ -802,8 +1091,8 @@ slaxExtPrintIt (const xmlChar *fmtstr, int argc, xmlChar **argv)
      * had "%j1" turned on.  But if this printf call uses a
      * difference format string, we nuke them.
      */
-    static xmlChar **last_argv;
-    static int last_argc;
+    static SLAX_THREAD_LOCAL xmlChar **last_argv;
+    static SLAX_THREAD_LOCAL int last_argc;
     xmlChar **new_argv = NULL;	/* Build new 'last' here */
 
     if (last_argv && last_argv[0] && !xmlStrEqual(fmtstr, last_argv[0]))
@@ -2094,7 +2383,7 @@ slaxExtEvaluate (xmlXPathParserContext *ctxt, int nargs)
 {
     xmlChar *str = NULL;
     xmlXPathObjectPtr ret = NULL;
-    char *sexpr;
+    slax_xpath_entry_t *sxep;
     int errors = 0;
 
     if (ctxt == NULL)
@@ -2117,29 +2406,37 @@ slaxExtEvaluate (xmlXPathParserContext *ctxt, int nargs)
 	return;
     }
 
-    /* Convert a SLAX expression into an XPath one */
-    sexpr = slaxSlaxToXpath("slax:evaluate", 1, (const char *) str, &errors);
-    if (sexpr == NULL || errors > 0) {
-        xsltGenericError(xsltGenericErrorContext,
-			 "slax:evalute: invalid expression: %s\n", str);
+    /*
+     * Convert the SLAX expression into a compiled XPath one.  The
+     * cache saves us from parsing and compiling the same expression
+     * every time we're called.
+     */
+    sxep = slaxXpathCacheGet("slax:evaluate", (const char *) str, &errors);
+    if (sxep == NULL) {
+	if (errors > 0)
+	    xsltGenericError(xsltGenericErrorContext,
+			     "slax:evalute: invalid expression: %s\n", str);
+	else
+	    xsltGenericError(xsltGenericErrorContext,
+		    "slax:evaluate: unable to evaluate expression '%s'\n", str);
 	valuePush(ctxt, xmlXPathNewNodeSet(NULL));
-	xmlFreeAndEasy(sexpr);
 	xmlFree(str);
 	return;
     }
 
     xmlFree(str);
 
-    ret = xmlXPathEval((const xmlChar *) sexpr, ctxt->context);
+    ret = xmlXPathCompiledEval(slaxXpathEntryComp(sxep), ctxt->context);
     if (ret)
 	valuePush(ctxt, ret);
     else {
 	xsltGenericError(xsltGenericErrorContext,
-		"slax:evaluate: unable to evaluate expression '%s'\n", sexpr);
+		"slax:evaluate: unable to evaluate expression '%s'\n",
+		slaxXpathEntryXpath(sxep));
 	valuePush(ctxt, xmlXPathNewNodeSet(NULL));
     }	
 
-    xmlFree(sexpr);
+    slaxXpathCacheRelease(sxep);
     return;
 }
 
@@ -2778,9 +3075,9 @@ slaxExtOutput (xmlXPathParserContextPtr ctxt, int nargs)
  * This is the callback function that we use to pass trace data
  * up to the caller.
  */
-static slaxProgressCallback_t slaxProgressCallback;
-static void *slaxProgressCallbackData;
-static int slaxExtEmitProgressMessages;
+static SLAX_THREAD_LOCAL slaxProgressCallback_t slaxProgressCallback;
+static SLAX_THREAD_LOCAL void *slaxProgressCallbackData;
+static SLAX_THREAD_LOCAL int slaxExtEmitProgressMessages;
 
 int
 slaxEmitProgressMessages (int allow)
@@ -2925,6 +3222,9 @@ slaxExtRegister (void)
     slaxRegisterElement(SLAX_URI, ELT_TRACE,
 			slaxTraceCompile, slaxTraceElement);
 
+    slaxRegisterElement(SLAX_URI, ELT_FOR,
+			slaxForCompile, slaxForElement);
+
     slaxRegisterElement(SLAX_URI, ELT_WHILE,
 			slaxWhileCompile, slaxWhileElement);
 
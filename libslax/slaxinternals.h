@@ -11,6 +11,7 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <stdint.h>
 #include <sys/param.h>
 
 #include <libxml/xmlmemory.h>
@@ -39,6 +40,30 @@ struct slax_data_s; typedef struct slax_data_s slax_data_t;
 
 extern int slaxYyDebug;
 
+/*
+ * Locks for the little shared state that changes after start up.
+ * Without pthreads, we assume a single thread and the locks vanish.
+ */
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+typedef pthread_mutex_t slax_mutex_t;
+#define SLAX_MUTEX_INITIALIZER PTHREAD_MUTEX_INITIALIZER
+#define slaxMutexLock(_m) pthread_mutex_lock(_m)
+#define slaxMutexUnlock(_m) pthread_mutex_unlock(_m)
+typedef pthread_once_t slax_once_t;
+#define SLAX_ONCE_INITIALIZER PTHREAD_ONCE_INIT
+#define slaxOnce(_o, _func) pthread_once(_o, _func)
+#else /* HAVE_PTHREAD_H */
+typedef int slax_mutex_t;
+#define SLAX_MUTEX_INITIALIZER 0
+#define slaxMutexLock(_m) ((void) (_m))
+#define slaxMutexUnlock(_m) ((void) (_m))
+typedef int slax_once_t;
+#define SLAX_ONCE_INITIALIZER 0
+#define slaxOnce(_o, _func) \
+    do { if (!*(_o)) { *(_o) = 1; (_func)(); } } while (0)
+#endif /* HAVE_PTHREAD_H */
+
 /*
  * The rest of the .c files expose so little we don't bother with
  * distinct header files.
@@ -78,6 +103,26 @@ slaxMvarCreateSvar (slax_data_t *sdp, const char *varname);
 void
 slaxMvarRegister (void);
 
+/*
+ * Note the start of a loop whose iterations can reclaim shadow
+ * containers, returning a mark for the following calls
+ */
+unsigned long
+slaxMvarLoopStart (void);
+
+/*
+ * Free shadow containers made since the mark that can no longer be
+ * referenced; called between iterations of the loop
+ */
+void
+slaxMvarReclaim (xsltTransformContextPtr ctxt, unsigned long mark);
+
+/*
+ * Note the end of a loop
+ */
+void
+slaxMvarLoopEnd (xsltTransformContextPtr ctxt, unsigned long mark);
+
 /* --- slaxwriter.h --- */
 
 struct slax_writer_s;
@@ -86,12 +131,25 @@ typedef struct slax_writer_s slax_writer_t;
 slax_writer_t *
 slaxGetWriter (slaxWriterFunc_t func, void *data);
 
+slax_writer_t *
+slaxGetWriterFd (int fd);
+
+slax_writer_t *
+slaxGetWriterBuffer (xmlBufferPtr xbuf);
+
 void
 slaxFreeWriter (slax_writer_t *swp);
 
 void
 slaxWrite (slax_writer_t *swp, const char *fmt, ...);
 
+void
+slaxWriteString (slax_writer_t *swp, const char *str, int len);
+
+/* Append a string literal, whose length we know at compile time */
+#define slaxWriteLiteral(_swp, _lit) \
+    slaxWriteString(_swp, "" _lit "", sizeof(_lit) - 1)
+
 int
 slaxWriteNewline (slax_writer_t *swp, int change);
 
@@ -120,3 +178,95 @@ slaxConvertExpression (const char *opt_expression, int is_slax);
 /* --- slaxloader.h -- */
 void
 slaxDataCleanup (slax_data_t *sdp);
+
+/* --- slaxcache.h --- */
+
+struct stat;
+
+/*
+ * Return the nanoseconds part of a file's mtime, or -1 if the
+ * platform doesn't give us one
+ */
+long
+slaxCacheMtimeNsec (struct stat *stp);
+
+/*
+ * Identify a cache entry and the state of the script it holds
+ */
+typedef struct slax_cache_key_s {
+    char sck_path[MAXPATHLEN];	/* Path of the cache entry */
+    time_t sck_mtime;		/* Modification time of the script */
+    long sck_nsec;		/* Nanoseconds of sck_mtime (-1 if unknown) */
+    off_t sck_size;		/* Size of the script */
+    uint64_t sck_hash;		/* Hash of the script contents */
+    int sck_valid;		/* Script can be cached */
+    int sck_hashed;		/* sck_hash has been computed */
+} slax_cache_key_t;
+
+/*
+ * Look for a valid cache entry for a script, returning the XSLT
+ * document if we have one.
+ */
+xmlDocPtr
+slaxCacheLoad (slax_cache_key_t *keyp, const char *filename, FILE *file,
+	       xmlDictPtr dict, int partial);
+
+/*
+ * Save a freshly parsed document in the cache, given the buffer
+ * it was parsed from
+ */
+void
+slaxCacheStore (slax_cache_key_t *keyp, const char *buf, size_t len,
+		xmlDocPtr docp);
+
+/* --- slaxscript.h --- */
+
+/*
+ * Record a file loaded while compiling a script for the registry
+ */
+void
+slaxScriptAddDependency (const char *path, FILE *file);
+
+/*
+ * Look for a shared copy of an import or include document, by the
+ * path it resolved to
+ */
+xmlDocPtr
+slaxScriptDocFind (const char *path, const char *url, FILE *file,
+		   xmlDictPtr dict);
+
+/*
+ * Keep a copy of a freshly parsed import or include document
+ */
+void
+slaxScriptDocSave (const char *path, FILE *file, xmlDocPtr docp);
+
+/* --- slaxxpath.h --- */
+
+struct slax_xpath_entry_s; typedef struct slax_xpath_entry_s
+    slax_xpath_entry_t;
+
+/*
+ * Return the cached, compiled form of a SLAX expression; release it
+ * with slaxXpathCacheRelease()
+ */
+slax_xpath_entry_t *
+slaxXpathCacheGet (const char *filename, const char *expr, int *errorsp);
+
+/*
+ * Release an entry returned by slaxXpathCacheGet()
+ */
+void
+slaxXpathCacheRelease (slax_xpath_entry_t *sxep);
+
+/*
+ * Return the compiled XPath held by an entry
+ */
+xmlXPathCompExprPtr
+slaxXpathEntryComp (slax_xpath_entry_t *sxep);
+
+/*
+ * Return the XPath form of an entry's expression
+ */
+const char *
+slaxXpathEntryXpath (slax_xpath_entry_t *sxep);
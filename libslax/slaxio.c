@@ -556,14 +556,14 @@ static char encoder[] = {
     '4', '5', '6', '7', '8', '9', '+', '/'
 };
 
-static char decoder[256];
+static SLAX_THREAD_LOCAL char decoder[256]; /* Built on first use */
 
 char *
 slaxBase64Encode (const char *buf, size_t blen, size_t *olenp)
 {
     int olen = (size_t) ((blen  + 2) / 3) * 4;
     char *data = xmlMalloc(olen + 1);
-    const char *cp, *ep;
+    const unsigned char *cp, *ep;
     char *out;
     uint32_t bits;
 
@@ -571,8 +571,8 @@ slaxBase64Encode (const char *buf, size_t blen, size_t *olenp)
 	return NULL;
 
     out = data;
-    cp = buf;
-    ep = buf + blen;
+    cp = (const unsigned char *) buf;
+    ep = cp + blen;
     while (cp < ep) {
 	bits = *cp++ << 16;
 	bits += cp < ep ? *cp++ << 8 : 0;
@@ -598,7 +598,7 @@ slaxBase64Encode (const char *buf, size_t blen, size_t *olenp)
 char *
 slaxBase64Decode (const char *buf, size_t blen, size_t *olenp)
 {
-    const char *cp, *ep;
+    const unsigned char *cp, *ep;
     uint32_t bits;
     int i;
     char *out, *data, *stop;
@@ -611,15 +611,20 @@ slaxBase64Decode (const char *buf, size_t blen, size_t *olenp)
 	    return NULL;
     }
 
+    if (blen == 0) {
+	*olenp = 0;
+	return xmlStrdup2("");
+    }
+
     if (decoder['A'] == 0) {
-	for (i = 0, cp = decoder; i < 0x40; i++)
+	for (i = 0; i < 0x40; i++)
 	    decoder[(uint) encoder[i]] = i;
     }
 
     int olen = (blen / 4) * 3;
 
-    cp = buf;
-    ep = buf + blen;
+    cp = (const unsigned char *) buf;
+    ep = cp + blen;
 
     if (buf[blen - 1] == '=') {
 	olen -= 1;
@@ -686,7 +691,7 @@ slaxAsprintf (char **ret, const char *format, ...)
     return rc;
 }
 
-static int slaxExitCode;
+static SLAX_THREAD_LOCAL int slaxExitCode;
 
 void
 slaxSetExitCode (int code)
@@ -705,7 +710,7 @@ typedef struct slax_error_data_s {
     xmlNodePtr sed_nodep;	/* Node to record into */
 } slax_error_data_t;
 
-static slax_error_data_t slax_error_data;
+static SLAX_THREAD_LOCAL slax_error_data_t slax_error_data;
 
 static void
 slaxGenericError (void *opaque, const char *fmt, ...)
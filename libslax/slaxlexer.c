@@ -16,6 +16,11 @@
 #include "slaxparser.h"
 #include <ctype.h>
 #include <errno.h>
+#include <limits.h>
+#include <sys/stat.h>
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+#include <sys/mman.h>
+#endif
 
 #include <libxslt/extensions.h>
 #include <libexslt/exslt.h>
@@ -25,7 +30,7 @@
 
 #define SLAX_MAX_CHAR	128	/* Size of our character tables */
 
-static int slaxSetup;		/* Have we initialized? */
+static slax_once_t slaxSetupOnce = SLAX_ONCE_INITIALIZER; /* Tables built */
 
 /*
  * These are lookup tables for one and two character literal tokens.
@@ -116,6 +121,17 @@ typedef struct keyword_mapping_s {
 #define KMF_STMT_KW	(1<<3)	/* Fancy statement (slax keyword in xpath) */
 #define KMF_JSON_KW	(1<<4)	/* JSON-only keywords */
 
+/*
+ * Keywords are all lowercase letters and dashes, so we find them
+ * using a dispatch table indexed by first character and length,
+ * built from keywordMap by slaxSetupLexer().  Each slot holds the
+ * index (plus one) of the first keywordMap entry with that first
+ * character and length, and keywordNext chains any others.
+ */
+#define KEYWORD_FIRST	'a'	/* Lowest first character of a keyword */
+#define KEYWORD_LAST	'z'	/* Highest first character of a keyword */
+#define KEYWORD_MAX_LEN	31	/* Longest keyword we can index */
+
 static keyword_mapping_t keywordMap[] = {
     { K_AND, "and", KMF_XPATH_KW },
     { K_APPEND, "append", KMF_SLAX_KW },
@@ -352,16 +368,20 @@ slaxTtnameMap_t slaxTtnameMap[] = {
     { 0, NULL }
 };
 
+#define KEYWORD_MAP_SIZE (sizeof(keywordMap) / sizeof(keywordMap[0]))
+
+static unsigned short keywordIndex[KEYWORD_LAST - KEYWORD_FIRST + 1]
+				  [KEYWORD_MAX_LEN + 1];
+static unsigned short keywordNext[KEYWORD_MAP_SIZE];
+
 /*
- * Set up the lexer's lookup tables
+ * Build the lexer's lookup tables; called once, via slaxSetupLexer()
  */
-void
-slaxSetupLexer (void)
+static void
+slaxBuildLexerTables (void)
 {
     int i, ttype;
 
-    slaxSetup = 1;
-
     for (i = 0; singleWideData[i]; i += 2)
 	singleWide[singleWideData[i + 1]] = singleWideData[i];
 
@@ -375,12 +395,43 @@ slaxSetupLexer (void)
 	slaxKeywordString[slaxTokenTranslate(keywordMap[i].km_ttype)]
 	    = keywordMap[i].km_string;
 
+    /*
+     * Build the keyword dispatch table.  We walk keywordMap backwards
+     * so each chain lists entries in table order.
+     */
+    for (i = KEYWORD_MAP_SIZE - 2; i >= 0; i--) {
+	const char *str = keywordMap[i].km_string;
+	int len = strlen(str);
+	unsigned short *slotp;
+
+	if (*str < KEYWORD_FIRST || *str > KEYWORD_LAST
+		|| len > KEYWORD_MAX_LEN) {
+	    slaxLog("slax: lex: keyword '%s' cannot be indexed", str);
+	    continue;
+	}
+
+	slotp = &keywordIndex[*str - KEYWORD_FIRST][len];
+	keywordNext[i] = *slotp;
+	*slotp = i + 1;
+    }
+
     for (i = 0; slaxTtnameMap[i].st_ttype; i++) {
 	ttype = slaxTokenTranslate(slaxTtnameMap[i].st_ttype);
 	slaxTokenNameFancy[ttype] =  slaxTtnameMap[i].st_name;
     }
 }
 
+/*
+ * Set up the lexer's lookup tables.  The tables are shared by all
+ * threads and never change once built, so they are built exactly
+ * once, and every caller sees them complete.
+ */
+void
+slaxSetupLexer (void)
+{
+    slaxOnce(&slaxSetupOnce, slaxBuildLexerTables);
+}
+
 /*
  * Does the given character end a token?
  */
@@ -391,26 +442,35 @@ slaxIsFinalChar (int ch)
 }
 
 /*
- * Does the input buffer start with the given keyword?
+ * Find the keyword at the start of the input buffer, if there is one.
+ * A keyword must be followed by a character that cannot continue a
+ * bare word, so we measure the bare word and look up its first
+ * character and length in the dispatch table.
  */
-static int
-slaxKeywordMatch (slax_data_t *sdp, const char *str)
+static keyword_mapping_t *
+slaxKeywordLookup (slax_data_t *sdp, int *lenp)
 {
-    int len = strlen(str);
-    int ch;
-
-    if (sdp->sd_len - sdp->sd_start < len)
-	return FALSE;
+    const char *cp = sdp->sd_buf + sdp->sd_start;
+    int max = sdp->sd_len - sdp->sd_start;
+    int ch = *cp, len, i;
+    keyword_mapping_t *kmp;
 
-    if (memcmp(sdp->sd_buf + sdp->sd_start, str, len) != 0)
-	return FALSE;
+    if (ch < KEYWORD_FIRST || ch > KEYWORD_LAST)
+	return NULL;
 
-    ch = sdp->sd_buf[sdp->sd_start + len];
+    for (len = 1; len < max && slaxIsBareChar(cp[len]); len++)
+	if (len >= KEYWORD_MAX_LEN)
+	    return NULL;
 
-    if (slaxIsBareChar(ch))
-	return FALSE;
+    for (i = keywordIndex[ch - KEYWORD_FIRST][len]; i; i = keywordNext[i - 1]) {
+	kmp = &keywordMap[i - 1];
+	if (memcmp(cp, kmp->km_string, len) == 0) {
+	    *lenp = len;
+	    return kmp;
+	}
+    }
 
-    return TRUE;
+    return NULL;
 }
 
 /*
@@ -458,8 +518,6 @@ slaxTripleWide (slax_data_t *sdp UNUSED, int ch1, int ch2, int ch3)
  * Ignore XPath keywords if they are not allowed.  Same for SLAX keywords.
  * For node test tokens, we look ahead for the open paren before
  * returning the token type.
- *
- * (Should this use a hash or something?)
  */
 static int
 slaxKeyword (slax_data_t *sdp)
@@ -468,83 +526,81 @@ slaxKeyword (slax_data_t *sdp)
     int xpath_kwa = XPATH_KEYWORDS_ALLOWED(sdp);
     int json_kwa = JSON_KEYWORDS_ALLOWED(sdp);
     keyword_mapping_t *kmp;
-    int ch;
+    int ch, len;
 
-    for (kmp = keywordMap; kmp->km_string; kmp++) {
-	if (slaxKeywordMatch(sdp, kmp->km_string)) {
-	    if (json_kwa && (kmp->km_flags & KMF_JSON_KW))
-		return kmp->km_ttype;
+    kmp = slaxKeywordLookup(sdp, &len);
+    if (kmp == NULL)
+	return 0;
 
-	    if (slax_kwa && (kmp->km_flags & KMF_SLAX_KW))
-		return kmp->km_ttype;
+    if (json_kwa && (kmp->km_flags & KMF_JSON_KW))
+	return kmp->km_ttype;
 
-	    if (xpath_kwa && (kmp->km_flags & KMF_XPATH_KW))
-		return kmp->km_ttype;
-
-	    if ((sdp->sd_last == L_ASSIGN || sdp->sd_last == L_EQUALS)
-			&& (kmp->km_flags & KMF_STMT_KW)) {
-		int look = sdp->sd_cur + strlen(kmp->km_string);
+    if (slax_kwa && (kmp->km_flags & KMF_SLAX_KW))
+	return kmp->km_ttype;
 
-		for ( ; look < sdp->sd_len; look++) {
-		    ch = sdp->sd_buf[look];
+    if (xpath_kwa && (kmp->km_flags & KMF_XPATH_KW))
+	return kmp->km_ttype;
 
-		    /*
-		     * An underscore here could be either the
-		     * concatenation operator or a bare word ("_foo")
-		     * or even just "_" as a bare word. Compare
-		     * 'var $a = call _;' and 'var $a = call _ call;'.
-		     */
-		    if (ch == '_') {
-			ch = sdp->sd_buf[++look];
-			if (slaxIsBareChar(ch))
-			    return kmp->km_ttype;
+    if ((sdp->sd_last == L_ASSIGN || sdp->sd_last == L_EQUALS)
+		&& (kmp->km_flags & KMF_STMT_KW)) {
+	int look = sdp->sd_cur + len;
 
-			if (ch == 0 || ch == '(' || ch == ';')
-			    return kmp->km_ttype;
-
-			if (!isspace(ch))
-			    break;
+	for ( ; look < sdp->sd_len; look++) {
+	    ch = sdp->sd_buf[look];
 
-			for (;;) {
-			    if (look > sdp->sd_len)
-				return kmp->km_ttype;
+	    /*
+	     * An underscore here could be either the
+	     * concatenation operator or a bare word ("_foo")
+	     * or even just "_" as a bare word. Compare
+	     * 'var $a = call _;' and 'var $a = call _ call;'.
+	     */
+	    if (ch == '_') {
+		ch = sdp->sd_buf[++look];
+		if (slaxIsBareChar(ch))
+		    return kmp->km_ttype;
 
-			    ch = sdp->sd_buf[++look];
-			    if (ch == 0 || ch == '(' || ch == ';')
-				return kmp->km_ttype;
+		if (ch == 0 || ch == '(' || ch == ';')
+		    return kmp->km_ttype;
 
-			    if (isspace(ch))
-				continue;
+		if (!isspace(ch))
+		    break;
 
-			    if (slaxIsBareChar(ch))
-				break;
-			}
-			break;
+		for (;;) {
+		    if (look > sdp->sd_len)
+			return kmp->km_ttype;
 
-		    } else if (slaxIsBareChar(ch))
+		    ch = sdp->sd_buf[++look];
+		    if (ch == 0 || ch == '(' || ch == ';')
 			return kmp->km_ttype;
 
-		    if (!isspace(ch))
+		    if (isspace(ch))
+			continue;
+
+		    if (slaxIsBareChar(ch))
 			break;
 		}
-	    }
+		break;
 
-	    if (kmp->km_flags & KMF_NODE_TEST) {
-		int look = sdp->sd_cur + strlen(kmp->km_string);
+	    } else if (slaxIsBareChar(ch))
+		return kmp->km_ttype;
 
-		for ( ; look < sdp->sd_len; look++) {
-		    ch = sdp->sd_buf[look];
-		    if (ch == '(')
-			return kmp->km_ttype;
-		    if (ch != ' ' && ch != '\t')
-			break;
-		}
+	    if (!isspace(ch))
+		break;
+	}
+    }
 
-		/* Didn't see the open paren, so it's not a node test */
-	    }
+    if (kmp->km_flags & KMF_NODE_TEST) {
+	int look = sdp->sd_cur + len;
 
-	    return 0;
+	for ( ; look < sdp->sd_len; look++) {
+	    ch = sdp->sd_buf[look];
+	    if (ch == '(')
+		return kmp->km_ttype;
+	    if (ch != ' ' && ch != '\t')
+		break;
 	}
+
+	/* Didn't see the open paren, so it's not a node test */
     }
 
     return 0;
@@ -578,7 +634,7 @@ slaxGetInput (slax_data_t *sdp, int final)
      * complete string, so further reads should fail
      */
     if (sdp->sd_parse == M_PARSE_XPATH || sdp->sd_parse == M_PARSE_SLAX
-		|| sdp->sd_file == NULL)
+		|| sdp->sd_file == NULL || (sdp->sd_flags & SDF_WHOLE_FILE))
 	return TRUE;
 
     for (;;) {
@@ -668,6 +724,86 @@ slaxGetInput (slax_data_t *sdp, int final)
     }
 }
 
+/*
+ * Load the entire input file into sd_buf, so the lexer can work
+ * straight out of one buffer instead of making slaxGetInput() read,
+ * scan, and shift the input a line at a time.  Regular files are
+ * mmap'd when the tail of the last page guarantees a trailing NUL;
+ * otherwise they are read in one go.  Pipes and terminals are left
+ * to slaxGetInput().
+ */
+void
+slaxSetupWholeInput (slax_data_t *sdp)
+{
+    struct stat st;
+    size_t len;
+    char *buf;
+
+    if (sdp->sd_file == NULL || sdp->sd_buf != NULL)
+	return;
+
+    if (fstat(fileno(sdp->sd_file), &st) < 0 || !S_ISREG(st.st_mode)
+	    || st.st_size >= INT_MAX - SD_BUF_FUDGE
+	    || ftell(sdp->sd_file) != 0)
+	return;
+
+    len = st.st_size;
+
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+    {
+	long pagesize = sysconf(_SC_PAGESIZE);
+
+	if (len > 0 && pagesize > 0 && (len % pagesize) != 0) {
+	    buf = mmap(NULL, len, PROT_READ, MAP_PRIVATE,
+		       fileno(sdp->sd_file), 0);
+	    if (buf != MAP_FAILED) {
+		sdp->sd_map_size = len;
+		goto done;
+	    }
+	}
+    }
+#endif /* HAVE_MMAP && HAVE_SYS_MMAN_H */
+
+    buf = xmlMalloc(len + 1);
+    if (buf == NULL)
+	return;
+
+    len = fread(buf, 1, len, sdp->sd_file);
+    if (ferror(sdp->sd_file)) {
+	xmlFree(buf);
+	rewind(sdp->sd_file);
+	return;
+    }
+    buf[len] = '\0';
+
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+ done:
+#endif /* HAVE_MMAP && HAVE_SYS_MMAN_H */
+    sdp->sd_buf = buf;
+    sdp->sd_len = sdp->sd_size = len;
+    sdp->sd_flags |= SDF_WHOLE_FILE;
+
+    if (slaxLogIsEnabled)
+	slaxLog("slax: lex: %s whole file (%lu bytes)",
+		sdp->sd_map_size ? "mapped" : "read", (unsigned long) len);
+
+    /* Skip a leading BOM, as slaxGetInput() does */
+    if (len >= 3 && (unsigned char) buf[0] == 0xef
+	    && (unsigned char) buf[1] == 0xbb
+	    && (unsigned char) buf[2] == 0xbf)
+	sdp->sd_cur += 3;
+
+    /* Skip a leading "#!" line, counting it */
+    if (buf[sdp->sd_cur] == '#' && buf[sdp->sd_cur + 1] == '!') {
+	char *cp = memchr(buf + sdp->sd_cur, '\n', len - sdp->sd_cur);
+
+	sdp->sd_cur = cp ? cp - buf + 1 : (int) len;
+	sdp->sd_line += 1;
+    }
+
+    sdp->sd_start = sdp->sd_cur;
+}
+
 #define COMMENT_MARKER_SIZE 2	/* "\/\*" or "\*\/" */
 
 /**
@@ -837,7 +973,7 @@ slaxCheckAxisName (slax_data_t *sdp, slax_string_t *axis)
  * sad.  And since libxml2 doesn't perform this escaping, we are
  * left to do it ourselves.  We turn "--" into "-&#2d;"
  */
-static xmlChar *
+xmlChar *
 slaxCommentMakeValue (xmlChar *input)
 {
     static const char dash[] = "&#2d;"; /* XML character entity for dash */
@@ -1237,8 +1373,7 @@ slaxYylex (slax_data_t *sdp, YYSTYPE *yylvalp)
     int rc, look;
     slax_string_t *ssp = NULL;
 
-    if (!slaxSetup)
-	slaxSetupLexer();
+    slaxSetupLexer();
 
     /*
      * If we've saved a token type into sd_ttype, then we return
@@ -45,6 +45,7 @@ struct slax_data_s {
     int sd_len;			/* Last valid byte in sd_buf (+1) */
     int sd_size;		/* Size of sd_buf */
     char *sd_buf;		/* Input buffer */
+    size_t sd_map_size;		/* Size of mmap'd sd_buf (or zero) */
     xmlParserCtxtPtr sd_ctxt;	/* XML Parser context */
     xmlDocPtr sd_docp;		/* The XML document we are building */
     xmlNsPtr sd_xsl_ns;		/* Pointer to the XSL namespace */
@@ -69,6 +70,7 @@ struct slax_data_s {
 #define SDF_SLSH_COMMENTS	(1<<8) /* Allow C++ style comments */
 #define SDF_SLSH_OPEN		(1<<9) /* C++ style comments is open */
 #define SDF_STRING		(1<<10) /* Parse a YANG string argument */
+#define SDF_WHOLE_FILE		(1<<11) /* sd_buf holds the entire file */
 
 
 #define SDF_NO_KEYWORDS (SDF_NO_SLAX_KEYWORDS | SDF_NO_XPATH_KEYWORDS)
@@ -115,6 +117,12 @@ slaxYyerror (slax_data_t *sdp, const char *str, slax_string_t *yylval,
 char *
 slaxExpectingError (const char *token, int yystate, int yychar);
 
+/*
+ * Escape "--" in comment text, returning NULL if there's none
+ */
+xmlChar *
+slaxCommentMakeValue (xmlChar *input);
+
 /**
  * Make a child node and assign it proper file/line number info.
  */
@@ -218,6 +226,12 @@ slaxIsVarChar (int ch)
 int
 slaxGetInput (slax_data_t *sdp, int final);
 
+/*
+ * Load the entire input file into sd_buf, if we can
+ */
+void
+slaxSetupWholeInput (slax_data_t *sdp);
+
 int
 slaxParseIsSlax (slax_data_t *sdp);
 
@@ -20,6 +20,9 @@
 #include <ctype.h>
 #include <sys/queue.h>
 #include <errno.h>
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+#include <sys/mman.h>
+#endif
 
 #include <libxslt/extensions.h>
 #include <libxslt/documents.h>
@@ -38,6 +41,61 @@ const xmlChar slaxNull[] = "";
 static slax_data_list_t slaxIncludes;
 static int slaxIncludesInited;
 
+/*
+ * Counters for generated variable names (SLAX_NAME_*).  Each thread
+ * numbers its own names, so a script gets the same names no matter
+ * what other threads are parsing.  But the registry shares parsed
+ * import documents between scripts compiled on different threads,
+ * so while it compiles, names come from process-wide counters and
+ * never repeat.
+ */
+static SLAX_THREAD_LOCAL unsigned slaxNameCounters[SLAX_NAME_MAX];
+static SLAX_THREAD_LOCAL int slaxNameShared; /* Use the shared counters */
+static unsigned slaxNameSharedCounters[SLAX_NAME_MAX];
+static slax_mutex_t slaxNameLock = SLAX_MUTEX_INITIALIZER;
+
+/*
+ * Return the next number for a generated name.  The numbers keep
+ * climbing across scripts, so a script and the files it imports
+ * never generate the same name.
+ */
+unsigned
+slaxNameNext (unsigned kind)
+{
+    unsigned num;
+
+    if (!slaxNameShared)
+	return ++slaxNameCounters[kind];
+
+    slaxMutexLock(&slaxNameLock);
+    num = ++slaxNameSharedCounters[kind];
+    slaxMutexUnlock(&slaxNameLock);
+
+    return num;
+}
+
+/*
+ * Draw generated names from the process-wide counters (or stop),
+ * returning the previous setting
+ */
+int
+slaxNameSetShared (int shared)
+{
+    int old = slaxNameShared;
+
+    slaxNameShared = shared;
+    return old;
+}
+
+/*
+ * Restart the numbering of generated names on this thread
+ */
+void
+slaxNameReset (void)
+{
+    bzero(slaxNameCounters, sizeof(slaxNameCounters));
+}
+
 /*
  * Add a directory to the list of directories searched for files
  */
@@ -167,6 +225,174 @@ slaxCommentAdd (slax_data_t *sdp, slax_string_t *value)
     return nodep;
 }
 
+/*
+ * Characters in XPath names; non-ASCII bytes are taken on faith
+ */
+static inline int
+slaxXpathNameStart (int ch)
+{
+    return (isalpha(ch) || ch == '_' || (ch & 0x80));
+}
+
+static inline int
+slaxXpathNameChar (int ch)
+{
+    return (isalnum(ch) || ch == '_' || ch == '-' || ch == '.' || (ch & 0x80));
+}
+
+#define SLAX_RTF_MAX_DEPTH	32 /* Max nesting slaxExprMayBeRtf() follows */
+
+/*
+ * Could the value of this XPath expression be a result tree
+ * fragment?  Only variables and extension functions (including
+ * <func:function>s) give RTFs; both come with a "$" or a prefix.
+ * XPath's and XSLT's own functions, paths, literals, and numbers
+ * never do.  The value of an expression with a comparison, logical,
+ * or arithmetic operator outside of any predicate or argument list
+ * is a boolean or a number, whatever its operands are.
+ *
+ * Saying "yes" is always safe, so anything we don't follow gets
+ * a "yes".
+ */
+static int
+slaxExprMayBeRtf (const char *expr)
+{
+    const unsigned char *cp = (const unsigned char *) expr;
+    const unsigned char *word;
+    unsigned nested = 0;	/* Bit per open bracket: predicate or args */
+    int depth = 0;		/* Number of open brackets */
+    int suspect = FALSE;	/* Saw a variable or an extension function */
+    int operand = FALSE;	/* Previous token can be an operand */
+    int prefixed;
+    unsigned quote;
+
+    for ( ; *cp; cp++) {
+	int inner = (nested != 0);
+
+	if (isspace(*cp))
+	    continue;
+
+	if (*cp == '"' || *cp == '\'') {
+	    quote = *cp;
+	    for (cp++; *cp && *cp != quote; cp++)
+		continue;
+	    if (*cp == '\0')
+		return TRUE;
+	    operand = TRUE;
+	    continue;
+	}
+
+	if (isdigit(*cp) || (*cp == '.' && isdigit(cp[1]))) {
+	    while (isdigit(cp[1]) || cp[1] == '.')
+		cp++;
+	    operand = TRUE;
+	    continue;
+	}
+
+	if (slaxXpathNameStart(*cp)) {
+	    word = cp;
+	    while (slaxXpathNameChar(cp[1]))
+		cp++;
+
+	    /* An operator name comes only after an operand */
+	    if (!inner && operand) {
+		size_t len = cp - word + 1;
+
+		if ((len == 2 && strncmp((const char *) word, "or", 2) == 0)
+			|| (len == 3 && (strncmp((const char *) word, "and", 3) == 0
+				|| strncmp((const char *) word, "div", 3) == 0
+				|| strncmp((const char *) word, "mod", 3) == 0)))
+		    return FALSE;
+	    }
+
+	    /* A QName: "prefix:local", but not an axis ("child::") */
+	    prefixed = (cp[1] == ':' && slaxXpathNameStart(cp[2]));
+	    if (prefixed) {
+		for (cp += 2; slaxXpathNameChar(cp[1]); cp++)
+		    continue;
+	    }
+
+	    while (isspace(cp[1]))
+		cp++;
+
+	    if (cp[1] == '(') {
+		/* A function call (or node test); the args are inner */
+		if (prefixed && !inner)
+		    suspect = TRUE;
+		if (++depth > SLAX_RTF_MAX_DEPTH)
+		    return TRUE;
+		nested |= 1U << (depth - 1);
+		cp++;
+		operand = FALSE;
+		continue;
+	    }
+
+	    operand = TRUE;
+	    continue;
+	}
+
+	switch (*cp) {
+	case '$':
+	    if (!inner)
+		suspect = TRUE;
+	    while (slaxIsVarChar(cp[1]))
+		cp++;
+	    operand = TRUE;
+	    break;
+
+	case '(':		/* Grouping; its contents are still outer */
+	case '[':		/* Predicate */
+	    if (++depth > SLAX_RTF_MAX_DEPTH)
+		return TRUE;
+	    if (*cp == '[')
+		nested |= 1U << (depth - 1);
+	    operand = FALSE;
+	    break;
+
+	case ')':
+	case ']':
+	    if (depth <= 0)
+		return TRUE;
+	    nested &= ~(1U << (depth - 1));
+	    depth -= 1;
+	    operand = TRUE;
+	    break;
+
+	case '=':
+	case '<':
+	case '>':
+	case '+':
+	    if (!inner)
+		return FALSE;
+	    operand = FALSE;
+	    break;
+
+	case '!':
+	    if (!inner && cp[1] == '=')
+		return FALSE;
+	    operand = FALSE;
+	    break;
+
+	case '-':		/* Binary or unary minus, never in a name */
+	case '*':		/* Multiply, when it follows an operand */
+	    if (!inner && (*cp == '-' || operand))
+		return FALSE;
+	    operand = TRUE;	/* The "*" name test */
+	    break;
+
+	case '.':		/* "." and ".." */
+	    operand = TRUE;
+	    break;
+
+	default:		/* "/", "//", "|", "@", "::", "," */
+	    operand = FALSE;
+	    break;
+	}
+    }
+
+    return (depth != 0) ? TRUE : suspect;
+}
+
 /*
  * If we know we're about to assign a result tree fragment (RTF)
  * to a variable, punt and do The Right Thing.
@@ -187,8 +413,6 @@ slaxAvoidRtf (slax_data_t *sdp)
     static const char node_value_format[] = EXT_PREFIX ":node-set(%s)";
     static const char temp_name_format[] = "%s-temp-%u";
 
-    static unsigned temp_count;
-
     xmlNodePtr nodep = sdp->sd_ctxt->node;
     xmlNodePtr newp;
     xmlChar *name;
@@ -202,10 +426,11 @@ slaxAvoidRtf (slax_data_t *sdp)
      * via the 'select' attribute and via contents of the element
      * itself.  In most cases, the select attribute is not an RTF
      * and doesn't need the node-set() functionality.  The main exception
-     * is <func:function>s, which are cursed to return RTFs.  Since
-     * we can't "know" if the expression is a func:function and since
-     * the cost of node-set() is minimal, we just wrap the select
-     * expression in a node-set call.
+     * is <func:function>s, which are cursed to return RTFs.  We can't
+     * "know" the type of a variable or an extension function, so
+     * those get wrapped in a node-set call.  Anything else is left
+     * alone: node-set() does nothing to a node-set and rejects
+     * strings, numbers, and booleans outright.
      */
     sel = xmlGetProp(nodep, (const xmlChar *) ATT_SELECT);
     if (sel) {
@@ -217,6 +442,12 @@ slaxAvoidRtf (slax_data_t *sdp)
 	    return;
 	}
 
+	if (!slaxExprMayBeRtf((const char *) sel)) {
+	    slaxLog("AvoidRTF: not an RTF: '%s'", sel);
+	    xmlFreeAndEasy(sel);
+	    return;
+	}
+
 	format = node_value_format;
 	old_value = (char *) sel;
 	vlen = strlen(old_value);
@@ -233,7 +464,8 @@ slaxAvoidRtf (slax_data_t *sdp)
 	 */
 	vlen = clen + strlen(temp_name_format) + 10 + 1; /* 10 is max %u */
 	temp_name = alloca(vlen);
-	snprintf(temp_name, vlen, temp_name_format, name, ++temp_count);
+	snprintf(temp_name, vlen, temp_name_format, name,
+		 slaxNameNext(SLAX_NAME_TEMP));
 
 	(void) xmlSetProp(sdp->sd_ctxt->node, (const xmlChar *) ATT_NAME,
 			  (xmlChar *) temp_name);
@@ -455,10 +687,10 @@ void
 slaxHandleEltArgPrep (slax_data_t *sdp)
 {
     static const char varfmt[] = SLAX_ELTARG_FORMAT;
-    static unsigned varcount;
     char varname[sizeof(varfmt) + SLAX_ELTARG_WIDTH];
 
-    snprintf(varname, sizeof(varname), varfmt, ++varcount);
+    snprintf(varname, sizeof(varname), varfmt,
+	     slaxNameNext(SLAX_NAME_ELTARG));
 
     slaxLog("slaxHandleEltArgPrep: '%s'", varname);
 
@@ -647,9 +879,15 @@ void
 slaxDataCleanup (slax_data_t *sdp)
 {
     if (sdp->sd_buf) {
-	xmlFree(sdp->sd_buf);
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+	if (sdp->sd_map_size)
+	    munmap(sdp->sd_buf, sdp->sd_map_size);
+	else
+#endif /* HAVE_MMAP && HAVE_SYS_MMAN_H */
+	    xmlFree(sdp->sd_buf);
 	sdp->sd_buf = NULL;
 	sdp->sd_cur = sdp->sd_size = 0;
+	sdp->sd_map_size = 0;
     }
 
     sdp->sd_ns = NULL;		/* We didn't allocate this */
@@ -680,8 +918,17 @@ slaxLoadFile (const char *filename, FILE *file, xmlDictPtr dict, int partial)
     slax_data_t sd;
     xmlDocPtr res;
     int rc;
-    xmlParserCtxtPtr ctxt = xmlNewParserCtxt();
+    slax_cache_key_t key;
+    xmlParserCtxtPtr ctxt;
 
+    /* If we've already compiled this script, skip the parser entirely */
+    res = slaxCacheLoad(&key, filename, file, dict, partial);
+    if (res) {
+	slaxDynLoad(res);	/* Check dynamic extensions */
+	return res;
+    }
+
+    ctxt = xmlNewParserCtxt();
     if (ctxt == NULL)
 	return NULL;
 
@@ -706,6 +953,7 @@ slaxLoadFile (const char *filename, FILE *file, xmlDictPtr dict, int partial)
 
     strlcpy(sd.sd_filename, filename, sizeof(sd.sd_filename));
     sd.sd_file = file;
+    slaxSetupWholeInput(&sd);
 
     sd.sd_ctxt = ctxt;
 
@@ -740,6 +988,11 @@ slaxLoadFile (const char *filename, FILE *file, xmlDictPtr dict, int partial)
     /* Save docp before slaxDataCleanup nukes it */
     res = sd.sd_docp;
     sd.sd_docp = NULL;
+
+    /* Cache the result, if we parsed the file from a single buffer */
+    if (res && (sd.sd_flags & SDF_WHOLE_FILE))
+	slaxCacheStore(&key, sd.sd_buf, sd.sd_len, res);
+
     slaxDataCleanup(&sd);
 
     if (res)
@@ -1046,9 +1299,13 @@ slaxLoader (const xmlChar *url, xmlDictPtr dict, int options,
     xmlDocPtr docp;
     char buf[BUFSIZ];
 
-    if (!slaxIsSlaxFile((const char *) url))
-	return slaxOriginalXsltDocDefaultLoader(url, dict, options,
-					    callerCtxt, type);
+    if (!slaxIsSlaxFile((const char *) url)) {
+	docp = slaxOriginalXsltDocDefaultLoader(url, dict, options,
+						callerCtxt, type);
+	if (docp)
+	    slaxScriptAddDependency((const char *) url, NULL);
+	return docp;
+    }
 
     if (url[0] == '-' && url[1] == 0)
 	file = stdin;
@@ -1082,7 +1339,18 @@ slaxLoader (const xmlChar *url, xmlDictPtr dict, int options,
 	}
     }
 
-    docp = slaxLoadFile((const char *) url, file, dict, 0);
+    if (file != stdin) {
+	/* Record the file and share its document with other scripts */
+	slaxScriptAddDependency(buf, file);
+	docp = slaxScriptDocFind(buf, (const char *) url, file, dict);
+    } else
+	docp = NULL;
+
+    if (docp == NULL) {
+	docp = slaxLoadFile((const char *) url, file, dict, 0);
+	if (file != stdin)
+	    slaxScriptDocSave(buf, file, docp);
+    }
 
     if (file != stdin)
 	fclose(file);
@@ -1135,6 +1403,7 @@ slaxEnable (int enable)
 {
     if (enable == SLAX_CLEANUP) {
 	xsltSetLoaderFunc(NULL);
+	slaxXpathCacheFlush();
 	if (slaxIncludesInited)
 	    slaxDataListClean(&slaxIncludes);
 
@@ -1154,6 +1423,9 @@ slaxEnable (int enable)
 
 	slaxDynInit();
 
+	/* Build the lexer tables now, before any threads can race */
+	slaxSetupLexer();
+
 	/*
 	 * Save the original doc loader to pass non-slax file into
 	 */
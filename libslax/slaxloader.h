@@ -51,6 +51,30 @@ slaxCommentAdd (slax_data_t *sdp, slax_string_t *value);
 void
 slaxAvoidRtf (slax_data_t *sdp);
 
+/*
+ * The parser invents variable names when it rewrites statements.
+ * Each kind of name has its own counter, kept per thread, or shared
+ * by the whole process after slaxNameSetShared(TRUE).
+ */
+#define SLAX_NAME_TEMP		0 /* Temporary for slaxAvoidRtf() */
+#define SLAX_NAME_ELTARG	1 /* Element-as-argument variable */
+#define SLAX_NAME_TERNARY	2 /* Ternary operator variable */
+#define SLAX_NAME_FOR		3 /* Saved "." for "for" loops */
+#define SLAX_NAME_MAX		4 /* Number of counters */
+
+/*
+ * Return the next number for a generated name of the given kind
+ */
+unsigned
+slaxNameNext (unsigned kind);
+
+/*
+ * Use process-wide counters for generated names on this thread (or
+ * stop), returning the previous setting
+ */
+int
+slaxNameSetShared (int shared);
+
 /**
  * Create namespace alias between the prefix given and the
  * containing (current) prefix.
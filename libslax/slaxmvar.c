@@ -27,12 +27,25 @@
 #include "slaxparser.h"
 #include <ctype.h>
 #include <errno.h>
+#include <limits.h>
 
 #include <libxslt/extensions.h>
 #include <libxslt/xsltutils.h>
 #include <libxslt/transform.h>
 #include <libxml/xpathInternals.h>
 
+/*
+ * Where a variable was last found on the stack.  Locals can't be
+ * redefined within a template, so if the same stack element is
+ * still in the same frame of the current template, it's still the
+ * variable we want, and we can skip the search.
+ */
+typedef struct mvar_slot_s {
+    xsltTransformContextPtr ms_ctxt; /* Context it was found in */
+    xsltStackElemPtr ms_elem;	/* Stack element found */
+    int ms_frame;		/* Index in ctxt->varsTab */
+} mvar_slot_t;
+
 typedef struct mvar_precomp_s {
     xsltElemPreComp mp_comp;	/* Standard precomp header */
     xmlXPathCompExprPtr mp_select; /* Compiled select expression */
@@ -42,8 +55,29 @@ typedef struct mvar_precomp_s {
     xmlChar *mp_localname;	   /* Pointer to localname _in_ mp_name */
     xmlChar *mp_uri;		   /* Namespace of the variable */
     xmlChar *mp_svarname;	   /* Name of the shadow variable */
+    const xmlChar *mp_dname;	   /* mp_name, from the dictionary */
+    const xmlChar *mp_duri;	   /* mp_uri, from the dictionary */
+    const xmlChar *mp_svar_dname;  /* Shadow's local name, from the dict */
+    const xmlChar *mp_svar_duri;   /* Shadow's uri, from the dict */
+    int mp_global;		   /* Variable is known to be global */
 } mvar_precomp_t;
 
+/*
+ * The precomp belongs to the stylesheet, which may be shared by
+ * transforms running in several threads, so the slots can't live
+ * there.  Each thread keeps a small direct-mapped cache of them,
+ * keyed by the precomp.  A collision just costs a full search.
+ */
+#define MVAR_SLOT_CACHE	64	/* Entries in the cache (a power of 2) */
+
+typedef struct mvar_slot_cache_s {
+    const mvar_precomp_t *msc_comp; /* Statement that owns the slots */
+    mvar_slot_t msc_var;	/* Where the variable was last found */
+    mvar_slot_t msc_svar;	/* Where the shadow was last found */
+} mvar_slot_cache_t;
+
+static SLAX_THREAD_LOCAL mvar_slot_cache_t slaxMvarSlotCache[MVAR_SLOT_CACHE];
+
 /*
  * Make the variable name for the shadow variable.
  */
@@ -283,6 +317,73 @@ slaxMvarLookupQname (xsltTransformContextPtr tctxt, const xmlChar *svarname,
     return slaxMvarLookup(tctxt, lname, uri, localp);
 }
 
+/*
+ * Return this thread's slots for a precompiled mvar statement,
+ * taking over the cache entry if another statement holds it.
+ */
+static mvar_slot_cache_t *
+slaxMvarSlots (const mvar_precomp_t *comp)
+{
+    mvar_slot_cache_t *msp;
+
+    msp = &slaxMvarSlotCache[((uintptr_t) comp / sizeof(*comp))
+			     & (MVAR_SLOT_CACHE - 1)];
+    if (msp->msc_comp != comp) {
+	memset(msp, 0, sizeof(*msp));
+	msp->msc_comp = comp;
+    }
+
+    return msp;
+}
+
+/**
+ * Find a variable for a precompiled mvar statement, using (and
+ * updating) the slot where we last found it.  The names must come
+ * from the dictionary.
+ *
+ * @ctxt:  the XSLT transformation context
+ * @slot:  where the variable was last found
+ * @dname:  the variable name
+ * @duri:  the variable namespace URI
+ * @global:  the variable is known to be global
+ * @returns the variable or NULL if not found
+ */
+static xsltStackElemPtr
+slaxMvarSlotLookup (xsltTransformContextPtr ctxt, mvar_slot_t *slot,
+		    const xmlChar *dname, const xmlChar *duri, int global)
+{
+    xsltStackElemPtr cur;
+    int i;
+
+    if (!global) {
+	i = slot->ms_frame;
+	if (slot->ms_ctxt == ctxt && i >= ctxt->varsBase
+		&& i < ctxt->varsNr) {
+	    for (cur = ctxt->varsTab[i]; cur != NULL; cur = cur->next) {
+		if (cur == slot->ms_elem) {
+		    if (cur->name == dname && cur->nameURI == duri)
+			return cur;
+		    break;
+		}
+	    }
+	}
+
+	/* Same search as slaxMvarLocalLookup(), but remember the spot */
+	for (i = ctxt->varsNr - 1; i >= ctxt->varsBase; i--) {
+	    for (cur = ctxt->varsTab[i]; cur != NULL; cur = cur->next) {
+		if (cur->name == dname && cur->nameURI == duri) {
+		    slot->ms_ctxt = ctxt;
+		    slot->ms_elem = cur;
+		    slot->ms_frame = i;
+		    return cur;
+		}
+	    }
+	}
+    }
+
+    return slaxMvarGlobalLookup(ctxt, dname, duri);
+}
+
 /**
  * Decide if a value is scalar, meaning not a node set.
  *
@@ -328,12 +429,346 @@ slaxCastValueToString (xmlXPathObjectPtr value, int *freep)
  * Return the root document for a shadow variable (svar)
  */
 static xsltStackElemPtr
-slaxMvarGetSvar (xsltTransformContextPtr ctxt,
-		 xsltStackElemPtr var UNUSED,
-		 const xmlChar *mvarname UNUSED,
-		 const xmlChar *svarname)
+slaxMvarGetSvar (xsltTransformContextPtr ctxt, mvar_precomp_t *comp)
+{
+    return slaxMvarSlotLookup(ctxt, &slaxMvarSlots(comp)->msc_svar,
+			      comp->mp_svar_dname, comp->mp_svar_duri,
+			      comp->mp_global);
+}
+
+/*
+ * Scalar appends ("append $x += 'y'") are the classic way to build
+ * a large string in a loop, so we keep the buffer behind a string
+ * mvar's value oversized and grow it by doubling, making each append
+ * amortized O(1) instead of a copy of everything so far.
+ *
+ * The buffer is just the value's stringval, which libxml2 copies and
+ * frees like any other string.  Its length and capacity live here,
+ * in a small per-thread cache keyed by the mvar's stack element.
+ * libxslt recycles stack elements and XPath objects without telling
+ * us, so an entry also names the shadow variable's root container,
+ * which belongs to a single instance of the mvar.  Any container
+ * that could take the place of a dead instance's root is made or
+ * initialized by us, and slaxMvarStringForget() drops the entries
+ * naming it first.  A missing entry just means the next append
+ * starts a new buffer.
+ */
+#define MVAR_STRING_MIN	64	/* Smallest buffer we'll allocate */
+#define MVAR_STRING_CACHE 64	/* Entries in the cache (a power of 2) */
+
+typedef struct mvar_string_s {
+    xsltStackElemPtr ms_var;	/* Mutable variable */
+    xmlDocPtr ms_root;		/* Root container of its shadow */
+    xmlXPathObjectPtr ms_value;	/* Value of the variable */
+    xmlChar *ms_buf;		/* Stringval of the value */
+    int ms_len;			/* Length of the string */
+    int ms_size;		/* Bytes allocated at ms_buf */
+} mvar_string_t;
+
+static SLAX_THREAD_LOCAL mvar_string_t slaxMvarStringCache[MVAR_STRING_CACHE];
+
+static mvar_string_t *
+slaxMvarStringSlot (xsltStackElemPtr var)
+{
+    return &slaxMvarStringCache[((uintptr_t) var / sizeof(*var))
+				& (MVAR_STRING_CACHE - 1)];
+}
+
+/*
+ * Forget the string buffers of the mvar instance whose shadow's root
+ * container is (or was) at the given address
+ */
+static void
+slaxMvarStringForget (xmlDocPtr root)
+{
+    int i;
+
+    for (i = 0; i < MVAR_STRING_CACHE; i++)
+	if (slaxMvarStringCache[i].ms_root == root)
+	    memset(&slaxMvarStringCache[i], 0, sizeof(slaxMvarStringCache[i]));
+}
+
+/*
+ * Return the root container of a shadow variable, which identifies
+ * the instance of the mvar
+ */
+static xmlDocPtr
+slaxMvarSvarRoot (xsltStackElemPtr svar)
+{
+    xmlNodeSetPtr nset;
+
+    if (svar == NULL || svar->value == NULL)
+	return NULL;
+
+    nset = svar->value->nodesetval;
+    if (nset == NULL || nset->nodeNr == 0 || nset->nodeTab == NULL)
+	return NULL;
+
+    return (xmlDocPtr) nset->nodeTab[0];
+}
+
+/*
+ * Each non-scalar "set" gives an mvar a new shadow container, and
+ * the old one is kept in case something still points into it.  In
+ * a long "while" loop that adds up.  But between iterations of a
+ * loop, the only evaluation frames still active were set up before
+ * the loop started.  Local variables are immutable and evaluated
+ * when they are declared, and variables declared inside the loop's
+ * body are gone by then.  So a container made during the loop can
+ * no longer be reached once it has been superseded, or once the
+ * shadow variable that owns it has gone out of scope.
+ * slaxWhileElement() calls slaxMvarReclaim() between iterations to
+ * free such containers.
+ *
+ * Containers we make while a loop is running are recorded here,
+ * oldest first, with the generation they were made in.
+ */
+typedef struct mvar_reclaim_s {
+    xsltTransformContextPtr mr_ctxt; /* Transform context */
+    xmlDocPtr mr_container;	/* Shadow container */
+    xsltStackElemPtr mr_svar;	/* Shadow variable that owns it */
+    unsigned long mr_gen;	/* Generation it was made in */
+    int mr_superseded;		/* Replaced by a newer container */
+} mvar_reclaim_t;
+
+static SLAX_THREAD_LOCAL mvar_reclaim_t *slaxMvarRecTab;
+static SLAX_THREAD_LOCAL int slaxMvarRecNr;   /* Entries in use */
+static SLAX_THREAD_LOCAL int slaxMvarRecMax;  /* Entries allocated */
+static SLAX_THREAD_LOCAL unsigned long slaxMvarGen; /* Current generation */
+static SLAX_THREAD_LOCAL int slaxMvarLoopDepth; /* Active "while" loops */
+static SLAX_THREAD_LOCAL unsigned long slaxMvarReclaimed; /* Containers */
+static SLAX_THREAD_LOCAL unsigned long slaxMvarReclaimedBytes;
+
+/*
+ * Register a new container with the context and, if we're inside a
+ * loop, record it as a candidate for reclaiming.
+ */
+static void
+slaxMvarRecordContainer (xsltTransformContextPtr ctxt,
+			 xsltStackElemPtr svar, xmlDocPtr container)
+{
+    mvar_reclaim_t *mrp;
+
+    slaxMvarStringForget(container);
+    xsltRegisterPersistRVT(ctxt, container);
+
+    if (slaxMvarLoopDepth == 0)
+	return;
+
+    if (slaxMvarRecNr >= slaxMvarRecMax) {
+	int max = slaxMvarRecMax ? slaxMvarRecMax * 2 : 16;
+
+	mrp = xmlRealloc(slaxMvarRecTab, max * sizeof(*mrp));
+	if (mrp == NULL)
+	    return;		/* It just won't be reclaimed */
+
+	slaxMvarRecTab = mrp;
+	slaxMvarRecMax = max;
+    }
+
+    mrp = &slaxMvarRecTab[slaxMvarRecNr++];
+    mrp->mr_ctxt = ctxt;
+    mrp->mr_container = container;
+    mrp->mr_svar = svar;
+    mrp->mr_gen = slaxMvarGen;
+    mrp->mr_superseded = FALSE;
+}
+
+/*
+ * Note that a container has been replaced by a newer one
+ */
+static void
+slaxMvarSupersede (xmlDocPtr container)
+{
+    int i;
+
+    for (i = slaxMvarRecNr - 1; i >= 0; i--) {
+	if (slaxMvarRecTab[i].mr_container == container) {
+	    slaxMvarRecTab[i].mr_superseded = TRUE;
+	    break;
+	}
+    }
+}
+
+/*
+ * Return the history (node set of containers) of a shadow variable
+ * if it is still in scope and the container is part of it, or NULL
+ * if the variable is gone.
+ */
+static xmlNodeSetPtr
+slaxMvarSvarHistory (xsltTransformContextPtr ctxt, xsltStackElemPtr svar,
+		     xmlDocPtr container)
+{
+    xsltStackElemPtr cur = NULL;
+    xmlNodeSetPtr nset;
+    int i;
+
+    for (i = ctxt->varsNr - 1; i >= 0 && cur == NULL; i--)
+	for (cur = ctxt->varsTab[i]; cur; cur = cur->next)
+	    if (cur == svar)
+		break;
+
+    if (cur == NULL && ctxt->globalVars)
+	cur = xmlHashLookup2(ctxt->globalVars, svar->name, svar->nameURI);
+
+    if (cur != svar || svar->value == NULL)
+	return NULL;
+
+    /* The stack element may have been reused for another variable */
+    nset = svar->value->nodesetval;
+    if (nset == NULL || !xmlXPathNodeSetContains(nset, (xmlNodePtr) container))
+	return NULL;
+
+    return nset;
+}
+
+/*
+ * Return a rough count of the memory used by a tree
+ */
+static unsigned long
+slaxMvarTreeSize (xmlDocPtr docp)
+{
+    unsigned long size = sizeof(*docp);
+    xmlNodePtr nodep = docp->children;
+    xmlAttrPtr attr;
+    xmlNsPtr ns;
+
+    while (nodep) {
+	size += sizeof(*nodep);
+	if (nodep->content && nodep->content != (xmlChar *) &nodep->properties
+		&& !xmlDictOwns(docp->dict, nodep->content))
+	    size += xmlStrlen(nodep->content) + 1;
+
+	if (nodep->type == XML_ELEMENT_NODE) {
+	    for (attr = nodep->properties; attr; attr = attr->next) {
+		size += sizeof(*attr);
+		if (attr->children)
+		    size += sizeof(*attr->children)
+			+ xmlStrlen(attr->children->content) + 1;
+	    }
+	    for (ns = nodep->nsDef; ns; ns = ns->next)
+		size += sizeof(*ns);
+	}
+
+	/* Walk the tree in document order, without recursing */
+	if (nodep->type == XML_ELEMENT_NODE && nodep->children) {
+	    nodep = nodep->children;
+	    continue;
+	}
+	while (nodep && nodep->next == NULL)
+	    nodep = (nodep->parent == (xmlNodePtr) docp) ? NULL : nodep->parent;
+	if (nodep)
+	    nodep = nodep->next;
+    }
+
+    return size;
+}
+
+/*
+ * Unhook a container from the context's list of persistent RVTs
+ * and release it
+ */
+static void
+slaxMvarFreeContainer (xsltTransformContextPtr ctxt, xmlDocPtr container)
+{
+    if (container->prev)
+	container->prev->next = container->next;
+    else if (ctxt->persistRVT == container)
+	ctxt->persistRVT = (xmlDocPtr) container->next;
+    else
+	return;			/* Not ours after all; leave it be */
+
+    if (container->next)
+	container->next->prev = container->prev;
+    container->next = container->prev = NULL;
+
+    slaxMvarReclaimed += 1;
+    slaxMvarReclaimedBytes += slaxMvarTreeSize(container);
+    slaxMvarStringForget(container);
+
+    xsltReleaseRVT(ctxt, container);
+}
+
+/*
+ * Note the start of a loop, returning the mark to pass to
+ * slaxMvarReclaim() and slaxMvarLoopEnd()
+ */
+unsigned long
+slaxMvarLoopStart (void)
+{
+    slaxMvarLoopDepth += 1;
+    return ++slaxMvarGen;
+}
+
+/*
+ * Free the containers made since "mark" that can no longer be reached
+ */
+void
+slaxMvarReclaim (xsltTransformContextPtr ctxt, unsigned long mark)
+{
+    mvar_reclaim_t *mrp;
+    xmlNodeSetPtr history;
+    int i, j;
+
+    for (i = slaxMvarRecNr - 1; i >= 0; i--) {
+	mrp = &slaxMvarRecTab[i];
+	if (mrp->mr_gen < mark)
+	    break;
+
+	if (mrp->mr_ctxt != ctxt)
+	    continue;
+
+	/*
+	 * The current container of a shadow variable that's still in
+	 * scope is in use; superseded ones are just history.
+	 */
+	history = slaxMvarSvarHistory(ctxt, mrp->mr_svar, mrp->mr_container);
+	if (history) {
+	    if (!mrp->mr_superseded)
+		continue;
+	    xmlXPathNodeSetDel(history, (xmlNodePtr) mrp->mr_container);
+	}
+
+	slaxMvarFreeContainer(ctxt, mrp->mr_container);
+	mrp->mr_container = NULL;
+    }
+
+    /* Squeeze out the entries we've freed */
+    for (i = j = i + 1; i < slaxMvarRecNr; i++)
+	if (slaxMvarRecTab[i].mr_container)
+	    slaxMvarRecTab[j++] = slaxMvarRecTab[i];
+    slaxMvarRecNr = j;
+}
+
+/*
+ * Note the end of a loop.  Once the outermost loop is done, nothing
+ * we've recorded can be reclaimed, so forget it all and
+ * release the table.
+ */
+void
+slaxMvarLoopEnd (xsltTransformContextPtr ctxt, unsigned long mark)
 {
-    return slaxMvarLookupQname(ctxt, svarname, NULL);
+    slaxMvarReclaim(ctxt, mark);
+
+    if (--slaxMvarLoopDepth <= 0) {
+	slaxMvarLoopDepth = 0;
+	slaxMvarRecNr = slaxMvarRecMax = 0;
+	xmlFreeAndEasy(slaxMvarRecTab);
+	slaxMvarRecTab = NULL;
+    }
+
+    if (slaxMvarReclaimed)
+	slaxLog("mvar: reclaimed %lu containers (%lu bytes) so far",
+		slaxMvarReclaimed, slaxMvarReclaimedBytes);
+}
+
+void
+slaxMvarGetCounters (unsigned long *containersp, unsigned long *bytesp)
+{
+    if (containersp)
+	*containersp = slaxMvarReclaimed;
+    if (bytesp)
+	*bytesp = slaxMvarReclaimedBytes;
 }
 
 /*
@@ -360,7 +795,7 @@ slaxMvarGetSvarRoot (xsltTransformContextPtr ctxt, xsltStackElemPtr svar)
      * MUST be the context the variable appears in.  We force this
      * by having every mvar initialized (via slax:mvar-init()).
      */
-    xsltRegisterPersistRVT(ctxt, container);
+    slaxMvarRecordContainer(ctxt, svar, container);
 
     /*
      * We build value as a nodeset containing the RTF/RVT.  It's
@@ -383,7 +818,8 @@ slaxMvarGetSvarRoot (xsltTransformContextPtr ctxt, xsltStackElemPtr svar)
 }
 
 static xmlDocPtr
-slaxMvarNewContainer (xsltTransformContextPtr ctxt, xsltStackElemPtr svar)
+slaxMvarNewContainer (xsltTransformContextPtr ctxt, xsltStackElemPtr svar,
+		      xmlDocPtr *oldp)
 {
     xmlXPathObjectPtr value = svar->value;
     xmlDocPtr container;
@@ -399,13 +835,17 @@ slaxMvarNewContainer (xsltTransformContextPtr ctxt, xsltStackElemPtr svar)
 	return NULL;
 
     /*
-     * The garbage collection list is linked via the next/prev or
-     * RTFs.
+     * Each container is registered with the context on its own;
+     * the shadow variable's value keeps the history, newest last.
+     * The caller tells us (via slaxMvarSupersede()) when the old
+     * one has been replaced.
      */
-    prev = value->nodesetval->nodeTab[value->nodesetval->nodeNr - 1];
-    prev->next = (xmlNodePtr) container;
+    slaxMvarRecordContainer(ctxt, svar, container);
 
+    prev = value->nodesetval->nodeTab[value->nodesetval->nodeNr - 1];
     xmlXPathNodeSetAdd(value->nodesetval, (xmlNodePtr) container);
+    if (oldp)
+	*oldp = (xmlDocPtr) prev;
 
     return container;
 }
@@ -432,21 +872,107 @@ slaxMvarAdd (xmlDocPtr container, xmlNodeSetPtr res, xmlNodePtr cur)
 
     newp = xmlDocCopyNode(cur, container, 1);
     if (newp) {
-	xmlAddChild((xmlNodePtr) container, newp);
-	if (res)
+	newp = xmlAddChild((xmlNodePtr) container, newp);
+	if (res && newp)
 	    xmlXPathNodeSetAdd(res, newp);
     }
 }
 
+/*
+ * Move (rather than copy) a node from an RTF we own into the
+ * container.  The adopt call fixes up any namespace references that
+ * point into the old document, like its "xml" namespace.
+ */
+static void
+slaxMvarMove (xmlDocPtr container, xmlNodeSetPtr res, xmlNodePtr cur)
+{
+    xmlDocPtr olddoc = cur->doc;
+
+    xmlUnlinkNode(cur);
+    if (olddoc != container
+	    && xmlDOMWrapAdoptNode(NULL, olddoc, cur, container,
+				   (xmlNodePtr) container, 0) != 0) {
+	xmlFreeNode(cur);
+	return;
+    }
+
+    cur = xmlAddChild((xmlNodePtr) container, cur);
+    if (res && cur)
+	xmlXPathNodeSetAdd(res, cur);
+}
+
+/*
+ * Add the children of an RTF to the container, moving them when
+ * the RTF is ours alone to gut, and copying them otherwise.
+ */
+static void
+slaxMvarAddChildren (xmlDocPtr container, xmlNodeSetPtr res,
+		     xmlNodePtr rtf, int owned)
+{
+    xmlNodePtr cur, next;
+
+    for (cur = rtf->children; cur; cur = next) {
+	next = cur->next;
+	if (owned)
+	    slaxMvarMove(container, res, cur);
+	else
+	    slaxMvarAdd(container, res, cur);
+    }
+}
+
+/*
+ * Decide whether the RTF "rtf" in node set "nset" belongs to the
+ * current statement alone, so its nodes can be moved instead of
+ * copied.  "owned" is an RTF we built ourselves (the statement's
+ * content).  Otherwise the RTF must have been registered as a local
+ * RVT after "base", meaning it was created while evaluating the
+ * statement's select expression (e.g. a function's result) and
+ * isn't a variable's value, and nothing else in the node set can
+ * point into it.
+ */
+static int
+slaxMvarOwnsRtf (xsltTransformContextPtr ctxt, xmlDocPtr base,
+		 xmlDocPtr owned, xmlNodeSetPtr nset, xmlNodePtr rtf)
+{
+    xmlDocPtr doc;
+    xmlNodePtr cur;
+    int i;
+
+    if (rtf == (xmlNodePtr) owned)
+	return TRUE;
+
+    for (doc = ctxt->localRVT; doc && doc != base;
+	 doc = (xmlDocPtr) doc->next)
+	if ((xmlNodePtr) doc == rtf)
+	    break;
+
+    if (doc == NULL || doc == base)
+	return FALSE;
+
+    for (i = 0; i < nset->nodeNr; i++) {
+	cur = nset->nodeTab[i];
+	if (cur == NULL || cur == rtf)
+	    continue;
+	if (cur->type == XML_NAMESPACE_DECL
+		|| (xmlNodePtr) cur->doc == rtf)
+	    return FALSE;
+    }
+
+    return TRUE;
+}
+
 /*
  * Set a mutable variable to the given value
  */
 static int
 slaxMvarSet (xsltTransformContextPtr ctxt, const xmlChar *name,
-	     const xmlChar *svarname, const xmlChar *uri UNUSED,
-	     xsltStackElemPtr var, xmlXPathObjectPtr value)
+	     const xmlChar *svarname, mvar_precomp_t *comp,
+	     xsltStackElemPtr var, xmlXPathObjectPtr value,
+	     xmlDocPtr base, xmlDocPtr tree)
 {
     xmlXPathObjectPtr old_value;
+    xmlDocPtr old_container = NULL;
+    mvar_string_t *msp;
     int i;
 
     slaxLog("mvar: set: %s --> %p (%p)", name, value, var->value);
@@ -461,7 +987,7 @@ slaxMvarSet (xsltTransformContextPtr ctxt, const xmlChar *name,
 	xmlNodeSetPtr res = NULL;
 	xmlNodeSetPtr nset = value->nodesetval;
 
-	svar = slaxMvarGetSvar(ctxt, var, name, svarname);
+	svar = slaxMvarGetSvar(ctxt, comp);
 	if (svar == NULL) {
 	    slaxTransformError2(ctxt,
 				"found not find shadow variable for %s (%s)",
@@ -469,19 +995,20 @@ slaxMvarSet (xsltTransformContextPtr ctxt, const xmlChar *name,
 	    return TRUE;
 	}
 
-	container = slaxMvarNewContainer(ctxt, svar);
-	if (container == NULL) {
+	res = xmlXPathNodeSetCreate(NULL);
+	if (res == NULL) {
 	    slaxTransformError2(ctxt,
-				"found not find shadow container for %s (%s)",
+				"found not make node set for %s (%s)",
 				name, svarname);
 	    return TRUE;
 	}
 
-	res = xmlXPathNodeSetCreate(NULL);
-	if (res == NULL) {
+	container = slaxMvarNewContainer(ctxt, svar, &old_container);
+	if (container == NULL) {
 	    slaxTransformError2(ctxt,
-				"found not make node set for %s (%s)",
+				"found not find shadow container for %s (%s)",
 				name, svarname);
+	    xmlXPathFreeNodeSet(res);
 	    return TRUE;
 	}
 
@@ -491,8 +1018,8 @@ slaxMvarSet (xsltTransformContextPtr ctxt, const xmlChar *name,
 		continue;
 
 	    if (XSLT_IS_RES_TREE_FRAG(cur)) {
-		for (cur = cur->children; cur; cur = cur->next)
-		    slaxMvarAdd(container, NULL, cur);
+		slaxMvarAddChildren(container, NULL, cur,
+			slaxMvarOwnsRtf(ctxt, base, tree, nset, cur));
 		xmlXPathNodeSetAdd(res, (xmlNodePtr) container);
 	    } else {
 		slaxMvarAdd(container, res, cur);
@@ -505,6 +1032,11 @@ slaxMvarSet (xsltTransformContextPtr ctxt, const xmlChar *name,
 	value = xmlXPathWrapNodeSet(res);
     }
 
+    /* Any string buffer we kept for the old value goes with it */
+    msp = slaxMvarStringSlot(var);
+    if (msp->ms_var == var)
+	memset(msp, 0, sizeof(*msp));
+
     /* Substitute our new value into the variable */
     old_value = var->value;
     var->value = value;
@@ -517,9 +1049,110 @@ slaxMvarSet (xsltTransformContextPtr ctxt, const xmlChar *name,
      */
     xmlXPathFreeObject(old_value);
 
+    /* Nothing of ours points into the old container now */
+    if (old_container)
+	slaxMvarSupersede(old_container);
+
     return FALSE;
 }
 
+/*
+ * Append the string value of "value" to the scalar value of "var",
+ * in place when possible.  Returns TRUE on allocation failure.
+ */
+static int
+slaxMvarAppendString (xsltStackElemPtr var, xsltStackElemPtr svar,
+		      xmlXPathObjectPtr value)
+{
+    mvar_string_t *msp = slaxMvarStringSlot(var);
+    xmlXPathObjectPtr obj = var->value;
+    xmlDocPtr root = slaxMvarSvarRoot(svar);
+    xmlChar *new_str, *buf;
+    int new_len, old_len, need, size;
+    int new_free = FALSE;
+
+    if (value->type == XPATH_STRING) {
+	new_str = value->stringval;
+    } else {
+	new_str = xmlXPathCastToString(value);
+	new_free = TRUE;
+    }
+    new_len = new_str ? xmlStrlen(new_str) : 0;
+
+    if (obj == NULL || root == NULL || msp->ms_var != var
+	    || msp->ms_root != root || msp->ms_value != obj
+	    || obj->type != XPATH_STRING || obj->stringval != msp->ms_buf) {
+	/*
+	 * First append since the last set: take ownership of the
+	 * current string value, making one if it's a number/boolean.
+	 */
+	xmlChar *old_str;
+
+	memset(msp, 0, sizeof(*msp));
+
+	if (obj && obj->type == XPATH_STRING && obj->stringval) {
+	    old_str = obj->stringval;
+	    obj->stringval = NULL;
+	} else {
+	    old_str = obj ? xmlXPathCastToString(obj) : NULL;
+	}
+
+	if (obj)
+	    xmlXPathFreeObject(obj);
+
+	obj = var->value = xmlXPathWrapString(old_str);
+	if (obj == NULL) {
+	    xmlFreeAndEasy(old_str);
+	    goto fail;
+	}
+
+	old_len = old_str ? xmlStrlen(old_str) : 0;
+	msp->ms_var = var;
+	msp->ms_root = root;
+	msp->ms_value = obj;
+	msp->ms_buf = obj->stringval;
+	msp->ms_len = old_len;
+	msp->ms_size = old_len + 1;
+    }
+
+    old_len = msp->ms_len;
+    need = old_len + new_len + 1;
+    if (need < 0)		/* Overflow */
+	goto fail;
+
+    if (need > msp->ms_size || obj->stringval == NULL) {
+	size = msp->ms_size < MVAR_STRING_MIN ? MVAR_STRING_MIN : msp->ms_size;
+	while (size < need) {
+	    if (size > INT_MAX / 2) {
+		size = need;
+		break;
+	    }
+	    size *= 2;
+	}
+
+	buf = xmlRealloc(obj->stringval, size);
+	if (buf == NULL)
+	    goto fail;
+
+	obj->stringval = msp->ms_buf = buf;
+	msp->ms_size = size;
+    }
+
+    if (new_len)
+	memcpy(obj->stringval + old_len, new_str, new_len);
+    obj->stringval[old_len + new_len] = '\0';
+    msp->ms_len = old_len + new_len;
+
+    if (new_free)
+	xmlFreeAndEasy(new_str);
+    return FALSE;
+
+ fail:
+    if (new_free)
+	xmlFreeAndEasy(new_str);
+    return TRUE;
+}
+
 /*
  * Append a value to a variable.  There are four possibilities here:
  *
@@ -533,8 +1166,9 @@ slaxMvarSet (xsltTransformContextPtr ctxt, const xmlChar *name,
  */
 static int
 slaxMvarAppend (xsltTransformContextPtr ctxt, const xmlChar *name,
-		const xmlChar *svarname UNUSED, const xmlChar *uri UNUSED,
-		xsltStackElemPtr var, xmlXPathObjectPtr value, xmlDocPtr tree)
+		const xmlChar *svarname, mvar_precomp_t *comp,
+		xsltStackElemPtr var, xmlXPathObjectPtr value,
+		xmlDocPtr base, xmlDocPtr tree)
 {
     xmlNodePtr newp = NULL, cur;
     xmlDocPtr container;
@@ -553,24 +1187,9 @@ slaxMvarAppend (xsltTransformContextPtr ctxt, const xmlChar *name,
 	    /*
 	     * case #1: [ scalar var / scalar value ] -> string concatenation
 	     */
-	    xmlChar *old_str = xmlXPathCastToString(var->value);
-	    xmlChar *new_str = xmlXPathCastToString(value);
-	    int old_len = old_str ? xmlStrlen(old_str) : 0;
-	    int new_len = new_str ? xmlStrlen(new_str) : 0;
-	    xmlChar *buf = xmlMalloc(old_len + new_len + 1);
-
-	    if (buf) {
-		memcpy(buf, old_str, old_len);
-		memcpy(buf + old_len, new_str, new_len);
-		buf[old_len + new_len] = '\0';
-
-		xmlXPathFreeObject(var->value);
-		var->value = xmlXPathWrapString(buf);
-	    }
-
-	    /* Free the values if we allocated them */
-	    xmlFreeAndEasy(old_str);
-	    xmlFreeAndEasy(new_str);
+	    if (slaxMvarAppendString(var, slaxMvarGetSvar(ctxt, comp), value))
+		slaxTransformError2(ctxt, "could not append to %s (%s)",
+				    name, svarname);
 
 	    return FALSE;
 
@@ -604,7 +1223,7 @@ slaxMvarAppend (xsltTransformContextPtr ctxt, const xmlChar *name,
 	}
     }
 
-    svar = slaxMvarGetSvar(ctxt, var, name, svarname);
+    svar = slaxMvarGetSvar(ctxt, comp);
     if (svar == NULL) {
 	slaxTransformError2(ctxt,
 			    "found not find shadow variable for %s (%s)",
@@ -652,21 +1271,14 @@ slaxMvarAppend (xsltTransformContextPtr ctxt, const xmlChar *name,
 	if (cur) {
 	    xmlAddChild(cur, newp);
 
-	    /* Add one node to the variable */
-	    slaxMvarAdd(container, NULL, cur);
-
-	    /*
-	     * Since slaxMvarAdd has copied cur into the container tree,
-	     * we need to release cur.
-	     */
-	    xmlFreeNode(cur);
+	    /* Add one node to the variable; it's already in our doc */
+	    xmlAddChild((xmlNodePtr) container, cur);
 	} else
 	    xmlFreeNode(newp); /* Clean up on error */
 
     } else if (tree) {
-	/* Add all the nodes in a tree to the variable */
-	for (cur = tree->children; cur; cur = cur->next)
-	    slaxMvarAdd(container, NULL, cur);
+	/* Move all the nodes in our tree to the variable */
+	slaxMvarAddChildren(container, NULL, (xmlNodePtr) tree, TRUE);
 
     } else if (nset) {
 	/* Add everything in the node set to the variable */
@@ -676,8 +1288,8 @@ slaxMvarAppend (xsltTransformContextPtr ctxt, const xmlChar *name,
 		continue;
 
 	    if (XSLT_IS_RES_TREE_FRAG(cur)) {
-		for (cur = cur->children; cur; cur = cur->next)
-		    slaxMvarAdd(container, NULL, cur);
+		slaxMvarAddChildren(container, NULL, cur,
+			slaxMvarOwnsRtf(ctxt, base, NULL, nset, cur));
 	    } else {
 		slaxMvarAdd(container, NULL, cur);
 	    }
@@ -689,12 +1301,26 @@ slaxMvarAppend (xsltTransformContextPtr ctxt, const xmlChar *name,
 
 static xmlNodePtr
 slaxFindVariable (xsltStylesheetPtr style UNUSED, xmlNodePtr inst,
-		  const xmlChar *name, const xmlChar *uri)
+		  const xmlChar *name, const xmlChar *uri, const char *elt)
 {
     xmlNodePtr parent, child;
     xmlChar *vname, *local;
 
     for (parent = inst; parent; parent = parent->parent) {
+	/* A <slax:for> binds its variable for everything inside it */
+	if (parent != inst && parent->type == XML_ELEMENT_NODE
+		&& streq(elt, ELT_VARIABLE)
+		&& streq((const char *) parent->name, ELT_FOR)
+		&& parent->ns && parent->ns->href
+		&& streq((const char *) parent->ns->href, SLAX_URI)) {
+	    vname = xmlGetNsProp(parent, (const xmlChar *) ATT_NAME, NULL);
+	    if (vname && uri == NULL && xmlStrEqual(vname, name)) {
+		xmlFree(vname);
+		return parent;
+	    }
+	    xmlFreeAndEasy(vname);
+	}
+
 	for (child = parent->children; child; child = child->next) {
 	    if (child->type != XML_ELEMENT_NODE)
 		continue;
@@ -705,7 +1331,7 @@ slaxFindVariable (xsltStylesheetPtr style UNUSED, xmlNodePtr inst,
 		      	? child->ns->prefix : slaxNull,
 		      child->name, child->type);
 
-	    if (!streq((const char *) child->name, ELT_VARIABLE))
+	    if (!streq((const char *) child->name, elt))
 		continue;
 
 	    if (child->ns == NULL || child->ns->href == NULL)
@@ -810,7 +1436,8 @@ slaxMvarCompile (xsltStylesheetPtr style, xmlNodePtr inst,
     }
 
     /* Look up the variable to report syntax errors */
-    var = slaxFindVariable(style, inst, comp->mp_localname, NULL);
+    var = slaxFindVariable(style, inst, comp->mp_localname, NULL,
+			   ELT_VARIABLE);
     if (var == NULL) {
 	slaxLog("mvar: variable not found '%s'.\n", comp->mp_localname);
 
@@ -862,6 +1489,38 @@ slaxMvarCompile (xsltStylesheetPtr style, xmlNodePtr inst,
 	style->errors += 1;
     }
 
+    /*
+     * Intern the names we look up at run time.  The transform
+     * context's dictionary is a child of the stylesheet's, so these
+     * are the same pointers the stack elements carry.
+     */
+    if (comp->mp_name)
+	comp->mp_dname = xmlDictLookup(style->dict, comp->mp_name, -1);
+    if (comp->mp_uri)
+	comp->mp_duri = xmlDictLookup(style->dict, comp->mp_uri, -1);
+    if (comp->mp_svarname) {
+	const xmlChar *lname = xmlStrchr(comp->mp_svarname, ':');
+
+	if (lname) {
+	    comp->mp_svar_duri = xmlDictLookup(style->dict, comp->mp_svarname,
+					       lname - comp->mp_svarname);
+	    lname += 1;
+	} else
+	    lname = comp->mp_svarname;
+	comp->mp_svar_dname = xmlDictLookup(style->dict, lname, -1);
+    }
+
+    /*
+     * An unqualified variable declared at the top level, with no
+     * parameter of the same name in sight, can only be global, so
+     * run-time lookups can go straight to the global table.
+     */
+    if (var && var->parent && var->parent->parent == (xmlNodePtr) var->doc
+	    && comp->mp_localname == comp->mp_name
+	    && slaxFindVariable(style, inst, comp->mp_localname, NULL,
+				ELT_PARAM) == NULL)
+	comp->mp_global = TRUE;
+
     /* Prebuild the namespace list */
     comp->mp_nslist = xmlGetNsList(inst->doc, inst);
     if (comp->mp_nslist != NULL) {
@@ -947,8 +1606,8 @@ slaxMvarElement (xsltTransformContextPtr ctxt,
 {
     xmlXPathObjectPtr value = NULL;
     xmlDocPtr tree = NULL;
+    xmlDocPtr base = ctxt->localRVT; /* RVTs made after this are ours */
     xsltStackElemPtr var;
-    int local;
 
     if (comp->mp_select) {
 	value = slaxMvarEvalString(ctxt, node,
@@ -965,18 +1624,21 @@ slaxMvarElement (xsltTransformContextPtr ctxt,
     } else
 	return;
 
-    var = slaxMvarLookup (ctxt, comp->mp_name, comp->mp_uri, &local);
+    var = slaxMvarSlotLookup(ctxt, &slaxMvarSlots(comp)->msc_var,
+			     comp->mp_dname, comp->mp_duri, comp->mp_global);
     if (var == NULL) {
 	xsltGenericError(xsltGenericErrorContext,
 			 "mvar variable not found: %s\n", comp->mp_name);
 	if (value)
 	    xmlXPathFreeObject(value);
+	if (tree)
+	    xmlFreeDoc(tree);
 	return;
     }
 
     if (append) {
 	slaxMvarAppend(ctxt, comp->mp_localname, comp->mp_svarname,
-		       comp->mp_uri, var, value, tree);
+		       comp, var, value, base, tree);
 
 	if (tree)
 	    xmlFreeDoc(tree);
@@ -994,7 +1656,7 @@ slaxMvarElement (xsltTransformContextPtr ctxt,
 
 	/* slaxMvarSet() consumed value and/or table, so don't free them */
 	slaxMvarSet(ctxt, comp->mp_localname, comp->mp_svarname,
-		    comp->mp_uri, var, value);
+		    comp, var, value, base, tree);
     }
 }
 
@@ -1094,6 +1756,9 @@ slaxMvarInit (xmlXPathParserContextPtr ctxt, int nargs)
      */
     container = slaxMvarLastContainer(tctxt, svar);
 
+    /* A new instance may have the root of an old one's shadow */
+    slaxMvarStringForget(slaxMvarSvarRoot(svar));
+
     if (xop) {
 	/*
 	 * xop is the new value that needs assigned to the var.  If
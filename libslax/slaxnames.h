@@ -58,6 +58,7 @@
 #define ATT_SVARNAME	"svarname"
 #define ATT_TERMINATE	"terminate"
 #define ATT_TEST	"test"
+#define ATT_TO		"to"
 #define ATT_TYPE	"type"
 #define ATT_UID		"uid"
 #define ATT_USE		"use"
@@ -89,6 +90,7 @@
 #define ELT_ERRNO	"errno"
 #define ELT_ERROR	"error"
 #define ELT_EXECUTABLE	"executable"
+#define ELT_FOR		"for"
 #define ELT_FOR_EACH	"for-each"
 #define ELT_FUNCTION	"function"
 #define ELT_GROUP	"group"
@@ -112,6 +114,7 @@
 #define ELT_PERMISSIONS "permissions"
 #define ELT_PRETTY	"pretty"
 #define ELT_QUOTES	"quotes"
+#define ELT_RECORD	"record"
 #define ELT_RECURSE	"recurse"
 #define ELT_RESULT	"result"
 #define ELT_SET_VARIABLE "set-variable"
@@ -1900,7 +1900,7 @@ for_each_stmt :
 	;
 
 for_stmt :
-	K_FOR T_VAR L_OPAREN xpath_expr_dotdotdot L_CPAREN
+	K_FOR T_VAR L_OPAREN xpath_expression L_CPAREN
 		{
 		    /*
 		     * The for loop is a little tricky.  We are creating
@@ -1914,12 +1914,11 @@ for_stmt :
 		     * }
 		     * This allows "." to remain unchanged.
 		     */
-		    static unsigned for_count;
 		    char buf[BUFSIZ];
 
 		    /* var $slax-dot-xxx = . */
 		    snprintf(buf, sizeof(buf), "%s%u",
-			     FOR_VARIABLE_PREFIX, ++for_count);
+			     FOR_VARIABLE_PREFIX, slaxNameNext(SLAX_NAME_FOR));
 		    slaxElementPush(slax_data, ELT_VARIABLE,
 				    ATT_NAME, buf + 1);
 		    slaxAttribAddLiteral(slax_data, ATT_SELECT, ".");
@@ -1929,10 +1928,6 @@ for_stmt :
 		    slaxElementPush(slax_data, ELT_FOR_EACH, NULL, NULL);
 		    slaxAttribAdd(slax_data, SAS_XPATH, ATT_SELECT, $4);
 
-		    if ($4->ss_ttype == M_SEQUENCE)
-			slaxSetSlaxNs(slax_data,
-				      slax_data->sd_ctxt->node, FALSE);
-
 		    /* Inner variable */
 		    slaxElementPush(slax_data, ELT_VARIABLE,
 				    ATT_NAME, $2->ss_token + 1);
@@ -1951,6 +1946,34 @@ for_stmt :
 		    $$ = STACK_CLEAR($1);
 		    STACK_UNUSED($6);
 		}
+
+	| K_FOR T_VAR L_OPAREN xpath_expression L_DOTDOTDOT
+			xpath_expression L_CPAREN
+		{
+		    /*
+		     * A range of integers doesn't need a node per
+		     * member, so we make a <slax:for> that counts
+		     * from one end to the other, binding the variable
+		     * to each number in turn.  "." is left untouched.
+		     */
+		    xmlNodePtr nodep;
+
+		    nodep = slaxElementPush(slax_data, ELT_FOR,
+					    ATT_NAME, $2->ss_token + 1);
+		    slaxAttribAdd(slax_data, SAS_XPATH, ATT_FROM, $4);
+		    slaxAttribAdd(slax_data, SAS_XPATH, ATT_TO, $6);
+
+		    if (nodep)
+			slaxSetSlaxNs(slax_data, nodep, TRUE);
+
+		    $$ = NULL;
+		}
+	    block
+		{
+		    slaxElementPop(slax_data);
+		    $$ = STACK_CLEAR($1);
+		    STACK_UNUSED($8);
+		}
 	;
 
 while_stmt :
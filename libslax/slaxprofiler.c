@@ -50,9 +50,12 @@ typedef struct slax_prof_s {
     slax_prof_entry_t sp_data[0]; /* Raw data, indexed by line number */
 } slax_prof_t;
 
-slax_prof_t *slax_profile;	/* Profiling data */
-time_usecs_t slax_profile_time_user; /* Last user time from getrusage */
-unsigned long slax_profile_time_system; /* Last system time from getrusage */
+/* Profiling follows the transform, so each thread has its own */
+static SLAX_THREAD_LOCAL slax_prof_t *slax_profile; /* Profiling data */
+static SLAX_THREAD_LOCAL time_usecs_t slax_profile_time_user;
+				/* Last user time from getrusage */
+static SLAX_THREAD_LOCAL unsigned long slax_profile_time_system;
+				/* Last system time from getrusage */
 
 static unsigned
 slaxProfCountLines (xmlDocPtr docp)
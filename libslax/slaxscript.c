@@ -0,0 +1,529 @@
+/*
+ * Copyright (c) 2013, Juniper Networks, Inc.
+ * All rights reserved.
+ * This SOFTWARE is licensed under the LICENSE provided in the
+ * ../Copyright file. By downloading, installing, copying, or otherwise
+ * using the SOFTWARE, you agree to be bound by the terms of that
+ * LICENSE.
+ *
+ * slaxscript.c -- in-process registry of compiled stylesheets
+ *
+ * Programs that embed libslax and run the same scripts over and over
+ * can use slaxScriptCacheGet() to get a compiled stylesheet, instead
+ * of calling slaxLoadFile() and xsltParseStylesheetDoc() each time.
+ * The stylesheet is compiled on first use and kept in the registry,
+ * where it is reference counted, so it can be handed out to several
+ * callers and is only freed once nobody holds it.
+ *
+ * While a script is compiled, slaxLoader() tells us about every
+ * file it loads for "import" and "include" statements, giving us
+ * the script's dependency closure.  Each later lookup stat()s the
+ * script and its dependencies, and recompiles if any has changed.
+ *
+ * Parsed import and include documents are also kept, so scripts that
+ * share library files parse them once.  They are keyed on the path
+ * the name resolved to, since the same relative name can find
+ * different files for different scripts.  libxslt takes ownership of
+ * the documents it loads, so the loader is given a copy, built in
+ * the dictionary of the importing stylesheet since libxslt compares
+ * interned names by address.
+ */
+
+#include "slaxinternals.h"
+#include <libslax/slax.h>
+#include <sys/stat.h>
+#include <sys/queue.h>
+#include <errno.h>
+
+#include <libxslt/transform.h>
+
+/*
+ * A file that a compiled script depends on, with the stat()
+ * information it had when the script was compiled
+ */
+typedef struct slax_script_dep_s {
+    TAILQ_ENTRY(slax_script_dep_s) ssd_link; /* Next dependency */
+    dev_t ssd_dev;		/* Device holding the file */
+    ino_t ssd_ino;		/* Inode number of the file */
+    time_t ssd_mtime;		/* Modification time */
+    long ssd_nsec;		/* Nanoseconds of ssd_mtime (-1 if unknown) */
+    off_t ssd_size;		/* Size in bytes */
+    char ssd_path[0];		/* Path of the file (follows) */
+} slax_script_dep_t;
+
+typedef TAILQ_HEAD(slax_script_dep_list_s, slax_script_dep_s)
+    slax_script_dep_list_t;
+
+/*
+ * A compiled script in the registry
+ */
+typedef struct slax_script_s {
+    TAILQ_ENTRY(slax_script_s) ss_link; /* Next script */
+    xsltStylesheetPtr ss_style;	/* Compiled stylesheet */
+    unsigned ss_refs;		/* Number of holders */
+    int ss_stale;		/* Replaced; free on last release */
+    slax_script_dep_list_t ss_deps; /* Script and its dependencies */
+    char ss_path[0];		/* Script name, as given (follows) */
+} slax_script_t;
+
+typedef TAILQ_HEAD(slax_script_list_s, slax_script_s) slax_script_list_t;
+
+/*
+ * A parsed import or include document, shared between scripts
+ */
+typedef struct slax_script_doc_s {
+    TAILQ_ENTRY(slax_script_doc_s) ssdoc_link; /* Next document */
+    xmlDocPtr ssdoc_docp;	/* Parsed document (master copy) */
+    slax_script_dep_t ssdoc_dep; /* File information (must be last) */
+} slax_script_doc_t;
+
+typedef TAILQ_HEAD(slax_script_doc_list_s, slax_script_doc_s)
+    slax_script_doc_list_t;
+
+static slax_script_list_t slaxScripts =
+    TAILQ_HEAD_INITIALIZER(slaxScripts); /* Current scripts */
+static slax_script_list_t slaxScriptsStale =
+    TAILQ_HEAD_INITIALIZER(slaxScriptsStale); /* Replaced but still held */
+static slax_script_doc_list_t slaxScriptDocs =
+    TAILQ_HEAD_INITIALIZER(slaxScriptDocs); /* Shared documents */
+static SLAX_THREAD_LOCAL slax_script_t *slaxScriptCurrent;
+				/* Script being compiled */
+
+/*
+ * The registry is shared by all threads, so a lock serializes access
+ * to it.  The lock is held while a script compiles, and
+ * slaxScriptCurrent is only set by the thread holding the lock, so
+ * slaxScriptDocFind() and slaxScriptDocSave() are covered as well.
+ */
+static slax_mutex_t slaxScriptLock = SLAX_MUTEX_INITIALIZER;
+
+/*
+ * Fill in the stat() information for a dependency, using the open
+ * file if we have one.  Returns TRUE on failure.
+ */
+static int
+slaxScriptDepStat (slax_script_dep_t *ssdp, const char *path, FILE *file)
+{
+    struct stat st;
+    int rc;
+
+    rc = file ? fstat(fileno(file), &st) : stat(path, &st);
+    if (rc < 0)
+	return TRUE;
+
+    ssdp->ssd_dev = st.st_dev;
+    ssdp->ssd_ino = st.st_ino;
+    ssdp->ssd_mtime = st.st_mtime;
+    ssdp->ssd_nsec = slaxCacheMtimeNsec(&st);
+    ssdp->ssd_size = st.st_size;
+    return FALSE;
+}
+
+/*
+ * Has the file behind a dependency changed since we recorded it?
+ */
+static int
+slaxScriptDepChanged (slax_script_dep_t *ssdp, FILE *file)
+{
+    slax_script_dep_t cur;
+
+    if (slaxScriptDepStat(&cur, ssdp->ssd_path, file))
+	return TRUE;
+
+    return (cur.ssd_dev != ssdp->ssd_dev || cur.ssd_ino != ssdp->ssd_ino
+	    || cur.ssd_mtime != ssdp->ssd_mtime
+	    || cur.ssd_nsec != ssdp->ssd_nsec
+	    || cur.ssd_size != ssdp->ssd_size);
+}
+
+/*
+ * Return the canonical name of a file, which is what we key files
+ * on: the same relative name can find different files, depending on
+ * the importing script and the current directory.  Falls back to
+ * the name itself if it can't be resolved.
+ */
+static const char *
+slaxScriptRealPath (const char *path, char *buf)
+{
+    return realpath(path, buf) ?: path;
+}
+
+/*
+ * Record a file as a dependency of the script being compiled
+ */
+static void
+slaxScriptAddDep (slax_script_t *ssp, const char *path, FILE *file)
+{
+    char real[MAXPATHLEN];
+    slax_script_dep_t *ssdp;
+
+    path = slaxScriptRealPath(path, real);
+
+    TAILQ_FOREACH(ssdp, &ssp->ss_deps, ssd_link) {
+	if (streq(ssdp->ssd_path, path))
+	    return;
+    }
+
+    ssdp = xmlMalloc(sizeof(*ssdp) + strlen(path) + 1);
+    if (ssdp == NULL)
+	return;
+
+    bzero(ssdp, sizeof(*ssdp));
+    strcpy(ssdp->ssd_path, path);
+
+    if (slaxScriptDepStat(ssdp, path, file)) {
+	/* Not a local file (e.g. a real URL), so we can't watch it */
+	xmlFree(ssdp);
+	return;
+    }
+
+    TAILQ_INSERT_TAIL(&ssp->ss_deps, ssdp, ssd_link);
+}
+
+/*
+ * Called by slaxLoader() for each file loaded while compiling
+ * a script.  Does nothing unless slaxScriptCacheGet() is compiling.
+ */
+void
+slaxScriptAddDependency (const char *path, FILE *file)
+{
+    if (slaxScriptCurrent && path)
+	slaxScriptAddDep(slaxScriptCurrent, path, file);
+}
+
+/*
+ * Copy a shared document, interning names in the given dictionary
+ * and giving it the URL it was loaded by
+ */
+static xmlDocPtr
+slaxScriptDocCopy (xmlDocPtr docp, xmlDictPtr dict, const char *url)
+{
+    xmlDocPtr newp;
+    xmlNodePtr nodep;
+
+    newp = xmlCopyDoc(docp, 0);
+    if (newp == NULL)
+	return NULL;
+
+    if (dict) {
+	newp->dict = dict;
+	xmlDictReference(dict);
+    }
+
+    if (url) {
+	xmlFreeAndEasy(const_drop(newp->URL));
+	newp->URL = xmlStrdup((const xmlChar *) url);
+    }
+
+    newp->children = xmlDocCopyNodeList(newp, docp->children);
+    for (nodep = newp->children; nodep; nodep = nodep->next) {
+	nodep->parent = (xmlNodePtr) newp;
+	newp->last = nodep;
+    }
+
+    return newp;
+}
+
+/*
+ * Look for a shared copy of an import or include document, given
+ * the path its name resolved to.  Returns a private copy for the
+ * caller, carrying the URL the caller loaded it by, or NULL if we
+ * don't have a valid one.
+ */
+xmlDocPtr
+slaxScriptDocFind (const char *path, const char *url, FILE *file,
+		   xmlDictPtr dict)
+{
+    char real[MAXPATHLEN];
+    slax_script_doc_t *ssdocp;
+
+    if (slaxScriptCurrent == NULL || path == NULL || file == NULL)
+	return NULL;
+
+    path = slaxScriptRealPath(path, real);
+
+    TAILQ_FOREACH(ssdocp, &slaxScriptDocs, ssdoc_link) {
+	if (!streq(ssdocp->ssdoc_dep.ssd_path, path))
+	    continue;
+
+	if (slaxScriptDepChanged(&ssdocp->ssdoc_dep, file)) {
+	    TAILQ_REMOVE(&slaxScriptDocs, ssdocp, ssdoc_link);
+	    xmlFreeDoc(ssdocp->ssdoc_docp);
+	    xmlFree(ssdocp);
+	    return NULL;
+	}
+
+	slaxLog("slax: script: sharing document '%s'", path);
+	return slaxScriptDocCopy(ssdocp->ssdoc_docp, dict, url);
+    }
+
+    return NULL;
+}
+
+/*
+ * Keep a copy of a freshly parsed import or include document
+ */
+void
+slaxScriptDocSave (const char *path, FILE *file, xmlDocPtr docp)
+{
+    char real[MAXPATHLEN];
+    slax_script_doc_t *ssdocp;
+
+    if (slaxScriptCurrent == NULL || path == NULL
+	    || file == NULL || docp == NULL)
+	return;
+
+    path = slaxScriptRealPath(path, real);
+
+    ssdocp = xmlMalloc(sizeof(*ssdocp) + strlen(path) + 1);
+    if (ssdocp == NULL)
+	return;
+
+    bzero(ssdocp, sizeof(*ssdocp));
+    strcpy(ssdocp->ssdoc_dep.ssd_path, path);
+
+    if (slaxScriptDepStat(&ssdocp->ssdoc_dep, path, file)) {
+	xmlFree(ssdocp);
+	return;
+    }
+
+    ssdocp->ssdoc_docp = slaxScriptDocCopy(docp, NULL, NULL);
+    if (ssdocp->ssdoc_docp == NULL) {
+	xmlFree(ssdocp);
+	return;
+    }
+
+    TAILQ_INSERT_TAIL(&slaxScriptDocs, ssdocp, ssdoc_link);
+}
+
+/*
+ * Free a script and its dependency list
+ */
+static void
+slaxScriptFree (slax_script_t *ssp)
+{
+    slax_script_dep_t *ssdp;
+
+    while ((ssdp = TAILQ_FIRST(&ssp->ss_deps)) != NULL) {
+	TAILQ_REMOVE(&ssp->ss_deps, ssdp, ssd_link);
+	xmlFree(ssdp);
+    }
+
+    if (ssp->ss_style)
+	xsltFreeStylesheet(ssp->ss_style);
+
+    xmlFree(ssp);
+}
+
+/*
+ * Take a script out of the registry.  If someone still holds it,
+ * it's freed when they release it.
+ */
+static void
+slaxScriptRetire (slax_script_t *ssp)
+{
+    TAILQ_REMOVE(&slaxScripts, ssp, ss_link);
+
+    if (ssp->ss_refs == 0) {
+	slaxScriptFree(ssp);
+	return;
+    }
+
+    ssp->ss_stale = TRUE;
+    TAILQ_INSERT_TAIL(&slaxScriptsStale, ssp, ss_link);
+}
+
+/*
+ * Has the script or anything it depends on changed?
+ */
+static int
+slaxScriptChanged (slax_script_t *ssp)
+{
+    slax_script_dep_t *ssdp;
+
+    TAILQ_FOREACH(ssdp, &ssp->ss_deps, ssd_link) {
+	if (slaxScriptDepChanged(ssdp, NULL)) {
+	    slaxLog("slax: script: '%s' changed (via '%s')",
+		    ssp->ss_path, ssdp->ssd_path);
+	    return TRUE;
+	}
+    }
+
+    return FALSE;
+}
+
+/*
+ * Compile a script, recording the files it depends on
+ */
+static slax_script_t *
+slaxScriptCompile (const char *filename)
+{
+    char buf[MAXPATHLEN];
+    slax_script_t *ssp, *saved;
+    xsltStylesheetPtr style = NULL;
+    xmlDocPtr docp;
+    FILE *file;
+    int shared;
+
+    ssp = xmlMalloc(sizeof(*ssp) + strlen(filename) + 1);
+    if (ssp == NULL)
+	return NULL;
+
+    bzero(ssp, sizeof(*ssp));
+    strcpy(ssp->ss_path, filename);
+    TAILQ_INIT(&ssp->ss_deps);
+
+    file = slaxFindIncludeFile(filename, buf, sizeof(buf));
+    if (file == NULL) {
+	slaxLog("slax: script: file open failed for '%s': %s",
+		filename, strerror(errno));
+	xmlFree(ssp);
+	return NULL;
+    }
+
+    slaxScriptAddDep(ssp, buf, file);
+
+    /* Let slaxLoader() record imports and includes as we compile */
+    saved = slaxScriptCurrent;
+    slaxScriptCurrent = ssp;
+
+    /*
+     * The documents we load may be shared with scripts compiled on
+     * other threads, so their generated names must not repeat
+     */
+    shared = slaxNameSetShared(TRUE);
+
+    docp = slaxLoadFile(filename, file, NULL, 0);
+    fclose(file);
+
+    if (docp) {
+	style = xsltParseStylesheetDoc(docp);
+	if (style == NULL)
+	    xmlFreeDoc(docp);
+	else if (style->errors) {
+	    xsltFreeStylesheet(style);
+	    style = NULL;
+	}
+    }
+
+    slaxNameSetShared(shared);
+    slaxScriptCurrent = saved;
+
+    if (style == NULL) {
+	slaxScriptFree(ssp);
+	return NULL;
+    }
+
+    ssp->ss_style = style;
+    return ssp;
+}
+
+/*
+ * Return a compiled stylesheet for the given script, compiling it
+ * if it's not in the registry or if it or any file it imports or
+ * includes has changed.  The caller must release the stylesheet with
+ * slaxScriptCacheRelease() and must not free it.
+ */
+xsltStylesheetPtr
+slaxScriptCacheGet (const char *filename)
+{
+    slax_script_t *ssp;
+
+    xsltStylesheetPtr style = NULL;
+
+    if (filename == NULL || slaxFilenameIsStd(filename))
+	return NULL;
+
+    slaxMutexLock(&slaxScriptLock);
+
+    TAILQ_FOREACH(ssp, &slaxScripts, ss_link) {
+	if (streq(ssp->ss_path, filename))
+	    break;
+    }
+
+    if (ssp) {
+	if (!slaxScriptChanged(ssp)) {
+	    ssp->ss_refs += 1;
+	    style = ssp->ss_style;
+	    goto done;
+	}
+
+	slaxScriptRetire(ssp);
+    }
+
+    ssp = slaxScriptCompile(filename);
+    if (ssp == NULL)
+	goto done;
+
+    slaxLog("slax: script: compiled '%s'", filename);
+
+    ssp->ss_refs = 1;
+    TAILQ_INSERT_HEAD(&slaxScripts, ssp, ss_link);
+    style = ssp->ss_style;
+
+ done:
+    slaxMutexUnlock(&slaxScriptLock);
+    return style;
+}
+
+/*
+ * Release a stylesheet returned by slaxScriptCacheGet()
+ */
+void
+slaxScriptCacheRelease (xsltStylesheetPtr style)
+{
+    slax_script_t *ssp;
+
+    if (style == NULL)
+	return;
+
+    slaxMutexLock(&slaxScriptLock);
+
+    TAILQ_FOREACH(ssp, &slaxScripts, ss_link) {
+	if (ssp->ss_style == style) {
+	    if (ssp->ss_refs > 0)
+		ssp->ss_refs -= 1;
+	    goto done;
+	}
+    }
+
+    TAILQ_FOREACH(ssp, &slaxScriptsStale, ss_link) {
+	if (ssp->ss_style == style) {
+	    if (ssp->ss_refs > 0)
+		ssp->ss_refs -= 1;
+
+	    if (ssp->ss_refs == 0) {
+		TAILQ_REMOVE(&slaxScriptsStale, ssp, ss_link);
+		slaxScriptFree(ssp);
+	    }
+	    goto done;
+	}
+    }
+
+ done:
+    slaxMutexUnlock(&slaxScriptLock);
+}
+
+/*
+ * Empty the registry and the shared documents.  Stylesheets that
+ * are still held are freed when they are released.
+ */
+void
+slaxScriptCacheFlush (void)
+{
+    slax_script_t *ssp;
+    slax_script_doc_t *ssdocp;
+
+    slaxMutexLock(&slaxScriptLock);
+
+    while ((ssp = TAILQ_FIRST(&slaxScripts)) != NULL)
+	slaxScriptRetire(ssp);
+
+    while ((ssdocp = TAILQ_FIRST(&slaxScriptDocs)) != NULL) {
+	TAILQ_REMOVE(&slaxScriptDocs, ssdocp, ssdoc_link);
+	xmlFreeDoc(ssdocp->ssdoc_docp);
+	xmlFree(ssdocp);
+    }
+
+    slaxMutexUnlock(&slaxScriptLock);
+}
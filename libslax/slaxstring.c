@@ -901,11 +901,11 @@ slaxTernaryRewrite (slax_data_t *sdp UNUSED, slax_string_t *scond,
 		    slax_string_t *qsp, slax_string_t *strue,
 		    slax_string_t *csp, slax_string_t *sfalse)
 {
-    static unsigned varnumber;
     static char varfmt[] = SLAX_TERNARY_VAR_FORMAT;
     char varname[sizeof(varfmt) + SLAX_TERNARY_VAR_FORMAT_WIDTH];
 
-    snprintf(varname, sizeof(varname), varfmt, ++varnumber);
+    snprintf(varname, sizeof(varname), varfmt,
+	     slaxNameNext(SLAX_NAME_TERNARY));
 
     slaxLog("slaxTernaryRewrite: %s/%s/%s", scond ? scond->ss_token : "",
 	    strue ? strue->ss_token : "", sfalse ? sfalse->ss_token : "");
@@ -1051,7 +1051,7 @@ slaxMoveImport (slax_data_t *sdp UNUSED, xmlNodePtr curp)
 
 xmlXPathObjectPtr
 slaxXpathEval (xmlNodePtr node, xmlNodePtr inst, xmlXPathContextPtr xpctxt,
-	       xsltStylesheetPtr script, const char *expr)
+	       const char *expr)
 {
     struct {
 	xmlDocPtr o_doc;
@@ -1064,21 +1064,12 @@ slaxXpathEval (xmlNodePtr node, xmlNodePtr inst, xmlXPathContextPtr xpctxt,
 
     xmlNsPtr *nsList;
     int nscount;
-    xmlXPathCompExprPtr comp;
+    slax_xpath_entry_t *sxep;
     xmlXPathObjectPtr res;
 
-    char *sexpr = NULL;
-
-    
-    sexpr = slaxSlaxToXpath("select", 1, (const char *) expr, NULL);
-    if (sexpr)
-	expr = sexpr;
-
-    comp = xsltXPathCompile(script, (const xmlChar *) expr);
-    if (comp == NULL) {
-	xmlFreeAndEasy(sexpr);
+    sxep = slaxXpathCacheGet("select", expr, NULL);
+    if (sxep == NULL)
 	return NULL;
-    }
 
     nsList = xmlGetNsList(inst->doc, inst);
     for (nscount = 0; nsList && nsList[nscount]; nscount++)
@@ -1098,7 +1089,7 @@ slaxXpathEval (xmlNodePtr node, xmlNodePtr inst, xmlXPathContextPtr xpctxt,
     xpctxt->nsNr = nscount;
 
     /* Run the compiled expression */
-    res = xmlXPathCompiledEval(comp, xpctxt);
+    res = xmlXPathCompiledEval(slaxXpathEntryComp(sxep), xpctxt);
 
     /* Restore saved values */
     xpctxt->doc = old.o_doc;
@@ -1108,8 +1099,7 @@ slaxXpathEval (xmlNodePtr node, xmlNodePtr inst, xmlXPathContextPtr xpctxt,
     xpctxt->nsNr = old.o_nscount;
     xpctxt->namespaces = old.o_nslist;
 
-    xmlFreeAndEasy(sexpr);
-    xmlXPathFreeCompExpr(comp);
+    slaxXpathCacheRelease(sxep);
     xmlFree(nsList);
 
     return res;
@@ -226,7 +226,7 @@ slaxMoveImport (slax_data_t *sdp, xmlNodePtr);
 
 xmlXPathObjectPtr
 slaxXpathEval (xmlNodePtr node, xmlNodePtr inst, xmlXPathContextPtr xpctxt,
-	       xsltStylesheetPtr script, const char *expr);
+	       const char *expr);
 
 xmlNodeSetPtr
 slaxXpathSelect (xmlDocPtr docp, xmlNodePtr nodep, const char *expr);
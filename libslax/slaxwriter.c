@@ -20,8 +20,11 @@
 #include <libexslt/exslt.h>
 #include "slaxparser.h"
 #include "jsonlexer.h"
+#include <sys/uio.h>
+#include <errno.h>
 
 #define BUF_EXTEND 2048		/* Bump the buffer by this amount */
+#define SLAX_WRITER_CHUNK 8192	/* Size of chunks written to sw_fd */
 
 struct slax_writer_s {
     const char *sw_filename;	/* Filename being parsed */
@@ -35,12 +38,18 @@ struct slax_writer_s {
     int sw_errors;		/* Errors reading or writing data */
     int sw_vers;		/* Target SLAX version number times 10 */
     unsigned sw_flags;		/* Flags for this instance (SWF_*) */
+    int sw_fd;			/* File descriptor (SWF_CHUNKED) */
+    char *sw_out;		/* Completed lines not yet written to sw_fd */
+    int sw_outlen;		/* Number of bytes in sw_out */
+    xmlBufferPtr sw_xbuf;	/* Buffer to append to, instead of sw_fd */
 };
 
 /* Flags for sw_flags */
 #define SWF_BLANKLINE	(1<<0)	/* Just wrote a blank line */
 #define SWF_FORLOOP	(1<<1)	/* Just wrote a "for" loop */
 #define SWF_LINENO	(1<<2)	/* Show line numbers */
+#define SWF_CHUNKED	(1<<3)	/* Write to sw_fd in chunks, not lines */
+#define SWF_MIDLINE	(1<<4)	/* Part of this line is already written */
 
 /* Values for sw_vers */
 #define SWF_VERS_10	10	/* Version 1.0 features only */
@@ -90,6 +99,123 @@ slaxSetSpacesAroundAttributeEquals (int spaces)
     slaxSpacesAroundAttributeEquals = spaces ? " " : "";
 }
 
+/*
+ * Write out whatever is in sw_out, along with an optional chunk of
+ * data that didn't fit there, in a single writev() call
+ */
+static int
+slaxWriteFlush (slax_writer_t *swp, const char *data, int len)
+{
+    struct iovec iov[2], *iovp = iov;
+    int iovcnt = 0;
+    ssize_t rc;
+
+    if (swp->sw_outlen > 0) {
+	iov[iovcnt].iov_base = swp->sw_out;
+	iov[iovcnt++].iov_len = swp->sw_outlen;
+    }
+    if (len > 0) {
+	iov[iovcnt].iov_base = const_drop(data);
+	iov[iovcnt++].iov_len = len;
+    }
+
+    swp->sw_outlen = 0;
+
+    while (iovcnt > 0) {
+	rc = writev(swp->sw_fd, iovp, iovcnt);
+	if (rc < 0) {
+	    if (errno == EINTR)
+		continue;
+	    swp->sw_errors += 1;
+	    return -1;
+	}
+
+	/* Skip over whatever made it out, in case of a short write */
+	while (iovcnt > 0 && (size_t) rc >= iovp->iov_len) {
+	    rc -= iovp->iov_len;
+	    iovp += 1;
+	    iovcnt -= 1;
+	}
+	if (iovcnt > 0) {
+	    iovp->iov_base = (char *) iovp->iov_base + rc;
+	    iovp->iov_len -= rc;
+	}
+    }
+
+    return 0;
+}
+
+/*
+ * Add data to the current chunk, writing the chunk out when it fills
+ */
+static int
+slaxWriteEmit (slax_writer_t *swp, const char *data, int len)
+{
+    /* A buffer grows as needed, so there's no chunk to fill */
+    if (swp->sw_xbuf) {
+	if (xmlBufferAdd(swp->sw_xbuf, (const xmlChar *) data, len) == 0)
+	    return 0;
+	swp->sw_errors += 1;
+	return -1;
+    }
+
+    if (swp->sw_outlen + len <= SLAX_WRITER_CHUNK) {
+	memcpy(swp->sw_out + swp->sw_outlen, data, len);
+	swp->sw_outlen += len;
+	return 0;
+    }
+
+    if (len >= SLAX_WRITER_CHUNK)
+	return slaxWriteFlush(swp, data, len);
+
+    if (slaxWriteFlush(swp, NULL, 0) < 0)
+	return -1;
+
+    memcpy(swp->sw_out, data, len);
+    swp->sw_outlen = len;
+    return 0;
+}
+
+/*
+ * Emit the indentation for the current line, if it hasn't been
+ */
+static int
+slaxWriteEmitIndent (slax_writer_t *swp)
+{
+    static const char spaces[] = "                                ";
+    int len;
+
+    if (swp->sw_flags & SWF_MIDLINE)
+	return 0;
+
+    for (len = swp->sw_indent * slaxIndent; len > 0;
+	     len -= sizeof(spaces) - 1) {
+	if (slaxWriteEmit(swp, spaces, (len < (int) sizeof(spaces) - 1)
+			  ? len : (int) sizeof(spaces) - 1) < 0)
+	    return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * When writing in chunks, a long line is written as it's built,
+ * rather than growing sw_buf to hold all of it.  Lines that close
+ * a block start with their brace, so a line this long never needs
+ * the outdent applied by slaxWriteNewline().
+ */
+static void
+slaxWritePartial (slax_writer_t *swp)
+{
+    if (slaxWriteEmitIndent(swp) < 0
+	    || slaxWriteEmit(swp, swp->sw_buf, swp->sw_cur) < 0)
+	return;
+
+    swp->sw_flags |= SWF_MIDLINE;
+    swp->sw_cur = 0;
+    swp->sw_buf[0] = '\0';
+}
+
 int
 slaxWriteNewline (slax_writer_t *swp, int change)
 {
@@ -98,16 +224,27 @@ slaxWriteNewline (slax_writer_t *swp, int change)
     if (swp->sw_buf == NULL)
 	return 0;
 
-    if (swp->sw_cur == 0)
+    if (swp->sw_cur == 0 && !(swp->sw_flags & SWF_MIDLINE))
 	swp->sw_flags |= SWF_BLANKLINE;
     else swp->sw_flags &= ~SWF_BLANKLINE;
 
     if (change < 0)
 	swp->sw_indent += change;
-    rc = (*swp->sw_write)(swp->sw_data, "%*s%s\n",
-			  swp->sw_indent * slaxIndent, "", swp->sw_buf);
-    if (rc < 0)
-	swp->sw_errors += 1;
+
+    if (swp->sw_flags & SWF_CHUNKED) {
+	rc = slaxWriteEmitIndent(swp);
+	if (rc >= 0)
+	    rc = slaxWriteEmit(swp, swp->sw_buf, swp->sw_cur);
+	if (rc >= 0)
+	    rc = slaxWriteEmit(swp, "\n", 1);
+	swp->sw_flags &= ~SWF_MIDLINE;
+
+    } else {
+	rc = (*swp->sw_write)(swp->sw_data, "%*s%s\n",
+			      swp->sw_indent * slaxIndent, "", swp->sw_buf);
+	if (rc < 0)
+	    swp->sw_errors += 1;
+    }
 
     if (change > 0) {
 	swp->sw_indent += change;
@@ -162,6 +299,30 @@ slaxIsXsl (xmlNodePtr nodep)
     return FALSE;
 }
 
+/*
+ * Append a string to the current line, without the overhead of
+ * formatting it.  If len is negative, the string is NUL-terminated.
+ */
+void
+slaxWriteString (slax_writer_t *swp, const char *str, int len)
+{
+    if (str == NULL)
+	return;
+    if (len < 0)
+	len = strlen(str);
+
+    if ((swp->sw_flags & SWF_CHUNKED) && swp->sw_cur >= SLAX_WRITER_CHUNK)
+	slaxWritePartial(swp);
+
+    if (swp->sw_cur + len >= swp->sw_bufsiz)
+	if (slaxWriteRealloc(swp, swp->sw_cur + len + BUF_EXTEND) == NULL)
+	    return;
+
+    memcpy(swp->sw_buf + swp->sw_cur, str, len);
+    swp->sw_cur += len;
+    swp->sw_buf[swp->sw_cur] = '\0';
+}
+
 void
 slaxWrite (slax_writer_t *swp, const char *fmt, ...)
 {
@@ -169,6 +330,15 @@ slaxWrite (slax_writer_t *swp, const char *fmt, ...)
     char *cp;
     va_list vap;
 
+    /* Formats with no conversions are just strings */
+    if (strchr(fmt, '%') == NULL) {
+	slaxWriteString(swp, fmt, -1);
+	return;
+    }
+
+    if ((swp->sw_flags & SWF_CHUNKED) && swp->sw_cur >= SLAX_WRITER_CHUNK)
+	slaxWritePartial(swp);
+
     for (;;) {
 	if (swp->sw_bufsiz != 0) {
 	    len = swp->sw_bufsiz - swp->sw_cur;
@@ -178,7 +348,7 @@ slaxWrite (slax_writer_t *swp, const char *fmt, ...)
 	    rc = vsnprintf(cp, len, fmt, vap);
 	    va_end(vap);
 
-	    if (rc <= len) {
+	    if (rc < len) {
 		swp->sw_cur += rc;
 		break;
 	    }
@@ -332,6 +502,9 @@ slaxIsDisableOutputEscaping (xmlNodePtr nodep)
 static char *
 slaxWriteCheckRoom (slax_writer_t *swp, int space)
 {
+    if ((swp->sw_flags & SWF_CHUNKED) && swp->sw_cur >= SLAX_WRITER_CHUNK)
+	slaxWritePartial(swp);
+
     if (swp->sw_cur + space >= swp->sw_bufsiz)
 	if (slaxWriteRealloc(swp, swp->sw_cur + space + BUF_EXTEND) == NULL)
 	    return NULL;
@@ -420,7 +593,7 @@ slaxWriteExpr (slax_writer_t *swp, xmlChar *content,
 	      initializer ? ""
 	      : (slaxV11(swp) && disable_escaping) ? "uexpr " : "expr ");
     slaxWriteEscaped(swp, (char *) content, SEF_TEXT);
-    slaxWrite(swp, "\";");
+    slaxWriteLiteral(swp, "\";");
     slaxWriteNewline(swp, 0);
 }
 
@@ -523,7 +696,7 @@ slaxWriteValue (slax_writer_t *swp, const char *value)
      * This is a remnant from when slaxWriteValue handled concat()
      * expansion, and should shortly be removed altogether.
      */
-    slaxWrite(swp, "%s", value);
+    slaxWriteString(swp, value, -1);
 }
 
 static int
@@ -660,14 +833,14 @@ slaxRewriteEltArg (slax_writer_t *swp UNUSED, xmlNodePtr nodep,
 	sw.sw_indent_extra = swp->sw_indent;
 
 	if (need_braces) {
-	    slaxWrite(&sw, "{");
+	    slaxWriteLiteral(&sw, "{");
 	    slaxWriteNewline(&sw, NEWL_INDENT);
 	}
 
 	slaxWriteChildren(&sw, curp->doc, curp, TRUE, need_braces);
 
 	if (need_braces)
-	    slaxWrite(&sw, "}");
+	    slaxWriteLiteral(&sw, "}");
 
 	/* Make a string of anything left in the buffer */
 	if (sw.sw_cur) {
@@ -1015,11 +1188,11 @@ slaxWriteContent (slax_writer_t *swp, xmlDocPtr docp UNUSED, xmlNodePtr nodep)
 	if (childp->type == XML_TEXT_NODE) {
 	    if (!slaxIsWhiteString(childp->content)) {
 		if (!first)
-		    slaxWrite(swp, " _ ");
+		    slaxWriteLiteral(swp, " _ ");
 		else first = FALSE;
-		slaxWrite(swp, "\"");
+		slaxWriteLiteral(swp, "\"");
 		slaxWriteEscaped(swp, (char *) childp->content, SEF_ATTRIB);
-		slaxWrite(swp, "\"");
+		slaxWriteLiteral(swp, "\"");
 	    }
 	    continue;
 	}
@@ -1035,7 +1208,7 @@ slaxWriteContent (slax_writer_t *swp, xmlDocPtr docp UNUSED, xmlNodePtr nodep)
 		    expr = slaxMakeExpression(swp, nodep, sel);
 
 		    if (!first)
-			slaxWrite(swp, " _ ");
+			slaxWriteLiteral(swp, " _ ");
 		    else first = FALSE;
 		    slaxWriteValue(swp, expr ?: UNKNOWN_EXPR);
 		    xmlFreeAndEasy(expr);
@@ -1049,7 +1222,7 @@ slaxWriteContent (slax_writer_t *swp, xmlDocPtr docp UNUSED, xmlNodePtr nodep)
 		    if (gcp->type == XML_TEXT_NODE
 			&& !slaxIsWhiteString(gcp->content)) {
 			if (!first)
-			    slaxWrite(swp, " _ ");
+			    slaxWriteLiteral(swp, " _ ");
 			else first = FALSE;
 			slaxWrite(swp, "\"%s\"", gcp->content);
 		    }
@@ -1179,10 +1352,10 @@ slaxWriteJsonElement (slax_writer_t *swp, xmlDocPtr docp, xmlNodePtr nodep,
 		slaxWriteNewline(swp, 0);
 
 	} else if (nodep->children->type != XML_TEXT_NODE) {
-	    slaxWrite(swp, " {");
+	    slaxWriteLiteral(swp, " {");
 	    slaxWriteNewline(swp, NEWL_INDENT);
 	    slaxWriteChildren(swp, docp, nodep, FALSE, trailing_newline);
-	    slaxWrite(swp, "}");
+	    slaxWriteLiteral(swp, "}");
 	    if (trailing_newline)
 		slaxWriteNewline(swp, NEWL_OUTDENT);
 
@@ -1196,18 +1369,18 @@ slaxWriteJsonElement (slax_writer_t *swp, xmlDocPtr docp, xmlNodePtr nodep,
 	if (oneliner) {
 	    xmlNodePtr childp;
 
-	    slaxWrite(swp, " [");
+	    slaxWriteLiteral(swp, " [");
 	    for (childp = nodep->children; childp; childp = childp->next) {
 		slaxWriteJsonValue(swp, docp, childp, FALSE);
 	    }
-	    slaxWrite(swp, " ],");
+	    slaxWriteLiteral(swp, " ],");
 	    if (trailing_newline)
 		slaxWriteNewline(swp, 0);
 	} else {
-	    slaxWrite(swp, " [");
+	    slaxWriteLiteral(swp, " [");
 	    slaxWriteNewline(swp, NEWL_INDENT);
 	    slaxWriteChildren(swp, docp, nodep, FALSE, TRUE);
-	    slaxWrite(swp, "],");
+	    slaxWriteLiteral(swp, "],");
 	    if (trailing_newline)
 		slaxWriteNewline(swp, NEWL_OUTDENT);
 	}
@@ -1279,44 +1452,44 @@ slaxWriteElementFull (slax_writer_t *swp, xmlDocPtr docp, xmlNodePtr nodep,
 		slaxWrite(swp, " %s%s%s%s=%s", pref ?: "", pref ? ":" : "",
 			  attrp->name, slaxSpacesAroundAttributeEquals,
 			  slaxSpacesAroundAttributeEquals);
-		slaxWrite(swp, "%s", content ?: UNKNOWN_EXPR);
+		slaxWriteString(swp, content ?: UNKNOWN_EXPR, -1);
 		xmlFreeAndEasy(content);
 	    }
 	}
     }
 
-    slaxWrite(swp, ">");
+    slaxWriteLiteral(swp, ">");
 
     if (must_braces) {
-	slaxWrite(swp, " ");
+	slaxWriteLiteral(swp, " ");
     } else {
 	if (nodep->children == NULL) {
 	    if (trailing_newline) {
-		slaxWrite(swp, ";");
+		slaxWriteLiteral(swp, ";");
 		slaxWriteNewline(swp, 0);
 	    }
 	    return;
 	}
 	
-	slaxWrite(swp, " ");
+	slaxWriteLiteral(swp, " ");
 
 	if (!slaxNeedsBraces(nodep)) {
 	    slaxWriteContent(swp, docp, nodep);
 	    if (trailing_newline) {
-		slaxWrite(swp, ";");
+		slaxWriteLiteral(swp, ";");
 		slaxWriteNewline(swp, 0);
 	    }
 	    return;
 	}
     }
 
-    slaxWrite(swp, "{");
+    slaxWriteLiteral(swp, "{");
     slaxWriteNewline(swp, NEWL_INDENT);
 
     slaxWriteAllNs(swp, docp, nodep);
     slaxWriteChildren(swp, docp, nodep, FALSE, TRUE);
 
-    slaxWrite(swp, "}");
+    slaxWriteLiteral(swp, "}");
     if (trailing_newline)
 	slaxWriteNewline(swp, NEWL_OUTDENT);
 }
@@ -1380,7 +1553,7 @@ slaxWriteNamedTemplateParams (slax_writer_t *swp, xmlDocPtr docp,
 		    slaxWriteValue(swp, expr);
 		    xmlFreeAndEasy(expr);
 		}
-		slaxWrite(swp, ";");
+		slaxWriteLiteral(swp, ";");
 		slaxWriteNewline(swp, 0);
 
 	    } else {
@@ -1416,7 +1589,7 @@ slaxWriteNamedTemplateParams (slax_writer_t *swp, xmlDocPtr docp,
 
 	    slaxWriteChildren(swp, docp, childp, FALSE, TRUE);
 	    
-	    slaxWrite(swp, "}");
+	    slaxWriteLiteral(swp, "}");
 	    slaxWriteNewline(swp, NEWL_OUTDENT);
 	}
 
@@ -1504,7 +1677,7 @@ slaxWriteTemplate (slax_writer_t *swp, xmlDocPtr docp, xmlNodePtr nodep)
 	slaxWrite(swp, "template %s%s%s (", name, match ? " match " : "",
 		  match ?: "");
 	slaxWriteNamedTemplateParams(swp, docp, nodep, FALSE, FALSE);
-	slaxWrite(swp, ")");
+	slaxWriteLiteral(swp, ")");
 
     } else if (match) {
 	char *expr = slaxMakeExpression(swp, nodep, match);
@@ -1512,14 +1685,14 @@ slaxWriteTemplate (slax_writer_t *swp, xmlDocPtr docp, xmlNodePtr nodep)
 	if (slaxV12(swp) && streq(expr, "/")) {
 	    xmlNodePtr childp = nodep->children;
 
-	    slaxWrite(swp, "main");
+	    slaxWriteLiteral(swp, "main");
 
 	    if (childp && priority == NULL && mode == NULL
 		&& nodep->nsDef == NULL) {
 		childp = slaxWriteIsMainElt(childp);
 		if (childp) {
 		    /* We have the case where 'main' can take an element */
-		    slaxWrite(swp, " ");
+		    slaxWriteLiteral(swp, " ");
 		    slaxWriteElementFull(swp, docp, childp, TRUE, TRUE);
 		    return;
 		}
@@ -1536,7 +1709,7 @@ slaxWriteTemplate (slax_writer_t *swp, xmlDocPtr docp, xmlNodePtr nodep)
     }
 
     if (nodep->children || priority || mode || nodep->nsDef) {
-	slaxWrite(swp, " {");
+	slaxWriteLiteral(swp, " {");
 	slaxWriteNewline(swp, NEWL_INDENT);
 
 	if (mode) {
@@ -1563,11 +1736,11 @@ slaxWriteTemplate (slax_writer_t *swp, xmlDocPtr docp, xmlNodePtr nodep)
 	slaxWriteAllNs(swp, docp, nodep);
 	slaxWriteChildren(swp, docp, nodep, FALSE, TRUE);
 
-	slaxWrite(swp, "}");
+	slaxWriteLiteral(swp, "}");
 	slaxWriteNewline(swp, NEWL_OUTDENT);
 
     } else {
-	slaxWrite(swp, " { }");
+	slaxWriteLiteral(swp, " { }");
 	slaxWriteNewline(swp, 0);
     }
 
@@ -1582,9 +1755,9 @@ slaxWriteFunctionResult (slax_writer_t *swp, xmlNodePtr nodep, char *sel)
 {
     char *expr = slaxMakeExpression(swp, nodep, sel);
 
-    slaxWrite(swp, "result ");
+    slaxWriteLiteral(swp, "result ");
     slaxWriteValue(swp, expr ?: UNKNOWN_EXPR);
-    slaxWrite(swp, ";");
+    slaxWriteLiteral(swp, ";");
     slaxWriteNewline(swp, 0);
     xmlFreeAndEasy(expr);
 }
@@ -1624,7 +1797,7 @@ slaxWriteFunctionElement (slax_writer_t *swp, xmlDocPtr docp, xmlNodePtr nodep)
 
 	slaxWrite(swp, "function %s (", fn);
 	slaxWriteNamedTemplateParams(swp, docp, nodep, FALSE, FALSE);
-	slaxWrite(swp, ") {");
+	slaxWriteLiteral(swp, ") {");
 	slaxWriteNewline(swp, NEWL_INDENT);
 
 	slaxWriteNamedTemplateParams(swp, docp, nodep, fn == NULL, TRUE);
@@ -1648,7 +1821,7 @@ slaxWriteFunctionElement (slax_writer_t *swp, xmlDocPtr docp, xmlNodePtr nodep)
 	 * Otherwise we need to put the contents of this <xx:result> element
 	 * into a "result" statement.
 	 */
-	slaxWrite(swp, "result {");
+	slaxWriteLiteral(swp, "result {");
 	slaxWriteNewline(swp, NEWL_INDENT);
 
     } else {
@@ -1666,7 +1839,7 @@ slaxWriteFunctionElement (slax_writer_t *swp, xmlDocPtr docp, xmlNodePtr nodep)
 	slaxWriteChildren(swp, docp, nodep, FALSE, TRUE);
     }
 
-    slaxWrite(swp, "}");
+    slaxWriteLiteral(swp, "}");
     slaxWriteNewline(swp, NEWL_OUTDENT);
 }
 
@@ -1679,7 +1852,7 @@ slaxWriteValueOf (slax_writer_t *swp, xmlDocPtr docp UNUSED, xmlNodePtr nodep)
 
     slaxWrite(swp, disable_escaping ? "uexpr " : "expr ");
     slaxWriteValue(swp, expr ?: UNKNOWN_EXPR);
-    slaxWrite(swp, ";");
+    slaxWriteLiteral(swp, ";");
     slaxWriteNewline(swp, 0);
 
     xmlFreeAndEasy(expr);
@@ -1849,7 +2022,7 @@ slaxWriteForLoop (slax_writer_t *swp, xmlDocPtr docp, xmlNodePtr outer_var,
 
     slaxWriteChildren(swp, docp, inner_for, FALSE, TRUE);
 
-    slaxWrite(swp, "}");
+    slaxWriteLiteral(swp, "}");
     slaxWriteNewline(swp, NEWL_OUTDENT);
 
     /*
@@ -2123,7 +2296,7 @@ slaxWriteVariable (slax_writer_t *swp, xmlDocPtr docp, xmlNodePtr nodep)
 	     */
 	    slaxWrite(swp, "%s $%s %s \"", tag, aname, operator);
 	    slaxWriteEscaped(swp, (char *) childp->content, SEF_DOUBLEQ);
-	    slaxWrite(swp, "\";");
+	    slaxWriteLiteral(swp, "\";");
 	    slaxWriteNewline(swp, 0);
 
 	} else if (slaxIsSimpleElement(childp)) {
@@ -2136,7 +2309,7 @@ slaxWriteVariable (slax_writer_t *swp, xmlDocPtr docp, xmlNodePtr nodep)
 
 	    slaxWriteChildren(swp, docp, vnode, FALSE, TRUE);
 
-	    slaxWrite(swp, "}");
+	    slaxWriteLiteral(swp, "}");
 	    slaxWriteNewline(swp, NEWL_OUTDENT);
 	}
 
@@ -2187,7 +2360,7 @@ slaxWriteVariable (slax_writer_t *swp, xmlDocPtr docp, xmlNodePtr nodep)
 
 	slaxWrite(swp, "%s $%s %s ", tag, aname, operator);
 	slaxWriteValue(swp, expr);
-	slaxWrite(swp, ";");
+	slaxWriteLiteral(swp, ";");
 	slaxWriteNewline(swp, 0);
 	xmlFreeAndEasy(expr);
 
@@ -2219,32 +2392,32 @@ slaxWriteTraceStmt (slax_writer_t *swp, xmlDocPtr docp UNUSED,
 	     * If there's only one child and it's text, we can emit
 	     * a simple string value.
 	     */
-	    slaxWrite(swp, "trace \"");
+	    slaxWriteLiteral(swp, "trace \"");
 	    slaxWriteEscaped(swp, (char *) childp->content, SEF_DOUBLEQ);
-	    slaxWrite(swp, "\";");
+	    slaxWriteLiteral(swp, "\";");
 	    slaxWriteNewline(swp, 0);
 
 	} else {
-	    slaxWrite(swp, "trace {");
+	    slaxWriteLiteral(swp, "trace {");
 	    slaxWriteNewline(swp, NEWL_INDENT);
 
 	    slaxWriteChildren(swp, docp, nodep, FALSE, TRUE);
 
-	    slaxWrite(swp, "}");
+	    slaxWriteLiteral(swp, "}");
 	    slaxWriteNewline(swp, NEWL_OUTDENT);
 	}
 
     } else if (sel) {
 	char *expr = slaxMakeExpression(swp, nodep, sel);
 
-	slaxWrite(swp, "trace ");
+	slaxWriteLiteral(swp, "trace ");
 	slaxWriteValue(swp, expr);
-	slaxWrite(swp, ";");
+	slaxWriteLiteral(swp, ";");
 	slaxWriteNewline(swp, 0);
 	xmlFreeAndEasy(expr);
 
     } else {
-	slaxWrite(swp, "trace { }");
+	slaxWriteLiteral(swp, "trace { }");
 	slaxWriteNewline(swp, 0);
     }
 
@@ -2258,9 +2431,9 @@ slaxWriteWhileStmt (slax_writer_t *swp, xmlDocPtr docp UNUSED,
     char *tst = slaxGetAttrib(nodep, ATT_TEST);
     char *expr = slaxMakeExpression(swp, nodep, tst);
 
-    slaxWrite(swp, "while (");
+    slaxWriteLiteral(swp, "while (");
     slaxWriteValue(swp, expr);
-    slaxWrite(swp, ") {");
+    slaxWriteLiteral(swp, ") {");
     slaxWriteNewline(swp, NEWL_INDENT);
 
     xmlFreeAndEasy(expr);
@@ -2268,7 +2441,37 @@ slaxWriteWhileStmt (slax_writer_t *swp, xmlDocPtr docp UNUSED,
 
     slaxWriteChildren(swp, docp, nodep, FALSE, TRUE);
 
-    slaxWrite(swp, "}");
+    slaxWriteLiteral(swp, "}");
+    slaxWriteNewline(swp, NEWL_OUTDENT);
+}
+
+/*
+ * Write a <slax:for> element, which the parser makes from a "for"
+ * loop over a range.
+ */
+static void
+slaxWriteForStmt (slax_writer_t *swp, xmlDocPtr docp, xmlNodePtr nodep)
+{
+    char *name = slaxGetAttrib(nodep, ATT_NAME);
+    char *from = slaxGetAttrib(nodep, ATT_FROM);
+    char *to = slaxGetAttrib(nodep, ATT_TO);
+    char *fexpr = slaxMakeExpression(swp, nodep, from);
+    char *texpr = slaxMakeExpression(swp, nodep, to);
+
+    slaxWriteBlankline(swp);
+    slaxWrite(swp, "for $%s (%s ... %s) {", name ?: "",
+	      fexpr ?: "", texpr ?: "");
+    slaxWriteNewline(swp, NEWL_INDENT);
+
+    xmlFreeAndEasy(texpr);
+    xmlFreeAndEasy(fexpr);
+    xmlFreeAndEasy(to);
+    xmlFreeAndEasy(from);
+    xmlFreeAndEasy(name);
+
+    slaxWriteChildren(swp, docp, nodep, FALSE, TRUE);
+
+    slaxWriteLiteral(swp, "}");
     slaxWriteNewline(swp, NEWL_OUTDENT);
 }
 
@@ -2291,7 +2494,7 @@ slaxWriteMvarStmt (slax_writer_t *swp, xmlDocPtr docp UNUSED,
 	     */
 	    slaxWrite(swp, "%s $%s %s \"", sn, name, op);
 	    slaxWriteEscaped(swp, (char *) childp->content, SEF_DOUBLEQ);
-	    slaxWrite(swp, "\";");
+	    slaxWriteLiteral(swp, "\";");
 	    slaxWriteNewline(swp, 0);
 
 	} else if (slaxIsSimpleElement(childp)) {
@@ -2304,7 +2507,7 @@ slaxWriteMvarStmt (slax_writer_t *swp, xmlDocPtr docp UNUSED,
 
 	    slaxWriteChildren(swp, docp, nodep, FALSE, TRUE);
 
-	    slaxWrite(swp, "}");
+	    slaxWriteLiteral(swp, "}");
 	    slaxWriteNewline(swp, NEWL_OUTDENT);
 	}
 
@@ -2313,7 +2516,7 @@ slaxWriteMvarStmt (slax_writer_t *swp, xmlDocPtr docp UNUSED,
 
 	slaxWrite(swp, "%s $%s %s ", sn, name, op);
 	slaxWriteValue(swp, expr);
-	slaxWrite(swp, ";");
+	slaxWriteLiteral(swp, ";");
 	slaxWriteNewline(swp, 0);
 	xmlFreeAndEasy(expr);
 
@@ -2342,7 +2545,7 @@ static void
 slaxWriteParam (slax_writer_t *swp, xmlDocPtr docp UNUSED, xmlNodePtr nodep)
 {
     if (swp->sw_indent > 2) {
-	slaxWrite(swp, "/* 'param' statement is inappropriately nested */");
+	slaxWriteLiteral(swp, "/* 'param' statement is inappropriately nested */");
 	slaxWriteNewline(swp, 0);
     }
 
@@ -2365,6 +2568,9 @@ slaxWriteSlaxElement (slax_writer_t *swp, xmlDocPtr docp,
     else if (streq((const char *) nodep->name, ELT_WHILE))
 	slaxWriteWhileStmt(swp, docp, nodep);
 
+    else if (streq((const char *) nodep->name, ELT_FOR))
+	slaxWriteForStmt(swp, docp, nodep);
+
     else if (streq((const char *) nodep->name, ELT_SET_VARIABLE))
 	slaxWriteMvarSetStmt(swp, docp, nodep);
 
@@ -2433,14 +2639,14 @@ slaxWriteEltArg (slax_writer_t *swp UNUSED, xmlDocPtr docp, xmlNodePtr curp,
     need_braces = slaxNeedsBlock(nodep);
 
     if (need_braces) {
-	slaxWrite(swp, "{");
+	slaxWriteLiteral(swp, "{");
 	slaxWriteNewline(swp, NEWL_INDENT);
     }
 
     slaxWriteChildren(swp, docp, nodep, TRUE, need_braces);
 
     if (need_braces)
-	slaxWrite(swp, "}");
+	slaxWriteLiteral(swp, "}");
 
     swp->sw_indent = save_indent;
     swp->sw_indent_extra = 0;   /* Just in case it wasn't needed */
@@ -2455,7 +2661,7 @@ slaxWriteApplyTemplates (slax_writer_t *swp, xmlDocPtr docp, xmlNodePtr nodep)
     char *sel = slaxGetAttrib(nodep, ATT_SELECT);
     xmlNodePtr childp;
 
-    slaxWrite(swp, "apply-templates");
+    slaxWriteLiteral(swp, "apply-templates");
     if (sel) {
 	char *expr = slaxMakeExpression(swp, nodep, sel);
 	
@@ -2465,12 +2671,12 @@ slaxWriteApplyTemplates (slax_writer_t *swp, xmlDocPtr docp, xmlNodePtr nodep)
     }
 
     if (nodep->children == NULL && mode == NULL && nodep->nsDef == NULL) {
-	slaxWrite(swp, ";");
+	slaxWriteLiteral(swp, ";");
 	slaxWriteNewline(swp, 0);
 	return;
     }
 
-    slaxWrite(swp, " {");
+    slaxWriteLiteral(swp, " {");
     slaxWriteNewline(swp, NEWL_INDENT);
 
     if (mode) {
@@ -2510,14 +2716,14 @@ slaxWriteApplyTemplates (slax_writer_t *swp, xmlDocPtr docp, xmlNodePtr nodep)
 		    int need_braces = slaxNeedsBlock(childp);
 
 		    if (need_braces) {
-			slaxWrite(swp, "{");
+			slaxWriteLiteral(swp, "{");
 			slaxWriteNewline(swp, NEWL_INDENT);
 		    }
 
 		    slaxWriteChildren(swp, docp, childp, TRUE, TRUE);
 
 		    if (need_braces) {
-			slaxWrite(swp, "}");
+			slaxWriteLiteral(swp, "}");
 			slaxWriteNewline(swp, NEWL_OUTDENT);
 		    }
 		}
@@ -2538,7 +2744,7 @@ slaxWriteApplyTemplates (slax_writer_t *swp, xmlDocPtr docp, xmlNodePtr nodep)
 	}
     }
 
-    slaxWrite(swp, "}");
+    slaxWriteLiteral(swp, "}");
     slaxWriteNewline(swp, NEWL_OUTDENT);
 }
 
@@ -2556,7 +2762,7 @@ slaxWriteCallTemplate (slax_writer_t *swp, xmlDocPtr docp, xmlNodePtr nodep)
     xmlFreeAndEasy(name);
 
     if (nodep->children == NULL) {
-	slaxWrite(swp, ");");
+	slaxWriteLiteral(swp, ");");
 	slaxWriteNewline(swp, 0);
 	return;
     }
@@ -2574,12 +2780,12 @@ slaxWriteCallTemplate (slax_writer_t *swp, xmlDocPtr docp, xmlNodePtr nodep)
 	sel = slaxGetAttrib(childp, ATT_SELECT);
 
 	if (!first)
-	    slaxWrite(swp, ", ");
+	    slaxWriteLiteral(swp, ", ");
 	first = FALSE;
 
 	slaxWrite(swp, "$%s", name);
 	if (!(name && sel && *sel == '$' && streq(name, sel + 1))) {
-	    slaxWrite(swp, " = ");
+	    slaxWriteLiteral(swp, " = ");
 	    if (sel) {
 		if (!slaxWriteIsEltArg(swp, sel)
 		    || !slaxWriteEltArg(swp, docp, childp, sel)) {
@@ -2589,22 +2795,22 @@ slaxWriteCallTemplate (slax_writer_t *swp, xmlDocPtr docp, xmlNodePtr nodep)
 		    xmlFreeAndEasy(expr);
 		}
 
-	    } else slaxWrite(swp, "''");
+	    } else slaxWriteLiteral(swp, "''");
 	}
 
 	xmlFreeAndEasy(sel);
 	xmlFreeAndEasy(name);
     }
 
-    slaxWrite(swp, ")");
+    slaxWriteLiteral(swp, ")");
 
     if (!need_braces) {
-	slaxWrite(swp, ";");
+	slaxWriteLiteral(swp, ";");
 	slaxWriteNewline(swp, 0);
 	return;
     }
 
-    slaxWrite(swp, " {");
+    slaxWriteLiteral(swp, " {");
     slaxWriteNewline(swp, NEWL_INDENT);
 
     for (childp = nodep->children; childp; childp = childp->next) {
@@ -2626,11 +2832,11 @@ slaxWriteCallTemplate (slax_writer_t *swp, xmlDocPtr docp, xmlNodePtr nodep)
 
 	slaxWriteChildren(swp, docp, childp, FALSE, TRUE);
 
-	slaxWrite(swp, " }");
+	slaxWriteLiteral(swp, " }");
 	slaxWriteNewline(swp, NEWL_OUTDENT);
     }
 
-    slaxWrite(swp, "}");
+    slaxWriteLiteral(swp, "}");
     slaxWriteNewline(swp, NEWL_OUTDENT);
 }
 
@@ -2648,7 +2854,7 @@ slaxWriteIf (slax_writer_t *swp, xmlDocPtr docp, xmlNodePtr nodep)
 
     slaxWriteChildren(swp, docp, nodep, FALSE, TRUE);
 
-    slaxWrite(swp, "}");
+    slaxWriteLiteral(swp, "}");
     slaxWriteNewline(swp, NEWL_OUTDENT);
 }
 
@@ -2675,7 +2881,7 @@ slaxWriteForEach (slax_writer_t *swp, xmlDocPtr docp, xmlNodePtr nodep)
 
     slaxWriteChildren(swp, docp, nodep, FALSE, TRUE);
 
-    slaxWrite(swp, "}");
+    slaxWriteLiteral(swp, "}");
     slaxWriteNewline(swp, NEWL_OUTDENT);
 }
 
@@ -2776,15 +2982,15 @@ slaxWriteStatementWithAttributes (slax_writer_t *swp, xmlDocPtr docp UNUSED,
 	      aval ?: optional ? "" : UNKNOWN_EXPR);
 
     if (slaxHasOtherAttributes(nodep, skip)) {
-	slaxWrite(swp, " {");
+	slaxWriteLiteral(swp, " {");
 	slaxWriteNewline(swp, NEWL_INDENT);
 
 	slaxWriteAllAttributes(swp, nodep, skip, avt);
 
-	slaxWrite(swp, "}");
+	slaxWriteLiteral(swp, "}");
 	slaxWriteNewline(swp, NEWL_OUTDENT);
     } else {
-	slaxWrite(swp, ";");
+	slaxWriteLiteral(swp, ";");
 	slaxWriteNewline(swp, 0);
     }
 
@@ -2839,7 +3045,7 @@ slaxWriteNumber (slax_writer_t *swp, xmlDocPtr docp UNUSED,
     slaxWrite(swp, "number%s%s", aval ? " " : "", aval ?: "");
 
     if (slaxHasOtherAttributes(nodep, skip)) {
-	slaxWrite(swp, " {");
+	slaxWriteLiteral(swp, " {");
 	slaxWriteNewline(swp, NEWL_INDENT);
 
 	slaxWriteAllAttributes(swp, nodep, skip2, TRUE);
@@ -2847,10 +3053,10 @@ slaxWriteNumber (slax_writer_t *swp, xmlDocPtr docp UNUSED,
 	slaxWriteStatementOneAttribute(swp, nodep, "from", ATT_FROM, S1A_XP);
 	slaxWriteStatementOneAttribute(swp, nodep, "count", ATT_COUNT, S1A_XP);
 
-	slaxWrite(swp, "}");
+	slaxWriteLiteral(swp, "}");
 	slaxWriteNewline(swp, NEWL_OUTDENT);
     } else {
-	slaxWrite(swp, ";");
+	slaxWriteLiteral(swp, ";");
 	slaxWriteNewline(swp, 0);
     }
 
@@ -2867,7 +3073,7 @@ slaxWriteCopyNode (slax_writer_t *swp, xmlDocPtr docp UNUSED,
     slaxWrite(swp, "copy-node%s%s", value ? " " : "", value ?: "");
 
     if (nodep->children || use) {
-	slaxWrite(swp, " {");
+	slaxWriteLiteral(swp, " {");
 	slaxWriteNewline(swp, NEWL_INDENT);
 
 	if (use) {
@@ -2879,10 +3085,10 @@ slaxWriteCopyNode (slax_writer_t *swp, xmlDocPtr docp UNUSED,
 	slaxWriteAllNs(swp, docp, nodep);
 	slaxWriteChildren(swp, docp, nodep, FALSE, TRUE);
 
-	slaxWrite(swp, "}");
+	slaxWriteLiteral(swp, "}");
 	slaxWriteNewline(swp, NEWL_OUTDENT);
     } else {
-	slaxWrite(swp, ";");
+	slaxWriteLiteral(swp, ";");
 	slaxWriteNewline(swp, 0);
     }
 
@@ -2900,16 +3106,16 @@ slaxWriteDecimalFormat (slax_writer_t *swp, xmlDocPtr docp UNUSED,
     slaxWrite(swp, "decimal-format %s", aval ?: UNKNOWN_EXPR);
 
     if (slaxHasOtherAttributes(nodep, skip)) {
-	slaxWrite(swp, " {");
+	slaxWriteLiteral(swp, " {");
 	slaxWriteNewline(swp, NEWL_INDENT);
 
 	slaxWriteAllAttributes(swp, nodep, skip2, TRUE);
 	slaxWriteStatementOneAttribute(swp, nodep, "nan", ATT_NAN, S1A_AVT);
 
-	slaxWrite(swp, "}");
+	slaxWriteLiteral(swp, "}");
 	slaxWriteNewline(swp, NEWL_OUTDENT);
     } else {
-	slaxWrite(swp, ";");
+	slaxWriteLiteral(swp, ";");
 	slaxWriteNewline(swp, 0);
     }
 
@@ -2927,17 +3133,17 @@ slaxWriteOutputMethod (slax_writer_t *swp, xmlDocPtr docp UNUSED,
     slaxWrite(swp, "output-method%s%s", aval ? " " : "", aval ?: "");
 
     if (slaxHasOtherAttributes(nodep, skip)) {
-	slaxWrite(swp, " {");
+	slaxWriteLiteral(swp, " {");
 	slaxWriteNewline(swp, NEWL_INDENT);
 
 	slaxWriteAllAttributes(swp, nodep, skip2, TRUE);
 	slaxWriteStatementOneAttribute(swp, nodep, "cdata-section-elements",
 				       ATT_CDATA_SECTION_ELEMENTS, S1A_NONE);
 
-	slaxWrite(swp, "}");
+	slaxWriteLiteral(swp, "}");
 	slaxWriteNewline(swp, NEWL_OUTDENT);
     } else {
-	slaxWrite(swp, ";");
+	slaxWriteLiteral(swp, ";");
 	slaxWriteNewline(swp, 0);
     }
 
@@ -2959,7 +3165,7 @@ slaxWriteKey (slax_writer_t *swp, xmlDocPtr docp UNUSED,
     slaxWriteStatementOneAttribute(swp, nodep, "match", ATT_MATCH, S1A_XP);
     slaxWriteStatementOneAttribute(swp, nodep, "value", ATT_USE, S1A_XP);
 
-    slaxWrite(swp, "}");
+    slaxWriteLiteral(swp, "}");
     slaxWriteNewline(swp, NEWL_OUTDENT);
 
     xmlFreeAndEasy(name);
@@ -2981,7 +3187,7 @@ slaxWriteAttributeStatement (slax_writer_t *swp, xmlDocPtr docp UNUSED,
     slaxWriteAllNs(swp, docp, nodep);
     slaxWriteChildren(swp, docp, nodep, FALSE, TRUE);
 
-    slaxWrite(swp, "}");
+    slaxWriteLiteral(swp, "}");
     slaxWriteNewline(swp, NEWL_OUTDENT);
 
     xmlFreeAndEasy(expr);
@@ -3000,7 +3206,7 @@ slaxWriteAttributeSetStatement (slax_writer_t *swp, xmlDocPtr docp UNUSED,
 
     slaxWrite(swp, "attribute-set %s", name);
     if (nodep->children || nodep->nsDef || asets) {
-	slaxWrite(swp, " {");
+	slaxWriteLiteral(swp, " {");
 	slaxWriteNewline(swp, NEWL_INDENT);
 
 	slaxWriteAllNs(swp, docp, nodep);
@@ -3010,12 +3216,12 @@ slaxWriteAttributeSetStatement (slax_writer_t *swp, xmlDocPtr docp UNUSED,
 	}
 	slaxWriteChildren(swp, docp, nodep, FALSE, TRUE);
 
-	slaxWrite(swp, "}");
+	slaxWriteLiteral(swp, "}");
 	slaxWriteNewline(swp, NEWL_OUTDENT);
 
     } else {
 	/* This should be an error */
-	slaxWrite(swp, ";");
+	slaxWriteLiteral(swp, ";");
 	slaxWriteNewline(swp, 0);
     }
 
@@ -3034,7 +3240,7 @@ slaxWriteElementStatement (slax_writer_t *swp, xmlDocPtr docp UNUSED,
 
     slaxWrite(swp, "element %s", expr);
     if (nodep->children || nodep->nsDef || asets || ns) {
-	slaxWrite(swp, " {");
+	slaxWriteLiteral(swp, " {");
 	slaxWriteNewline(swp, NEWL_INDENT);
 
 	if (ns) {
@@ -3056,11 +3262,11 @@ slaxWriteElementStatement (slax_writer_t *swp, xmlDocPtr docp UNUSED,
 
 	slaxWriteChildren(swp, docp, nodep, FALSE, TRUE);
 
-	slaxWrite(swp, "}");
+	slaxWriteLiteral(swp, "}");
 	slaxWriteNewline(swp, NEWL_OUTDENT);
 
     } else {
-	slaxWrite(swp, ";");
+	slaxWriteLiteral(swp, ";");
 	slaxWriteNewline(swp, 0);
     }
 
@@ -3098,7 +3304,7 @@ slaxWriteChoose (slax_writer_t *swp, xmlDocPtr docp, xmlNodePtr nodep)
 
 	} else if (streq((const char *) childp->name, ELT_OTHERWISE)) {
 	    slaxWriteNewline(swp, NEWL_OUTDENT);
-	    slaxWrite(swp, "} else {");
+	    slaxWriteLiteral(swp, "} else {");
 	    slaxWriteNewline(swp, NEWL_INDENT);
 
 	    slaxWriteChildren(swp, docp, childp, FALSE, TRUE);
@@ -3109,7 +3315,7 @@ slaxWriteChoose (slax_writer_t *swp, xmlDocPtr docp, xmlNodePtr nodep)
     }
 
     if (!first) {
-	slaxWrite(swp, "}");
+	slaxWriteLiteral(swp, "}");
 	slaxWriteNewline(swp, NEWL_OUTDENT);
     }
 }
@@ -3132,13 +3338,13 @@ static void
 slaxWriteFallback (slax_writer_t *swp, xmlDocPtr docp UNUSED,
 			    xmlNodePtr nodep)
 {
-    slaxWrite(swp, "fallback {");
+    slaxWriteLiteral(swp, "fallback {");
     slaxWriteNewline(swp, NEWL_INDENT);
 
     slaxWriteAllNs(swp, docp, nodep);
     slaxWriteChildren(swp, docp, nodep, FALSE, TRUE);
 
-    slaxWrite(swp, "}");
+    slaxWriteLiteral(swp, "}");
     slaxWriteNewline(swp, NEWL_OUTDENT);
 }
 
@@ -3150,27 +3356,27 @@ slaxWriteComplexElement (slax_writer_t *swp, xmlDocPtr docp UNUSED,
     slaxWrite(swp, "%s%s%s", stmt, arg ? " " : "", arg ?: "");
 
     if (nodep->children == NULL) {
-	slaxWrite(swp, ";");
+	slaxWriteLiteral(swp, ";");
 	slaxWriteNewline(swp, 0);
 	return;
     }
 
     if (oneliner && !slaxNeedsBraces(nodep)) {
 	if (arg == NULL)
-	    slaxWrite(swp, " ");
+	    slaxWriteLiteral(swp, " ");
 	slaxWriteContent(swp, docp, nodep);
-	slaxWrite(swp, ";");
+	slaxWriteLiteral(swp, ";");
 	slaxWriteNewline(swp, 0);
 	return;
     }
 
-    slaxWrite(swp, " {");
+    slaxWriteLiteral(swp, " {");
     slaxWriteNewline(swp, NEWL_INDENT);
 
     slaxWriteAllNs(swp, docp, nodep);
     slaxWriteChildren(swp, docp, nodep, FALSE, TRUE);
 
-    slaxWrite(swp, "}");
+    slaxWriteLiteral(swp, "}");
     slaxWriteNewline(swp, NEWL_OUTDENT);
 }
 
@@ -3380,30 +3586,30 @@ slaxWriteComment (slax_writer_t *swp, xmlDocPtr docp UNUSED, xmlNodePtr nodep)
 static void
 slaxWriteCommentStatement (slax_writer_t *swp, xmlDocPtr docp, xmlNodePtr nodep)
 {
-    slaxWrite(swp, "comment");
+    slaxWriteLiteral(swp, "comment");
 
     if (nodep->children == NULL) {
-	slaxWrite(swp, ";");
+	slaxWriteLiteral(swp, ";");
 	slaxWriteNewline(swp, 0);
 	return;
     }
 	
-    slaxWrite(swp, " ");
+    slaxWriteLiteral(swp, " ");
 
     if (!slaxNeedsBraces(nodep)) {
 	slaxWriteContent(swp, docp, nodep);
-	slaxWrite(swp, ";");
+	slaxWriteLiteral(swp, ";");
 	slaxWriteNewline(swp, 0);
 	return;
     }
 
-    slaxWrite(swp, "{");
+    slaxWriteLiteral(swp, "{");
     slaxWriteNewline(swp, NEWL_INDENT);
 
     slaxWriteAllNs(swp, docp, nodep);
     slaxWriteChildren(swp, docp, nodep, FALSE, TRUE);
 
-    slaxWrite(swp, "}");
+    slaxWriteLiteral(swp, "}");
     slaxWriteNewline(swp, NEWL_OUTDENT);
 }
 
@@ -3476,10 +3682,21 @@ slaxWriteChildren (slax_writer_t *swp, xmlDocPtr docp, xmlNodePtr nodep,
 static void
 slaxWriteCleanup (slax_writer_t *swp)
 {
+    /* Like the line-at-a-time case, an unfinished line is dropped */
+    if (swp->sw_flags & SWF_CHUNKED) {
+	slaxWriteFlush(swp, NULL, 0);
+	swp->sw_flags &= ~(SWF_CHUNKED | SWF_MIDLINE);
+    }
+
     if (swp->sw_buf) {
 	xmlFree(swp->sw_buf);
 	swp->sw_buf = NULL;
     }
+
+    if (swp->sw_out) {
+	xmlFree(swp->sw_out);
+	swp->sw_out = NULL;
+    }
 }
 
 slax_writer_t *
@@ -3498,6 +3715,48 @@ slaxGetWriter (slaxWriterFunc_t func, void *data)
     return swp;
 }
 
+/*
+ * Return a writer that writes straight to a file descriptor, in
+ * chunks of SLAX_WRITER_CHUNK bytes rather than a line at a time
+ */
+slax_writer_t *
+slaxGetWriterFd (int fd)
+{
+    slax_writer_t *swp = slaxGetWriter(NULL, NULL);
+
+    if (swp == NULL)
+	return NULL;
+
+    swp->sw_out = xmlMalloc(SLAX_WRITER_CHUNK);
+    if (swp->sw_out == NULL) {
+	xmlFree(swp);
+	return NULL;
+    }
+
+    swp->sw_fd = fd;
+    swp->sw_flags |= SWF_CHUNKED;
+
+    return swp;
+}
+
+/*
+ * Return a writer that appends to an xmlBuffer, so the output ends
+ * up in one contiguous string without a copy per line
+ */
+slax_writer_t *
+slaxGetWriterBuffer (xmlBufferPtr xbuf)
+{
+    slax_writer_t *swp = slaxGetWriter(NULL, NULL);
+
+    if (swp == NULL)
+	return NULL;
+
+    swp->sw_xbuf = xbuf;
+    swp->sw_flags |= SWF_CHUNKED;
+
+    return swp;
+}
+
 void
 slaxFreeWriter (slax_writer_t *swp)
 {
@@ -3505,26 +3764,15 @@ slaxFreeWriter (slax_writer_t *swp)
     xmlFree(swp);
 }
 
-/**
- * slaxWriteDoc:
- * Write an XSLT document in SLAX format
- * @param func fprintf-like callback function to write data
- * @param data data passed to callback
- * @param docp source document (XSLT stylesheet)
- * @param partial Should we write partial (snippet) output?
- * @param version Version number to use
+/*
+ * Write an XSLT document in SLAX format, using the given writer
  */
-int
-slaxWriteDoc (slaxWriterFunc_t func, void *data, xmlDocPtr docp,
-	      int partial,  const char *version)
+static int
+slaxWriteDocWriter (slax_writer_t *swp, xmlDocPtr docp,
+		    int partial, const char *version)
 {
     xmlNodePtr nodep;
     xmlNodePtr childp;
-    slax_writer_t sw;
-
-    bzero(&sw, sizeof(sw));
-    sw.sw_write = func;
-    sw.sw_data = data;
 
     nodep = xmlDocGetRootElement(docp);
     if (nodep == NULL || nodep->name == NULL)
@@ -3533,17 +3781,17 @@ slaxWriteDoc (slaxWriterFunc_t func, void *data, xmlDocPtr docp,
     /* If the user asked for version 1.0, we avoid 1.1 features */
     if (version) {
 	if (streq(version, "1.0"))
-	    sw.sw_vers = SWF_VERS_10;
+	    swp->sw_vers = SWF_VERS_10;
 	else if (streq(version, "1.1"))
-	    sw.sw_vers = SWF_VERS_11;
+	    swp->sw_vers = SWF_VERS_11;
 	else if (streq(version, "1.2"))
-	    sw.sw_vers = SWF_VERS_12;
+	    swp->sw_vers = SWF_VERS_12;
     }
 
     if (!partial) {
-	slaxWrite(&sw, "version %s;", version ?: SLAX_VERSION);
-	slaxWriteNewline(&sw, 0);
-	slaxWriteNewline(&sw, 0);
+	slaxWrite(swp, "version %s;", version ?: SLAX_VERSION);
+	slaxWriteNewline(swp, 0);
+	slaxWriteNewline(swp, 0);
     }
 
     /*
@@ -3551,16 +3799,16 @@ slaxWriteDoc (slaxWriterFunc_t func, void *data, xmlDocPtr docp,
      */
     for (childp = docp->children; childp; childp = childp->next)
 	if (childp->type == XML_COMMENT_NODE)
-	    slaxWriteComment(&sw, docp, childp);
+	    slaxWriteComment(swp, docp, childp);
 
-    slaxWriteAllNs(&sw, docp, nodep);
+    slaxWriteAllNs(swp, docp, nodep);
 
     if (streq((const char *) nodep->name, ELT_STYLESHEET)
 		|| streq((const char *) nodep->name, ELT_TRANSFORM)) {
-	slaxWriteChildren(&sw, docp, nodep, FALSE, TRUE);
+	slaxWriteChildren(swp, docp, nodep, FALSE, TRUE);
 
     } else if (partial) {
-	slaxWriteElement(&sw, docp, nodep);
+	slaxWriteElement(swp, docp, nodep);
 
     } else {
 	/*
@@ -3568,18 +3816,64 @@ slaxWriteDoc (slaxWriterFunc_t func, void *data, xmlDocPtr docp,
 	 * it must be a "iteral result element".  See the XSLT spec:
 	 * [7.1.1 Literal Result Elements]).
 	 */
-	slaxWrite(&sw, "match / {");
-	slaxWriteNewline(&sw, NEWL_INDENT);
+	slaxWriteLiteral(swp, "match / {");
+	slaxWriteNewline(swp, NEWL_INDENT);
 
-	slaxWriteElement(&sw, docp, nodep);
+	slaxWriteElement(swp, docp, nodep);
 
-	slaxWrite(&sw, "}");
-	slaxWriteNewline(&sw, NEWL_OUTDENT);
+	slaxWriteLiteral(swp, "}");
+	slaxWriteNewline(swp, NEWL_OUTDENT);
     }
 
-    slaxWriteCleanup(&sw);
+    slaxWriteCleanup(swp);
+
+    return (swp->sw_errors == 0);
+}
+
+/**
+ * slaxWriteDoc:
+ * Write an XSLT document in SLAX format
+ * @param func fprintf-like callback function to write data
+ * @param data data passed to callback
+ * @param docp source document (XSLT stylesheet)
+ * @param partial Should we write partial (snippet) output?
+ * @param version Version number to use
+ */
+int
+slaxWriteDoc (slaxWriterFunc_t func, void *data, xmlDocPtr docp,
+	      int partial,  const char *version)
+{
+    slax_writer_t sw;
+
+    bzero(&sw, sizeof(sw));
+    sw.sw_write = func;
+    sw.sw_data = data;
+
+    return slaxWriteDocWriter(&sw, docp, partial, version);
+}
+
+/**
+ * slaxWriteDocFd:
+ * Write an XSLT document in SLAX format to a file descriptor
+ * @param fd file descriptor to write to
+ * @param docp source document (XSLT stylesheet)
+ * @param partial Should we write partial (snippet) output?
+ * @param version Version number to use
+ */
+int
+slaxWriteDocFd (int fd, xmlDocPtr docp, int partial, const char *version)
+{
+    slax_writer_t *swp;
+    int rc;
+
+    swp = slaxGetWriterFd(fd);
+    if (swp == NULL)
+	return FALSE;
+
+    rc = slaxWriteDocWriter(swp, docp, partial, version);
+    slaxFreeWriter(swp);
 
-    return (sw.sw_errors == 0);
+    return rc;
 }
 
 
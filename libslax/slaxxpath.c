@@ -0,0 +1,299 @@
+/*
+ * Copyright (c) 2013, Juniper Networks, Inc.
+ * All rights reserved.
+ * This SOFTWARE is licensed under the LICENSE provided in the
+ * ../Copyright file. By downloading, installing, copying, or otherwise
+ * using the SOFTWARE, you agree to be bound by the terms of that
+ * LICENSE.
+ *
+ * slaxxpath.c -- cache of compiled SLAX expressions
+ *
+ * slax:evaluate() and the debugger turn SLAX expressions into XPath
+ * at run time, which means running the SLAX parser and then the
+ * XPath compiler on every call.  Scripts tend to evaluate a handful
+ * of distinct expressions many times over, so we keep the compiled
+ * XPath for the most recently used expressions in a small LRU cache.
+ *
+ * A compiled XPath expression holds prefixes, not namespaces: the
+ * prefixes are resolved against the namespaces in the XPath context
+ * when the expression is evaluated.  So the expression string is the
+ * whole key, and one entry serves every namespace context.
+ *
+ * The cache is kept per thread, like other transform state, so
+ * entries are never shared between threads.  An entry in use is held
+ * by a reference, so an expression that evaluates another expression
+ * cannot have its own entry evicted from under it.  A thread's cache
+ * is flushed when the thread exits.
+ */
+
+#include "slaxinternals.h"
+#include <libslax/slax.h>
+#include <sys/queue.h>
+
+#define SLAX_XPATH_CACHE_SIZE	64 /* Max number of entries */
+#define SLAX_XPATH_CACHE_BUCKETS 128 /* Hash buckets (power of two) */
+
+struct slax_xpath_entry_s {
+    LIST_ENTRY(slax_xpath_entry_s) sxe_hash; /* Next in hash bucket */
+    TAILQ_ENTRY(slax_xpath_entry_s) sxe_lru; /* LRU list (most recent 1st) */
+    unsigned sxe_hashval;	/* Hash of sxe_expr */
+    unsigned sxe_refs;		/* Number of holders */
+    int sxe_errors;		/* Errors converting the expression */
+    xmlXPathCompExprPtr sxe_comp; /* Compiled XPath */
+    char *sxe_xpath;		/* XPath form of the expression */
+    char sxe_expr[0];		/* SLAX expression (follows) */
+};
+
+typedef LIST_HEAD(slax_xpath_bucket_s, slax_xpath_entry_s)
+    slax_xpath_bucket_t;
+typedef TAILQ_HEAD(slax_xpath_lru_s, slax_xpath_entry_s) slax_xpath_lru_t;
+
+static SLAX_THREAD_LOCAL slax_xpath_bucket_t
+    slaxXpathBuckets[SLAX_XPATH_CACHE_BUCKETS];
+static SLAX_THREAD_LOCAL slax_xpath_lru_t slaxXpathLru;
+static SLAX_THREAD_LOCAL unsigned slaxXpathCount; /* Number of entries */
+static SLAX_THREAD_LOCAL unsigned long slaxXpathHits; /* Cache hits */
+static SLAX_THREAD_LOCAL unsigned long slaxXpathMisses; /* Cache misses */
+
+#ifdef HAVE_PTHREAD_H
+/*
+ * A thread-specific key whose destructor flushes the cache, so a
+ * thread that exits without calling slaxXpathCacheFlush() doesn't
+ * leak its entries.  The key's value is only a marker that the
+ * thread has a cache.
+ */
+static pthread_key_t slaxXpathKey;
+static slax_once_t slaxXpathKeyOnce = SLAX_ONCE_INITIALIZER;
+static int slaxXpathKeyValid;	/* pthread_key_create() worked */
+
+static void
+slaxXpathThreadExit (void *value UNUSED)
+{
+    slaxXpathCacheFlush();
+}
+
+static void
+slaxXpathKeyCreate (void)
+{
+    slaxXpathKeyValid = (pthread_key_create(&slaxXpathKey,
+					    slaxXpathThreadExit) == 0);
+}
+#endif /* HAVE_PTHREAD_H */
+
+/*
+ * Set up this thread's cache
+ */
+static void
+slaxXpathThreadInit (void)
+{
+    TAILQ_INIT(&slaxXpathLru);
+
+#ifdef HAVE_PTHREAD_H
+    slaxOnce(&slaxXpathKeyOnce, slaxXpathKeyCreate);
+    if (slaxXpathKeyValid)
+	pthread_setspecific(slaxXpathKey, &slaxXpathLru);
+#endif /* HAVE_PTHREAD_H */
+}
+
+/*
+ * Hash an expression (FNV-1a)
+ */
+static unsigned
+slaxXpathHash (const char *expr)
+{
+    const unsigned char *cp = (const unsigned char *) expr;
+    unsigned hash = 2166136261U;
+
+    for ( ; *cp; cp++) {
+	hash ^= *cp;
+	hash *= 16777619U;
+    }
+
+    return hash;
+}
+
+static void
+slaxXpathEntryFree (slax_xpath_entry_t *sxep)
+{
+    LIST_REMOVE(sxep, sxe_hash);
+    TAILQ_REMOVE(&slaxXpathLru, sxep, sxe_lru);
+    slaxXpathCount -= 1;
+
+    xmlXPathFreeCompExpr(sxep->sxe_comp);
+    xmlFree(sxep->sxe_xpath);
+    xmlFree(sxep);
+}
+
+/*
+ * Evict the least recently used entries that nobody holds, until
+ * we're back under the size limit
+ */
+static void
+slaxXpathEvict (void)
+{
+    slax_xpath_entry_t *sxep, *prev;
+
+    for (sxep = TAILQ_LAST(&slaxXpathLru, slax_xpath_lru_s);
+	 sxep && slaxXpathCount > SLAX_XPATH_CACHE_SIZE; sxep = prev) {
+	prev = TAILQ_PREV(sxep, slax_xpath_lru_s, sxe_lru);
+	if (sxep->sxe_refs == 0)
+	    slaxXpathEntryFree(sxep);
+    }
+}
+
+/*
+ * Return an entry to the caller, unless the caller cares about
+ * conversion errors and the expression had some
+ */
+static slax_xpath_entry_t *
+slaxXpathEntryUse (slax_xpath_entry_t *sxep, int *errorsp)
+{
+    if (errorsp && sxep->sxe_errors) {
+	*errorsp = sxep->sxe_errors;
+	return NULL;
+    }
+
+    sxep->sxe_refs += 1;
+    return sxep;
+}
+
+/*
+ * Return the compiled form of a SLAX expression, converting and
+ * compiling it if it's not in the cache.  The entry must be released
+ * with slaxXpathCacheRelease().  Returns NULL if the expression
+ * cannot be compiled.  If errorsp is given, we also return NULL
+ * (setting *errorsp) for an expression the SLAX parser rejects;
+ * otherwise the parser's fallback (the expression as given) is used.
+ */
+slax_xpath_entry_t *
+slaxXpathCacheGet (const char *filename, const char *expr, int *errorsp)
+{
+    slax_xpath_entry_t *sxep;
+    unsigned hashval;
+    slax_xpath_bucket_t *bucketp;
+    xmlXPathCompExprPtr comp;
+    char *xpath;
+    int errors = 0;
+
+    if (errorsp)
+	*errorsp = 0;
+
+    if (slaxXpathLru.tqh_last == NULL)
+	slaxXpathThreadInit();
+
+    hashval = slaxXpathHash(expr);
+    bucketp = &slaxXpathBuckets[hashval & (SLAX_XPATH_CACHE_BUCKETS - 1)];
+
+    LIST_FOREACH(sxep, bucketp, sxe_hash) {
+	if (sxep->sxe_hashval == hashval && streq(sxep->sxe_expr, expr)) {
+	    slaxXpathHits += 1;
+
+	    if (sxep != TAILQ_FIRST(&slaxXpathLru)) {
+		TAILQ_REMOVE(&slaxXpathLru, sxep, sxe_lru);
+		TAILQ_INSERT_HEAD(&slaxXpathLru, sxep, sxe_lru);
+	    }
+
+	    return slaxXpathEntryUse(sxep, errorsp);
+	}
+    }
+
+    slaxXpathMisses += 1;
+
+    xpath = slaxSlaxToXpath(filename, 1, expr, &errors);
+    if (xpath == NULL) {
+	if (errorsp)
+	    *errorsp = errors ?: 1;
+	return NULL;
+    }
+
+    comp = xmlXPathCompile((const xmlChar *) xpath);
+    if (comp == NULL) {
+	if (errorsp)
+	    *errorsp = errors;
+	xmlFree(xpath);
+	return NULL;
+    }
+
+    sxep = xmlMalloc(sizeof(*sxep) + strlen(expr) + 1);
+    if (sxep == NULL) {
+	xmlXPathFreeCompExpr(comp);
+	xmlFree(xpath);
+	return NULL;
+    }
+
+    bzero(sxep, sizeof(*sxep));
+    strcpy(sxep->sxe_expr, expr);
+    sxep->sxe_hashval = hashval;
+    sxep->sxe_comp = comp;
+    sxep->sxe_xpath = xpath;
+    sxep->sxe_errors = errors;
+
+    LIST_INSERT_HEAD(bucketp, sxep, sxe_hash);
+    TAILQ_INSERT_HEAD(&slaxXpathLru, sxep, sxe_lru);
+    slaxXpathCount += 1;
+
+    /* Take our reference before making room, so we're not evicted */
+    sxep = slaxXpathEntryUse(sxep, errorsp);
+
+    if (slaxXpathCount > SLAX_XPATH_CACHE_SIZE)
+	slaxXpathEvict();
+
+    return sxep;
+}
+
+/*
+ * Release an entry returned by slaxXpathCacheGet()
+ */
+void
+slaxXpathCacheRelease (slax_xpath_entry_t *sxep)
+{
+    if (sxep && sxep->sxe_refs > 0)
+	sxep->sxe_refs -= 1;
+
+    if (slaxXpathCount > SLAX_XPATH_CACHE_SIZE)
+	slaxXpathEvict();
+}
+
+xmlXPathCompExprPtr
+slaxXpathEntryComp (slax_xpath_entry_t *sxep)
+{
+    return sxep->sxe_comp;
+}
+
+const char *
+slaxXpathEntryXpath (slax_xpath_entry_t *sxep)
+{
+    return sxep->sxe_xpath;
+}
+
+/*
+ * Return this thread's hit and miss counters
+ */
+void
+slaxXpathCacheGetCounters (unsigned long *hitsp, unsigned long *missesp)
+{
+    if (hitsp)
+	*hitsp = slaxXpathHits;
+    if (missesp)
+	*missesp = slaxXpathMisses;
+}
+
+/*
+ * Empty this thread's cache.  Entries still held are left alone.
+ * The caches of other threads can't be touched safely from here;
+ * each is flushed when its thread exits.
+ */
+void
+slaxXpathCacheFlush (void)
+{
+    slax_xpath_entry_t *sxep, *next;
+
+    if (slaxXpathLru.tqh_last == NULL)
+	return;
+
+    for (sxep = TAILQ_FIRST(&slaxXpathLru); sxep; sxep = next) {
+	next = TAILQ_NEXT(sxep, sxe_lru);
+	if (sxep->sxe_refs == 0)
+	    slaxXpathEntryFree(sxep);
+    }
+}
@@ -16,18 +16,26 @@
 
 #include <libxslt/transform.h>
 #include <libxml/HTMLparser.h>
+#include <libxml/xmlreader.h>
 #include <libxslt/xsltutils.h>
+#include <libxslt/imports.h>
 #include <libxml/globals.h>
 #include <libxml/xpathInternals.h>
 #include <libexslt/exslt.h>
 #include <libslax/slaxdyn.h>
 #include <libslax/slaxdata.h>
 #include <libslax/jsonlexer.h>
+#include <libslax/jsonreader.h>
 #include <libslax/jsonwriter.h>
+#include <libslax/jsonbinary.h>
 
 #include <err.h>
+#include <errno.h>
+#include <limits.h>
 #include <time.h>
+#include <dirent.h>
 #include <sys/time.h>
+#include <sys/stat.h>
 #include <stdio.h>
 
 static slax_data_list_t plist;
@@ -46,6 +54,7 @@ static char **opt_args;
 static char *opt_show_variable; /* Variable (in script) to show */
 static char *opt_show_select;   /* Expression (in script) to show */
 static char *opt_xpath;		/* XPath expresion to match on */
+static char *opt_stream_records; /* Path of records to run one at a time */
 
 static int opt_html;		/* Parse input as HTML */
 static int opt_indent;		/* Indent the output (pretty print) */
@@ -55,6 +64,11 @@ static int opt_empty_input;	/* Use an empty input file */
 static int opt_slax_output;	/* Make output in SLAX format */
 static int opt_json_tagging;	/* Tag JSON output */
 static int opt_json_flags;	/* Flags for JSON conversion */
+static int opt_json_lines;	/* JSON input/output is one record per line */
+static int opt_json_output;	/* Write results as JSON */
+static int opt_binary_format;	/* CBOR or MessagePack (JB_*) */
+static int opt_bxml_input;	/* Input is binary XML */
+static int opt_bxml_output;	/* Write results as binary XML */
 static int opt_keep_text;	/* Don't add a rule to discard text values */
 
 static const char *
@@ -72,71 +86,84 @@ get_filename (const char *filename, char ***pargv, int outp)
     return filename;
 }
 
-static int
-do_format (const char *name UNUSED, const char *output,
-		 const char *input, char **argv)
+/*
+ * Load a script for --check, --format, or --slax-to-xslt.  If the
+ * file can't be opened, NULL is returned with *open_errorp set to
+ * the errno value; otherwise *open_errorp is zero.
+ */
+static xmlDocPtr
+load_script (const char *filename, int partial, int *open_errorp)
 {
-    FILE *infile = NULL, *outfile;
+    FILE *file;
     xmlDocPtr docp;
 
-    if (mini_docp == NULL)
-	input = get_filename(input, &argv, -1);
-    output = get_filename(output, &argv, -1);
+    *open_errorp = 0;
 
-    if (mini_docp)
-	docp = mini_docp;
+    if (slaxFilenameIsStd(filename))
+	file = stdin;
     else {
-	if (slaxFilenameIsStd(input))
-	    infile = stdin;
-	else {
-	    infile = fopen(input, "r");
-	    if (infile == NULL)
-		err(1, "file open failed for '%s'", input);
+	file = fopen(filename, "r");
+	if (file == NULL) {
+	    *open_errorp = errno;
+	    return NULL;
 	}
+    }
 
-	docp = slaxLoadFile(input, infile, NULL, opt_partial);
+    docp = slaxLoadFile(filename, file, NULL, partial);
 
-	if (infile != stdin)
-	    fclose(infile);
+    if (file != stdin)
+	fclose(file);
 
-	if (docp == NULL)
-	    errx(1, "cannot parse file: '%s'", input);
-    }
+    return docp;
+}
 
-    if (output == NULL || slaxFilenameIsStd(output))
-	outfile = stdout;
-    else {
-	outfile = fopen(output, "w");
-	if (outfile == NULL)
-	    err(1, "could not open output file: '%s'", output);
+/*
+ * Compile a loaded script for --check, consuming the document.
+ * Returns the number of errors found.
+ */
+static int
+check_script (xmlDocPtr docp)
+{
+    xsltStylesheetPtr script;
+    int errors;
+
+    script = xsltParseStylesheetDoc(docp);
+    if (script == NULL) {
+	xmlFreeDoc(docp);
+	return 1;
     }
 
-    slaxWriteDoc((slaxWriterFunc_t) fprintf, outfile, docp,
-		 opt_partial, opt_version);
+    errors = script->errors;
+    xsltFreeStylesheet(script);
 
-    if (outfile != stdout)
-	fclose(outfile);
+    return errors;
+}
 
-    xmlFreeDoc(docp);
+/*
+ * Write a loaded script as SLAX (for --format) or as XSLT (for
+ * --slax-to-xslt).  Returns non-zero on failure.
+ */
+static int
+write_script (FILE *outfile, xmlDocPtr docp, int format)
+{
+    fflush(outfile);
 
-    return 0;
+    if (format) {
+	if (!slaxWriteDocFd(fileno(outfile), docp, opt_partial, opt_version))
+	    return -1;
+    } else
+	slaxDumpToFd(fileno(outfile), docp, opt_partial);
+
+    return ferror(outfile) ? -1 : 0;
 }
 
 static int
-do_slax_to_xslt (const char *name UNUSED, const char *output,
-		 const char *input, char **argv)
+convert_script (const char *output, const char *input, char **argv,
+		int format)
 {
-    FILE *infile = NULL, *outfile;
+    FILE *outfile;
     xmlDocPtr docp;
-
-    if (opt_expression) {
-	char *res = slaxConvertExpression(opt_expression, TRUE);
-	if (res) {
-	    printf("%s\n", res);
-	    xmlFree(res);
-	}
-	return res ? 0 : -1;
-    }
+    int open_error;
 
     if (mini_docp == NULL)
 	input = get_filename(input, &argv, -1);
@@ -145,19 +172,11 @@ do_slax_to_xslt (const char *name UNUSED, const char *output,
     if (mini_docp)
 	docp = mini_docp;
     else {
-	if (slaxFilenameIsStd(input))
-	    infile = stdin;
-	else {
-	    infile = fopen(input, "r");
-	    if (infile == NULL)
-		err(1, "file open failed for '%s'", input);
+	docp = load_script(input, opt_partial, &open_error);
+	if (open_error) {
+	    errno = open_error;
+	    err(1, "file open failed for '%s'", input);
 	}
-
-	docp = slaxLoadFile(input, infile, NULL, opt_partial);
-
-	if (infile != stdin)
-	    fclose(infile);
-
 	if (docp == NULL)
 	    errx(1, "cannot parse file: '%s'", input);
     }
@@ -170,7 +189,7 @@ do_slax_to_xslt (const char *name UNUSED, const char *output,
 	    err(1, "could not open output file: '%s'", output);
     }
 
-    slaxDumpToFd(fileno(outfile), docp, opt_partial);
+    write_script(outfile, docp, format);
 
     if (outfile != stdout)
 	fclose(outfile);
@@ -180,6 +199,29 @@ do_slax_to_xslt (const char *name UNUSED, const char *output,
     return 0;
 }
 
+static int
+do_format (const char *name UNUSED, const char *output,
+		 const char *input, char **argv)
+{
+    return convert_script(output, input, argv, TRUE);
+}
+
+static int
+do_slax_to_xslt (const char *name UNUSED, const char *output,
+		 const char *input, char **argv)
+{
+    if (opt_expression) {
+	char *res = slaxConvertExpression(opt_expression, TRUE);
+	if (res) {
+	    printf("%s\n", res);
+	    xmlFree(res);
+	}
+	return res ? 0 : -1;
+    }
+
+    return convert_script(output, input, argv, FALSE);
+}
+
 static int
 do_xslt_to_slax (const char *name UNUSED, const char *output,
 		 const char *input, char **argv)
@@ -214,8 +256,8 @@ do_xslt_to_slax (const char *name UNUSED, const char *output,
 	    err(1, "could not open file: '%s'", output);
     }
 
-    slaxWriteDoc((slaxWriterFunc_t) fprintf, outfile, docp,
-		 opt_partial, opt_version);
+    fflush(outfile);
+    slaxWriteDocFd(fileno(outfile), docp, opt_partial, opt_version);
 
     if (outfile != stdout)
 	fclose(outfile);
@@ -225,6 +267,58 @@ do_xslt_to_slax (const char *name UNUSED, const char *output,
     return 0;
 }
 
+/*
+ * Write one record of JSON lines input as soon as it's been read,
+ * indented as a child of the <json> element (unless --partial)
+ */
+static int
+json_lines_record (xmlDocPtr docp, void *opaque)
+{
+    xmlOutputBufferPtr out = opaque;
+
+    if (!opt_partial)
+	xmlOutputBufferWrite(out, 2, "  ");
+    xmlNodeDumpOutput(out, docp, xmlDocGetRootElement(docp),
+		      opt_partial ? 0 : 1, 1, "UTF-8");
+    xmlOutputBufferWrite(out, 1, "\n");
+    xmlFreeDoc(docp);
+
+    return out->error ? -1 : 0;
+}
+
+/*
+ * Turn JSON lines into a <json> element with a <record> child for
+ * each line, writing each record as it's read
+ */
+static int
+do_json_lines_to_xml (const char *input, FILE *outfile)
+{
+    xmlOutputBufferPtr out;
+    int rc;
+
+    fflush(outfile);
+    out = xmlOutputBufferCreateFd(fileno(outfile), NULL);
+    if (out == NULL)
+	errx(1, "out of memory");
+
+    if (!opt_partial)
+	xmlOutputBufferWriteString(out, "<?xml version=\"1.0\" "
+				   "encoding=\"UTF-8\" standalone=\"yes\"?>\n"
+				   "<" ELT_JSON ">\n");
+
+    rc = slaxJsonLinesFileToXml(input, NULL, opt_json_flags,
+				json_lines_record, out);
+
+    if (!opt_partial)
+	xmlOutputBufferWriteString(out, "</" ELT_JSON ">\n");
+    xmlOutputBufferClose(out);
+
+    if (rc)
+	errx(1, "errors parsing file: '%s'", input);
+
+    return 0;
+}
+
 static int
 do_json_to_xml (const char *name UNUSED, const char *output,
 		 const char *input, char **argv)
@@ -235,6 +329,22 @@ do_json_to_xml (const char *name UNUSED, const char *output,
     input = get_filename(input, &argv, 0);
     output = get_filename(output, &argv, -1);
 
+    if (opt_json_lines) {
+	if (output == NULL || slaxFilenameIsStd(output))
+	    outfile = stdout;
+	else {
+	    outfile = fopen(output, "w");
+	    if (outfile == NULL)
+		err(1, "could not open file: '%s'", output);
+	}
+
+	do_json_lines_to_xml(input, outfile);
+
+	if (outfile != stdout)
+	    fclose(outfile);
+	return 0;
+    }
+
     docp = slaxJsonFileToXml(input, NULL, opt_json_flags);
     if (docp == NULL) {
 	errx(1, "cannot parse file: '%s'", input);
@@ -262,6 +372,39 @@ do_json_to_xml (const char *name UNUSED, const char *output,
 static int
 do_xml_to_json (const char *name UNUSED, const char *output,
 		 const char *input, char **argv)
+{
+    FILE *outfile;
+    int rc;
+
+    input = get_filename(input, &argv, 0);
+    output = get_filename(output, &argv, -1);
+
+    if (output == NULL || slaxFilenameIsStd(output))
+	outfile = stdout;
+    else {
+	outfile = fopen(output, "w");
+	if (outfile == NULL)
+	    err(1, "could not open file: '%s'", output);
+    }
+
+    /* The input is converted as it's read, without building a tree */
+    fflush(outfile);
+    rc = slaxJsonWriteFileFd(fileno(outfile), input,
+			     opt_json_lines ? JWF_LINES
+			     : opt_indent ? JWF_PRETTY : 0);
+
+    if (outfile != stdout)
+	fclose(outfile);
+
+    if (rc < 0)
+	errx(1, "cannot parse file: '%s'", input);
+
+    return 0;
+}
+
+static int
+do_binary_to_xml (const char *name UNUSED, const char *output,
+		  const char *input, char **argv)
 {
     xmlDocPtr docp;
     FILE *outfile;
@@ -269,12 +412,57 @@ do_xml_to_json (const char *name UNUSED, const char *output,
     input = get_filename(input, &argv, 0);
     output = get_filename(output, &argv, -1);
 
-    docp = xmlReadFile(input, NULL, XSLT_PARSE_OPTIONS);
-    if (docp == NULL) {
+    docp = slaxJsonBinaryFileToXml(opt_binary_format, input, NULL,
+				   opt_json_flags);
+    if (docp == NULL)
 	errx(1, "cannot parse file: '%s'", input);
-        return -1;
+
+    if (output == NULL || slaxFilenameIsStd(output))
+	outfile = stdout;
+    else {
+	outfile = fopen(output, "w");
+	if (outfile == NULL)
+	    err(1, "could not open file: '%s'", output);
     }
 
+    slaxDumpToFd(fileno(outfile), docp, opt_partial);
+
+    if (outfile != stdout)
+	fclose(outfile);
+
+    xmlFreeDoc(docp);
+
+    return 0;
+}
+
+static int
+do_xml_to_binary (const char *name UNUSED, const char *output,
+		  const char *input, char **argv)
+{
+    xmlDocPtr docp;
+    xmlNodePtr root;
+    xmlBufferPtr xbuf;
+    FILE *outfile;
+
+    input = get_filename(input, &argv, 0);
+    output = get_filename(output, &argv, -1);
+
+    docp = xmlReadFile(input, NULL, XSLT_PARSE_OPTIONS);
+    if (docp == NULL)
+	errx(1, "cannot parse file: '%s'", input);
+
+    root = xmlDocGetRootElement(docp);
+    if (root == NULL)
+	errx(1, "invalid document (no root node)");
+
+    xbuf = xmlBufferCreate();
+    if (xbuf == NULL)
+	errx(1, "out of memory");
+    xmlBufferSetAllocationScheme(xbuf, XML_BUFFER_ALLOC_DOUBLEIT);
+
+    if (slaxJsonBinaryWriteNode(opt_binary_format, xbuf, root) < 0)
+	errx(1, "cannot encode file: '%s'", input);
+
     if (output == NULL || slaxFilenameIsStd(output))
 	outfile = stdout;
     else {
@@ -283,12 +471,14 @@ do_xml_to_json (const char *name UNUSED, const char *output,
 	    err(1, "could not open file: '%s'", output);
     }
 
-    slaxJsonWriteDoc((slaxWriterFunc_t) fprintf, outfile, docp,
-		     opt_indent ? JWF_PRETTY : 0);
+    if (fwrite(xmlBufferContent(xbuf), 1, xmlBufferLength(xbuf), outfile)
+	    != (size_t) xmlBufferLength(xbuf) || fflush(outfile) != 0)
+	err(1, "could not write file: '%s'", output ?: "-");
 
     if (outfile != stdout)
 	fclose(outfile);
 
+    xmlBufferFree(xbuf);
     xmlFreeDoc(docp);
 
     return 0;
@@ -418,6 +608,246 @@ buildEmptyFile (void)
     return docp;
 }
 
+/*
+ * Read the input document for a transform, in the requested format
+ */
+static xmlDocPtr
+read_input (const char *input)
+{
+    if (opt_empty_input)
+	return buildEmptyFile();
+    if (opt_bxml_input)
+	return slaxBxmlLoadFile(input, NULL);
+    if (opt_html)
+	return htmlReadFile(input, encoding, options);
+    return xmlReadFile(input, encoding, options);
+}
+
+/*
+ * Write the result of a transform in the requested format.  With
+ * --json-output, the result tree goes straight to the JSON writer,
+ * rather than being serialized as XML and parsed again.  With
+ * --stream-records, each result is already one record, so
+ * --json-lines writes it as a single line.
+ */
+static void
+write_result (FILE *outfile, xmlDocPtr res, xsltStylesheetPtr script)
+{
+    unsigned flags;
+
+    if (opt_bxml_output) {
+	fflush(outfile);
+	if (slaxBxmlSaveFd(fileno(outfile), res) < 0)
+	    warn("could not write binary XML");
+
+    } else if (opt_json_output) {
+	if (opt_json_lines)
+	    flags = opt_stream_records ? 0 : JWF_LINES;
+	else
+	    flags = opt_indent ? JWF_PRETTY : 0;
+
+	fflush(outfile);
+	if (slaxJsonWriteDocFd(fileno(outfile), res, flags) < 0)
+	    warnx("result has no top element to write as JSON");
+
+    } else if (opt_slax_output) {
+	fflush(outfile);
+	slaxWriteDocFd(fileno(outfile), res, TRUE, opt_version);
+
+    } else
+	xsltSaveResultToFile(outfile, res, script);
+}
+
+#define RECORD_PATH_MAX	32	/* Max steps in a --stream-records path */
+#define ELT_RESULTS	"results" /* Element holding --stream-records results */
+
+/*
+ * The path given to --stream-records, as a list of element names.
+ * An absolute path ("/a/b/c") must match from the top element; a
+ * relative one ("b/c") matches at any depth.  A "*" step matches any
+ * element.
+ */
+typedef struct record_path_s {
+    int rp_absolute;		/* Path starts at the top element */
+    int rp_count;		/* Number of steps */
+    char *rp_steps[RECORD_PATH_MAX]; /* Names, from the top down */
+    char *rp_buf;		/* Copy of the path, holding the steps */
+} record_path_t;
+
+static void
+record_path_parse (record_path_t *rpp, const char *path)
+{
+    char *copy, *cp, *step;
+
+    bzero(rpp, sizeof(*rpp));
+
+    copy = rpp->rp_buf = strdup(path);
+    if (copy == NULL)
+	errx(1, "out of memory");
+
+    cp = copy;
+    if (*cp == '/') {
+	rpp->rp_absolute = TRUE;
+	cp += 1;
+    }
+
+    while ((step = strsep(&cp, "/")) != NULL) {
+	if (*step == '\0' || rpp->rp_count >= RECORD_PATH_MAX)
+	    errx(1, "invalid record path: '%s'", path);
+	rpp->rp_steps[rpp->rp_count++] = step;
+    }
+}
+
+/*
+ * Does the element at the given depth, with the given ancestors,
+ * match the record path?
+ */
+static int
+record_path_match (record_path_t *rpp, const xmlChar **names, int depth)
+{
+    int i, base = depth + 1 - rpp->rp_count;
+
+    if (base < 0 || (rpp->rp_absolute && base != 0))
+	return FALSE;
+
+    for (i = 0; i < rpp->rp_count; i++) {
+	if (!streq(rpp->rp_steps[i], "*")
+	        && !streq(rpp->rp_steps[i], (const char *) names[base + i]))
+	    return FALSE;
+    }
+
+    return TRUE;
+}
+
+/*
+ * Run the script over each record of a large input.  The input is
+ * read with an xmlTextReader, and each element matching the record
+ * path is expanded, placed in a document of its own, and handed to
+ * the script.  Its result is written before the next record is read,
+ * so memory use is bounded by the largest record, not the input.
+ * Unless the output is JSON, SLAX, or text, or --partial is given,
+ * the results are wrapped in a <results> element, so the output is
+ * one XML document.
+ */
+static int
+run_records (xsltStylesheetPtr script, const char *input, FILE *outfile)
+{
+    record_path_t rp;
+    xmlTextReaderPtr reader;
+    xmlNodePtr nodep, parent, prev, next;
+    xmlDocPtr docp, res;
+    const xmlChar **names = NULL, **newp;
+    const xmlChar *method, *enc;
+    int size = 0, depth, rc, wrap;
+    unsigned long count = 0;
+
+    record_path_parse(&rp, opt_stream_records);
+
+    reader = xmlReaderForFile(input, encoding, options);
+    if (reader == NULL)
+	errx(1, "unable to open: '%s'", input);
+
+    XSLT_GET_IMPORT_PTR(method, script, method);
+    XSLT_GET_IMPORT_PTR(enc, script, encoding);
+
+    wrap = !opt_partial && !opt_json_output && !opt_slax_output
+	&& (method == NULL || xmlStrEqual(method, (const xmlChar *) "xml"));
+
+    /* Each result is a piece of the whole, so has no declaration */
+    script->omitXmlDeclaration = 1;
+
+    if (wrap) {
+	if (enc)
+	    fprintf(outfile, "<?xml version=\"1.0\" encoding=\"%s\"?>\n",
+		    (const char *) enc);
+	else
+	    fprintf(outfile, "<?xml version=\"1.0\"?>\n");
+	fprintf(outfile, "<" ELT_RESULTS ">\n");
+    }
+
+    rc = xmlTextReaderRead(reader);
+    while (rc == 1) {
+	if (xmlTextReaderNodeType(reader) != XML_READER_TYPE_ELEMENT) {
+	    rc = xmlTextReaderRead(reader);
+	    continue;
+	}
+
+	/* Remember the names of the current element and its ancestors */
+	depth = xmlTextReaderDepth(reader);
+	if (depth >= size) {
+	    size = size ? size * 2 : 64;
+	    newp = realloc(names, size * sizeof(*names));
+	    if (newp == NULL)
+		errx(1, "out of memory");
+	    names = newp;
+	}
+	names[depth] = xmlTextReaderConstName(reader);
+
+	if (!record_path_match(&rp, names, depth)) {
+	    rc = xmlTextReaderRead(reader);
+	    continue;
+	}
+
+	nodep = xmlTextReaderExpand(reader);
+	if (nodep == NULL) {
+	    rc = -1;
+	    break;
+	}
+
+	/*
+	 * Rather than copy the record, we lend it to a document of its
+	 * own for the transform, and put it back afterwards, so the
+	 * reader can free it as usual.  The document shares the
+	 * reader's dictionary, so the names stay valid.
+	 */
+	docp = xmlNewDoc((const xmlChar *) XML_DEFAULT_VERSION);
+	if (docp == NULL)
+	    errx(1, "out of memory");
+	docp->dict = nodep->doc->dict;
+	if (docp->dict)
+	    xmlDictReference(docp->dict);
+	if (!slaxFilenameIsStd(input))
+	    docp->URL = xmlStrdup((const xmlChar *) input);
+
+	parent = nodep->parent;
+	prev = nodep->prev;
+	next = nodep->next;
+	xmlDocSetRootElement(docp, nodep);
+
+	res = xsltApplyStylesheet(script, docp, params);
+	if (res) {
+	    write_result(outfile, res, script);
+	    xmlFreeDoc(res);
+	}
+
+	xmlUnlinkNode(nodep);
+	if (prev)
+	    xmlAddNextSibling(prev, nodep);
+	else if (next)
+	    xmlAddPrevSibling(next, nodep);
+	else
+	    xmlAddChild(parent, nodep);
+
+	xmlFreeDoc(docp);
+	count += 1;
+
+	/* Move past the record, letting the reader free it */
+	rc = xmlTextReaderNext(reader);
+    }
+
+    if (wrap)
+	fprintf(outfile, "</" ELT_RESULTS ">\n");
+
+    xmlFreeTextReader(reader);
+    free(names);
+    free(rp.rp_buf);
+
+    if (rc < 0)
+	errx(1, "error parsing '%s' after %lu records", input, count);
+
+    return 0;
+}
+
 static int
 do_run (const char *name, const char *output, const char *input, char **argv)
 {
@@ -457,18 +887,31 @@ do_run (const char *name, const char *output, const char *input, char **argv)
 	errx(1, "%d errors parsing script: '%s'",
 	     script ? script->errors : 1, scriptname);
 
-    if (opt_empty_input)
-	indoc = buildEmptyFile();
-    else if (opt_html)
-	indoc = htmlReadFile(input, encoding, options);
-    else
-	indoc = xmlReadFile(input, encoding, options);
-    if (indoc == NULL)
-	errx(1, "unable to parse: '%s'", input);
-
     if (opt_indent)
 	script->indent = 1;
 
+    if (opt_stream_records) {
+	if (output == NULL || slaxFilenameIsStd(output))
+	    outfile = stdout;
+	else {
+	    outfile = fopen(output, "w");
+	    if (outfile == NULL)
+		err(1, "could not open file: '%s'", output);
+	}
+
+	run_records(script, input, outfile);
+
+	if (outfile != stdout)
+	    fclose(outfile);
+
+	xsltFreeStylesheet(script);
+	return 0;
+    }
+
+    indoc = read_input(input);
+    if (indoc == NULL)
+	errx(1, "unable to parse: '%s'", input);
+
     if (opt_debugger) {
 	slaxDebugInit();
 	slaxDebugSetStylesheet(script);
@@ -491,11 +934,7 @@ do_run (const char *name, const char *output, const char *input, char **argv)
 		err(1, "could not open file: '%s'", output);
 	}
 
-	if (opt_slax_output)
-	    slaxWriteDoc((slaxWriterFunc_t) fprintf, outfile, res,
-		 TRUE, opt_version);
-	else
-	    xsltSaveResultToFile(outfile, res, script);
+	write_result(outfile, res, script);
 
 	if (outfile != stdout)
 	    fclose(outfile);
@@ -546,12 +985,7 @@ do_xpath (const char *name UNUSED, const char *output,
 	errx(1, "%d errors parsing script: '%s'",
 	     script ? script->errors : 1, opt_xpath);
 
-    if (opt_empty_input)
-	indoc = buildEmptyFile();
-    else if (opt_html)
-	indoc = htmlReadFile(input, encoding, options);
-    else
-	indoc = xmlReadFile(input, encoding, options);
+    indoc = read_input(input);
     if (indoc == NULL)
 	errx(1, "unable to parse: '%s'", input);
 
@@ -577,11 +1011,7 @@ do_xpath (const char *name UNUSED, const char *output,
 		err(1, "could not open file: '%s'", output);
 	}
 
-	if (opt_slax_output)
-	    slaxWriteDoc((slaxWriterFunc_t) fprintf, outfile, res,
-		 TRUE, opt_version);
-	else
-	    xsltSaveResultToFile(outfile, res, script);
+	write_result(outfile, res, script);
 
 	if (outfile != stdout)
 	    fclose(outfile);
@@ -601,36 +1031,457 @@ do_check (const char *name, const char *output UNUSED,
 {
     xmlDocPtr scriptdoc;
     const char *scriptname;
-    FILE *scriptfile;
-    xsltStylesheetPtr script;
+    int open_error, errors;
 
     scriptname = get_filename(name, &argv, -1);
 
     if (slaxFilenameIsStd(scriptname))
 	errx(1, "script file cannot be stdin");
 
-    scriptfile = fopen(scriptname, "r");
-    if (scriptfile == NULL)
+    scriptdoc = load_script(scriptname, 0, &open_error);
+    if (open_error) {
+	errno = open_error;
 	err(1, "file open failed for '%s'", scriptname);
-
-    scriptdoc = slaxLoadFile(scriptname, scriptfile, NULL, 0);
+    }
     if (scriptdoc == NULL)
 	errx(1, "cannot parse: '%s'", scriptname);
-    if (scriptfile != stdin)
-	fclose(scriptfile);
 
-    script = xsltParseStylesheetDoc(scriptdoc);
-    if (script == NULL || script->errors != 0)
-	errx(1, "%d errors parsing script: '%s'",
-	     script ? script->errors : 1, scriptname);
+    errors = check_script(scriptdoc);
+    if (errors != 0)
+	errx(1, "%d errors parsing script: '%s'", errors, scriptname);
 
     fprintf(stderr, "script check succeeds\n");
 
-    xsltFreeStylesheet(script);
+    return 0;
+}
+
+/*
+ * Batch mode: run --check, --format, or --slax-to-xslt over many
+ * scripts on a pool of worker threads.  Each worker captures its
+ * output and messages, and the main thread prints them in the order
+ * the scripts were given, so results don't depend on scheduling.
+ * Workers never get more than BATCH_WINDOW jobs ahead of the printer,
+ * which bounds the number of captured results held at once.
+ */
+#define BATCH_WINDOW_PER_THREAD 4
+
+typedef struct batch_job_s {
+    char *bj_filename;		/* Script to process */
+    FILE *bj_out;		/* Captured output (a tmpfile) */
+    xmlBufferPtr bj_err;	/* Captured error messages */
+    int bj_failed;		/* Did this script fail? */
+    int bj_done;		/* Has a worker finished it? */
+} batch_job_t;
+
+static int opt_batch;		/* Process many scripts at once */
+static int opt_jobs;		/* Number of worker threads */
+static int (*batch_func)(const char *, const char *, const char *, char **);
+static const char *batch_output; /* Directory for results */
+static batch_job_t *batch_jobs;	/* Jobs, in output order */
+static int batch_count;		/* Number of jobs */
+static int batch_max;		/* Number of jobs allocated */
+static int batch_next;		/* Next job to hand out */
+static int batch_printed;	/* Jobs printed so far */
+static int batch_window;	/* Max jobs ahead of the printer */
+static SLAX_THREAD_LOCAL batch_job_t *batch_current; /* Worker's job */
+
+#ifdef HAVE_PTHREAD_H
+static pthread_mutex_t batch_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t batch_cond = PTHREAD_COND_INITIALIZER;
+#endif /* HAVE_PTHREAD_H */
 
+/*
+ * Record an error message for the current job, or print it if
+ * we're not in a job
+ */
+static void
+batch_verror (const char *fmt, va_list vap)
+{
+    char buf[BUFSIZ];
+    int len;
+
+    if (batch_current == NULL) {
+	vfprintf(stderr, fmt, vap);
+	return;
+    }
+
+    len = vsnprintf(buf, sizeof(buf), fmt, vap);
+    if (len >= (int) sizeof(buf))
+	len = sizeof(buf) - 1;
+    if (len > 0)
+	xmlBufferAdd(batch_current->bj_err, (xmlChar *) buf, len);
+}
+
+static void
+batch_error (void *opaque UNUSED, const char *fmt, ...)
+{
+    va_list vap;
+
+    va_start(vap, fmt);
+    batch_verror(fmt, vap);
+    va_end(vap);
+}
+
+/*
+ * Like slaxIoStdioErrorCallback(), but into the current job
+ */
+static int
+batch_slax_error (const char *fmt, va_list vap)
+{
+    batch_verror(fmt, vap);
+    batch_error(NULL, "\n");
     return 0;
 }
 
+static void
+batch_add (const char *filename)
+{
+    batch_job_t *bjp;
+
+    if (batch_count >= batch_max) {
+	batch_max = batch_max ? batch_max * 2 : 256;
+	batch_jobs = xmlRealloc(batch_jobs, batch_max * sizeof(*batch_jobs));
+	if (batch_jobs == NULL)
+	    errx(1, "out of memory");
+    }
+
+    bjp = &batch_jobs[batch_count++];
+    bzero(bjp, sizeof(*bjp));
+    bjp->bj_filename = (char *) xmlStrdup((const xmlChar *) filename);
+    bjp->bj_err = xmlBufferCreate();
+    if (bjp->bj_filename == NULL || bjp->bj_err == NULL)
+	errx(1, "out of memory");
+}
+
+static int
+batch_compare (const void *a, const void *b)
+{
+    return strcmp(*(char * const *) a, *(char * const *) b);
+}
+
+/*
+ * Add the SLAX scripts under a directory, in sorted order
+ */
+static void
+batch_add_directory (const char *dir)
+{
+    DIR *dirp;
+    struct dirent *dp;
+    struct stat st;
+    char **names = NULL;
+    int count = 0, max = 0, i;
+    size_t len;
+    char *path;
+
+    dirp = opendir(dir);
+    if (dirp == NULL)
+	err(1, "cannot open directory: '%s'", dir);
+
+    while ((dp = readdir(dirp)) != NULL) {
+	if (dp->d_name[0] == '.')
+	    continue;
+
+	if (count >= max) {
+	    max = max ? max * 2 : 64;
+	    names = xmlRealloc(names, max * sizeof(*names));
+	    if (names == NULL)
+		errx(1, "out of memory");
+	}
+
+	len = strlen(dir) + strlen(dp->d_name) + 2;
+	names[count] = xmlMalloc(len);
+	if (names[count] == NULL)
+	    errx(1, "out of memory");
+	snprintf(names[count++], len, "%s/%s", dir, dp->d_name);
+    }
+
+    closedir(dirp);
+
+    if (names)
+	qsort(names, count, sizeof(*names), batch_compare);
+
+    for (i = 0; i < count; i++) {
+	path = names[i];
+	len = strlen(path);
+
+	/*
+	 * Don't follow symlinks to directories, since they can lead
+	 * back up the tree, but do take symlinks to scripts.
+	 */
+	if (lstat(path, &st) == 0) {
+	    if (S_ISDIR(st.st_mode))
+		batch_add_directory(path);
+	    else if (len > 5 && streq(path + len - 5, ".slax")
+		     && (!S_ISLNK(st.st_mode)
+			 || (stat(path, &st) == 0 && !S_ISDIR(st.st_mode))))
+		batch_add(path);
+	}
+
+	xmlFree(path);
+    }
+
+    xmlFreeAndEasy(names);
+}
+
+/*
+ * Open the file that will hold the result of a job.  With --output,
+ * results go under that directory, using the script's own path.
+ */
+static FILE *
+batch_open_output (batch_job_t *bjp)
+{
+    char path[MAXPATHLEN], *cp;
+    const char *name = bjp->bj_filename;
+    size_t len;
+
+    if (batch_output == NULL)
+	return tmpfile();
+
+    while (*name == '/' || (name[0] == '.' && name[1] == '/'))
+	name += (*name == '/') ? 1 : 2;
+
+    /* A ".." component would take us out of the output directory */
+    for (cp = strstr(name, ".."); cp; cp = strstr(cp + 2, "..")) {
+	if ((cp == name || cp[-1] == '/')
+		&& (cp[2] == '\0' || cp[2] == '/')) {
+	    errno = EINVAL;
+	    return NULL;
+	}
+    }
+
+    len = snprintf(path, sizeof(path), "%s/%s", batch_output, name);
+    if (len >= sizeof(path))
+	return NULL;
+
+    if (batch_func == do_slax_to_xslt && len > 5
+	    && streq(path + len - 5, ".slax"))
+	strcpy(path + len - 5, ".xsl");
+
+    /* Make any missing directories along the way */
+    for (cp = strchr(path + 1, '/'); cp; cp = strchr(cp + 1, '/')) {
+	*cp = '\0';
+	mkdir(path, 0755);
+	*cp = '/';
+    }
+
+    return fopen(path, "w");
+}
+
+/*
+ * Process one script, recording the results in the job
+ */
+static void
+batch_run_job (batch_job_t *bjp)
+{
+    const char *filename = bjp->bj_filename;
+    xmlDocPtr docp;
+    int partial = (batch_func == do_check) ? 0 : opt_partial;
+    int open_error, errors;
+
+    batch_current = bjp;
+    slaxNameReset();		/* Same names as a run of its own */
+
+    docp = load_script(filename, partial, &open_error);
+    if (open_error) {
+	batch_error(NULL, "%s: file open failed: %s\n",
+		    filename, strerror(open_error));
+	bjp->bj_failed = TRUE;
+	goto done;
+    }
+
+    if (docp == NULL) {
+	batch_error(NULL, "%s: cannot parse file\n", filename);
+	bjp->bj_failed = TRUE;
+	goto done;
+    }
+
+    if (batch_func == do_check) {
+	errors = check_script(docp);
+	if (errors != 0) {
+	    batch_error(NULL, "%s: %d errors parsing script\n",
+			filename, errors);
+	    bjp->bj_failed = TRUE;
+	} else
+	    batch_error(NULL, "%s: script check succeeds\n", filename);
+	goto done;
+    }
+
+    bjp->bj_out = batch_open_output(bjp);
+    if (bjp->bj_out == NULL) {
+	if (errno == EINVAL)
+	    batch_error(NULL, "%s: output file would be outside '%s'\n",
+			filename, batch_output);
+	else
+	    batch_error(NULL, "%s: could not open output file: %s\n",
+			filename, strerror(errno));
+	bjp->bj_failed = TRUE;
+	xmlFreeDoc(docp);
+	goto done;
+    }
+
+    if (write_script(bjp->bj_out, docp, batch_func == do_format))
+	bjp->bj_failed = TRUE;
+
+    if (batch_output) {
+	if (fclose(bjp->bj_out) != 0)
+	    bjp->bj_failed = TRUE;
+	bjp->bj_out = NULL;
+    }
+
+    xmlFreeDoc(docp);
+
+ done:
+    batch_current = NULL;
+}
+
+/*
+ * Print the results of a finished job, in order
+ */
+static void
+batch_print_job (batch_job_t *bjp)
+{
+    char buf[BUFSIZ];
+    size_t len;
+
+    if (bjp->bj_out) {
+	fflush(bjp->bj_out);
+	rewind(bjp->bj_out);
+	while ((len = fread(buf, 1, sizeof(buf), bjp->bj_out)) > 0)
+	    fwrite(buf, 1, len, stdout);
+	fclose(bjp->bj_out);
+	bjp->bj_out = NULL;
+    }
+
+    fflush(stdout);
+    fwrite(xmlBufferContent(bjp->bj_err), 1,
+	   xmlBufferLength(bjp->bj_err), stderr);
+
+    xmlBufferFree(bjp->bj_err);
+    bjp->bj_err = NULL;
+    xmlFree(bjp->bj_filename);
+    bjp->bj_filename = NULL;
+}
+
+#ifdef HAVE_PTHREAD_H
+static void *
+batch_worker (void *arg UNUSED)
+{
+    batch_job_t *bjp;
+
+    /* libxml2 keeps its error handler per thread */
+    xmlSetGenericErrorFunc(NULL, batch_error);
+
+    pthread_mutex_lock(&batch_lock);
+
+    for (;;) {
+	while (batch_next < batch_count
+	       && batch_next >= batch_printed + batch_window)
+	    pthread_cond_wait(&batch_cond, &batch_lock);
+
+	if (batch_next >= batch_count)
+	    break;
+
+	bjp = &batch_jobs[batch_next++];
+	pthread_mutex_unlock(&batch_lock);
+
+	batch_run_job(bjp);
+
+	pthread_mutex_lock(&batch_lock);
+	bjp->bj_done = TRUE;
+	pthread_cond_broadcast(&batch_cond);
+    }
+
+    pthread_mutex_unlock(&batch_lock);
+    return NULL;
+}
+#endif /* HAVE_PTHREAD_H */
+
+static int
+do_batch (const char *name UNUSED, const char *output,
+	  const char *input UNUSED, char **argv)
+{
+    struct stat st;
+    batch_job_t *bjp;
+    int i, failures = 0;
+#ifdef HAVE_PTHREAD_H
+    pthread_t *tids;
+#endif /* HAVE_PTHREAD_H */
+
+    for ( ; *argv; argv++) {
+	if (stat(*argv, &st) == 0 && S_ISDIR(st.st_mode))
+	    batch_add_directory(*argv);
+	else
+	    batch_add(*argv);
+    }
+
+    if (batch_count == 0)
+	errx(1, "no scripts to process");
+
+    if (output) {
+	if (mkdir(output, 0755) < 0 && errno != EEXIST)
+	    err(1, "cannot create output directory: '%s'", output);
+	batch_output = output;
+    }
+
+    slaxIoRegister(NULL, NULL, NULL, batch_slax_error);
+    xsltSetGenericErrorFunc(NULL, batch_error);
+    xmlSetGenericErrorFunc(NULL, batch_error);
+
+    if (opt_jobs <= 0)
+	opt_jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    if (opt_jobs <= 0)
+	opt_jobs = 1;
+    if (opt_jobs > batch_count)
+	opt_jobs = batch_count;
+    batch_window = opt_jobs * BATCH_WINDOW_PER_THREAD;
+
+#ifdef HAVE_PTHREAD_H
+    tids = alloca(opt_jobs * sizeof(*tids));
+    for (i = 0; i < opt_jobs; i++)
+	if (pthread_create(&tids[i], NULL, batch_worker, NULL) != 0)
+	    errx(1, "cannot start worker thread");
+
+    pthread_mutex_lock(&batch_lock);
+    for (i = 0; i < batch_count; i++) {
+	bjp = &batch_jobs[i];
+	while (!bjp->bj_done)
+	    pthread_cond_wait(&batch_cond, &batch_lock);
+	pthread_mutex_unlock(&batch_lock);
+
+	batch_print_job(bjp);
+	if (bjp->bj_failed)
+	    failures += 1;
+
+	pthread_mutex_lock(&batch_lock);
+	batch_printed = i + 1;
+	pthread_cond_broadcast(&batch_cond);
+    }
+    pthread_mutex_unlock(&batch_lock);
+
+    for (i = 0; i < opt_jobs; i++)
+	pthread_join(tids[i], NULL);
+#else /* HAVE_PTHREAD_H */
+    for (i = 0; i < batch_count; i++) {
+	bjp = &batch_jobs[i];
+	batch_run_job(bjp);
+	batch_print_job(bjp);
+	if (bjp->bj_failed)
+	    failures += 1;
+    }
+#endif /* HAVE_PTHREAD_H */
+
+    xmlFree(batch_jobs);
+    batch_jobs = NULL;
+
+    if (failures) {
+	fprintf(stderr, "%d of %d script%s failed\n",
+		failures, batch_count, (batch_count == 1) ? "" : "s");
+	slaxSetExitCode(1);
+    }
+
+    return failures ? -1 : 0;
+}
+
 static const char mini_prefix[] = "version " SLAX_VERSION ";\n";
 static const char mini_discard[] = "match text() { }\n";
 
@@ -698,18 +1549,24 @@ print_help (void)
     fprintf(stderr,
 "Usage: slaxproc [mode] [options] [script] [files]\n"
 "    Modes:\n"
+"\t--cbor-to-xml: Turn CBOR data into XML\n"
 "\t--check OR -c: check syntax and content for a SLAX script\n"
 "\t--format OR -F: format (pretty print) a SLAX script\n"
 "\t--json-to-xml: Turn JSON data into XML\n"
+"\t--msgpack-to-xml: Turn MessagePack data into XML\n"
 "\t--run OR -r: run a SLAX script (the default mode)\n"
 "\t--show-select: show XPath selection from the input document\n"
 "\t--show-variable: show contents of a global variable\n"
 "\t--slax-to-xslt OR -x: turn SLAX into XSLT\n"
+"\t--xml-to-cbor: turn XML into CBOR\n"
 "\t--xml-to-json: turn XML into JSON\n"
+"\t--xml-to-msgpack: turn XML into MessagePack\n"
 "\t--xpath <xpath> OR -X <xpath>: select XPath data from input\n"
 "\t--xslt-to-slax OR -s: turn XSLT into SLAX\n"
 "\n"
 "    Options:\n"
+"\t--batch OR -B: run the mode over many scripts (or directories)\n"
+"\t--cache-dir <dir>: cache compiled scripts in the given directory\n"
 "\t--debug OR -d: enable the SLAX/XSLT debugger\n"
 "\t--empty OR -E: give an empty document for input\n"
 "\t--exslt OR -e: enable the EXSLT library\n"
@@ -720,6 +1577,10 @@ print_help (void)
 "\t--include <dir> OR -I <dir>: search directory for includes/imports\n"
 "\t--indent OR -g: indent output ala output-method/indent\n"
 "\t--input <file> OR -i <file>: take input from the given file\n"
+"\t--input-format <format>: read input as xml, html, or bxml (binary)\n"
+"\t--jobs <count> OR -j <count>: number of worker threads for --batch\n"
+"\t--json-lines: JSON data is one record per line (JSON lines)\n"
+"\t--json-output: write the results of --run as JSON\n"
 "\t--json-tagging: tag json-style input with the 'json' attribute\n"
 "\t--keep-text: mini-templates should not discard text\n"
 "\t--lib <dir> OR -L <dir>: search directory for extension libraries\n"
@@ -730,9 +1591,11 @@ print_help (void)
 "\t--no-randomize: do not initialize the random number generator\n"
 "\t--no-tty: do not fall back to stdin for tty io\n"
 "\t--output <file> OR -o <file>: make output into the given file\n"
+"\t--output-format <format>: write results as xml, json, or bxml (binary)\n"
 "\t--param <name> <value> OR -a <name> <value>: pass parameters\n"
 "\t--partial OR -p: allow partial SLAX input to --slax-to-xslt\n"
 "\t--slax-output OR -S: Write the result using SLAX-style XML (braces, etc)\n"
+"\t--stream-records <path>: run the script on each record in the input\n"
 "\t--trace <file> OR -t <file>: write trace data to a file\n"
 "\t--verbose OR -v: enable debugging output (slaxLog())\n"
 "\t--version OR -V: show version information (and exit)\n"
@@ -771,6 +1634,8 @@ main (int argc UNUSED, char **argv)
     unsigned ioflags = 0;
     int opt_ignore_arguments = FALSE;
     char *opt_log_file = NULL;
+    char *opt_cache_dir = NULL;
+    unsigned long hits, misses, containers, bytes;
 
     slaxDataListInit(&plist);
     slaxDataListInit(&mini_templates);
@@ -789,7 +1654,13 @@ main (int argc UNUSED, char **argv)
 	 * - then list the options in alphabetically order
 	 */
 
-	if (streq(cp, "--check") || streq(cp, "-c")) {
+	if (streq(cp, "--cbor-to-xml")) {
+	    if (func)
+		errx(1, "open one action allowed");
+	    func = do_binary_to_xml;
+	    opt_binary_format = JB_CBOR;
+
+	} else if (streq(cp, "--check") || streq(cp, "-c")) {
 	    if (func)
 		errx(1, "open one action allowed");
 	    func = do_check;
@@ -810,6 +1681,12 @@ main (int argc UNUSED, char **argv)
 		errx(1, "open one action allowed");
 	    func = do_json_to_xml;
 
+	} else if (streq(cp, "--msgpack-to-xml")) {
+	    if (func)
+		errx(1, "open one action allowed");
+	    func = do_binary_to_xml;
+	    opt_binary_format = JB_MSGPACK;
+
 	} else if (streq(cp, "--run") || streq(cp, "-r")) {
 	    if (func)
 		errx(1, "open one action allowed");
@@ -832,17 +1709,35 @@ main (int argc UNUSED, char **argv)
 		errx(1, "open one action allowed");
 	    func = do_slax_to_xslt;
 
+	} else if (streq(cp, "--xml-to-cbor")) {
+	    if (func)
+		errx(1, "open one action allowed");
+	    func = do_xml_to_binary;
+	    opt_binary_format = JB_CBOR;
+
 	} else if (streq(cp, "--xml-to-json")) {
 	    if (func)
 		errx(1, "open one action allowed");
 	    func = do_xml_to_json;
 
+	} else if (streq(cp, "--xml-to-msgpack")) {
+	    if (func)
+		errx(1, "open one action allowed");
+	    func = do_xml_to_binary;
+	    opt_binary_format = JB_MSGPACK;
+
 	} else if (streq(cp, "--xslt-to-slax") || streq(cp, "-s")) {
 	    if (func)
 		errx(1, "open one action allowed");
 	    func = do_xslt_to_slax;
 
 /* Non-mode flags start here */
+	} else if (streq(cp, "--batch") || streq(cp, "-B")) {
+	    opt_batch = TRUE;
+
+	} else if (streq(cp, "--cache-dir")) {
+	    opt_cache_dir = check_arg("cache directory", &argv);
+
 	} else if (streq(cp, "--debug") || streq(cp, "-d")) {
 	    opt_debugger = TRUE;
 
@@ -876,6 +1771,34 @@ main (int argc UNUSED, char **argv)
 	} else if (streq(cp, "--input") || streq(cp, "-i")) {
 	    input = check_arg("input file", &argv);
 
+	} else if (streq(cp, "--input-format")) {
+	    const char *fmt = check_arg("input format", &argv);
+
+	    if (streq(fmt, "bxml"))
+		opt_bxml_input = TRUE;
+	    else if (streq(fmt, "html"))
+		opt_html = TRUE;
+	    else if (!streq(fmt, "xml"))
+		errx(1, "unknown input format: '%s'", fmt);
+
+	} else if (streq(cp, "--jobs") || streq(cp, "-j")) {
+	    const char *jobs = check_arg("number of jobs", &argv);
+	    char *ep;
+	    long val;
+
+	    errno = 0;
+	    val = strtol(jobs, &ep, 10);
+	    if (errno || ep == jobs || *ep != '\0'
+		    || val <= 0 || val > INT_MAX)
+		errx(1, "invalid number of jobs: '%s'", jobs);
+	    opt_jobs = val;
+
+	} else if (streq(cp, "--json-lines")) {
+	    opt_json_lines = TRUE;
+
+	} else if (streq(cp, "--json-output")) {
+	    opt_json_output = TRUE;
+
 	} else if (streq(cp, "--json-tagging")) {
 	    opt_json_tagging = TRUE;
 
@@ -906,6 +1829,16 @@ main (int argc UNUSED, char **argv)
 	} else if (streq(cp, "--output") || streq(cp, "-o")) {
 	    output = check_arg("output file name", &argv);
 
+	} else if (streq(cp, "--output-format")) {
+	    const char *fmt = check_arg("output format", &argv);
+
+	    if (streq(fmt, "bxml"))
+		opt_bxml_output = TRUE;
+	    else if (streq(fmt, "json"))
+		opt_json_output = TRUE;
+	    else if (!streq(fmt, "xml"))
+		errx(1, "unknown output format: '%s'", fmt);
+
 	} else if (streq(cp, "--param") || streq(cp, "-a")) {
 	    char *pname = check_arg("parameter name", &argv);
 	    char *pvalue = check_arg("parameter value", &argv);
@@ -934,6 +1867,9 @@ main (int argc UNUSED, char **argv)
 	} else if (streq(cp, "--slax-output") || streq(cp, "-S")) {
 	    opt_slax_output = TRUE;
 
+	} else if (streq(cp, "--stream-records")) {
+	    opt_stream_records = check_arg("record path", &argv);
+
 	} else if (streq(cp, "--trace") || streq(cp, "-t")) {
 	    trace_file = check_arg("trace file name", &argv);
 
@@ -971,7 +1907,7 @@ main (int argc UNUSED, char **argv)
     if (cp)
 	slaxIncludeAddPath(cp);
 
-    params = alloca(nbparams * 2 * sizeof(*params) + 1);
+    params = alloca((nbparams * 2 + 1) * sizeof(*params));
     i = 0;
     SLAXDATALIST_FOREACH(dnp, &plist) {
 	params[i++] = dnp->dn_data;
@@ -981,6 +1917,24 @@ main (int argc UNUSED, char **argv)
     if (func == NULL)
 	func = do_run; /* the default action */
 
+    if (opt_stream_records) {
+	if (func != do_run)
+	    errx(1, "--stream-records works with --run");
+	if (opt_debugger || opt_empty_input || opt_html || opt_bxml_input
+	        || opt_bxml_output)
+	    errx(1, "--stream-records needs XML input and cannot be used "
+		 "with --debug or binary XML output");
+    }
+
+    if (opt_batch) {
+	if (func != do_check && func != do_format && func != do_slax_to_xslt)
+	    errx(1, "--batch works with --check, --format, or --slax-to-xslt");
+	if (name || input || !TAILQ_EMPTY(&mini_templates) || opt_expression)
+	    errx(1, "--batch takes script names as arguments");
+	batch_func = func;
+	func = do_batch;
+    }
+
     /*
      * Seed the random number generator.  This is optional to allow
      * test jigs to take advantage of the default stream of generated
@@ -1012,6 +1966,9 @@ main (int argc UNUSED, char **argv)
 	slaxLogEnable(TRUE);
     }
 
+    if (opt_cache_dir && slaxCacheSetDirectory(opt_cache_dir) < 0)
+	err(1, "could not use cache directory: '%s'", opt_cache_dir);
+
     if (use_exslt) {
 	exsltRegisterAll();
 	slaxDynMarkExslt();
@@ -1038,6 +1995,22 @@ main (int argc UNUSED, char **argv)
 
     func(name, output, input, argv);
 
+    if (opt_cache_dir) {
+	slaxCacheGetCounters(&hits, &misses);
+	slaxLog("slaxproc: cache: %lu hit%s, %lu miss%s", hits,
+		(hits == 1) ? "" : "s", misses, (misses == 1) ? "" : "es");
+    }
+
+    slaxXpathCacheGetCounters(&hits, &misses);
+    if (hits || misses)
+	slaxLog("slaxproc: xpath cache: %lu hit%s, %lu miss%s", hits,
+		(hits == 1) ? "" : "s", misses, (misses == 1) ? "" : "es");
+
+    slaxMvarGetCounters(&containers, &bytes);
+    if (containers)
+	slaxLog("slaxproc: mvar: reclaimed %lu container%s (%lu bytes)",
+		containers, (containers == 1) ? "" : "s", bytes);
+
     if (trace_fp && trace_fp != stderr)
 	fclose(trace_fp);
 
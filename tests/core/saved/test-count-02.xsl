@@ -127,37 +127,29 @@
   <xsl:template name="test2">
     <xsl:variable name="slax-x" mvarname="x"/>
     <xsl:variable xmlns:slax="http://xml.libslax.org/slax" name="x" select="slax:mvar-init(&quot;x&quot;, &quot;slax-x&quot;, $slax-x, 0)" mutable="yes" svarname="slax-x"/>
-    <xsl:variable name="slax-dot-1" select="."/>
-    <xsl:for-each xmlns:slax="http://xml.libslax.org/slax" select="slax:build-sequence(1, 20)">
-      <xsl:variable name="i" select="."/>
-      <xsl:for-each select="$slax-dot-1">
-        <slax:set-variable xmlns:slax="http://xml.libslax.org/slax" name="x" svarname="slax-x" select="$x + $i"/>
-        <test2>
-          <xsl:value-of select="$x"/>
-        </test2>
-      </xsl:for-each>
-    </xsl:for-each>
+    <slax:for xmlns:slax="http://xml.libslax.org/slax" name="i" from="1" to="20">
+      <slax:set-variable xmlns:slax="http://xml.libslax.org/slax" name="x" svarname="slax-x" select="$x + $i"/>
+      <test2>
+        <xsl:value-of select="$x"/>
+      </test2>
+    </slax:for>
   </xsl:template>
   <xsl:template name="test3">
     <xsl:variable name="slax-errors" mvarname="errors"/>
     <xsl:variable xmlns:slax="http://xml.libslax.org/slax" name="errors" mutable="yes" select="slax:mvar-init(&quot;errors&quot;, &quot;slax-errors&quot;, $slax-errors)" svarname="slax-errors"/>
-    <xsl:variable name="slax-dot-2" select="."/>
-    <xsl:for-each xmlns:slax="http://xml.libslax.org/slax" select="slax:build-sequence(1, 20)">
-      <xsl:variable name="i" select="."/>
-      <xsl:for-each select="$slax-dot-2">
-        <xsl:variable name="x-temp-1">
-          <error>
-            <line>
-              <xsl:value-of select="$i"/>
-            </line>
-            <message>Shut 'er down Clancey!  She's a-pumping mud!</message>
-          </error>
-        </xsl:variable>
-        <xsl:variable xmlns:slax-ext="http://xmlsoft.org/XSLT/namespace" name="x" select="slax-ext:node-set($x-temp-1)"/>
-        <slax:append-to-variable xmlns:slax="http://xml.libslax.org/slax" name="errors" svarname="slax-errors" select="$x"/>
-        <slax:trace xmlns:slax="http://xml.libslax.org/slax" select="$errors"/>
-      </xsl:for-each>
-    </xsl:for-each>
+    <slax:for xmlns:slax="http://xml.libslax.org/slax" name="i" from="1" to="20">
+      <xsl:variable name="x-temp-1">
+        <error>
+          <line>
+            <xsl:value-of select="$i"/>
+          </line>
+          <message>Shut 'er down Clancey!  She's a-pumping mud!</message>
+        </error>
+      </xsl:variable>
+      <xsl:variable xmlns:slax-ext="http://xmlsoft.org/XSLT/namespace" name="x" select="slax-ext:node-set($x-temp-1)"/>
+      <slax:append-to-variable xmlns:slax="http://xml.libslax.org/slax" name="errors" svarname="slax-errors" select="$x"/>
+      <slax:trace xmlns:slax="http://xml.libslax.org/slax" select="$errors"/>
+    </slax:for>
     <errors>
       <xsl:copy-of select="$errors"/>
     </errors>
@@ -32,15 +32,11 @@ and finally, line five
       </back-reference>
       <sequence>
         <xsl:for-each xmlns:slax="http://xml.libslax.org/slax" select="slax:build-sequence(1, 3)">
-          <xsl:variable name="slax-dot-1" select="."/>
-          <xsl:for-each xmlns:slax="http://xml.libslax.org/slax" select="slax:build-sequence(1, 4)">
-            <xsl:variable name="i" select="."/>
-            <xsl:for-each select="$slax-dot-1">
-              <i>
-                <xsl:value-of select="concat(., &quot;:&quot;, $i)"/>
-              </i>
-            </xsl:for-each>
-          </xsl:for-each>
+          <slax:for xmlns:slax="http://xml.libslax.org/slax" name="i" from="1" to="4">
+            <i>
+              <xsl:value-of select="concat(., &quot;:&quot;, $i)"/>
+            </i>
+          </slax:for>
         </xsl:for-each>
       </sequence>
       <first>
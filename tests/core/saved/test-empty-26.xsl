@@ -14,24 +14,16 @@
           <xsl:value-of select="."/>
         </down>
       </xsl:for-each>
-      <xsl:variable name="slax-dot-1" select="."/>
-      <xsl:for-each xmlns:slax="http://xml.libslax.org/slax" select="slax:build-sequence($min, $max)">
-        <xsl:variable name="x" select="."/>
-        <xsl:for-each select="$slax-dot-1">
-          <up>
-            <xsl:value-of select="$x"/>
-          </up>
-        </xsl:for-each>
-      </xsl:for-each>
-      <xsl:variable name="slax-dot-2" select="."/>
-      <xsl:for-each xmlns:slax="http://xml.libslax.org/slax" select="slax:build-sequence($max, $min)">
-        <xsl:variable name="y" select="."/>
-        <xsl:for-each select="$slax-dot-2">
-          <down>
-            <xsl:value-of select="$y"/>
-          </down>
-        </xsl:for-each>
-      </xsl:for-each>
+      <slax:for xmlns:slax="http://xml.libslax.org/slax" name="x" from="$min" to="$max">
+        <up>
+          <xsl:value-of select="$x"/>
+        </up>
+      </slax:for>
+      <slax:for xmlns:slax="http://xml.libslax.org/slax" name="y" from="$max" to="$min">
+        <down>
+          <xsl:value-of select="$y"/>
+        </down>
+      </slax:for>
     </top>
   </xsl:template>
 </xsl:stylesheet>
@@ -4,6 +4,8 @@
     <x>ManManMan</x>
     <x>Fish Sauce</x>
     <x>amazingly awesome sizabilities</x>
+    <x>café</x>
+    <x/>
   </xsl:variable>
   <xsl:variable xmlns:slax-ext="http://xmlsoft.org/XSLT/namespace" name="test" select="slax-ext:node-set($test-temp-1)"/>
   <xsl:template match="/">
@@ -14,6 +16,9 @@
       <out>
         <xsl:value-of xmlns:slax="http://xml.libslax.org/slax" select="slax:base64-decode(&quot;TWFuTWFuTWFu&quot;)"/>
       </out>
+      <out>
+        <xsl:value-of xmlns:slax="http://xml.libslax.org/slax" select="slax:base64-decode(&quot;Y2Fmw6k=&quot;)"/>
+      </out>
       <xsl:variable name="slax-dot-1" select="."/>
       <xsl:for-each select="$test/x">
         <xsl:variable name="in" select="."/>
@@ -0,0 +1,44 @@
+<?xml version="1.0" encoding="UTF-8" standalone="yes"?>
+<xsl:stylesheet xmlns:xsl="http://www.w3.org/1999/XSL/Transform" xmlns:func="http://exslt.org/functions" xmlns:my="http://example.com/my" xmlns:slax-ext="http://xmlsoft.org/XSLT/namespace" version="1.0" extension-element-prefixes="func slax-ext">
+  <xsl:template match="/">
+    <op-script-results>
+      <xsl:variable name="count" select="count(//*)"/>
+      <xsl:variable name="name" select="concat(&quot;name&quot;, $count)"/>
+      <xsl:variable name="sum" select="$count + 1"/>
+      <xsl:variable name="test" select="$count &gt; 1 and $name != &quot;none&quot;"/>
+      <xsl:variable name="nodes-temp-1">
+        <one>
+          <two>two</two>
+        </one>
+      </xsl:variable>
+      <xsl:variable xmlns:slax-ext="http://xmlsoft.org/XSLT/namespace" name="nodes" select="slax-ext:node-set($nodes-temp-1)"/>
+      <xsl:variable xmlns:slax-ext="http://xmlsoft.org/XSLT/namespace" name="all" select="slax-ext:node-set($nodes/one/two)"/>
+      <xsl:variable xmlns:slax-ext="http://xmlsoft.org/XSLT/namespace" name="mine" select="slax-ext:node-set(my:two())"/>
+      <output>
+        <count>
+          <xsl:value-of select="$count"/>
+        </count>
+        <name>
+          <xsl:value-of select="$name"/>
+        </name>
+        <sum>
+          <xsl:value-of select="$sum"/>
+        </sum>
+        <test>
+          <xsl:value-of select="$test"/>
+        </test>
+        <all>
+          <xsl:value-of select="$all"/>
+        </all>
+        <mine>
+          <xsl:value-of select="$mine/two"/>
+        </mine>
+      </output>
+    </op-script-results>
+  </xsl:template>
+  <func:function name="my:two">
+    <func:result>
+      <two>two</two>
+    </func:result>
+  </func:function>
+</xsl:stylesheet>
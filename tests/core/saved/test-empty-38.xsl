@@ -0,0 +1,51 @@
+<?xml version="1.0" encoding="UTF-8" standalone="yes"?>
+<xsl:stylesheet xmlns:xsl="http://www.w3.org/1999/XSL/Transform" xmlns:slax="http://xml.libslax.org/slax" version="1.0" extension-element-prefixes="slax">
+  <xsl:variable name="slax-glob" mvarname="glob"/>
+  <xsl:variable xmlns:slax="http://xml.libslax.org/slax" name="glob" select="slax:mvar-init(&quot;glob&quot;, &quot;slax-glob&quot;, $slax-glob, &quot;g&quot;)" mutable="yes" svarname="slax-glob"/>
+  <xsl:template match="/">
+    <xsl:variable name="slax-str" mvarname="str"/>
+    <xsl:variable xmlns:slax="http://xml.libslax.org/slax" name="str" select="slax:mvar-init(&quot;str&quot;, &quot;slax-str&quot;, $slax-str, &quot;a&quot;)" mutable="yes" svarname="slax-str"/>
+    <slax:append-to-variable xmlns:slax="http://xml.libslax.org/slax" name="str" svarname="slax-str" select="&quot;b&quot;"/>
+    <slax:append-to-variable xmlns:slax="http://xml.libslax.org/slax" name="str" svarname="slax-str" select="3"/>
+    <slax:append-to-variable xmlns:slax="http://xml.libslax.org/slax" name="str" svarname="slax-str" select="true()"/>
+    <xsl:variable name="snap" select="$str"/>
+    <slax:append-to-variable xmlns:slax="http://xml.libslax.org/slax" name="str" svarname="slax-str" select="&quot;-after-snap&quot;"/>
+    <xsl:variable name="slax-num" mvarname="num"/>
+    <xsl:variable xmlns:slax="http://xml.libslax.org/slax" name="num" select="slax:mvar-init(&quot;num&quot;, &quot;slax-num&quot;, $slax-num, 4)" mutable="yes" svarname="slax-num"/>
+    <slax:append-to-variable xmlns:slax="http://xml.libslax.org/slax" name="num" svarname="slax-num" select="&quot;x&quot;"/>
+    <xsl:variable name="slax-long" mvarname="long"/>
+    <xsl:variable xmlns:slax="http://xml.libslax.org/slax" name="long" mutable="yes" select="slax:mvar-init(&quot;long&quot;, &quot;slax-long&quot;, $slax-long)" svarname="slax-long"/>
+    <slax:for xmlns:slax="http://xml.libslax.org/slax" name="i" from="1" to="40">
+      <slax:append-to-variable xmlns:slax="http://xml.libslax.org/slax" name="long" svarname="slax-long" select="concat($i, &quot;,&quot;)"/>
+    </slax:for>
+    <xsl:variable name="before" select="$long"/>
+    <slax:set-variable xmlns:slax="http://xml.libslax.org/slax" name="long" svarname="slax-long" select="&quot;reset&quot;"/>
+    <slax:append-to-variable xmlns:slax="http://xml.libslax.org/slax" name="long" svarname="slax-long" select="&quot;+1&quot;"/>
+    <slax:append-to-variable xmlns:slax="http://xml.libslax.org/slax" name="long" svarname="slax-long" select="&quot;+2&quot;"/>
+    <slax:append-to-variable xmlns:slax="http://xml.libslax.org/slax" name="glob" svarname="slax-glob" select="&quot;-one&quot;"/>
+    <slax:append-to-variable xmlns:slax="http://xml.libslax.org/slax" name="glob" svarname="slax-glob" select="&quot;-two&quot;"/>
+    <top>
+      <str>
+        <xsl:value-of select="$str"/>
+      </str>
+      <snap>
+        <xsl:value-of select="$snap"/>
+      </snap>
+      <num>
+        <xsl:value-of select="$num"/>
+      </num>
+      <before>
+        <xsl:value-of select="$before"/>
+      </before>
+      <before-length>
+        <xsl:value-of select="string-length($before)"/>
+      </before-length>
+      <long>
+        <xsl:value-of select="$long"/>
+      </long>
+      <glob>
+        <xsl:value-of select="$glob"/>
+      </glob>
+    </top>
+  </xsl:template>
+</xsl:stylesheet>
@@ -0,0 +1,54 @@
+<?xml version="1.0" encoding="UTF-8" standalone="yes"?>
+<xsl:stylesheet xmlns:xsl="http://www.w3.org/1999/XSL/Transform" xmlns:my="http://example.com/my" xmlns:slax="http://xml.libslax.org/slax" xmlns:slax-func="http://exslt.org/functions" version="1.0" extension-element-prefixes="slax slax-func">
+  <xsl:variable name="slax-list" mvarname="list"/>
+  <xsl:variable xmlns:slax="http://xml.libslax.org/slax" name="list" mutable="yes" select="slax:mvar-init(&quot;list&quot;, &quot;slax-list&quot;, $slax-list)" svarname="slax-list"/>
+  <xsl:template match="/">
+    <xsl:variable name="fixed">
+      <item n="fixed">fixed</item>
+    </xsl:variable>
+    <top>
+      <slax:set-variable xmlns:slax="http://xml.libslax.org/slax" name="list" svarname="slax-list">
+        <item n="1" xml:lang="en">one</item>
+      </slax:set-variable>
+      <slax:append-to-variable xmlns:slax="http://xml.libslax.org/slax" name="list" svarname="slax-list">
+        <item n="2">
+          <sub>two</sub>
+        </item>
+      </slax:append-to-variable>
+      <slax:append-to-variable xmlns:slax="http://xml.libslax.org/slax" name="list" svarname="slax-list" select="my:item(3)"/>
+      <slax:append-to-variable xmlns:slax="http://xml.libslax.org/slax" name="list" svarname="slax-list" select="$fixed"/>
+      <slax:append-to-variable xmlns:slax="http://xml.libslax.org/slax" name="list" svarname="slax-list" select="&quot;four&quot;"/>
+      <first>
+        <count>
+          <xsl:value-of select="count($list/item)"/>
+        </count>
+        <xsl:for-each select="$list/item">
+          <seen n="{@n}" lang="{@xml:lang}">
+            <xsl:value-of select="."/>
+          </seen>
+        </xsl:for-each>
+      </first>
+      <slax:set-variable xmlns:slax="http://xml.libslax.org/slax" name="list" svarname="slax-list" select="my:item(5)"/>
+      <slax:append-to-variable xmlns:slax="http://xml.libslax.org/slax" name="list" svarname="slax-list">
+        <item n="6"/>
+      </slax:append-to-variable>
+      <second>
+        <count>
+          <xsl:value-of select="count($list/item)"/>
+        </count>
+        <xsl:copy-of select="$list"/>
+      </second>
+      <fixed>
+        <xsl:copy-of select="$fixed"/>
+      </fixed>
+    </top>
+  </xsl:template>
+  <slax-func:function xmlns:slax-func="http://exslt.org/functions" name="my:item">
+    <xsl:param name="n"/>
+    <slax-func:result xmlns:slax-func="http://exslt.org/functions">
+      <item n="{$n}">
+        <sub>from-function</sub>
+      </item>
+    </slax-func:result>
+  </slax-func:function>
+</xsl:stylesheet>
@@ -0,0 +1,46 @@
+<?xml version="1.0" encoding="UTF-8" standalone="yes"?>
+<xsl:stylesheet xmlns:xsl="http://www.w3.org/1999/XSL/Transform" xmlns:slax="http://xml.libslax.org/slax" version="1.0" extension-element-prefixes="slax">
+  <xsl:template match="/">
+    <xsl:variable xmlns:xsl="http://www.w3.org/1999/XSL/Transform" name="slax-state" mvarname="state">
+      <state n="0"/>
+    </xsl:variable>
+    <xsl:variable xmlns:slax="http://xml.libslax.org/slax" name="state" mutable="yes" select="slax:mvar-init(&quot;state&quot;, &quot;slax-state&quot;, $slax-state)" svarname="slax-state"/>
+    <xsl:variable name="start" select="$state"/>
+    <xsl:variable name="slax-seen" mvarname="seen"/>
+    <xsl:variable xmlns:slax="http://xml.libslax.org/slax" name="seen" select="slax:mvar-init(&quot;seen&quot;, &quot;slax-seen&quot;, $slax-seen, 0)" mutable="yes" svarname="slax-seen"/>
+    <slax:while xmlns:slax="http://xml.libslax.org/slax" test="$state/state/@n &lt; 5">
+      <xsl:variable name="n" select="$state/state/@n + 1"/>
+      <xsl:variable name="old" select="$state"/>
+      <slax:set-variable xmlns:slax="http://xml.libslax.org/slax" name="state" svarname="slax-state">
+        <state n="{$n}">
+          <xsl:copy-of select="$old/state/step"/>
+          <step>
+            <xsl:value-of select="$n"/>
+          </step>
+        </state>
+      </slax:set-variable>
+      <slax:set-variable xmlns:slax="http://xml.libslax.org/slax" name="seen" svarname="slax-seen" select="$seen + count($state/state/step)"/>
+      <xsl:variable xmlns:xsl="http://www.w3.org/1999/XSL/Transform" name="slax-inner" mvarname="inner">
+        <inner n="0"/>
+      </xsl:variable>
+      <xsl:variable xmlns:slax="http://xml.libslax.org/slax" name="inner" mutable="yes" select="slax:mvar-init(&quot;inner&quot;, &quot;slax-inner&quot;, $slax-inner)" svarname="slax-inner"/>
+      <slax:while xmlns:slax="http://xml.libslax.org/slax" test="$inner/inner/@n &lt; 2">
+        <slax:set-variable xmlns:slax="http://xml.libslax.org/slax" name="inner" svarname="slax-inner">
+          <inner n="{$inner/inner/@n + 1}"/>
+        </slax:set-variable>
+      </slax:while>
+      <slax:set-variable xmlns:slax="http://xml.libslax.org/slax" name="seen" svarname="slax-seen" select="$seen + $inner/inner/@n"/>
+    </slax:while>
+    <top>
+      <start>
+        <xsl:copy-of select="$start"/>
+      </start>
+      <final>
+        <xsl:copy-of select="$state"/>
+      </final>
+      <seen>
+        <xsl:value-of select="$seen"/>
+      </seen>
+    </top>
+  </xsl:template>
+</xsl:stylesheet>
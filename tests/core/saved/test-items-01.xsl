@@ -9,40 +9,32 @@
           <xsl:value-of select="."/>
         </first>
       </xsl:for-each>
-      <xsl:variable name="slax-dot-1" select="."/>
-      <xsl:for-each xmlns:slax="http://xml.libslax.org/slax" select="slax:build-sequence($x, count)">
-        <xsl:variable name="i" select="."/>
-        <xsl:for-each select="$slax-dot-1">
-          <second count="{count}">
-            <xsl:value-of select="$i"/>
-          </second>
-        </xsl:for-each>
-      </xsl:for-each>
-      <xsl:variable name="slax-dot-2" select="."/>
-      <xsl:for-each xmlns:slax="http://xml.libslax.org/slax" select="slax:build-sequence(1 - size, 10 div 3)">
-        <xsl:variable name="i" select="."/>
-        <xsl:for-each select="$slax-dot-2">
-          <third>
-            <xsl:value-of select="$i"/>
-          </third>
-        </xsl:for-each>
-      </xsl:for-each>
+      <slax:for xmlns:slax="http://xml.libslax.org/slax" name="i" from="$x" to="count">
+        <second count="{count}">
+          <xsl:value-of select="$i"/>
+        </second>
+      </slax:for>
+      <slax:for xmlns:slax="http://xml.libslax.org/slax" name="i" from="1 - size" to="10 div 3">
+        <third>
+          <xsl:value-of select="$i"/>
+        </third>
+      </slax:for>
       <!-- Simple test case -->
-      <xsl:variable name="slax-dot-3" select="."/>
+      <xsl:variable name="slax-dot-1" select="."/>
       <xsl:for-each select="item">
         <xsl:variable name="i" select="."/>
-        <xsl:for-each select="$slax-dot-3">
+        <xsl:for-each select="$slax-dot-1">
           <li item="{class}">
             <xsl:value-of select="$i"/>
           </li>
         </xsl:for-each>
       </xsl:for-each>
       <!-- Test that 'sort' gets relocated -->
-      <xsl:variable name="slax-dot-4" select="."/>
+      <xsl:variable name="slax-dot-2" select="."/>
       <xsl:for-each select="item">
         <xsl:sort select="." order="ascending"/>
         <xsl:variable name="i" select="."/>
-        <xsl:for-each select="$slax-dot-4">
+        <xsl:for-each select="$slax-dot-2">
           <ul item="{class}">
             <xsl:value-of select="$i"/>
           </ul>
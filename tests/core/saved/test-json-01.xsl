@@ -55,6 +55,8 @@
               "equipment": [ "hat", "desk", "attitude" ]
             }</nine>
     <ten>{ "the	end": 1, "moment of truth": 2.5e-5, "3com": "dead" }</ten>
+    <eleven>{ "ctl": "a\u0001b\u001fc", "bell": "x\by", "quote": "say \"hi\"",
+                "slash": "back\\slash", "sep": "line\u2028sep" }</eleven>
   </xsl:variable>
   <xsl:variable xmlns:slax-ext="http://xmlsoft.org/XSLT/namespace" name="tests" select="slax-ext:node-set($tests-temp-1)"/>
   <xsl:param name="root" select="&quot;my-top&quot;"/>
@@ -9,6 +9,18 @@
       </xsl:variable>
       <xsl:variable name="str" select="xutil:xml-to-json($xml)"/>
       <xsl:value-of xmlns:slax="http://xml.libslax.org/slax" select="slax:output($str)"/>
+      <xsl:variable name="escapes">
+        <json>
+          <quote>say "hi"</quote>
+          <slash>back\slash</slash>
+          <ctl>tab	here
+newline</ctl>
+          <sep>line sep</sep>
+        </json>
+      </xsl:variable>
+      <escapes>
+        <xsl:value-of select="xutil:xml-to-json($escapes)"/>
+      </escapes>
     </op-script-results>
   </xsl:template>
 </xsl:stylesheet>
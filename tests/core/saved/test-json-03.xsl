@@ -0,0 +1,21 @@
+<?xml version="1.0" encoding="UTF-8" standalone="yes"?>
+<xsl:stylesheet xmlns:xsl="http://www.w3.org/1999/XSL/Transform" xmlns:xutil="http://xml.libslax.org/xutil" version="1.0" extension-element-prefixes="xutil">
+  <xsl:variable name="lines" select="'{ &quot;name&quot;: &quot;one&quot;, &quot;n&quot;: 1 }&#10;[ 1, 2, 3 ]&#10;&#10;{ &quot;name&quot;: &quot;bad&quot;,&#10;{ &quot;name&quot;: &quot;three&quot;, &quot;ok&quot;: true }&#10;'"/>
+  <xsl:template match="/">
+    <top>
+      <xsl:variable name="opts">
+        <json-lines>yes</json-lines>
+      </xsl:variable>
+      <xsl:variable name="xml" select="xutil:json-to-xml($lines, $opts)"/>
+      <xml>
+        <xsl:copy-of select="$xml"/>
+      </xml>
+      <skipped>
+        <xsl:value-of select="$xml/@errors"/>
+      </skipped>
+      <back>
+        <xsl:value-of select="xutil:xml-to-json($xml, $opts)"/>
+      </back>
+    </top>
+  </xsl:template>
+</xsl:stylesheet>
@@ -0,0 +1,289 @@
+/*
+ * Copyright (c) 2013, Juniper Networks, Inc.
+ * All rights reserved.
+ * This SOFTWARE is licensed under the LICENSE provided in the
+ * ../Copyright file. By downloading, installing, copying, or otherwise
+ * using the SOFTWARE, you agree to be bound by the terms of that
+ * LICENSE.
+ *
+ * slaxregistry.c -- check the registry of compiled stylesheets
+ *
+ * A script that imports a library file is fetched twice with
+ * slaxScriptCacheGet(), which must hand back the same stylesheet.
+ * Then the library is rewritten, first within the same second and
+ * at the same size, then at a new size, and each fetch must give a
+ * new stylesheet that sees the change, while the old ones stay
+ * usable until they are released.
+ *
+ * Last, two scripts in different directories import the same
+ * relative name, each getting its own library file, and a third
+ * script shares the first one's library.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/param.h>
+
+#include <libxml/parser.h>
+#include <libxslt/xsltInternals.h>
+#include <libxslt/transform.h>
+#include <libxslt/xsltutils.h>
+
+#include "slaxconfig.h"
+#include <libslax/slax.h>
+
+static int checks;
+static int failures;
+static int shares;		/* Shared documents handed out */
+
+static void
+check (int ok, const char *what)
+{
+    checks += 1;
+    if (!ok) {
+	fprintf(stderr, "slaxregistry: failed: %s\n", what);
+	failures += 1;
+    }
+}
+
+/*
+ * Count the registry's "sharing document" log messages
+ */
+static void
+log_callback (void *opaque UNUSED, const char *fmt, va_list vap UNUSED)
+{
+    if (strstr(fmt, "sharing document"))
+	shares += 1;
+}
+
+/*
+ * Write a file, returning non-zero on failure
+ */
+static int
+write_file (const char *dir, const char *name, const char *content)
+{
+    char path[MAXPATHLEN];
+    FILE *fp;
+
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    fp = fopen(path, "w");
+    if (fp == NULL) {
+	perror(path);
+	return 1;
+    }
+
+    fputs(content, fp);
+    return fclose(fp) != 0;
+}
+
+/*
+ * Set a file's mtime to a fixed second, with the given nanoseconds
+ */
+static int
+set_mtime (const char *dir, const char *name, long nsec)
+{
+    char path[MAXPATHLEN];
+    struct timespec times[2];
+
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    times[0].tv_sec = times[1].tv_sec = 1000000000;
+    times[0].tv_nsec = times[1].tv_nsec = nsec;
+
+    if (utimensat(AT_FDCWD, path, times, 0) < 0) {
+	perror(path);
+	return 1;
+    }
+
+    return 0;
+}
+
+/*
+ * Write a script that imports "lib.slax" and a lib.slax that
+ * outputs the given word
+ */
+static int
+write_pair (const char *dir, const char *name, const char *word)
+{
+    char lib[BUFSIZ];
+
+    if (mkdir(dir, 0755) < 0 && errno != EEXIST) {
+	perror(dir);
+	return 1;
+    }
+
+    snprintf(lib, sizeof(lib),
+	     "version 1.2;\n"
+	     "template word () {\n"
+	     "    <word> \"%s\";\n"
+	     "}\n", word);
+
+    return write_file(dir, name,
+		      "version 1.2;\n"
+		      "import \"lib.slax\";\n"
+		      "match / {\n"
+		      "    <out> {\n"
+		      "        call word();\n"
+		      "    }\n"
+		      "}\n")
+	|| write_file(dir, "lib.slax", lib);
+}
+
+/*
+ * Does running the stylesheet produce output containing the string?
+ */
+static int
+run_has (xsltStylesheetPtr style, const char *want)
+{
+    xmlDocPtr indoc, res;
+    xmlChar *out = NULL;
+    int len = 0, found = 0;
+
+    if (style == NULL)
+	return 0;
+
+    indoc = xmlReadMemory("<top/>", 6, "input", NULL, 0);
+    if (indoc == NULL)
+	return 0;
+
+    res = xsltApplyStylesheet(style, indoc, NULL);
+    if (res) {
+	xsltSaveResultToString(&out, &len, res, style);
+	xmlFreeDoc(res);
+    }
+    xmlFreeDoc(indoc);
+
+    if (out) {
+	found = (strstr((char *) out, want) != NULL);
+	xmlFree(out);
+    }
+
+    return found;
+}
+
+int
+main (int argc, char **argv)
+{
+    char script[MAXPATHLEN], cwd[MAXPATHLEN];
+    char dir_a[MAXPATHLEN], dir_b[MAXPATHLEN];
+    xsltStylesheetPtr first, second, third, fourth;
+    xsltStylesheetPtr style_a, style_b, style_c;
+    const char *dir;
+
+    if (argc < 2) {
+	fprintf(stderr, "usage: slaxregistry dir\n");
+	return 1;
+    }
+
+    dir = argv[1];
+    if (mkdir(dir, 0755) < 0 && errno != EEXIST) {
+	perror(dir);
+	return 1;
+    }
+
+    if (write_file(dir, "main.slax",
+		   "version 1.2;\n"
+		   "import \"lib.slax\";\n"
+		   "match / {\n"
+		   "    <out> {\n"
+		   "        call word();\n"
+		   "    }\n"
+		   "}\n")
+	    || write_file(dir, "lib.slax",
+			  "version 1.2;\n"
+			  "template word () {\n"
+			  "    <word> \"one\";\n"
+			  "}\n")
+	    || set_mtime(dir, "lib.slax", 100))
+	return 1;
+
+    snprintf(script, sizeof(script), "%s/main.slax", dir);
+
+    xmlInitParser();
+    xsltInit();
+    slaxEnable(SLAX_ENABLE);
+
+    first = slaxScriptCacheGet(script);
+    check(first != NULL, "script compiles");
+    check(run_has(first, "<word>one</word>"), "first output");
+
+    second = slaxScriptCacheGet(script);
+    check(second == first, "unchanged script is reused");
+
+    /* Change the imported file within the same second, at the same size */
+    if (write_file(dir, "lib.slax",
+		   "version 1.2;\n"
+		   "template word () {\n"
+		   "    <word> \"two\";\n"
+		   "}\n")
+	    || set_mtime(dir, "lib.slax", 200))
+	return 1;
+
+    third = slaxScriptCacheGet(script);
+    check(third != NULL && third != first, "same-second change recompiles");
+    check(run_has(third, "<word>two</word>"), "same-second output");
+
+    /* Change it again, at a new size */
+    if (write_file(dir, "lib.slax",
+		   "version 1.2;\n"
+		   "template word () {\n"
+		   "    <word> \"twenty-two\";\n"
+		   "}\n"))
+	return 1;
+
+    fourth = slaxScriptCacheGet(script);
+    check(fourth != NULL && fourth != third, "changed import recompiles");
+    check(run_has(fourth, "<word>twenty-two</word>"), "recompiled output");
+    check(run_has(first, "<word>one</word>"), "held stylesheet still runs");
+
+    slaxScriptCacheRelease(second);
+    slaxScriptCacheRelease(first);
+    slaxScriptCacheRelease(third);
+    slaxScriptCacheRelease(fourth);
+
+    /*
+     * The same relative name, "lib.slax", from two directories.
+     * Run from each directory, so the names are identical.
+     */
+    snprintf(dir_a, sizeof(dir_a), "%s/a", dir);
+    snprintf(dir_b, sizeof(dir_b), "%s/b", dir);
+    if (getcwd(cwd, sizeof(cwd)) == NULL
+	    || write_pair(dir_a, "a.slax", "from-a")
+	    || write_pair(dir_a, "c.slax", "from-a")
+	    || write_pair(dir_b, "b.slax", "from-b"))
+	return 1;
+
+    slaxLogEnableCallback(log_callback, NULL);
+    slaxLogEnable(1);
+    shares = 0;
+
+    style_a = chdir(dir_a) == 0 ? slaxScriptCacheGet("a.slax") : NULL;
+    style_b = chdir(dir_b) == 0 ? slaxScriptCacheGet("b.slax") : NULL;
+    style_c = chdir(dir_a) == 0 ? slaxScriptCacheGet("c.slax") : NULL;
+    if (chdir(cwd) < 0)
+	perror(cwd);
+    slaxLogEnable(0);
+
+    check(run_has(style_a, "<word>from-a</word>"), "first directory");
+    check(run_has(style_b, "<word>from-b</word>"), "second directory");
+    check(run_has(style_c, "<word>from-a</word>"), "third script");
+    check(shares == 1, "library shared by the first and third scripts");
+
+    slaxScriptCacheRelease(style_a);
+    slaxScriptCacheRelease(style_b);
+    slaxScriptCacheRelease(style_c);
+    slaxScriptCacheFlush();
+
+    printf("slaxregistry: %d checks: %d failure%s\n",
+	   checks, failures, (failures == 1) ? "" : "s");
+
+    slaxEnable(SLAX_CLEANUP);
+    xsltCleanupGlobals();
+    xmlCleanupParser();
+
+    return failures ? 1 : 0;
+}
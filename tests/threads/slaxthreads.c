@@ -0,0 +1,266 @@
+/*
+ * Copyright (c) 2013, Juniper Networks, Inc.
+ * All rights reserved.
+ * This SOFTWARE is licensed under the LICENSE provided in the
+ * ../Copyright file. By downloading, installing, copying, or otherwise
+ * using the SOFTWARE, you agree to be bound by the terms of that
+ * LICENSE.
+ *
+ * slaxthreads.c -- run SLAX transforms on several threads at once
+ *
+ * Each test case from the given directory (foo-NN.slax, run against
+ * foo.xml) is first run serially, twice, to get its expected output.
+ * Cases whose serial runs disagree (dates, random numbers) and cases
+ * that write files (which every thread would share) are skipped.
+ * Then a pool of threads runs every case several times, each thread
+ * parsing its own copy of the script and input, and every result
+ * must match the serial one.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/param.h>
+#include <pthread.h>
+
+#include <libxml/parser.h>
+#include <libxslt/xsltInternals.h>
+#include <libxslt/transform.h>
+#include <libxslt/xsltutils.h>
+#include <libexslt/exslt.h>
+
+#include "slaxconfig.h"
+#include <libslax/slax.h>
+
+#define MAX_CASES	1024
+
+typedef struct test_case_s {
+    char tc_script[MAXPATHLEN];	/* Script file */
+    char tc_data[MAXPATHLEN];	/* Input document */
+    xmlChar *tc_expected;	/* Result of the serial run */
+    int tc_len;			/* Length of tc_expected */
+} test_case_t;
+
+static test_case_t cases[MAX_CASES];
+static int ncases;
+static int rounds = 4;
+static int failures;
+static pthread_mutex_t failure_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void
+quiet (void *opaque UNUSED, const char *fmt UNUSED, ...)
+{
+    return;
+}
+
+/*
+ * Run one test case, returning the serialized result
+ */
+static xmlChar *
+run_case (test_case_t *tcp, int *lenp)
+{
+    char buf[MAXPATHLEN];
+    FILE *file;
+    xmlDocPtr scriptdoc, indoc, res;
+    xsltStylesheetPtr script;
+    xmlChar *out = NULL;
+
+    *lenp = 0;
+
+    file = slaxFindIncludeFile(tcp->tc_script, buf, sizeof(buf));
+    if (file == NULL)
+	return NULL;
+
+    scriptdoc = slaxLoadFile(tcp->tc_script, file, NULL, 0);
+    fclose(file);
+    if (scriptdoc == NULL)
+	return NULL;
+
+    script = xsltParseStylesheetDoc(scriptdoc);
+    if (script == NULL || script->errors) {
+	if (script)
+	    xsltFreeStylesheet(script);
+	else
+	    xmlFreeDoc(scriptdoc);
+	return NULL;
+    }
+
+    indoc = xmlReadFile(tcp->tc_data, NULL, XSLT_PARSE_OPTIONS);
+    if (indoc) {
+	script->indent = 1;
+	res = xsltApplyStylesheet(script, indoc, NULL);
+	if (res) {
+	    xsltSaveResultToString(&out, lenp, res, script);
+	    xmlFreeDoc(res);
+	}
+	xmlFreeDoc(indoc);
+    }
+
+    xsltFreeStylesheet(script);
+    return out;
+}
+
+static void *
+run_thread (void *arg UNUSED)
+{
+    xmlChar *out;
+    int i, r, len;
+
+    /* libxml2 keeps its error handler per thread */
+    xmlSetGenericErrorFunc(NULL, quiet);
+
+    for (r = 0; r < rounds; r++) {
+	for (i = 0; i < ncases; i++) {
+	    test_case_t *tcp = &cases[(i + r) % ncases];
+
+	    if (tcp->tc_expected == NULL)
+		continue;
+
+	    out = run_case(tcp, &len);
+	    if (out == NULL || len != tcp->tc_len
+		    || memcmp(out, tcp->tc_expected, len) != 0) {
+		pthread_mutex_lock(&failure_lock);
+		fprintf(stderr, "slaxthreads: %s: output differs\n",
+			tcp->tc_script);
+		failures += 1;
+		pthread_mutex_unlock(&failure_lock);
+	    }
+	    xmlFree(out);
+	}
+    }
+
+    return NULL;
+}
+
+/*
+ * Does the script write files of its own?
+ */
+static int
+writes_files (const char *filename)
+{
+    char buf[BUFSIZ];
+    FILE *fp;
+    int rc = 0;
+
+    fp = fopen(filename, "r");
+    if (fp == NULL)
+	return 0;
+
+    while (!rc && fgets(buf, sizeof(buf), fp))
+	rc = (strstr(buf, "redirect:write") || strstr(buf, "exsl:document"));
+
+    fclose(fp);
+    return rc;
+}
+
+/*
+ * Find the test cases: every foo-NN.slax with a matching foo.xml
+ */
+static void
+find_cases (const char *dir)
+{
+    DIR *dirp;
+    struct dirent *dp;
+    test_case_t *tcp;
+    char *cp;
+    size_t len;
+
+    dirp = opendir(dir);
+    if (dirp == NULL) {
+	perror(dir);
+	exit(1);
+    }
+
+    while ((dp = readdir(dirp)) != NULL && ncases < MAX_CASES) {
+	len = strlen(dp->d_name);
+	if (len < 6 || strcmp(dp->d_name + len - 5, ".slax") != 0)
+	    continue;
+
+	tcp = &cases[ncases];
+	snprintf(tcp->tc_script, sizeof(tcp->tc_script), "%s/%s",
+		 dir, dp->d_name);
+	snprintf(tcp->tc_data, sizeof(tcp->tc_data), "%s/%s",
+		 dir, dp->d_name);
+
+	cp = strrchr(tcp->tc_data, '-');
+	if (cp == NULL)
+	    continue;
+	strcpy(cp, ".xml");
+
+	if (access(tcp->tc_data, R_OK) == 0 && !writes_files(tcp->tc_script))
+	    ncases += 1;
+    }
+
+    closedir(dirp);
+}
+
+int
+main (int argc, char **argv)
+{
+    pthread_t *tids;
+    xmlChar *again;
+    int nthreads = 8, i, len, used = 0;
+
+    if (argc < 2) {
+	fprintf(stderr, "usage: slaxthreads dir [threads [rounds]]\n");
+	return 1;
+    }
+
+    if (argc > 2)
+	nthreads = atoi(argv[2]);
+    if (argc > 3)
+	rounds = atoi(argv[3]);
+    if (nthreads <= 0 || rounds <= 0)
+	return 1;
+
+    xmlInitParser();
+    xsltInit();
+    slaxEnable(SLAX_ENABLE);
+    exsltRegisterAll();
+    slaxDynMarkExslt();
+    xsltSetGenericErrorFunc(NULL, quiet);
+    xmlSetGenericErrorFunc(NULL, quiet);
+
+    find_cases(argv[1]);
+
+    for (i = 0; i < ncases; i++) {
+	test_case_t *tcp = &cases[i];
+
+	tcp->tc_expected = run_case(tcp, &tcp->tc_len);
+	if (tcp->tc_expected == NULL)
+	    continue;
+
+	again = run_case(tcp, &len);
+	if (again == NULL || len != tcp->tc_len
+	        || memcmp(again, tcp->tc_expected, len) != 0) {
+	    xmlFree(tcp->tc_expected);
+	    tcp->tc_expected = NULL;
+	} else
+	    used += 1;
+	xmlFree(again);
+    }
+
+    tids = calloc(nthreads, sizeof(*tids));
+    if (tids == NULL)
+	return 1;
+
+    for (i = 0; i < nthreads; i++)
+	pthread_create(&tids[i], NULL, run_thread, NULL);
+    for (i = 0; i < nthreads; i++)
+	pthread_join(tids[i], NULL);
+
+    printf("slaxthreads: %d cases, %d threads, %d rounds: %d failure%s\n",
+	   used, nthreads, rounds, failures, (failures == 1) ? "" : "s");
+
+    for (i = 0; i < ncases; i++)
+	xmlFree(cases[i].tc_expected);
+    free(tids);
+
+    slaxEnable(SLAX_CLEANUP);
+    xsltCleanupGlobals();
+    xmlCleanupParser();
+
+    return failures ? 1 : 0;
+}